@@ -0,0 +1,142 @@
+// Times one BSFilterBatch against one BSFilter per series, on many
+// stochastic volatility series that share their parameters. The separate
+// filters are run one after another; the batch runs on 1 and 4 threads.
+// Prints one CSV row per (engine, number of series) pair with the seconds per
+// time step (for all of the series) and the series-steps per second.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <pf/batch_filter.h>
+#include <pf/bootstrap_filter.h>
+#include <pf/resamplers.h>
+#include <pf/rv_eval.h>
+
+#define NUMPARTS 1000
+#define NUMSTEPS 20
+#define FLOATTYPE double
+
+#define PHI .91
+#define BETA .5
+#define SIGMA 1.0
+
+using namespace pf;
+
+using resamp_t = resamplers::systematic_resampler<NUMPARTS, 1, FLOATTYPE>;
+
+// one series at a time, one particle at a time
+class svol_single : public filters::BSFilter<NUMPARTS, 1, 1, resamp_t,
+                                             FLOATTYPE> {
+public:
+  using ssv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+  using osv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+
+  std::mt19937 m_gen{1};
+  std::normal_distribution<FLOATTYPE> m_z;
+
+  FLOATTYPE logMuEv(const ssv &x1) {
+    return rveval::evalUnivNorm<FLOATTYPE>(
+        x1(0), 0.0, SIGMA / std::sqrt(1.0 - PHI * PHI), true);
+  }
+  ssv q1Samp(const osv & /*y1*/) {
+    return ssv::Constant(m_z(m_gen) * SIGMA / std::sqrt(1.0 - PHI * PHI));
+  }
+  FLOATTYPE logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  ssv fSamp(const ssv &xtm1) {
+    return ssv::Constant(PHI * xtm1(0) + m_z(m_gen) * SIGMA);
+  }
+  FLOATTYPE logGEv(const osv &yt, const ssv &xt) {
+    return rveval::evalUnivNorm<FLOATTYPE>(yt(0), 0.0,
+                                           BETA * std::exp(.5 * xt(0)), true);
+  }
+};
+
+// every series at once, one series per hook call
+template <size_t nthreads>
+class svol_batch
+    : public filters::BSFilterBatch<NUMPARTS, 1, 1, FLOATTYPE, nthreads> {
+public:
+  using base_t = filters::BSFilterBatch<NUMPARTS, 1, 1, FLOATTYPE, nthreads>;
+  using typename base_t::constStateRef;
+  using typename base_t::osv;
+  using typename base_t::rng_t;
+  using typename base_t::stateRef;
+  using typename base_t::wtRef;
+
+  svol_batch(size_t numSeries) : base_t(numSeries, 1, 1) {}
+
+  void muSampBatch(stateRef x1, size_t, rng_t &gen) {
+    std::normal_distribution<FLOATTYPE> z(0.0,
+                                          SIGMA / std::sqrt(1.0 - PHI * PHI));
+    for (size_t i = 0; i < NUMPARTS; ++i)
+      x1(0, i) = z(gen);
+  }
+  void fSampBatch(stateRef xt, size_t, rng_t &gen) {
+    std::normal_distribution<FLOATTYPE> z(0.0, SIGMA);
+    for (size_t i = 0; i < NUMPARTS; ++i)
+      xt(0, i) = PHI * xt(0, i) + z(gen);
+  }
+  void logGEvBatch(const osv &yt, constStateRef xt, wtRef out, size_t) {
+    auto x = xt.row(0).array().transpose();
+    out = -.5 * rveval::log_two_pi<FLOATTYPE> - std::log(BETA) - .5 * x -
+          .5 * yt(0) * yt(0) / (BETA * BETA) * (-x).exp();
+  }
+};
+
+// the observations, one column per series
+Eigen::Matrix<FLOATTYPE, 1, Eigen::Dynamic> data(size_t t, size_t numSeries) {
+  Eigen::Matrix<FLOATTYPE, 1, Eigen::Dynamic> y(1, numSeries);
+  for (size_t s = 0; s < numSeries; ++s)
+    y(s) = std::sin(.3 * t + s);
+  return y;
+}
+
+void report(const char *name, size_t numSeries, double seconds) {
+  std::cout << name << "," << numSeries << "," << NUMPARTS << ","
+            << seconds / NUMSTEPS << ","
+            << numSeries * NUMSTEPS / seconds << "\n";
+}
+
+void time_separate(size_t numSeries) {
+  std::vector<std::unique_ptr<svol_single>> filters;
+  for (size_t s = 0; s < numSeries; ++s)
+    filters.push_back(std::make_unique<svol_single>());
+  std::chrono::duration<double> elapsed(0.0);
+  for (size_t t = 0; t < NUMSTEPS; ++t) {
+    auto y = data(t, numSeries);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t s = 0; s < numSeries; ++s)
+      filters[s]->filter(svol_single::osv::Constant(y(s)));
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+  report("BSFilter", numSeries, elapsed.count());
+}
+
+template <size_t nthreads>
+void time_batch(const char *name, size_t numSeries) {
+  auto filter = std::make_unique<svol_batch<nthreads>>(numSeries);
+  std::chrono::duration<double> elapsed(0.0);
+  for (size_t t = 0; t < NUMSTEPS; ++t) {
+    auto y = data(t, numSeries);
+    auto start = std::chrono::steady_clock::now();
+    filter->filter(y);
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+  report(name, numSeries, elapsed.count());
+}
+
+int main() {
+  std::cout << "engine,num_series,nparts,seconds_per_step,"
+               "series_steps_per_second\n";
+  for (size_t numSeries : {16, 64, 256}) {
+    time_separate(numSeries);
+    time_batch<1>("BSFilterBatch<1 thread>", numSeries);
+    time_batch<4>("BSFilterBatch<4 threads>", numSeries);
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+// Times BSFilterMT against the number of threads on a model with an
+// expensive observation density. Prints one CSV row per thread count.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#include <pf/bootstrap_filter.h>
+#include <pf/resamplers.h>
+#include <pf/rv_eval.h>
+
+#define NUMPARTS 100000
+#define NUMCOMPONENTS 64 // how expensive logGEv is
+#define NUMSTEPS 20
+#define FLOATTYPE double
+
+using namespace pf;
+
+// stochastic volatility with a mixture-of-normals observation density
+template <size_t nthreads>
+class mixture_svol
+    : public filters::BSFilterMT<
+          NUMPARTS, 1, 1, resamplers::systematic_resampler<NUMPARTS, 1, FLOATTYPE>,
+          FLOATTYPE, nthreads> {
+public:
+  using ssv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+  using osv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+  using base_t = filters::BSFilterMT<
+      NUMPARTS, 1, 1, resamplers::systematic_resampler<NUMPARTS, 1, FLOATTYPE>,
+      FLOATTYPE, nthreads>;
+  using rng_t = typename base_t::rng_t;
+
+  FLOATTYPE m_phi = .91;
+  FLOATTYPE m_sigma = 1.0;
+
+  mixture_svol() : base_t(1, 1234) {}
+
+  FLOATTYPE logMuEv(const ssv &x1) {
+    return rveval::evalUnivNorm<FLOATTYPE>(
+        x1(0), 0.0, m_sigma / std::sqrt(1.0 - m_phi * m_phi), true);
+  }
+  ssv q1Samp(const osv & /*y1*/, rng_t &gen) {
+    std::normal_distribution<FLOATTYPE> z(0.0, 1.0);
+    return ssv::Constant(z(gen) * m_sigma / std::sqrt(1.0 - m_phi * m_phi));
+  }
+  FLOATTYPE logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  ssv fSamp(const ssv &xtm1, rng_t &gen) {
+    std::normal_distribution<FLOATTYPE> z(0.0, 1.0);
+    return ssv::Constant(m_phi * xtm1(0) + z(gen) * m_sigma);
+  }
+  FLOATTYPE logGEv(const osv &yt, const ssv &xt) {
+    FLOATTYPE logDens = -std::numeric_limits<FLOATTYPE>::infinity();
+    for (size_t k = 0; k < NUMCOMPONENTS; ++k) {
+      FLOATTYPE scale = (1.0 + k / FLOATTYPE(NUMCOMPONENTS)) * std::exp(.5 * xt(0));
+      logDens = rveval::log_sum_exp<FLOATTYPE>(
+          logDens, rveval::evalUnivNorm<FLOATTYPE>(yt(0), 0.0, scale, true));
+    }
+    return logDens - std::log(FLOATTYPE(NUMCOMPONENTS));
+  }
+};
+
+template <size_t nthreads> double seconds_per_step() {
+  auto mod = std::make_unique<mixture_svol<nthreads>>();
+  Eigen::Matrix<FLOATTYPE, 1, 1> y;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t t = 0; t < NUMSTEPS; ++t) {
+    y(0) = std::sin(.3 * t);
+    mod->filter(y);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / NUMSTEPS;
+}
+
+template <size_t nthreads> void report(double serial) {
+  double secs = seconds_per_step<nthreads>();
+  std::cout << nthreads << "," << NUMPARTS << "," << secs << ","
+            << serial / secs << "\n";
+}
+
+int main() {
+  std::cout << "nthreads,nparts,seconds_per_step,speedup\n";
+  double serial = seconds_per_step<1>();
+  std::cout << 1 << "," << NUMPARTS << "," << serial << "," << 1.0 << "\n";
+  report<2>(serial);
+  report<4>(serial);
+  report<8>(serial);
+  report<16>(serial);
+  report<32>(serial);
+  return 0;
+}
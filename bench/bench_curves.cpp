@@ -0,0 +1,142 @@
+// Compares sys_hilb_resampler with sys_morton_resampler inside a common random
+// number particle filter. The model is a three dimensional AR(1) state
+// observed through the sum of its coordinates plus noise. For each resampler
+// the filter is run NUMRUNS times on the same simulated data with fresh common
+// random numbers, and one CSV row reports the variance of the log-likelihood
+// estimates, the seconds per filtering step and the seconds per resampling
+// step (timed on its own, on a cloud of particles from the model).
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <pf/resamplers.h>
+#include <pf/rv_eval.h>
+#include <pf/sisr_filter.h>
+
+#define NUMPARTS 1000
+#define NUMBITS 10
+#define DIMX 3
+#define NUMTIME 100
+#define NUMRUNS 50
+#define NUMRESAMPLES 200
+#define FLOATTYPE double
+
+#define PHI .9
+#define SIGMAX 1.0
+#define SIGMAY .5
+
+using namespace pf;
+using namespace pf::filters;
+
+using ssv = Eigen::Matrix<FLOATTYPE, DIMX, 1>;
+using osv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+using usvr = Eigen::Matrix<FLOATTYPE, 1, 1>;
+
+// bootstrap filter: the proposal is the state transition
+template <typename resamp_t>
+class ar_sum : public SISRFilterCRN<NUMPARTS, DIMX, 1, DIMX, 1, resamp_t,
+                                    FLOATTYPE> {
+public:
+  FLOATTYPE logMuEv(const ssv &x1) { return logFEv(x1, ssv::Zero()); }
+  ssv Xi1(const ssv &U, const osv &y1) { return Xit(ssv::Zero(), U, y1); }
+  FLOATTYPE logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  FLOATTYPE logGEv(const osv &yt, const ssv &xt) {
+    return rveval::evalUnivNorm<FLOATTYPE>(yt(0), xt.sum(), SIGMAY, true);
+  }
+  FLOATTYPE logFEv(const ssv &xt, const ssv &xtm1) {
+    FLOATTYPE ans = 0.0;
+    for (size_t i = 0; i < DIMX; ++i)
+      ans += rveval::evalUnivNorm<FLOATTYPE>(xt(i), PHI * xtm1(i), SIGMAX,
+                                             true);
+    return ans;
+  }
+  ssv Xit(const ssv &xtm1, const ssv &U, const osv & /*yt*/) {
+    return PHI * xtm1 + SIGMAX * U;
+  }
+  FLOATTYPE logQEv(const ssv &xt, const ssv &xtm1, const osv & /*yt*/) {
+    return logFEv(xt, xtm1);
+  }
+};
+
+template <typename resamp_t>
+void compare(const char *name, const std::vector<osv> &data) {
+  using filt_t = ar_sum<resamp_t>;
+  using arrayUs = std::array<ssv, NUMPARTS>;
+  std::mt19937 gen(2);
+  std::normal_distribution<FLOATTYPE> z;
+  auto U = std::make_unique<arrayUs>();
+  usvr ur;
+
+  // log-likelihood estimates across common random number draws
+  FLOATTYPE sum = 0.0;
+  FLOATTYPE sumSq = 0.0;
+  std::chrono::duration<double> filterTime(0.0);
+  for (size_t run = 0; run < NUMRUNS; ++run) {
+    auto f = std::make_unique<filt_t>();
+    FLOATTYPE logLike = 0.0;
+    for (const auto &yt : data) {
+      for (auto &u : *U)
+        for (size_t i = 0; i < DIMX; ++i)
+          u(i) = z(gen);
+      ur(0) = z(gen);
+      auto start = std::chrono::steady_clock::now();
+      f->filter(yt, *U, ur);
+      filterTime += std::chrono::steady_clock::now() - start;
+      logLike += f->getLogCondLike();
+    }
+    sum += logLike;
+    sumSq += logLike * logLike;
+  }
+  FLOATTYPE mean = sum / NUMRUNS;
+  FLOATTYPE var = (sumSq - NUMRUNS * mean * mean) / (NUMRUNS - 1);
+
+  // resampling alone, on draws from the stationary distribution
+  auto r = std::make_unique<resamp_t>();
+  auto parts = std::make_unique<std::array<ssv, NUMPARTS>>();
+  auto logWts = std::make_unique<std::array<FLOATTYPE, NUMPARTS>>();
+  FLOATTYPE sd = SIGMAX / std::sqrt(1.0 - PHI * PHI);
+  std::chrono::duration<double> resampTime(0.0);
+  for (size_t rep = 0; rep < NUMRESAMPLES; ++rep) {
+    for (size_t i = 0; i < NUMPARTS; ++i) {
+      for (size_t j = 0; j < DIMX; ++j)
+        (*parts)[i](j) = sd * z(gen);
+      (*logWts)[i] = -.5 * (*parts)[i].squaredNorm();
+    }
+    ur(0) = z(gen);
+    auto start = std::chrono::steady_clock::now();
+    r->resampLogWts(*parts, *logWts, ur);
+    resampTime += std::chrono::steady_clock::now() - start;
+  }
+
+  std::cout << name << "," << mean << "," << var << ","
+            << filterTime.count() / (NUMRUNS * data.size()) << ","
+            << resampTime.count() / NUMRESAMPLES << "\n";
+}
+
+int main() {
+  // simulate one data set
+  std::mt19937 gen(1);
+  std::normal_distribution<FLOATTYPE> z;
+  std::vector<osv> data(NUMTIME);
+  ssv x = ssv::Zero();
+  for (auto &yt : data) {
+    for (size_t i = 0; i < DIMX; ++i)
+      x(i) = PHI * x(i) + SIGMAX * z(gen);
+    yt(0) = x.sum() + SIGMAY * z(gen);
+  }
+
+  using hilb = resamplers::sys_hilb_resampler<NUMPARTS, DIMX, NUMBITS,
+                                              FLOATTYPE>;
+  using morton = resamplers::sys_morton_resampler<NUMPARTS, DIMX, NUMBITS,
+                                                  FLOATTYPE>;
+  std::cout << "resampler,mean_loglike,var_loglike,seconds_per_step,"
+               "seconds_per_resample\n";
+  compare<hilb>("sys_hilb_resampler", data);
+  compare<morton>("sys_morton_resampler", data);
+  return 0;
+}
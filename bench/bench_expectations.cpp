@@ -0,0 +1,86 @@
+// Times one filtering step when the filter mean and second moment are
+// requested as a vector of std::functions returning dynamic matrices, and when
+// they are requested as a tuple of functors with fixed-size return types.
+// Prints one CSV row per way.
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <pf/bootstrap_filter.h>
+#include <pf/resamplers.h>
+
+#define NUMPARTS 50000
+#define NUMSTEPS 50
+#define DIMSTATE 3
+#define FLOATTYPE double
+
+using namespace pf;
+
+using resamp_t =
+    resamplers::systematic_resampler<NUMPARTS, DIMSTATE, FLOATTYPE>;
+using ssv = Eigen::Matrix<FLOATTYPE, DIMSTATE, 1>;
+using osv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+using Mat = Eigen::Matrix<FLOATTYPE, Eigen::Dynamic, Eigen::Dynamic>;
+
+// a three dimensional random walk observed through its first coordinate
+class rw_model
+    : public filters::static_bsfilter<rw_model, NUMPARTS, DIMSTATE, 1,
+                                      resamp_t, FLOATTYPE> {
+public:
+  using ssv = ::ssv;
+  using osv = ::osv;
+
+  std::mt19937 m_gen{1234};
+  std::normal_distribution<FLOATTYPE> m_z;
+
+  FLOATTYPE logMuEv(const ssv &x1) { return -.5 * x1.squaredNorm(); }
+  ssv q1Samp(const osv &) {
+    return ssv::NullaryExpr([this]() { return m_z(m_gen); });
+  }
+  FLOATTYPE logQ1Ev(const ssv &x1, const osv &) { return logMuEv(x1); }
+  FLOATTYPE logGEv(const osv &yt, const ssv &xt) {
+    return -.5 * (yt(0) - xt(0)) * (yt(0) - xt(0));
+  }
+  ssv fSamp(const ssv &xtm1) {
+    return xtm1 + ssv::NullaryExpr([this]() { return m_z(m_gen); });
+  }
+};
+
+template <typename step_t> double seconds_per_step(step_t step) {
+  auto mod = std::make_unique<rw_model>();
+  osv y;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t t = 0; t < NUMSTEPS; ++t) {
+    y(0) = std::sin(.3 * t);
+    step(*mod, y);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / NUMSTEPS;
+}
+
+int main() {
+
+  std::vector<std::function<const Mat(const ssv &)>> fs{
+      [](const ssv &x) -> const Mat { return x; },
+      [](const ssv &x) -> const Mat { return x * x.transpose(); }};
+  auto hs = std::make_tuple([](const ssv &x) { return x; },
+                            [](const ssv &x) { return x * x.transpose(); });
+
+  double dyn = seconds_per_step(
+      [&fs](rw_model &mod, const osv &y) { mod.filter(y, fs); });
+  double stat = seconds_per_step(
+      [&hs](rw_model &mod, const osv &y) { mod.filter(y, hs); });
+
+  std::cout << "expectations,nparts,seconds_per_step,speedup\n";
+  std::cout << "std::function," << NUMPARTS << "," << dyn << "," << 1.0
+            << "\n";
+  std::cout << "tuple," << NUMPARTS << "," << stat << "," << dyn / stat
+            << "\n";
+  return 0;
+}
@@ -0,0 +1,158 @@
+// Times PMMH on a short stochastic volatility series: a hand-written loop
+// that heap-allocates and builds a new filter (with a new seed) for every
+// proposal, against the pmmh driver, which builds one filter per chain and
+// resets it for every proposal, with one chain and with four chains on four
+// threads. Prints one CSV row per sampler with the seconds per iteration (for
+// one chain), the iterations per second (over all chains) and the acceptance
+// rate.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <pf/bootstrap_filter.h>
+#include <pf/pmmh.h>
+#include <pf/resamplers.h>
+#include <pf/rv_eval.h>
+
+#define NUMPARTS 1000
+#define NUMTIME 10
+#define NUMITERS 500
+#define FLOATTYPE double
+
+#define BETA .5
+#define SIGMA 1.0
+
+using namespace pf;
+
+using resamp_t = resamplers::systematic_resampler<NUMPARTS, 1, FLOATTYPE>;
+using param_t = Eigen::Matrix<FLOATTYPE, 1, 1>;
+
+// the autoregressive coefficient is unknown
+class svol_phi : public filters::BSFilter<NUMPARTS, 1, 1, resamp_t,
+                                          FLOATTYPE> {
+public:
+  using ssv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+  using osv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+
+  FLOATTYPE m_phi;
+  std::mt19937 m_gen;
+  std::normal_distribution<FLOATTYPE> m_z;
+
+  svol_phi(FLOATTYPE phi, unsigned long seed) : m_phi(phi), m_gen(seed) {}
+
+  FLOATTYPE logMuEv(const ssv &x1) {
+    return rveval::evalUnivNorm<FLOATTYPE>(
+        x1(0), 0.0, SIGMA / std::sqrt(1.0 - m_phi * m_phi), true);
+  }
+  ssv q1Samp(const osv & /*y1*/) {
+    return ssv::Constant(m_z(m_gen) * SIGMA /
+                         std::sqrt(1.0 - m_phi * m_phi));
+  }
+  FLOATTYPE logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  ssv fSamp(const ssv &xtm1) {
+    return ssv::Constant(m_phi * xtm1(0) + m_z(m_gen) * SIGMA);
+  }
+  FLOATTYPE logGEv(const osv &yt, const ssv &xt) {
+    return rveval::evalUnivNorm<FLOATTYPE>(yt(0), 0.0,
+                                           BETA * std::exp(.5 * xt(0)), true);
+  }
+};
+
+FLOATTYPE logPrior(const param_t &theta) {
+  return std::abs(theta(0)) < 1.0 ? 0.0
+                                  : -std::numeric_limits<FLOATTYPE>::infinity();
+}
+
+void report(const char *name, size_t numChains, double seconds,
+            double acceptRate) {
+  std::cout << name << "," << numChains << "," << NUMPARTS << "," << NUMTIME
+            << "," << seconds / NUMITERS << ","
+            << numChains * NUMITERS / seconds << "," << acceptRate << "\n";
+}
+
+// what everyone writes by hand
+void time_naive(const std::vector<svol_phi::osv> &data) {
+  std::mt19937 gen(3);
+  std::normal_distribution<FLOATTYPE> step(0.0, .1);
+  std::uniform_real_distribution<FLOATTYPE> unif;
+  unsigned long seed = 1;
+  auto logLike = [&data, &seed](FLOATTYPE phi) {
+    auto f = std::make_unique<svol_phi>(phi, seed++);
+    FLOATTYPE ans = 0.0;
+    for (const auto &yt : data) {
+      f->filter(yt);
+      ans += f->getLogCondLike();
+    }
+    return ans;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  param_t current = param_t::Constant(.5);
+  FLOATTYPE currLogLike = logLike(current(0));
+  unsigned int numAccepted = 0;
+  for (size_t iter = 0; iter < NUMITERS; ++iter) {
+    param_t proposal = param_t::Constant(current(0) + step(gen));
+    if (logPrior(proposal) == -std::numeric_limits<FLOATTYPE>::infinity())
+      continue;
+    FLOATTYPE propLogLike = logLike(proposal(0));
+    if (std::log(unif(gen)) < propLogLike - currLogLike) {
+      current = proposal;
+      currLogLike = propLogLike;
+      numAccepted++;
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  report("hand_written", 1, elapsed.count(),
+         static_cast<double>(numAccepted) / NUMITERS);
+}
+
+template <size_t nchains>
+void time_driver(const std::vector<svol_phi::osv> &data) {
+  using sampler_t = mcmc::pmmh<svol_phi, param_t, nchains>;
+  auto sampler = std::make_unique<sampler_t>(
+      [](const param_t &theta, unsigned long seed) {
+        return svol_phi(theta(0), seed);
+      },
+      [](svol_phi &f, const param_t &theta) {
+        f.m_phi = theta(0);
+        f.reset();
+      },
+      data, logPrior,
+      [](const param_t &theta, typename sampler_t::rng_t &gen) -> param_t {
+        std::normal_distribution<FLOATTYPE> step(0.0, .1);
+        return param_t::Constant(theta(0) + step(gen));
+      },
+      typename sampler_t::log_prop_dens_t(), 3);
+  std::array<param_t, nchains> starts;
+  starts.fill(param_t::Constant(.5));
+  sampler->run(starts, NUMITERS);
+  double acceptRate = 0.0;
+  for (size_t k = 0; k < nchains; ++k)
+    acceptRate += sampler->getAcceptanceRate(k) / nchains;
+  report("pmmh", nchains, sampler->getRunSeconds(), acceptRate);
+}
+
+int main() {
+  // simulate one short data set
+  std::mt19937 gen(1);
+  std::normal_distribution<FLOATTYPE> z;
+  std::vector<svol_phi::osv> data(NUMTIME);
+  FLOATTYPE x = 0.0;
+  for (auto &yt : data) {
+    x = .9 * x + SIGMA * z(gen);
+    yt(0) = BETA * std::exp(.5 * x) * z(gen);
+  }
+
+  std::cout << "sampler,num_chains,nparts,num_time,seconds_per_iter,"
+               "iters_per_second,acceptance_rate\n";
+  time_naive(data);
+  time_driver<1>(data);
+  time_driver<4>(data);
+  return 0;
+}
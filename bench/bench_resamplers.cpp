@@ -0,0 +1,169 @@
+// Times every single-threaded resampler for 10^2 up to 10^5 particles, state
+// dimensions 1 and 8, and three kinds of weights:
+//   uniform:   every log weight is 0
+//   lognormal: the log weights are iid Normal(0, 1)
+//   dominant:  one particle has weight nparts, the others have weight 1, so
+//              it carries about half of the total
+// Each row reports the seconds per resample, the particles resampled per
+// second, and the offspring-count variance: the average over particles of
+// (count_i - nparts * w_i)^2, where count_i is the number of copies of
+// particle i. Lower is better for both. Prints CSV by default, or a JSON array
+// when run with the argument "json".
+//
+// The resamplers keep their scratch arrays (including a copy of the
+// particles) on the stack, so the sweep skips any size whose particles take
+// more than MAXPARTBYTES: with dimension 8 it stops at 10^4 particles. That
+// keeps it within a default 8 MiB stack.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+#include <pf/resamplers.h>
+
+#define FLOATTYPE double
+#define MINSECONDS 0.05          // time each resampler for at least this long
+#define MINREPS 3                // and for at least this many resamples
+#define MAXPARTBYTES (1ul << 20) // largest particle array to resample
+
+using namespace pf;
+using namespace pf::resamplers;
+
+enum class weights { uniform, lognormal, dominant };
+
+const char *weightName(weights wt) {
+  switch (wt) {
+  case weights::uniform:
+    return "uniform";
+  case weights::lognormal:
+    return "lognormal";
+  default:
+    return "dominant";
+  }
+}
+
+bool asJson = false;
+bool firstRow = true;
+
+void printRow(const char *name, size_t nparts, size_t dimx, weights wt,
+              double seconds, double offspringVar) {
+  if (asJson) {
+    std::cout << (firstRow ? "[\n" : ",\n") << "  {\"resampler\": \"" << name
+              << "\", \"nparts\": " << nparts << ", \"dimx\": " << dimx
+              << ", \"weights\": \"" << weightName(wt)
+              << "\", \"seconds_per_resample\": " << seconds
+              << ", \"particles_per_second\": " << nparts / seconds
+              << ", \"offspring_var\": " << offspringVar << "}";
+  } else {
+    if (firstRow)
+      std::cout << "resampler,nparts,dimx,weights,seconds_per_resample,"
+                   "particles_per_second,offspring_var\n";
+    std::cout << name << "," << nparts << "," << dimx << ","
+              << weightName(wt) << "," << seconds << "," << nparts / seconds
+              << "," << offspringVar << "\n";
+  }
+  firstRow = false;
+}
+
+// crn is true for the resamplers that take a common random number instead of
+// holding their own generator
+template <typename resamp_t, size_t nparts, size_t dimx, bool crn = false>
+void time_one(const char *name, weights wt) {
+  using ssv = Eigen::Matrix<FLOATTYPE, dimx, 1>;
+  using usvr = Eigen::Matrix<FLOATTYPE, 1, 1>;
+  std::unique_ptr<resamp_t> r;
+  if constexpr (crn)
+    r = std::make_unique<resamp_t>();
+  else
+    r = std::make_unique<resamp_t>(1);
+  auto parts = std::make_unique<std::array<ssv, nparts>>();
+  auto logWts = std::make_unique<std::array<FLOATTYPE, nparts>>();
+  auto w = std::make_unique<std::array<FLOATTYPE, nparts>>();
+  auto counts = std::make_unique<std::array<unsigned, nparts>>();
+  std::mt19937 gen(2);
+  std::normal_distribution<FLOATTYPE> z;
+
+  size_t reps = 0;
+  double sqErr = 0.0;
+  std::chrono::duration<double> elapsed(0.0);
+  while (elapsed.count() < MINSECONDS || reps < MINREPS) {
+
+    // fresh particles and weights
+    for (size_t i = 0; i < nparts; ++i) {
+      for (size_t j = 0; j < dimx; ++j)
+        (*parts)[i](j) = z(gen);
+      if (wt == weights::uniform)
+        (*logWts)[i] = 0.0;
+      else if (wt == weights::lognormal)
+        (*logWts)[i] = z(gen);
+      else
+        (*logWts)[i] = (i == 0) ? std::log(static_cast<FLOATTYPE>(nparts))
+                                : 0.0;
+    }
+    kernels::normalizedWeights(logWts->data(), w->data(), nparts);
+
+    usvr ur;
+    ur(0) = z(gen);
+    auto start = std::chrono::steady_clock::now();
+    if constexpr (crn)
+      r->resampLogWts(*parts, *logWts, ur);
+    else
+      r->resampLogWts(*parts, *logWts);
+    elapsed += std::chrono::steady_clock::now() - start;
+
+    // offspring counts against their expectations
+    counts->fill(0);
+    for (size_t i = 0; i < nparts; ++i)
+      (*counts)[r->getAncestors()[i]]++;
+    for (size_t i = 0; i < nparts; ++i) {
+      double err = (*counts)[i] - nparts * (*w)[i];
+      sqErr += err * err;
+    }
+    ++reps;
+  }
+  printRow(name, nparts, dimx, wt, elapsed.count() / reps,
+           sqErr / (reps * nparts));
+}
+
+template <size_t nparts, size_t dimx> void time_all(weights wt) {
+  constexpr size_t num_bits = 128 / dimx < 16 ? 128 / dimx : 16;
+  using F = FLOATTYPE;
+  time_one<mn_resampler<nparts, dimx, F>, nparts, dimx>("mn_resampler", wt);
+  time_one<mn_resamp_fast1<nparts, dimx, F>, nparts, dimx>("mn_resamp_fast1",
+                                                           wt);
+  time_one<log_mn_resampler_mt<nparts, dimx, F>, nparts, dimx>(
+      "log_mn_resampler_mt", wt);
+  time_one<resid_resampler<nparts, dimx, F>, nparts, dimx>("resid_resampler",
+                                                           wt);
+  time_one<resid_sys_resampler<nparts, dimx, F>, nparts, dimx>(
+      "resid_sys_resampler", wt);
+  time_one<stratif_resampler<nparts, dimx, F>, nparts, dimx>(
+      "stratif_resampler", wt);
+  time_one<systematic_resampler<nparts, dimx, F>, nparts, dimx>(
+      "systematic_resampler", wt);
+  time_one<sys_hilb_resampler<nparts, dimx, num_bits, F>, nparts, dimx, true>(
+      "sys_hilb_resampler", wt);
+  time_one<sys_morton_resampler<nparts, dimx, num_bits, F>, nparts, dimx,
+           true>("sys_morton_resampler", wt);
+}
+
+template <size_t nparts> void time_sizes() {
+  for (weights wt : {weights::uniform, weights::lognormal, weights::dominant}) {
+    time_all<nparts, 1>(wt);
+    if constexpr (nparts * 8 * sizeof(FLOATTYPE) <= MAXPARTBYTES)
+      time_all<nparts, 8>(wt);
+  }
+}
+
+int main(int argc, char **argv) {
+  asJson = argc > 1 && std::string(argv[1]) == "json";
+  time_sizes<100>();
+  time_sizes<1000>();
+  time_sizes<10000>();
+  time_sizes<100000>();
+  if (asJson)
+    std::cout << "\n]\n";
+  return 0;
+}
@@ -0,0 +1,70 @@
+// Times the Metropolis and rejection resamplers against systematic_resampler
+// on increasingly skewed weights: the log weights are iid Normal(0, sigma^2),
+// so max(w) / mean(w) grows quickly with sigma. The Metropolis and rejection
+// resamplers are timed on one thread and on four. Prints one CSV row per
+// (resampler, sigma) pair.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+
+#include <pf/resamplers.h>
+
+#define NUMPARTS 10000
+#define NUMREPS 5
+#define FLOATTYPE double
+
+using namespace pf;
+
+template <typename resamp_t> double seconds_per_resample(FLOATTYPE sigma) {
+  using ssv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+  auto r = std::make_unique<resamp_t>(1);
+  auto parts = std::make_unique<std::array<ssv, NUMPARTS>>();
+  auto logWts = std::make_unique<std::array<FLOATTYPE, NUMPARTS>>();
+  std::mt19937 gen(2);
+  std::normal_distribution<FLOATTYPE> z(0.0, sigma);
+
+  std::chrono::duration<double> elapsed(0.0);
+  for (size_t rep = 0; rep < NUMREPS; ++rep) {
+    for (size_t i = 0; i < NUMPARTS; ++i) {
+      (*parts)[i](0) = i;
+      (*logWts)[i] = z(gen);
+    }
+    auto start = std::chrono::steady_clock::now();
+    r->resampLogWts(*parts, *logWts);
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+  return elapsed.count() / NUMREPS;
+}
+
+int main() {
+  using systematic =
+      resamplers::systematic_resampler<NUMPARTS, 1, FLOATTYPE>;
+  using metropolis32 =
+      resamplers::metropolis_resampler<NUMPARTS, 1, FLOATTYPE, 32>;
+  using metropolis256 =
+      resamplers::metropolis_resampler<NUMPARTS, 1, FLOATTYPE, 256>;
+  using metropolis32_4 =
+      resamplers::metropolis_resampler<NUMPARTS, 1, FLOATTYPE, 32, 4>;
+  using rejection = resamplers::rejection_resampler<NUMPARTS, 1, FLOATTYPE>;
+  using rejection_4 =
+      resamplers::rejection_resampler<NUMPARTS, 1, FLOATTYPE, 4>;
+
+  std::cout << "resampler,sigma,seconds_per_resample\n";
+  for (FLOATTYPE sigma : {0.5, 1.0, 2.0, 3.0}) {
+    std::cout << "systematic_resampler," << sigma << ","
+              << seconds_per_resample<systematic>(sigma) << "\n";
+    std::cout << "metropolis_resampler<32>," << sigma << ","
+              << seconds_per_resample<metropolis32>(sigma) << "\n";
+    std::cout << "metropolis_resampler<256>," << sigma << ","
+              << seconds_per_resample<metropolis256>(sigma) << "\n";
+    std::cout << "metropolis_resampler<32 4 threads>," << sigma << ","
+              << seconds_per_resample<metropolis32_4>(sigma) << "\n";
+    std::cout << "rejection_resampler," << sigma << ","
+              << seconds_per_resample<rejection>(sigma) << "\n";
+    std::cout << "rejection_resampler<4 threads>," << sigma << ","
+              << seconds_per_resample<rejection_4>(sigma) << "\n";
+  }
+  return 0;
+}
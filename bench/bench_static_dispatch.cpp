@@ -0,0 +1,103 @@
+// Times the virtual BSFilter against the CRTP static_bsfilter on a model whose
+// hooks are cheap enough that the per-particle call overhead matters. Prints
+// one CSV row per filter.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+
+#include <pf/bootstrap_filter.h>
+#include <pf/resamplers.h>
+
+#define NUMPARTS 10000
+#define NUMSTEPS 200
+#define FLOATTYPE double
+
+using namespace pf;
+
+using resamp_t = resamplers::systematic_resampler<NUMPARTS, 1, FLOATTYPE>;
+
+// the hooks of an AR(1) plus noise model
+class ar1_hooks {
+public:
+  using ssv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+  using osv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+
+  std::mt19937 m_gen{1234};
+  std::normal_distribution<FLOATTYPE> m_z;
+
+  FLOATTYPE logMuEv(const ssv &x1) { return -.5 * x1(0) * x1(0); }
+  ssv q1Samp(const osv & /*y1*/) { return ssv::Constant(m_z(m_gen)); }
+  FLOATTYPE logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  FLOATTYPE logGEv(const osv &yt, const ssv &xt) {
+    return -.5 * (yt(0) - xt(0)) * (yt(0) - xt(0));
+  }
+  ssv fSamp(const ssv &xtm1) {
+    return ssv::Constant(.9 * xtm1(0) + m_z(m_gen));
+  }
+};
+
+class ar1_virtual
+    : public filters::BSFilter<NUMPARTS, 1, 1, resamp_t, FLOATTYPE> {
+public:
+  using ssv = ar1_hooks::ssv;
+  using osv = ar1_hooks::osv;
+
+  ar1_hooks m_hooks;
+
+  FLOATTYPE logMuEv(const ssv &x1) { return m_hooks.logMuEv(x1); }
+  ssv q1Samp(const osv &y1) { return m_hooks.q1Samp(y1); }
+  FLOATTYPE logQ1Ev(const ssv &x1, const osv &y1) {
+    return m_hooks.logQ1Ev(x1, y1);
+  }
+  FLOATTYPE logGEv(const osv &yt, const ssv &xt) {
+    return m_hooks.logGEv(yt, xt);
+  }
+  ssv fSamp(const ssv &xtm1) { return m_hooks.fSamp(xtm1); }
+};
+
+class ar1_static
+    : public filters::static_bsfilter<ar1_static, NUMPARTS, 1, 1, resamp_t,
+                                      FLOATTYPE> {
+public:
+  using ssv = ar1_hooks::ssv;
+  using osv = ar1_hooks::osv;
+
+  ar1_hooks m_hooks;
+
+  FLOATTYPE logMuEv(const ssv &x1) { return m_hooks.logMuEv(x1); }
+  ssv q1Samp(const osv &y1) { return m_hooks.q1Samp(y1); }
+  FLOATTYPE logQ1Ev(const ssv &x1, const osv &y1) {
+    return m_hooks.logQ1Ev(x1, y1);
+  }
+  FLOATTYPE logGEv(const osv &yt, const ssv &xt) {
+    return m_hooks.logGEv(yt, xt);
+  }
+  ssv fSamp(const ssv &xtm1) { return m_hooks.fSamp(xtm1); }
+};
+
+template <typename filter_t> double seconds_per_step() {
+  auto mod = std::make_unique<filter_t>();
+  Eigen::Matrix<FLOATTYPE, 1, 1> y;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t t = 0; t < NUMSTEPS; ++t) {
+    y(0) = std::sin(.3 * t);
+    mod->filter(y);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / NUMSTEPS;
+}
+
+int main() {
+  std::cout << "filter,nparts,seconds_per_step,speedup\n";
+  double virt = seconds_per_step<ar1_virtual>();
+  double stat = seconds_per_step<ar1_static>();
+  std::cout << "BSFilter," << NUMPARTS << "," << virt << "," << 1.0 << "\n";
+  std::cout << "static_bsfilter," << NUMPARTS << "," << stat << ","
+            << virt / stat << "\n";
+  return 0;
+}
@@ -0,0 +1,99 @@
+// Times stratif_resampler against the quadratic index search it used to do
+// and against systematic_resampler, for 10^2 up to 10^5 particles. Prints one
+// CSV row per (resampler, nparts) pair. The resamplers keep their scratch
+// arrays on the stack, so the sweep stops where those would outgrow a default
+// 8 MiB stack.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+
+#include <pf/resamplers.h>
+
+#define FLOATTYPE double
+#define MINSECONDS 0.2 // time each resampler for at least this long
+
+using namespace pf;
+
+// the old stratified resampler: every U searches the cumsums from the start
+template <size_t nparts> class quadratic_stratif {
+public:
+  using ssv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+  using arrayVec = std::array<ssv, nparts>;
+  using arrayFloat = std::array<FLOATTYPE, nparts>;
+
+  quadratic_stratif(unsigned long seed) : m_gen(seed) {}
+
+  void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
+    arrayFloat w;
+    kernels::normalizedWeights(oldLogUnNormWts.data(), w.data(), nparts);
+    arrayFloat cumsums;
+    std::partial_sum(w.begin(), w.end(), cumsums.begin());
+    std::uniform_real_distribution<FLOATTYPE> u_sampler(0.0, 1.0 / nparts);
+    for (size_t i = 0; i < nparts; ++i) {
+      FLOATTYPE u = static_cast<FLOATTYPE>(i) / nparts + u_sampler(m_gen);
+      m_idx[i] = nparts - 1;
+      for (unsigned int j = 0; j < nparts; ++j) {
+        if (cumsums[j] >= u) {
+          m_idx[i] = j;
+          break;
+        }
+      }
+    }
+    for (size_t i = 0; i < nparts; ++i)
+      m_tmpParts[i] = oldParts[m_idx[i]];
+    oldParts = m_tmpParts;
+    std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0);
+  }
+
+private:
+  std::mt19937 m_gen;
+  std::array<unsigned int, nparts> m_idx;
+  arrayVec m_tmpParts;
+};
+
+template <typename resamp_t, size_t nparts>
+double seconds_per_resample() {
+  using ssv = Eigen::Matrix<FLOATTYPE, 1, 1>;
+  auto r = std::make_unique<resamp_t>(1);
+  auto parts = std::make_unique<std::array<ssv, nparts>>();
+  auto logWts = std::make_unique<std::array<FLOATTYPE, nparts>>();
+  std::mt19937 gen(2);
+  std::normal_distribution<FLOATTYPE> z;
+
+  size_t reps = 0;
+  std::chrono::duration<double> elapsed(0.0);
+  while (elapsed.count() < MINSECONDS) {
+    for (size_t i = 0; i < nparts; ++i) {
+      (*parts)[i](0) = z(gen);
+      (*logWts)[i] = -.5 * (*parts)[i](0) * (*parts)[i](0);
+    }
+    auto start = std::chrono::steady_clock::now();
+    r->resampLogWts(*parts, *logWts);
+    elapsed += std::chrono::steady_clock::now() - start;
+    ++reps;
+  }
+  return elapsed.count() / reps;
+}
+
+template <size_t nparts> void time_all() {
+  using stratif = resamplers::stratif_resampler<nparts, 1, FLOATTYPE>;
+  using systematic = resamplers::systematic_resampler<nparts, 1, FLOATTYPE>;
+  std::cout << "stratif_resampler," << nparts << ","
+            << seconds_per_resample<stratif, nparts>() << "\n";
+  std::cout << "systematic_resampler," << nparts << ","
+            << seconds_per_resample<systematic, nparts>() << "\n";
+  std::cout << "quadratic_stratif," << nparts << ","
+            << seconds_per_resample<quadratic_stratif<nparts>, nparts>()
+            << "\n";
+}
+
+int main() {
+  std::cout << "resampler,nparts,seconds_per_resample\n";
+  time_all<100>();
+  time_all<1000>();
+  time_all<10000>();
+  time_all<100000>();
+  return 0;
+}
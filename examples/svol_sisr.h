@@ -34,6 +34,10 @@ public:
   float_t logFEv(const ssv &xt, const ssv &xtm1);
   ssv qSamp(const ssv &xtm1, const osv &yt);
   float_t logQEv(const ssv &xt, const ssv &xtm1, const osv &yt);
+
+  // optional: all of the observation densities in one vectorized expression
+  void logGEvBatch(const osv &yt, const std::array<ssv, nparts> &xt,
+                   std::array<float_t, nparts> &out);
 };
 
 template <size_t nparts, size_t dimx, size_t dimy, typename resampT,
@@ -79,6 +83,23 @@ float_t svol_sisr<nparts, dimx, dimy, resampT, float_t>::logGEv(const osv &yt,
                                        m_beta * std::exp(.5 * xt(0)), true);
 }
 
+template <size_t nparts, size_t dimx, size_t dimy, typename resampT,
+          typename float_t>
+void svol_sisr<nparts, dimx, dimy, resampT, float_t>::logGEvBatch(
+    const osv &yt, const std::array<ssv, nparts> &xt,
+    std::array<float_t, nparts> &out) {
+  // read the first coordinate of every particle in place
+  static_assert(sizeof(ssv) == dimx * sizeof(float_t),
+                "state vectors must be tightly packed");
+  Eigen::Map<const Eigen::Array<float_t, Eigen::Dynamic, 1>, 0,
+             Eigen::InnerStride<dimx>>
+      x(xt[0].data(), nparts);
+  Eigen::Map<Eigen::Array<float_t, Eigen::Dynamic, 1>> logGs(out.data(),
+                                                            nparts);
+  logGs = -.5 * rveval::log_two_pi<float_t> - std::log(m_beta) - .5 * x -
+          .5 * yt(0) * yt(0) / (m_beta * m_beta) * (-x).exp();
+}
+
 template <size_t nparts, size_t dimx, size_t dimy, typename resampT,
           typename float_t>
 float_t
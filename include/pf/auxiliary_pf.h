@@ -3,6 +3,7 @@
 
 #include <array>      //array
 #include <functional> // function
+#include <iostream>   // cout
 #include <vector>     // vector
 
 #ifdef DROPPINGTHISINRPACKAGE
@@ -16,27 +17,35 @@
 
 #include "pf_base.h"
 #include "rv_samp.h" // for k_generator
+#include "weight_kernels.h"
 
 namespace pf {
 
 namespace filters {
 
-//! A base-class for Auxiliary Particle Filtering. Filtering only, no smoothing.
+//! CRTP (static dispatch) version of APF.
 /**
- * @class APF
+ * @class static_apf
  * @author taylor
  * @file auxiliary_pf.h
  * @brief A base class for Auxiliary Particle Filtering.
  * Inherit from this if you want to use an APF for your state space model.
  * Filtering only, no smoothing.
+ *
+ * The model hooks are resolved at compile time: Derived inherits from this
+ * class and provides logMuEv, propMu, q1Samp, fSamp, logQ1Ev and logGEv as
+ * public member functions with the same signatures as the pure virtual ones in
+ * APF, so they can be inlined into the particle loops. Derived may also provide
+ * its own logGEvBatch, propMuBatch or fSampBatch.
+ * @tparam Derived the model class
  * @tparam nparts the number of particles
  * @tparam dimx the dimension of the state
  * @tparam dimy the dimension of the observations
  * @tparam resamp_t the resampler type
  */
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug = false>
-class APF : public bases::pf_base<float_t, dimy, dimx> {
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug = false>
+class static_apf : public bases::pf_base<float_t, dimy, dimx> {
 private:
   /** "state size vector" type alias for linear algebra stuff */
   using ssv = Eigen::Matrix<float_t, dimx, 1>;
@@ -55,13 +64,15 @@ public:
   /**
    * @brief The constructor.
    * @param rs resampling schedule (e.g. resample every rs time points).
+   * @param essFrac if positive, rs is ignored and the particles are resampled
+   * whenever the effective sample size drops below essFrac * nparts.
    */
-  APF(const unsigned int &rs = 1);
+  static_apf(const unsigned int &rs = 1, const float_t &essFrac = 0.0);
 
   /**
    * @brief The (virtual) destructor
    */
-  virtual ~APF();
+  virtual ~static_apf();
 
   /**
    * @brief Get the latest log conditional likelihood.
@@ -69,6 +80,40 @@ public:
    */
   float_t getLogCondLike() const;
 
+  /**
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
+   */
+  float_t getESS() const;
+
+  /**
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
+   */
+  bool getResampled() const;
+
+  /**
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
+   */
+  unsigned int getNumResamps() const;
+
+  /**
+   * @brief Reseeds the generator of the resampler. Generators that belong to
+   * the model are left alone. island_filter calls this on every island it
+   * copies, so a copy does not resample exactly like its ancestor.
+   * @param seed the new seed
+   */
+  void reseedGenerators(unsigned long seed);
+
+  /**
+   * @brief Takes the filter back to before its first time step, so it can be
+   * run again (e.g. on new parameters) without being rebuilt. The particle
+   * storage, the resampler and any generators are kept as they are.
+   */
+  void reset();
+
   /**
    * @brief return all stored expectations (taken with respect to
    * $p(x_t|y_{1:t})$
@@ -89,55 +134,31 @@ public:
                   std::vector<std::function<const Mat(const ssv &)>>());
 
   /**
-   * @brief Evaluates the log of mu.
-   * @param x1 a Eigen::Matrix<float_t,dimx,1> representing time 1's state.
-   * @return a float_t evaluation.
-   */
-  virtual float_t logMuEv(const ssv &x1) = 0;
-
-  /**
-   * @brief Evaluates the proposal distribution taking a
-   * Eigen::Matrix<float_t,dimx,1> from the previous time's state, and returning
-   * a state for the current time.
-   * @param xtm1 a Eigen::Matrix<float_t,dimx,1> representing the previous
-   * time's state.
-   * @return a Eigen::Matrix<float_t,dimx,1> representing a likely current time
-   * state, to be used by the observation density.
-   */
-  virtual ssv propMu(const ssv &xtm1) = 0;
-
-  /**
-   * @brief Samples from q1.
-   * @param y1 a Eigen::Matrix<float_t,dimy,1> representing time 1's data point.
-   * @return a Eigen::Matrix<float_t,dimx,1> sample for time 1's state.
+   * @brief Evaluates the log of g for every particle at once. The default
+   * calls logGEv once per particle; override it to vectorize the computation.
+   * @param yt a Eigen::Matrix<float_t,dimy,1> representing time t's data
+   * observation.
+   * @param xt all of time t's states.
+   * @param out where the nparts evaluations are written.
    */
-  virtual ssv q1Samp(const osv &y1) = 0;
+  void logGEvBatch(const osv &yt, const arrayVec &xt, arrayfloat_t &out);
 
   /**
-   * @brief Samples from f.
-   * @param xtm1 a Eigen::Matrix<float_t,dimx,1> representing the previous
-   * time's state.
-   * @return a Eigen::Matrix<float_t,dimx,1> state sample for the current time.
+   * @brief Calls propMu for every particle at once. The default calls propMu
+   * once per particle.
+   * @param xtm1 all of the previous time's states.
+   * @param out where the nparts "likely" current states are written.
    */
-  virtual ssv fSamp(const ssv &xtm1) = 0;
+  void propMuBatch(const arrayVec &xtm1, arrayVec &out);
 
   /**
-   * @brief Evaluates the log of q1.
-   * @param x1 a Eigen::Matrix<float_t,dimx,1> representing time 1's state.
-   * @param y1 a Eigen::Matrix<float_t,dimy,1> representing time 1's data
-   * observation.
-   * @return a float_t evaluation.
+   * @brief Samples from f for every particle at once. The default calls fSamp
+   * once per particle.
+   * @param xtm1 all of the previous time's states.
+   * @param xt where the current state samples are written (may be the same
+   * array as xtm1).
    */
-  virtual float_t logQ1Ev(const ssv &x1, const osv &y1) = 0;
-
-  /**
-   * @brief Evaluates the log of g.
-   * @param yt a Eigen::Matrix<float_t,dimy,1> representing time t's data
-   * observation.
-   * @param xt a Eigen::Matrix<float_t,dimx,1> representing time t's state.
-   * @return a float_t evaluation.
-   */
-  virtual float_t logGEv(const osv &yt, const ssv &xt) = 0;
+  void fSampBatch(const arrayVec &xtm1, arrayVec &xt);
 
 protected:
   /** @brief particle samples */
@@ -155,6 +176,25 @@ protected:
   /** @brief the resampling schedule */
   unsigned int m_rs;
 
+  /** @brief resample when the ESS drops below this fraction of nparts (if
+   * positive) */
+  float_t m_essFrac;
+
+  /** @brief the most recent effective sample size */
+  float_t m_ess;
+
+  /** @brief whether the most recent step resampled */
+  bool m_resampled;
+
+  /** @brief how many times the particles have been resampled */
+  unsigned int m_numResamps;
+
+  /** @brief exp(log weight - max log weight), filled once per time step */
+  arrayfloat_t m_expWts;
+
+  /** @brief log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
+
   /** @brief resampler object (default ctor'd)*/
   resamp_t m_resampler;
 
@@ -163,40 +203,72 @@ protected:
 
   /** @brief expectations E[h(x_t) | y_{1:t}] for user defined "h"s */
   std::vector<Mat> m_expectations;
+
+  /**
+   * @brief this object as the model class (the CRTP cast)
+   * @return a reference to the model
+   */
+  Derived &derived();
 };
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-APF<nparts, dimx, dimy, resamp_t, float_t, debug>::APF(const unsigned int &rs)
-    : m_now(0), m_logLastCondLike(0.0), m_rs(rs) {
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+           debug>::static_apf(const unsigned int &rs, const float_t &essFrac)
+    : m_now(0), m_logLastCondLike(0.0), m_rs(rs), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nparts)), m_resampled(false),
+      m_numResamps(0), m_logOldWtSum(std::log(static_cast<float_t>(nparts))) {
   std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
 }
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-APF<nparts, dimx, dimy, resamp_t, float_t, debug>::~APF() {}
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+           debug>::~static_apf() {}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                debug>::logGEvBatch(
+    const osv &yt, const arrayVec &xt, arrayfloat_t &out) {
+  for (size_t ii = 0; ii < nparts; ++ii)
+    out[ii] = derived().logGEv(yt, xt[ii]);
+}
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-void APF<nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                debug>::propMuBatch(const arrayVec &xtm1, arrayVec &out) {
+  for (size_t ii = 0; ii < nparts; ++ii)
+    out[ii] = derived().propMu(xtm1[ii]);
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                debug>::fSampBatch(const arrayVec &xtm1, arrayVec &xt) {
+  for (size_t ii = 0; ii < nparts; ++ii)
+    xt[ii] = derived().fSamp(xtm1[ii]);
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
     const osv &data,
     const std::vector<std::function<const Mat(const ssv &)>> &fs) {
 
   if (m_now > 0) {
 
     // set up "first stage weights" to make k index sampler
+    // g(y_t | mu_t) is kept for the second stage weights
     arrayfloat_t logFirstStageUnNormWeights = m_logUnNormWeights;
-    arrayVec oldPartics = m_particles;
-    float_t m3(-std::numeric_limits<float_t>::infinity());
+    arrayVec muTs;
+    arrayfloat_t logGMuTs;
+    derived().propMuBatch(m_particles, muTs);
+    derived().logGEvBatch(data, muTs, logGMuTs);
     float_t m2(-std::numeric_limits<float_t>::infinity());
     for (size_t ii = 0; ii < nparts; ++ii) {
-      // update m3
-      if (m_logUnNormWeights[ii] > m3)
-        m3 = m_logUnNormWeights[ii];
-
-      // sample
-      ssv xtm1 = oldPartics[ii];
-      logFirstStageUnNormWeights[ii] += logGEv(data, propMu(xtm1));
+      logFirstStageUnNormWeights[ii] += logGMuTs[ii];
 
       // accumulate things
       if (logFirstStageUnNormWeights[ii] > m2)
@@ -215,23 +287,17 @@ void APF<nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
     arrayUInt myKs = m_kGen.sample(logFirstStageUnNormWeights);
 
     // now draw xts
+    arrayVec oldPartics = m_particles;
+    for (size_t ii = 0; ii < nparts; ++ii)
+      m_particles[ii] = oldPartics[myKs[ii]];
+    derived().fSampBatch(m_particles, m_particles);
+    arrayfloat_t logGs;
+    derived().logGEvBatch(data, m_particles, logGs);
+
     float_t m1(-std::numeric_limits<float_t>::infinity());
-    float_t first_cll_sum(0.0);
-    float_t second_cll_sum(0.0);
-    float_t third_cll_sum(0.0);
-    ssv xtm1k;
-    ssv muT;
     for (size_t ii = 0; ii < nparts; ++ii) {
-      // calclations for log p(y_t|y_{1:t-1}) (using log-sum-exp trick)
-      second_cll_sum += std::exp(logFirstStageUnNormWeights[ii] - m2);
-      third_cll_sum += std::exp(m_logUnNormWeights[ii] - m3);
-
-      // sampling and unnormalized weight update
-      xtm1k = oldPartics[myKs[ii]];
-      m_particles[ii] = fSamp(xtm1k);
-      muT = propMu(xtm1k);
-      m_logUnNormWeights[ii] +=
-          logGEv(data, m_particles[ii]) - logGEv(data, muT);
+      // unnormalized weight update
+      m_logUnNormWeights[ii] += logGs[ii] - logGMuTs[myKs[ii]];
 
 #ifndef DROPPINGTHISINRPACKAGE
       if constexpr (debug) {
@@ -246,12 +312,16 @@ void APF<nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
         m1 = m_logUnNormWeights[ii];
     }
 
-    // calculate estimate for log of last conditonal likelihood
-    for (size_t p = 0; p < nparts; ++p)
-      first_cll_sum += std::exp(m_logUnNormWeights[p] - m1);
+    // exponentiate the weights once and use them for the log of the last
+    // conditional likelihood, the ESS and the expectations
+    // (the first-stage weights only enter through their sum)
+    float_t first_cll_sum = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, m1);
+    float_t second_cll_sum =
+        kernels::sumExpShift(logFirstStageUnNormWeights.data(), nparts, m2);
     m_logLastCondLike = m1 + std::log(first_cll_sum) + m2 +
-                        std::log(second_cll_sum) - 2 * m3 -
-                        2 * std::log(third_cll_sum);
+                        std::log(second_cll_sum) - 2 * m_logOldWtSum;
+    m_ess = kernels::ess(m_expWts.data(), nparts, first_cll_sum);
 
 #ifndef DROPPINGTHISINRPACKAGE
     if constexpr (debug)
@@ -263,18 +333,10 @@ void APF<nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
     unsigned int fId(0);
     for (auto &h : fs) {
 
-      Mat testOutput = h(m_particles[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
-
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
-        numer +=
-            h(m_particles[prtcl]) * std::exp(m_logUnNormWeights[prtcl] - m1);
-        denom += std::exp(m_logUnNormWeights[prtcl] - m1);
-      }
-      m_expectations[fId] = numer / denom;
+      Mat numer = h(m_particles[0]) * m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+        numer += h(m_particles[prtcl]) * m_expWts[prtcl];
+      m_expectations[fId] = numer / first_cll_sum;
 
 #ifndef DROPPINGTHISINRPACKAGE
       if constexpr (debug)
@@ -285,22 +347,33 @@ void APF<nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
       fId++;
     }
 
-    // if you have to resample
-    if ((m_now + 1) % m_rs == 0)
+    // if you have to resample (this sets all the log weights to 0)
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_rs == 0;
+    if (m_resampled) {
       m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = m1 + std::log(first_cll_sum);
+    }
 
     // advance time
     m_now += 1;
 
   } else { // (m_now == 0)
 
+    // sample particles
+    for (size_t ii = 0; ii < nparts; ++ii)
+      m_particles[ii] = derived().q1Samp(data);
+    arrayfloat_t logGs;
+    derived().logGEvBatch(data, m_particles, logGs);
+
     float_t max(-std::numeric_limits<float_t>::infinity());
     for (size_t ii = 0; ii < nparts; ++ii) {
-      // sample particles
-      m_particles[ii] = q1Samp(data);
-      m_logUnNormWeights[ii] = logMuEv(m_particles[ii]);
-      m_logUnNormWeights[ii] += logGEv(data, m_particles[ii]);
-      m_logUnNormWeights[ii] -= logQ1Ev(m_particles[ii], data);
+      m_logUnNormWeights[ii] = derived().logMuEv(m_particles[ii]);
+      m_logUnNormWeights[ii] += logGs[ii];
+      m_logUnNormWeights[ii] -= derived().logQ1Ev(m_particles[ii], data);
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
@@ -318,29 +391,22 @@ void APF<nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
     }
 
     // calculate log-likelihood with log-exp-sum trick
-    float_t sumExp(0.0);
-    for (size_t i = 0; i < nparts; ++i) {
-      sumExp += std::exp(m_logUnNormWeights[i] - max);
-    }
+    // (the exponentiated weights are reused for the ESS and the expectations)
+    float_t sumExp = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, max);
     m_logLastCondLike =
         -std::log(static_cast<float_t>(nparts)) + max + std::log(sumExp);
+    m_ess = kernels::ess(m_expWts.data(), nparts, sumExp);
 
     // calculate expectations before you resample
     m_expectations.resize(fs.size());
     unsigned int fId(0);
     for (auto &h : fs) {
 
-      Mat testOutput = h(m_particles[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
-        numer +=
-            h(m_particles[prtcl]) * std::exp(m_logUnNormWeights[prtcl] - max);
-        denom += std::exp(m_logUnNormWeights[prtcl] - max);
-      }
-      m_expectations[fId] = numer / denom;
+      Mat numer = h(m_particles[0]) * m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+        numer += h(m_particles[prtcl]) * m_expWts[prtcl];
+      m_expectations[fId] = numer / sumExp;
 
 #ifndef DROPPINGTHISINRPACKAGE
       if constexpr (debug)
@@ -352,28 +418,246 @@ void APF<nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
     }
 
     // resample if you should (automatically normalizes)
-    if ((m_now + 1) % m_rs == 0)
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_rs == 0;
+    if (m_resampled) {
       m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = max + std::log(sumExp);
+    }
 
     // advance time step
     m_now += 1;
   }
 }
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
 float_t
-APF<nparts, dimx, dimy, resamp_t, float_t, debug>::getLogCondLike() const {
+static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+           debug>::getLogCondLike() const {
   return m_logLastCondLike;
 }
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-auto APF<nparts, dimx, dimy, resamp_t, float_t, debug>::getExpectations() const
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+float_t static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                   debug>::getESS() const {
+  return m_ess;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+bool static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+unsigned int static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                        debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                debug>::reseedGenerators(unsigned long seed) {
+  m_resampler.seed(seed);
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                debug>::reset() {
+  m_now = 0;
+  m_logLastCondLike = 0.0;
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
+  m_ess = static_cast<float_t>(nparts);
+  m_resampled = false;
+  m_numResamps = 0;
+  m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+auto static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                debug>::getExpectations() const
     -> std::vector<Mat> {
   return m_expectations;
 }
 
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+Derived &static_apf<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                    debug>::derived() {
+  return static_cast<Derived &>(*this);
+}
+
+//! A base-class for Auxiliary Particle Filtering. Filtering only, no smoothing.
+/**
+ * @class APF
+ * @author taylor
+ * @file auxiliary_pf.h
+ * @brief A base class for Auxiliary Particle Filtering.
+ * Inherit from this if you want to use an APF for your state space model.
+ * Filtering only, no smoothing.
+ * @tparam nparts the number of particles
+ * @tparam dimx the dimension of the state
+ * @tparam dimy the dimension of the observations
+ * @tparam resamp_t the resampler type
+ */
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug = false>
+class APF
+    : public static_apf<
+          APF<nparts, dimx, dimy, resamp_t, float_t, debug>, nparts, dimx, dimy,
+          resamp_t, float_t, debug> {
+private:
+  /** "state size vector" type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** "observation size vector" type alias for linear algebra stuff */
+  using osv = Eigen::Matrix<float_t, dimy, 1>;
+  /** type alias for linear algebra stuff (dimension of the state ^2) */
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** type alias for array of float_ts */
+  using arrayfloat_t = std::array<float_t, nparts>;
+  /** type alias for array of state vectors */
+  using arrayVec = std::array<ssv, nparts>;
+  /** type alias for array of unsigned ints */
+  using arrayUInt = std::array<unsigned int, nparts>;
+
+  /** the static base class that runs the filter */
+  using base_t = static_apf<APF, nparts, dimx, dimy, resamp_t, float_t, debug>;
+
+public:
+  /**
+   * @brief The constructor.
+   * @param rs resampling schedule (e.g. resample every rs time points).
+   * @param essFrac if positive, rs is ignored and the particles are resampled
+   * whenever the effective sample size drops below essFrac * nparts.
+   */
+  APF(const unsigned int &rs = 1, const float_t &essFrac = 0.0);
+
+  /**
+   * @brief The (virtual) destructor
+   */
+  virtual ~APF();
+
+  /**
+   * @brief Evaluates the log of mu.
+   * @param x1 a Eigen::Matrix<float_t,dimx,1> representing time 1's state.
+   * @return a float_t evaluation.
+   */
+  virtual float_t logMuEv(const ssv &x1) = 0;
+
+  /**
+   * @brief Evaluates the proposal distribution taking a
+   * Eigen::Matrix<float_t,dimx,1> from the previous time's state, and returning
+   * a state for the current time.
+   * @param xtm1 a Eigen::Matrix<float_t,dimx,1> representing the previous
+   * time's state.
+   * @return a Eigen::Matrix<float_t,dimx,1> representing a likely current time
+   * state, to be used by the observation density.
+   */
+  virtual ssv propMu(const ssv &xtm1) = 0;
+
+  /**
+   * @brief Samples from q1.
+   * @param y1 a Eigen::Matrix<float_t,dimy,1> representing time 1's data point.
+   * @return a Eigen::Matrix<float_t,dimx,1> sample for time 1's state.
+   */
+  virtual ssv q1Samp(const osv &y1) = 0;
+
+  /**
+   * @brief Samples from f.
+   * @param xtm1 a Eigen::Matrix<float_t,dimx,1> representing the previous
+   * time's state.
+   * @return a Eigen::Matrix<float_t,dimx,1> state sample for the current time.
+   */
+  virtual ssv fSamp(const ssv &xtm1) = 0;
+
+  /**
+   * @brief Evaluates the log of q1.
+   * @param x1 a Eigen::Matrix<float_t,dimx,1> representing time 1's state.
+   * @param y1 a Eigen::Matrix<float_t,dimy,1> representing time 1's data
+   * observation.
+   * @return a float_t evaluation.
+   */
+  virtual float_t logQ1Ev(const ssv &x1, const osv &y1) = 0;
+
+  /**
+   * @brief Evaluates the log of g.
+   * @param yt a Eigen::Matrix<float_t,dimy,1> representing time t's data
+   * observation.
+   * @param xt a Eigen::Matrix<float_t,dimx,1> representing time t's state.
+   * @return a float_t evaluation.
+   */
+  virtual float_t logGEv(const osv &yt, const ssv &xt) = 0;
+
+  /**
+   * @brief Evaluates the log of g for every particle at once. The default
+   * calls logGEv once per particle; override it to vectorize the computation.
+   * @param yt a Eigen::Matrix<float_t,dimy,1> representing time t's data
+   * observation.
+   * @param xt all of time t's states.
+   * @param out where the nparts evaluations are written.
+   */
+  virtual void logGEvBatch(const osv &yt, const arrayVec &xt,
+                           arrayfloat_t &out);
+
+  /**
+   * @brief Calls propMu for every particle at once. The default calls propMu
+   * once per particle.
+   * @param xtm1 all of the previous time's states.
+   * @param out where the nparts "likely" current states are written.
+   */
+  virtual void propMuBatch(const arrayVec &xtm1, arrayVec &out);
+
+  /**
+   * @brief Samples from f for every particle at once. The default calls fSamp
+   * once per particle.
+   * @param xtm1 all of the previous time's states.
+   * @param xt where the current state samples are written (may be the same
+   * array as xtm1).
+   */
+  virtual void fSampBatch(const arrayVec &xtm1, arrayVec &xt);
+};
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+APF<nparts, dimx, dimy, resamp_t, float_t, debug>::APF(const unsigned int &rs,
+                                                       const float_t &essFrac)
+    : base_t(rs, essFrac) {}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+APF<nparts, dimx, dimy, resamp_t, float_t, debug>::~APF() {}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void APF<nparts, dimx, dimy, resamp_t, float_t, debug>::logGEvBatch(
+    const osv &yt, const arrayVec &xt, arrayfloat_t &out) {
+  base_t::logGEvBatch(yt, xt, out);
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void APF<nparts, dimx, dimy, resamp_t, float_t, debug>::propMuBatch(
+    const arrayVec &xtm1, arrayVec &out) {
+  base_t::propMuBatch(xtm1, out);
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void APF<nparts, dimx, dimy, resamp_t, float_t, debug>::fSampBatch(
+    const arrayVec &xtm1, arrayVec &xt) {
+  base_t::fSampBatch(xtm1, xt);
+}
+
 } // namespace filters
 } // namespace pf
 #endif // APF_H
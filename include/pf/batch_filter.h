@@ -0,0 +1,429 @@
+#ifndef BATCH_FILTER_H
+#define BATCH_FILTER_H
+
+#include <array>
+#include <chrono>    // for seeding with the clock
+#include <cmath>     // log
+#include <cstdint>   // uint64_t
+#include <iostream>  // cout
+#include <numeric>   // partial_sum
+#include <stdexcept> // invalid_argument
+#include <vector>
+
+#ifdef DROPPINGTHISINRPACKAGE
+#include <RcppEigen.h>
+// [[Rcpp::depends(RcppEigen)]]
+#else
+#include <Eigen/Dense>
+#endif
+
+#include "resamplers.h" // for arrangeAncestors()
+#include "rv_samp.h"    // for rvsamp::counter_rng
+#include "thread_pool.h"
+#include "weight_kernels.h"
+
+namespace pf {
+
+namespace filters {
+
+//! A base class for running one bootstrap particle filter on many time series.
+/**
+ * @class BSFilterBatch
+ * @author taylor
+ * @file batch_filter.h
+ * @brief bootstrap particle filters for numSeries independent time series
+ * that share one model, all advanced by one call to filter() with a
+ * dimy x numSeries block of observations. The particles of every series live
+ * in one dimx x (nparts * numSeries) matrix, series s in columns
+ * s * nparts, ..., (s + 1) * nparts - 1, and the log weights in one
+ * nparts x numSeries array, so each series' particles and weights are
+ * contiguous. The series are split into nthreads contiguous blocks, and each
+ * thread propagates, weights and (systematically) resamples its own series.
+ * The hooks are handed a whole series at a time, so they can be written as
+ * Eigen array expressions that vectorize over the particles, and a virtual
+ * call costs one call per series instead of one per particle. Every series
+ * draws its random numbers from its own counter_rng stream, which is a
+ * single 64 bit state, so for a fixed seed the output does not depend on
+ * nthreads. The hooks are called concurrently for different series, so they
+ * must not modify shared state. Unlike BSFilter, the time 1 proposal is the
+ * time 1 state distribution.
+ * @tparam nparts the number of particles for each series
+ * @tparam dimx the dimension of the state
+ * @tparam dimy the dimension of the observations
+ * @tparam float_t the type of floating point numbers (e.g. float or double)
+ * @tparam nthreads the number of threads (including the calling thread)
+ * @tparam debug whether to print debugging information
+ */
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug = false>
+class BSFilterBatch {
+public:
+  /** type alias for the random number generator of each series */
+  using rng_t = rvsamp::counter_rng;
+  /** "obs size vector" type alias for linear algebra stuff */
+  using osv = Eigen::Matrix<float_t, dimy, 1>;
+  /** type alias for the observations of every series (one per column) */
+  using obsBlock = Eigen::Matrix<float_t, dimy, Eigen::Dynamic>;
+  /** type alias for particles stored one per column */
+  using soaStates = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+  /** type alias for a view of one series' particles */
+  using stateRef = Eigen::Ref<soaStates>;
+  /** type alias for a read-only view of one series' particles */
+  using constStateRef = Eigen::Ref<const soaStates>;
+  /** type alias for a column of weights */
+  using wtArray = Eigen::Array<float_t, Eigen::Dynamic, 1>;
+  /** type alias for a view of one series' weights */
+  using wtRef = Eigen::Ref<wtArray>;
+  /** type alias for a read-only view of one series' weights */
+  using constWtRef = Eigen::Ref<const wtArray>;
+
+  static_assert(nthreads > 0, "need at least one thread");
+
+  /**
+   * @brief The constructor that seeds the series' generators with the clock.
+   * @param numSeries the number of time series
+   * @param rs the resampling schedule (e.g. every rs time point)
+   */
+  BSFilterBatch(size_t numSeries, const unsigned int &rs = 1);
+
+  /**
+   * @brief The constructor that sets the seed deterministically.
+   * @param numSeries the number of time series
+   * @param rs the resampling schedule (e.g. every rs time point)
+   * @param seed the seed that every series' stream is derived from
+   * @param essFrac if positive, rs is ignored and each series is resampled
+   * whenever its effective sample size drops below essFrac * nparts
+   */
+  BSFilterBatch(size_t numSeries, const unsigned int &rs, unsigned long seed,
+                const float_t &essFrac = 0.0);
+
+  /**
+   * @brief The (virtual) destructor
+   */
+  virtual ~BSFilterBatch();
+
+  /**
+   * @brief The number of time series.
+   * @return the number of series
+   */
+  size_t getNumSeries() const;
+
+  /**
+   * @brief Returns the most recent (log-) conditional likelihoods.
+   * @return log p(y_t | y_{1:t-1}) for every series
+   */
+  const wtArray &getLogCondLikes() const;
+
+  /**
+   * @brief Returns the effective sample sizes of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2 for every series
+   */
+  const wtArray &getESS() const;
+
+  /**
+   * @brief Returns the most recent filtering means.
+   * @return E[x_t | y_{1:t}] for every series (one per column)
+   */
+  const soaStates &getFilterMeans() const;
+
+  /**
+   * @brief The number of times one series has been resampled so far.
+   * @param series which series
+   * @return the number of resampling steps
+   */
+  unsigned int getNumResamps(size_t series) const;
+
+  /**
+   * @brief one series' particles (after any resampling).
+   * @param series which series
+   * @return a read-only view of its dimx x nparts particles
+   */
+  constStateRef getParticles(size_t series) const;
+
+  /**
+   * @brief one series' log unnormalized weights (after any resampling).
+   * @param series which series
+   * @return a read-only view of its nparts weights
+   */
+  constWtRef getLogWeights(size_t series) const;
+
+  /**
+   * @brief updates the filtering distribution of every series on a new
+   * block of data.
+   * @param data the most recent data point of every series (one per column)
+   */
+  void filter(const obsBlock &data);
+
+  /**
+   * @brief Samples every particle of one series from the time 1 state
+   * distribution.
+   * @param x1 where the dimx x nparts samples are written
+   * @param series which series
+   * @param gen the series' random number generator
+   */
+  virtual void muSampBatch(stateRef x1, size_t series, rng_t &gen) = 0;
+
+  /**
+   * @brief Samples every particle of one series from the state transition
+   * distribution, in place.
+   * @param xt the time t-1 states on the way in, the time t states on the way
+   * out
+   * @param series which series
+   * @param gen the series' random number generator
+   */
+  virtual void fSampBatch(stateRef xt, size_t series, rng_t &gen) = 0;
+
+  /**
+   * @brief Calculate logGEv for every particle of one series.
+   * @param yt the series' time t datum
+   * @param xt the series' time t states
+   * @param out where the nparts log-density evaluations are written
+   * @param series which series
+   */
+  virtual void logGEvBatch(const osv &yt, constStateRef xt, wtRef out,
+                           size_t series) = 0;
+
+private:
+  /** type alias for array of floating points */
+  using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for array of integers */
+  using arrayInt = std::array<unsigned int, nparts>;
+
+  /**
+   * @brief propagates, weights and (maybe) resamples one series
+   * @param yt the series' time t datum
+   * @param series which series
+   * @param tid the calling thread, whose scratch space is used
+   */
+  void step(const osv &yt, size_t series, unsigned int tid);
+
+  /** @brief the number of time series */
+  size_t m_numSeries;
+
+  /** @brief particle samples of every series (one per column) */
+  soaStates m_particles;
+
+  /** @brief particle unnormalized weights (one series per column) */
+  Eigen::Array<float_t, Eigen::Dynamic, Eigen::Dynamic> m_logUnNormWeights;
+
+  /** @brief time point */
+  unsigned int m_now;
+
+  /** @brief log p(y_t|y_{1:t-1}) or log p(y1) of every series */
+  wtArray m_logLastCondLikes;
+
+  /** @brief the most recent filtering means (one per column) */
+  soaStates m_means;
+
+  /** @brief resampling schedule (e.g. resample every __ time points) */
+  unsigned int m_resampSched;
+
+  /** @brief resample a series when its ESS drops below this fraction of
+   * nparts (if positive) */
+  float_t m_essFrac;
+
+  /** @brief the most recent effective sample size of every series */
+  wtArray m_ess;
+
+  /** @brief how many times every series has been resampled */
+  std::vector<unsigned int> m_numResamps;
+
+  /** @brief log of the sum of the weights carried into the next time step */
+  wtArray m_logOldWtSums;
+
+  /** @brief one random number stream per series */
+  std::vector<rng_t> m_gens;
+
+  /** @brief exponentiated weights (then their cumulative sums) per thread */
+  std::vector<arrayFloat> m_expWts;
+
+  /** @brief ancestor indexes per thread */
+  std::vector<arrayInt> m_ancestors;
+
+  /** @brief the worker threads */
+  parallel::thread_pool m_pool;
+};
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+BSFilterBatch<nparts, dimx, dimy, float_t, nthreads, debug>::BSFilterBatch(
+    size_t numSeries, const unsigned int &rs)
+    : BSFilterBatch(numSeries, rs,
+                    static_cast<unsigned long>(
+                        std::chrono::high_resolution_clock::now()
+                            .time_since_epoch()
+                            .count())) {}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+BSFilterBatch<nparts, dimx, dimy, float_t, nthreads, debug>::BSFilterBatch(
+    size_t numSeries, const unsigned int &rs, unsigned long seed,
+    const float_t &essFrac)
+    : m_numSeries(numSeries),
+      m_particles(soaStates::Zero(dimx, nparts * numSeries)),
+      m_logUnNormWeights(nparts, numSeries), m_now(0),
+      m_logLastCondLikes(wtArray::Zero(numSeries)),
+      m_means(soaStates::Zero(dimx, numSeries)), m_resampSched(rs),
+      m_essFrac(essFrac),
+      m_ess(wtArray::Constant(numSeries, static_cast<float_t>(nparts))),
+      m_numResamps(numSeries, 0),
+      m_logOldWtSums(wtArray::Constant(
+          numSeries, std::log(static_cast<float_t>(nparts)))),
+      m_expWts(nthreads), m_ancestors(nthreads), m_pool(nthreads) {
+  m_logUnNormWeights.setZero();
+
+  // give every series its own stream
+  m_gens.reserve(numSeries);
+  for (size_t s = 0; s < numSeries; ++s)
+    m_gens.emplace_back(seed, s);
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+BSFilterBatch<nparts, dimx, dimy, float_t, nthreads, debug>::~BSFilterBatch() {
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+void BSFilterBatch<nparts, dimx, dimy, float_t, nthreads, debug>::filter(
+    const obsBlock &data) {
+
+  if (static_cast<size_t>(data.cols()) != m_numSeries)
+    throw std::invalid_argument(
+        "need one column of observations for every series");
+
+  // each thread takes a block of series through the whole time step
+  m_pool.run([this, &data](unsigned int tid) {
+    auto range = parallel::block_range(m_numSeries, nthreads, tid);
+    for (size_t s = range.first; s < range.second; ++s)
+      step(data.col(s), s, tid);
+  });
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+  if constexpr (debug)
+    for (size_t s = 0; s < m_numSeries; ++s)
+      std::cout << "time: " << m_now << ", series: " << s
+                << ", log cond like: " << m_logLastCondLikes(s)
+                << ", ess: " << m_ess(s) << "\n";
+#endif
+
+  // advance time
+  m_now += 1;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+void BSFilterBatch<nparts, dimx, dimy, float_t, nthreads, debug>::step(
+    const osv &yt, size_t s, unsigned int tid) {
+
+  auto x = m_particles.middleCols(s * nparts, nparts);
+  auto logWts = m_logUnNormWeights.col(s);
+  rng_t &gen = m_gens[s];
+  float_t *w = m_expWts[tid].data();
+  Eigen::Map<wtArray> logGs(w, nparts);
+
+  // sample and get weight adjustments
+  if (m_now > 0)
+    fSampBatch(x, s, gen);
+  else
+    muSampBatch(x, s, gen);
+  logGEvBatch(yt, x, logGs, s);
+  logWts += logGs;
+
+  // exponentiate the weights once (log-exp-sum trick) and use them for
+  // log p(y_t|y_{1:t-1}), the ESS and the filtering mean
+  float_t maxNumer = kernels::max(logWts.data(), nparts);
+  float_t sumExp = kernels::expShift(logWts.data(), w, nparts, maxNumer);
+  m_logLastCondLikes(s) = maxNumer + std::log(sumExp) - m_logOldWtSums(s);
+  m_ess(s) = kernels::ess(w, nparts, sumExp);
+  m_means.col(s) =
+      x * Eigen::Map<const Eigen::Matrix<float_t, Eigen::Dynamic, 1>>(
+              w, nparts) /
+      sumExp;
+
+  // resample if you should (this sets all the log weights to 0)
+  bool resample = m_essFrac > 0.0 ? m_ess(s) < m_essFrac * nparts
+                                  : (m_now + 1) % m_resampSched == 0;
+  if (!resample) {
+    m_logOldWtSums(s) = maxNumer + std::log(sumExp);
+    return;
+  }
+
+  // systematic resampling, copying in place
+  std::partial_sum(w, w + nparts, w);
+  arrayInt &idx = m_ancestors[tid];
+  float_t u0 = static_cast<float_t>(gen.unif());
+  unsigned int j = 0;
+  for (size_t i = 0; i < nparts; ++i) {
+    float_t u = (i + u0) / nparts * w[nparts - 1];
+    while (j < nparts - 1 && w[j] < u)
+      j++;
+    idx[i] = j;
+  }
+  resamplers::arrangeAncestors<nparts>(idx);
+  for (size_t i = 0; i < nparts; ++i)
+    if (idx[i] != i)
+      x.col(i) = x.col(idx[i]);
+  logWts.setZero();
+  m_logOldWtSums(s) = std::log(static_cast<float_t>(nparts));
+  m_numResamps[s]++;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+size_t
+BSFilterBatch<nparts, dimx, dimy, float_t, nthreads, debug>::getNumSeries()
+    const {
+  return m_numSeries;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+auto BSFilterBatch<nparts, dimx, dimy, float_t, nthreads,
+                   debug>::getLogCondLikes() const -> const wtArray & {
+  return m_logLastCondLikes;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+auto BSFilterBatch<nparts, dimx, dimy, float_t, nthreads, debug>::getESS()
+    const -> const wtArray & {
+  return m_ess;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+auto BSFilterBatch<nparts, dimx, dimy, float_t, nthreads,
+                   debug>::getFilterMeans() const -> const soaStates & {
+  return m_means;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+unsigned int
+BSFilterBatch<nparts, dimx, dimy, float_t, nthreads, debug>::getNumResamps(
+    size_t series) const {
+  return m_numResamps[series];
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+auto BSFilterBatch<nparts, dimx, dimy, float_t, nthreads, debug>::getParticles(
+    size_t series) const -> constStateRef {
+  return m_particles.middleCols(series * nparts, nparts);
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename float_t,
+          size_t nthreads, bool debug>
+auto BSFilterBatch<nparts, dimx, dimy, float_t, nthreads,
+                   debug>::getLogWeights(size_t series) const -> constWtRef {
+  return m_logUnNormWeights.col(series);
+}
+
+} // namespace filters
+
+} // namespace pf
+
+#endif // BATCH_FILTER_H
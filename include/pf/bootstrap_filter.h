@@ -2,6 +2,11 @@
 #define BOOTSTRAP_FILTER_H
 
 #include <array>
+#include <chrono>   // for seeding with the clock
+#include <cstdint>  // uint32_t
+#include <iostream> // cout
+#include <random>   // mt19937
+#include <tuple>    // apply, make_tuple
 #include <vector>
 
 #ifdef DROPPINGTHISINRPACKAGE
@@ -12,25 +17,1341 @@
 #endif
 
 #include "pf_base.h"
+#include "thread_pool.h"
+#include "weight_kernels.h"
 
 namespace pf {
 
 namespace filters {
 
+//! CRTP (static dispatch) version of BSFilter.
+/**
+ * @class static_bsfilter
+ * @author taylor
+ * @file bootstrap_filter.h
+ * @brief bootstrap particle filter
+ *
+ * The model hooks are resolved at compile time: Derived inherits from this
+ * class and provides logMuEv, q1Samp, logQ1Ev, logGEv and fSamp as public
+ * member functions with the same signatures as the pure virtual ones in
+ * BSFilter, so they can be inlined into the particle loops. Derived may also
+ * provide its own logGEvBatch or fSampBatch.
+ * @tparam Derived the model class
+ * @tparam nparts the number of particles
+ * @tparam dimx the dimension of the state
+ * @tparam dimy the dimension of the observations
+ * @tparam resamp_t the type of resampler
+ */
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug = false>
+class static_bsfilter : public bases::pf_base<float_t, dimy, dimx> {
+private:
+  /** "state size vector" type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** "obs size vector" type alias for linear algebra stuff */
+  using osv = Eigen::Matrix<float_t, dimy, 1>; // obs size vec
+  /** type alias for dynamically sized matrix */
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** type alias for linear algebra stuff */
+  using arrayStates = std::array<ssv, nparts>;
+  /** type alias for array of floating points */
+  using arrayFloat = std::array<float_t, nparts>;
+
+public:
+  /**
+   * @brief The constructor
+   * @param rs the resampling schedule (e.g. every rs time point)
+   * @param essFrac if positive, rs is ignored and the particles are resampled
+   * whenever the effective sample size drops below essFrac * nparts
+   */
+  static_bsfilter(const unsigned int &rs = 1, const float_t &essFrac = 0.0);
+
+  /**
+   * @brief The (virtual) destructor
+   */
+  virtual ~static_bsfilter();
+
+  /**
+   * @brief Returns the most recent (log-) conditional likelihood.
+   * @return log p(y_t | y_{1:t-1})
+   */
+  float_t getLogCondLike() const;
+
+  /**
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
+   */
+  float_t getESS() const;
+
+  /**
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
+   */
+  bool getResampled() const;
+
+  /**
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
+   */
+  unsigned int getNumResamps() const;
+
+  /**
+   * @brief Reseeds the generator of the resampler. Generators that belong to
+   * the model are left alone. island_filter calls this on every island it
+   * copies, so a copy does not resample exactly like its ancestor.
+   * @param seed the new seed
+   */
+  void reseedGenerators(unsigned long seed);
+
+  /**
+   * @brief Takes the filter back to before its first time step, so it can be
+   * run again (e.g. on new parameters) without being rebuilt. The particle
+   * storage, the resampler and any generators are kept as they are.
+   */
+  void reset();
+
+  /**
+   * @brief updates filtering distribution on a new datapoint.
+   * Optionally stores expectations of functionals.
+   * @param data the most recent data point
+   * @param fs a vector of functions if you want to calculate expectations.
+   */
+  void filter(const osv &data,
+              const std::vector<std::function<const Mat(const ssv &)>> &fs =
+                  std::vector<std::function<const Mat(const ssv &)>>());
+
+  /**
+   * @brief return all stored expectations (taken with respect to
+   * $p(x_t|y_{1:t})$
+   * @return return a std::vector<Mat> of expectations. How many depends on how
+   * many callbacks you gave to
+   */
+  auto getExpectations() const -> std::vector<Mat>;
+
+  /**
+   * @brief updates filtering distribution on a new datapoint and returns
+   * expectations of functionals whose types are known at compile time. Each
+   * h in hs is called with a state and returns a scalar or a fixed-size Eigen
+   * matrix. The weighted sums are accumulated in that type, so unlike the
+   * std::function version nothing is allocated per particle and every h can
+   * be inlined. getExpectations() returns an empty vector after a call to
+   * this overload.
+   * @param data the most recent data point
+   * @param hs a std::tuple of functors
+   * @return a std::tuple with E[h(x_t) | y_{1:t}] for every h in hs
+   */
+  template <typename... Hs>
+  auto filter(const osv &data, const std::tuple<Hs...> &hs)
+      -> std::tuple<bases::expectation_t<Hs, ssv>...>;
+
+  /**
+   * @brief Calculate logGEv for every particle at once. The default calls
+   * logGEv once per particle; override it to vectorize the whole weight
+   * computation.
+   * @param yt is a const Vec& describing the time t datum
+   * @param xt all of the time t states
+   * @param out where the nparts log-density evaluations are written
+   */
+  void logGEvBatch(const osv &yt, const arrayStates &xt, arrayFloat &out);
+
+  /**
+   * @brief Sample from the state transition distribution for every particle
+   * at once. The default calls fSamp once per particle.
+   * @param xtm1 all of the time t-1 states
+   * @param xt where the time t samples are written (may be the same array as
+   * xtm1)
+   */
+  void fSampBatch(const arrayStates &xtm1, arrayStates &xt);
+
+protected:
+  /** @brief particle samples */
+  arrayStates m_particles;
+
+  /** @brief particle unnormalized weights */
+  arrayFloat m_logUnNormWeights;
+
+  /** @brief time point */
+  unsigned int m_now;
+
+  /** @brief log p(y_t|y_{1:t-1}) or log p(y1)  */
+  float_t m_logLastCondLike;
+
+  /** @brief resampler object */
+  resamp_t m_resampler;
+
+  /** @brief expectations E[h(x_t) | y_{1:t}] for user defined "h"s */
+  std::vector<Mat> m_expectations;
+
+  /** @brief resampling schedule (e.g. resample every __ time points) */
+  unsigned int m_resampSched;
+
+  /** @brief resample when the ESS drops below this fraction of nparts (if
+   * positive) */
+  float_t m_essFrac;
+
+  /** @brief the most recent effective sample size */
+  float_t m_ess;
+
+  /** @brief whether the most recent step resampled */
+  bool m_resampled;
+
+  /** @brief how many times the particles have been resampled */
+  unsigned int m_numResamps;
+
+  /** @brief exp(log weight - max log weight), filled once per time step */
+  arrayFloat m_expWts;
+
+  /** @brief log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
+
+  /**
+   * @brief samples and weights the particles for one time step, then
+   * exponentiates the weights into m_expWts and updates the log conditional
+   * likelihood and the ESS
+   * @param data the most recent data point
+   * @return the sum of m_expWts
+   */
+  float_t weightStep(const osv &data);
+
+  /**
+   * @brief the weighted average of h over the current particles
+   * @param h a functor taking a state
+   * @param sumExp the sum of m_expWts
+   * @return E[h(x_t) | y_{1:t}]
+   */
+  template <typename H>
+  auto weightedMean(const H &h, float_t sumExp) -> bases::expectation_t<H, ssv>;
+
+  /**
+   * @brief resamples if it is time to, and advances the time step
+   */
+  void resampleStep();
+
+  /**
+   * @brief this object as the model class (the CRTP cast)
+   * @return a reference to the model
+   */
+  Derived &derived();
+};
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                debug>::static_bsfilter(const unsigned int &rs,
+                                        const float_t &essFrac)
+    : m_now(0), m_logLastCondLike(0.0), m_resampSched(rs), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nparts)), m_resampled(false), m_numResamps(0),
+      m_logOldWtSum(std::log(static_cast<float_t>(nparts)))
+
+{
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                debug>::~static_bsfilter() {}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                     debug>::logGEvBatch(
+    const osv &yt, const arrayStates &xt, arrayFloat &out) {
+  for (size_t ii = 0; ii < nparts; ++ii)
+    out[ii] = derived().logGEv(yt, xt[ii]);
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                     debug>::fSampBatch(
+    const arrayStates &xtm1, arrayStates &xt) {
+  for (size_t ii = 0; ii < nparts; ++ii)
+    xt[ii] = derived().fSamp(xtm1[ii]);
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                     debug>::filter(
+    const osv &dat,
+    const std::vector<std::function<const Mat(const ssv &)>> &fs) {
+
+  // fs may be a different size than last time (or than at time 1)
+  if (m_expectations.size() != fs.size())
+    m_expectations.resize(fs.size());
+  float_t sumExp = weightStep(dat);
+
+  // calculate expectations before you resample
+  unsigned int fId(0);
+  for (auto &h : fs) {
+
+    Mat numer = h(m_particles[0]) * m_expWts[0];
+    for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+      numer += h(m_particles[prtcl]) * m_expWts[prtcl];
+    m_expectations[fId] = numer / sumExp;
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+    if constexpr (debug)
+      std::cout << "transposed expectation " << fId << ": "
+                << m_expectations[fId].transpose() << "\n";
+#endif
+
+    fId++;
+  }
+
+  resampleStep();
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+template <typename... Hs>
+auto static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                     debug>::filter(const osv &dat,
+                                    const std::tuple<Hs...> &hs)
+    -> std::tuple<bases::expectation_t<Hs, ssv>...> {
+
+  // no std::function expectations are stored at this time step
+  m_expectations.clear();
+  float_t sumExp = weightStep(dat);
+
+  // calculate expectations before you resample
+  auto expectations = std::apply(
+      [this, sumExp](const auto &...h) {
+        return std::make_tuple(weightedMean(h, sumExp)...);
+      },
+      hs);
+
+  resampleStep();
+  return expectations;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+float_t static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                        debug>::weightStep(const osv &dat) {
+
+  arrayFloat logGs;
+  if (m_now > 0) {
+
+    // sample and get weight adjustments for all particles at once
+    derived().fSampBatch(m_particles, m_particles);
+    derived().logGEvBatch(dat, m_particles, logGs);
+    for (size_t ii = 0; ii < nparts; ++ii)
+      m_logUnNormWeights[ii] += logGs[ii];
+
+  } else //  (m_now == 0) //time 1
+  {
+    // sample particles
+    for (size_t ii = 0; ii < nparts; ++ii)
+      m_particles[ii] = derived().q1Samp(dat);
+    derived().logGEvBatch(dat, m_particles, logGs);
+
+    for (size_t ii = 0; ii < nparts; ++ii) {
+      m_logUnNormWeights[ii] = derived().logMuEv(m_particles[ii]);
+      m_logUnNormWeights[ii] += logGs[ii];
+      m_logUnNormWeights[ii] -= derived().logQ1Ev(m_particles[ii], dat);
+    }
+  }
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+  if constexpr (debug)
+    for (size_t ii = 0; ii < nparts; ++ii)
+      std::cout << "time: " << m_now
+                << ", transposed sample: " << m_particles[ii].transpose()
+                << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
+#endif
+
+  // exponentiate the weights once (log-exp-sum trick) and use them for
+  // log p(y_t|y_{1:t-1}), the ESS and the expectations
+  float_t maxNumer = kernels::max(m_logUnNormWeights.data(), nparts);
+  float_t sumExp = kernels::expShift(
+      m_logUnNormWeights.data(), m_expWts.data(), nparts, maxNumer);
+  m_logLastCondLike = maxNumer + std::log(sumExp) - m_logOldWtSum;
+  m_ess = kernels::ess(m_expWts.data(), nparts, sumExp);
+  return sumExp;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+template <typename H>
+auto static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                     debug>::weightedMean(const H &h, float_t sumExp)
+    -> bases::expectation_t<H, ssv> {
+  bases::expectation_t<H, ssv> numer = h(m_particles[0]) * m_expWts[0];
+  for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+    numer += h(m_particles[prtcl]) * m_expWts[prtcl];
+  return numer / sumExp;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                     debug>::resampleStep() {
+
+  // resample if you should (this sets all the log weights to 0)
+  m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                : (m_now + 1) % m_resampSched == 0;
+  if (m_resampled) {
+    m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+    m_numResamps++;
+    m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+  } else {
+    // (that is, max log weight + log sum of the exponentiated weights)
+    m_logOldWtSum += m_logLastCondLike;
+  }
+
+  // advance time
+  m_now += 1;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+float_t
+static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                debug>::getLogCondLike() const {
+  return m_logLastCondLike;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+float_t static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                        debug>::getESS() const {
+  return m_ess;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+bool static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                     debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+unsigned int static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                             debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                     debug>::reseedGenerators(unsigned long seed) {
+  m_resampler.seed(seed);
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                     debug>::reset() {
+  m_now = 0;
+  m_logLastCondLike = 0.0;
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
+  m_ess = static_cast<float_t>(nparts);
+  m_resampled = false;
+  m_numResamps = 0;
+  m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+auto static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                     debug>::getExpectations()
+    const -> std::vector<Mat> {
+  return m_expectations;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+Derived &static_bsfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                         debug>::derived() {
+  return static_cast<Derived &>(*this);
+}
+
 //! A base class for the bootstrap particle filter.
 /**
- * @class BSFilter
+ * @class BSFilter
+ * @author taylor
+ * @file bootstrap_filter.h
+ * @brief bootstrap particle filter
+ * @tparam nparts the number of particles
+ * @tparam dimx the dimension of the state
+ * @tparam dimy the dimension of the observations
+ * @tparam resamp_t the type of resampler
+ */
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug = false>
+class BSFilter
+    : public static_bsfilter<
+          BSFilter<nparts, dimx, dimy, resamp_t, float_t, debug>, nparts, dimx,
+          dimy, resamp_t, float_t, debug> {
+private:
+  /** "state size vector" type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** "obs size vector" type alias for linear algebra stuff */
+  using osv = Eigen::Matrix<float_t, dimy, 1>; // obs size vec
+  /** type alias for dynamically sized matrix */
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** type alias for linear algebra stuff */
+  using arrayStates = std::array<ssv, nparts>;
+  /** type alias for array of floating points */
+  using arrayFloat = std::array<float_t, nparts>;
+
+  /** the static base class that runs the filter */
+  using base_t =
+      static_bsfilter<BSFilter, nparts, dimx, dimy, resamp_t, float_t, debug>;
+
+public:
+  /**
+   * @brief The constructor
+   * @param rs the resampling schedule (e.g. every rs time point)
+   * @param essFrac if positive, rs is ignored and the particles are resampled
+   * whenever the effective sample size drops below essFrac * nparts
+   */
+  BSFilter(const unsigned int &rs = 1, const float_t &essFrac = 0.0);
+
+  /**
+   * @brief The (virtual) destructor
+   */
+  virtual ~BSFilter();
+
+  /**
+   * @brief  Calculate muEv or logmuEv
+   * @param x1 is a const Vec& describing the state sample
+   * @return the density or log-density evaluation
+   */
+  virtual float_t logMuEv(const ssv &x1) = 0;
+
+  /**
+   * @brief Samples from time 1 proposal
+   * @param y1 is a const Vec& representing the first observed datum
+   * @return the sample as a Vec
+   */
+  virtual ssv q1Samp(const osv &y1) = 0;
+
+  /**
+   * @brief Calculate q1Ev or log q1Ev
+   * @param x1 is a const Vec& describing the time 1 state sample
+   * @param y1 is a const Vec& describing the time 1 datum
+   * @return the density or log-density evaluation
+   */
+  virtual float_t logQ1Ev(const ssv &x1, const osv &y1) = 0;
+
+  /**
+   * @brief Calculate gEv or logGEv
+   * @param yt is a const Vec& describing the time t datum
+   * @param xt is a const Vec& describing the time t state
+   * @return the density or log-density evaluation
+   */
+  virtual float_t logGEv(const osv &yt, const ssv &xt) = 0;
+
+  /**
+   * @brief Sample from the state transition distribution
+   * @param xtm1 is a const Vec& describing the time t-1 state
+   * @return the sample as a Vec
+   */
+  virtual ssv fSamp(const ssv &xtm1) = 0;
+
+  /**
+   * @brief Calculate logGEv for every particle at once. The default calls
+   * logGEv once per particle; override it to vectorize the whole weight
+   * computation.
+   * @param yt is a const Vec& describing the time t datum
+   * @param xt all of the time t states
+   * @param out where the nparts log-density evaluations are written
+   */
+  virtual void logGEvBatch(const osv &yt, const arrayStates &xt,
+                           arrayFloat &out);
+
+  /**
+   * @brief Sample from the state transition distribution for every particle
+   * at once. The default calls fSamp once per particle.
+   * @param xtm1 all of the time t-1 states
+   * @param xt where the time t samples are written (may be the same array as
+   * xtm1)
+   */
+  virtual void fSampBatch(const arrayStates &xtm1, arrayStates &xt);
+};
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+BSFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::BSFilter(
+    const unsigned int &rs, const float_t &essFrac)
+    : base_t(rs, essFrac) {}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+BSFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::~BSFilter() {}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void BSFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::logGEvBatch(
+    const osv &yt, const arrayStates &xt, arrayFloat &out) {
+  base_t::logGEvBatch(yt, xt, out);
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void BSFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::fSampBatch(
+    const arrayStates &xtm1, arrayStates &xt) {
+  base_t::fSampBatch(xtm1, xt);
+}
+
+//! A base class for the bootstrap particle filter that propagates and weights
+//! particles on several threads.
+/**
+ * @class BSFilterMT
+ * @author taylor
+ * @file bootstrap_filter.h
+ * @brief multi-threaded bootstrap particle filter. The particles are split into
+ * nthreads contiguous blocks, and each block is propagated and weighted on its
+ * own thread with its own random number generator. The two sampling hooks are
+ * handed that generator, and the resampler is seeded from the same seed, so
+ * for a fixed seed and a fixed nthreads the output is reproducible. All of the
+ * hooks are called concurrently, so they must not modify shared state.
+ * @tparam nparts the number of particles
+ * @tparam dimx the dimension of the state
+ * @tparam dimy the dimension of the observations
+ * @tparam resamp_t the type of resampler (must be constructible from a seed)
+ * @tparam float_t the type of floating point numbers (e.g. float or double)
+ * @tparam nthreads the number of threads (including the calling thread)
+ * @tparam debug whether to print debugging information
+ */
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug = false>
+class BSFilterMT : public bases::pf_base<float_t, dimy, dimx> {
+private:
+  /** "state size vector" type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** "obs size vector" type alias for linear algebra stuff */
+  using osv = Eigen::Matrix<float_t, dimy, 1>; // obs size vec
+  /** type alias for dynamically sized matrix */
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** type alias for linear algebra stuff */
+  using arrayStates = std::array<ssv, nparts>;
+  /** type alias for array of floating points */
+  using arrayFloat = std::array<float_t, nparts>;
+
+  static_assert(nthreads > 0, "need at least one thread");
+
+public:
+  /** type alias for the random number generator handed to each thread */
+  using rng_t = std::mt19937;
+
+  /**
+   * @brief The constructor that seeds all thread generators with the clock.
+   * @param rs the resampling schedule (e.g. every rs time point)
+   */
+  BSFilterMT(const unsigned int &rs = 1);
+
+  /**
+   * @brief The constructor that sets the seed deterministically.
+   * @param rs the resampling schedule (e.g. every rs time point)
+   * @param seed the seed that all per-thread generators are derived from
+   * @param essFrac if positive, rs is ignored and the particles are resampled
+   * whenever the effective sample size drops below essFrac * nparts
+   */
+  BSFilterMT(const unsigned int &rs, unsigned long seed,
+             const float_t &essFrac = 0.0);
+
+  /**
+   * @brief The (virtual) destructor
+   */
+  virtual ~BSFilterMT();
+
+  /**
+   * @brief Returns the most recent (log-) conditional likelihood.
+   * @return log p(y_t | y_{1:t-1})
+   */
+  float_t getLogCondLike() const;
+
+  /**
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
+   */
+  float_t getESS() const;
+
+  /**
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
+   */
+  bool getResampled() const;
+
+  /**
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
+   */
+  unsigned int getNumResamps() const;
+
+  /**
+   * @brief Reseeds the per-thread generators handed to the sampling hooks and
+   * the generator of the resampler, the same way the seeded constructor does.
+   * island_filter calls this on every island it copies, so a copy does not
+   * move or resample exactly like its ancestor.
+   * @param seed the new seed
+   */
+  void reseedGenerators(unsigned long seed);
+
+  /**
+   * @brief Takes the filter back to before its first time step, so it can be
+   * run again (e.g. on new parameters) without being rebuilt. The particle
+   * storage, the resampler and any generators are kept as they are.
+   */
+  void reset();
+
+  /**
+   * @brief updates filtering distribution on a new datapoint.
+   * Optionally stores expectations of functionals.
+   * @param data the most recent data point
+   * @param fs a vector of functions if you want to calculate expectations.
+   */
+  void filter(const osv &data,
+              const std::vector<std::function<const Mat(const ssv &)>> &fs =
+                  std::vector<std::function<const Mat(const ssv &)>>());
+
+  /**
+   * @brief return all stored expectations (taken with respect to
+   * $p(x_t|y_{1:t})$
+   * @return return a std::vector<Mat> of expectations. How many depends on how
+   * many callbacks you gave to
+   */
+  auto getExpectations() const -> std::vector<Mat>;
+
+  /**
+   * @brief  Calculate muEv or logmuEv
+   * @param x1 is a const Vec& describing the state sample
+   * @return the density or log-density evaluation
+   */
+  virtual float_t logMuEv(const ssv &x1) = 0;
+
+  /**
+   * @brief Samples from time 1 proposal
+   * @param y1 is a const Vec& representing the first observed datum
+   * @param gen the calling thread's random number generator
+   * @return the sample as a Vec
+   */
+  virtual ssv q1Samp(const osv &y1, rng_t &gen) = 0;
+
+  /**
+   * @brief Calculate q1Ev or log q1Ev
+   * @param x1 is a const Vec& describing the time 1 state sample
+   * @param y1 is a const Vec& describing the time 1 datum
+   * @return the density or log-density evaluation
+   */
+  virtual float_t logQ1Ev(const ssv &x1, const osv &y1) = 0;
+
+  /**
+   * @brief Calculate gEv or logGEv
+   * @param yt is a const Vec& describing the time t datum
+   * @param xt is a const Vec& describing the time t state
+   * @return the density or log-density evaluation
+   */
+  virtual float_t logGEv(const osv &yt, const ssv &xt) = 0;
+
+  /**
+   * @brief Sample from the state transition distribution
+   * @param xtm1 is a const Vec& describing the time t-1 state
+   * @param gen the calling thread's random number generator
+   * @return the sample as a Vec
+   */
+  virtual ssv fSamp(const ssv &xtm1, rng_t &gen) = 0;
+
+protected:
+  /** @brief particle samples */
+  arrayStates m_particles;
+
+  /** @brief particle unnormalized weights */
+  arrayFloat m_logUnNormWeights;
+
+  /** @brief time point */
+  unsigned int m_now;
+
+  /** @brief log p(y_t|y_{1:t-1}) or log p(y1)  */
+  float_t m_logLastCondLike;
+
+  /** @brief resampler object */
+  resamp_t m_resampler;
+
+  /** @brief expectations E[h(x_t) | y_{1:t}] for user defined "h"s */
+  std::vector<Mat> m_expectations;
+
+  /** @brief resampling schedule (e.g. resample every __ time points) */
+  unsigned int m_resampSched;
+
+  /** @brief resample when the ESS drops below this fraction of nparts (if
+   * positive) */
+  float_t m_essFrac;
+
+  /** @brief the most recent effective sample size */
+  float_t m_ess;
+
+  /** @brief whether the most recent step resampled */
+  bool m_resampled;
+
+  /** @brief how many times the particles have been resampled */
+  unsigned int m_numResamps;
+
+  /** @brief exp(log weight - max log weight), filled once per time step */
+  arrayFloat m_expWts;
+
+  /** @brief log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
+
+  /** @brief one random number generator per thread */
+  std::array<rng_t, nthreads> m_gens;
+
+  /** @brief the worker threads */
+  parallel::thread_pool m_pool;
+};
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug>
+BSFilterMT<nparts, dimx, dimy, resamp_t, float_t, nthreads, debug>::BSFilterMT(
+    const unsigned int &rs)
+    : BSFilterMT(rs, static_cast<unsigned long>(
+                         std::chrono::high_resolution_clock::now()
+                             .time_since_epoch()
+                             .count())) {}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug>
+BSFilterMT<nparts, dimx, dimy, resamp_t, float_t, nthreads, debug>::BSFilterMT(
+    const unsigned int &rs, unsigned long seed, const float_t &essFrac)
+    : m_now(0), m_logLastCondLike(0.0), m_resampler(seed + nthreads),
+      m_resampSched(rs), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nparts)), m_resampled(false),
+      m_numResamps(0), m_logOldWtSum(std::log(static_cast<float_t>(nparts))),
+      m_pool(nthreads) {
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
+  reseedGenerators(seed);
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug>
+BSFilterMT<nparts, dimx, dimy, resamp_t, float_t, nthreads,
+           debug>::~BSFilterMT() {}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug>
+void BSFilterMT<nparts, dimx, dimy, resamp_t, float_t, nthreads,
+                debug>::filter(const osv &dat,
+                               const std::vector<std::function<const Mat(
+                                   const ssv &)>> &fs) {
+
+  if (m_now > 0) {
+
+    // propagate and weight each block on its own thread
+    m_pool.run([this, &dat](unsigned int tid) {
+      auto range = parallel::block_range(nparts, nthreads, tid);
+      rng_t &gen = m_gens[tid];
+      for (size_t ii = range.first; ii < range.second; ++ii) {
+        m_particles[ii] = fSamp(m_particles[ii], gen);
+        m_logUnNormWeights[ii] += logGEv(dat, m_particles[ii]);
+      }
+    });
+
+  } else { // (m_now == 0) // time 1
+
+    m_pool.run([this, &dat](unsigned int tid) {
+      auto range = parallel::block_range(nparts, nthreads, tid);
+      rng_t &gen = m_gens[tid];
+      for (size_t ii = range.first; ii < range.second; ++ii) {
+        m_particles[ii] = q1Samp(dat, gen);
+        m_logUnNormWeights[ii] = logMuEv(m_particles[ii]);
+        m_logUnNormWeights[ii] += logGEv(dat, m_particles[ii]);
+        m_logUnNormWeights[ii] -= logQ1Ev(m_particles[ii], dat);
+      }
+    });
+  }
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+  if constexpr (debug)
+    for (size_t ii = 0; ii < nparts; ++ii)
+      std::cout << "time: " << m_now
+                << ", transposed sample: " << m_particles[ii].transpose()
+                << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
+#endif
+
+  // exponentiate the weights once (log-exp-sum trick) and use them for
+  // log p(y_t|y_{1:t-1}), the ESS and the expectations
+  float_t maxNumer = kernels::max(m_logUnNormWeights.data(), nparts);
+  float_t sumExp = kernels::expShift(
+      m_logUnNormWeights.data(), m_expWts.data(), nparts, maxNumer);
+  m_logLastCondLike = maxNumer + std::log(sumExp) - m_logOldWtSum;
+  m_ess = kernels::ess(m_expWts.data(), nparts, sumExp);
+
+  // fs may be a different size than last time (or than at time 1)
+  if (m_expectations.size() != fs.size())
+    m_expectations.resize(fs.size());
+
+  // calculate expectations before you resample
+  unsigned int fId(0);
+  for (auto &h : fs) {
+
+    Mat numer = h(m_particles[0]) * m_expWts[0];
+    for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+      numer += h(m_particles[prtcl]) * m_expWts[prtcl];
+    m_expectations[fId] = numer / sumExp;
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+    if constexpr (debug)
+      std::cout << "transposed expectation " << fId << ": "
+                << m_expectations[fId].transpose() << "\n";
+#endif
+
+    fId++;
+  }
+
+  // resample if you should (this sets all the log weights to 0)
+  m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                : (m_now + 1) % m_resampSched == 0;
+  if (m_resampled) {
+    m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+    m_numResamps++;
+    m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+  } else {
+    m_logOldWtSum = maxNumer + std::log(sumExp);
+  }
+
+  // advance time
+  m_now += 1;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug>
+float_t BSFilterMT<nparts, dimx, dimy, resamp_t, float_t, nthreads,
+                   debug>::getLogCondLike() const {
+  return m_logLastCondLike;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug>
+float_t BSFilterMT<nparts, dimx, dimy, resamp_t, float_t, nthreads,
+                   debug>::getESS() const {
+  return m_ess;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug>
+bool BSFilterMT<nparts, dimx, dimy, resamp_t, float_t, nthreads,
+                debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug>
+unsigned int BSFilterMT<nparts, dimx, dimy, resamp_t, float_t, nthreads,
+                        debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug>
+void BSFilterMT<nparts, dimx, dimy, resamp_t, float_t, nthreads,
+                debug>::reseedGenerators(unsigned long seed) {
+  m_resampler.seed(seed + nthreads);
+
+  // give every thread its own stream
+  for (size_t tid = 0; tid < nthreads; ++tid) {
+    std::seed_seq seq{
+        static_cast<std::uint32_t>(seed),
+        static_cast<std::uint32_t>(static_cast<std::uint64_t>(seed) >> 32),
+        static_cast<std::uint32_t>(tid)};
+    m_gens[tid].seed(seq);
+  }
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug>
+void BSFilterMT<nparts, dimx, dimy, resamp_t, float_t, nthreads,
+                debug>::reset() {
+  m_now = 0;
+  m_logLastCondLike = 0.0;
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
+  m_ess = static_cast<float_t>(nparts);
+  m_resampled = false;
+  m_numResamps = 0;
+  m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, size_t nthreads, bool debug>
+auto BSFilterMT<nparts, dimx, dimy, resamp_t, float_t, nthreads,
+                debug>::getExpectations() const -> std::vector<Mat> {
+  return m_expectations;
+}
+
+//! A base class for the bootstrap particle filter that stores its particles
+//! in one matrix.
+/**
+ * @class BSFilterSoA
+ * @author taylor
+ * @file bootstrap_filter.h
+ * @brief bootstrap particle filter with "structure of arrays" storage. The
+ * particles are the columns of one dimx x nparts matrix instead of an array of
+ * small vectors, so the weights and each state coordinate are contiguous in
+ * memory and the weighting, likelihood and expectation loops can be
+ * vectorized. Hooks receive a (read-only) view of a column, so nothing is
+ * copied on the way in. The resampler must provide
+ * resampLogWts(Eigen::Matrix<float_t, dimx, Eigen::Dynamic>&, arrayFloat&),
+ * which the standard resamplers in resamplers.h do.
+ * @tparam nparts the number of particles
+ * @tparam dimx the dimension of the state
+ * @tparam dimy the dimension of the observations
+ * @tparam resamp_t the type of resampler
+ * @tparam float_t the type of floating point numbers (e.g. float or double)
+ * @tparam debug whether to print debugging information
+ */
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug = false>
+class BSFilterSoA : public bases::pf_base<float_t, dimy, dimx> {
+private:
+  /** "state size vector" type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** "obs size vector" type alias for linear algebra stuff */
+  using osv = Eigen::Matrix<float_t, dimy, 1>; // obs size vec
+  /** type alias for dynamically sized matrix */
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** type alias for all particles (one per column) */
+  using soaStates = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+  /** type alias for a read-only view of one particle */
+  using ssvRef = Eigen::Ref<const ssv>;
+  /** type alias for array of floating points */
+  using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for vectorized operations on the weights */
+  using wtArray = Eigen::Array<float_t, Eigen::Dynamic, 1>;
+
+public:
+  /**
+   * @brief The constructor
+   * @param rs the resampling schedule (e.g. every rs time point)
+   * @param essFrac if positive, rs is ignored and the particles are resampled
+   * whenever the effective sample size drops below essFrac * nparts
+   */
+  BSFilterSoA(const unsigned int &rs = 1, const float_t &essFrac = 0.0);
+
+  /**
+   * @brief The (virtual) destructor
+   */
+  virtual ~BSFilterSoA();
+
+  /**
+   * @brief Returns the most recent (log-) conditional likelihood.
+   * @return log p(y_t | y_{1:t-1})
+   */
+  float_t getLogCondLike() const;
+
+  /**
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
+   */
+  float_t getESS() const;
+
+  /**
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
+   */
+  bool getResampled() const;
+
+  /**
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
+   */
+  unsigned int getNumResamps() const;
+
+  /**
+   * @brief Reseeds the generator of the resampler. Generators that belong to
+   * the model are left alone. island_filter calls this on every island it
+   * copies, so a copy does not resample exactly like its ancestor.
+   * @param seed the new seed
+   */
+  void reseedGenerators(unsigned long seed);
+
+  /**
+   * @brief Takes the filter back to before its first time step, so it can be
+   * run again (e.g. on new parameters) without being rebuilt. The particle
+   * storage, the resampler and any generators are kept as they are.
+   */
+  void reset();
+
+  /**
+   * @brief updates filtering distribution on a new datapoint.
+   * Optionally stores expectations of functionals.
+   * @param data the most recent data point
+   * @param fs a vector of functions if you want to calculate expectations.
+   */
+  void filter(const osv &data,
+              const std::vector<std::function<const Mat(const ssv &)>> &fs =
+                  std::vector<std::function<const Mat(const ssv &)>>());
+
+  /**
+   * @brief return all stored expectations (taken with respect to
+   * $p(x_t|y_{1:t})$
+   * @return return a std::vector<Mat> of expectations. How many depends on how
+   * many callbacks you gave to
+   */
+  auto getExpectations() const -> std::vector<Mat>;
+
+  /**
+   * @brief  Calculate muEv or logmuEv
+   * @param x1 is a view of the state sample
+   * @return the density or log-density evaluation
+   */
+  virtual float_t logMuEv(const ssvRef &x1) = 0;
+
+  /**
+   * @brief Samples from time 1 proposal
+   * @param y1 is a const Vec& representing the first observed datum
+   * @return the sample as a Vec
+   */
+  virtual ssv q1Samp(const osv &y1) = 0;
+
+  /**
+   * @brief Calculate q1Ev or log q1Ev
+   * @param x1 is a view of the time 1 state sample
+   * @param y1 is a const Vec& describing the time 1 datum
+   * @return the density or log-density evaluation
+   */
+  virtual float_t logQ1Ev(const ssvRef &x1, const osv &y1) = 0;
+
+  /**
+   * @brief Calculate gEv or logGEv
+   * @param yt is a const Vec& describing the time t datum
+   * @param xt is a view of the time t state
+   * @return the density or log-density evaluation
+   */
+  virtual float_t logGEv(const osv &yt, const ssvRef &xt) = 0;
+
+  /**
+   * @brief Sample from the state transition distribution
+   * @param xtm1 is a view of the time t-1 state
+   * @return the sample as a Vec
+   */
+  virtual ssv fSamp(const ssvRef &xtm1) = 0;
+
+protected:
+  /** @brief particle samples (one per column) */
+  soaStates m_particles;
+
+  /** @brief particle unnormalized weights */
+  arrayFloat m_logUnNormWeights;
+
+  /** @brief time point */
+  unsigned int m_now;
+
+  /** @brief log p(y_t|y_{1:t-1}) or log p(y1)  */
+  float_t m_logLastCondLike;
+
+  /** @brief resampler object */
+  resamp_t m_resampler;
+
+  /** @brief expectations E[h(x_t) | y_{1:t}] for user defined "h"s */
+  std::vector<Mat> m_expectations;
+
+  /** @brief resampling schedule (e.g. resample every __ time points) */
+  unsigned int m_resampSched;
+
+  /** @brief resample when the ESS drops below this fraction of nparts (if
+   * positive) */
+  float_t m_essFrac;
+
+  /** @brief the most recent effective sample size */
+  float_t m_ess;
+
+  /** @brief whether the most recent step resampled */
+  bool m_resampled;
+
+  /** @brief how many times the particles have been resampled */
+  unsigned int m_numResamps;
+
+  /** @brief exp(log weight - max log weight), filled once per time step */
+  wtArray m_expWts;
+
+  /** @brief log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
+};
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+BSFilterSoA<nparts, dimx, dimy, resamp_t, float_t, debug>::BSFilterSoA(
+    const unsigned int &rs, const float_t &essFrac)
+    : m_particles(soaStates::Zero(dimx, nparts)), m_now(0),
+      m_logLastCondLike(0.0), m_resampSched(rs), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nparts)), m_resampled(false),
+      m_numResamps(0), m_expWts(nparts),
+      m_logOldWtSum(std::log(static_cast<float_t>(nparts))) {
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+BSFilterSoA<nparts, dimx, dimy, resamp_t, float_t, debug>::~BSFilterSoA() {}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void BSFilterSoA<nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
+    const osv &dat,
+    const std::vector<std::function<const Mat(const ssv &)>> &fs) {
+
+  Eigen::Map<wtArray> logWts(m_logUnNormWeights.data(), nparts);
+
+  if (m_now > 0) {
+
+    // sample and get weight adjustments
+    for (size_t ii = 0; ii < nparts; ++ii) {
+      m_particles.col(ii) = fSamp(m_particles.col(ii));
+      logWts(ii) += logGEv(dat, m_particles.col(ii));
+    }
+  } else {
+    // sample from the time 1 proposal
+    for (size_t ii = 0; ii < nparts; ++ii) {
+      m_particles.col(ii) = q1Samp(dat);
+      logWts(ii) = logMuEv(m_particles.col(ii)) +
+                   logGEv(dat, m_particles.col(ii)) -
+                   logQ1Ev(m_particles.col(ii), dat);
+    }
+  }
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+  if constexpr (debug)
+    for (size_t ii = 0; ii < nparts; ++ii)
+      std::cout << "time: " << m_now
+                << ", transposed sample: " << m_particles.col(ii).transpose()
+                << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
+#endif
+
+  // exponentiate the weights once (log-exp-sum trick) and use them for
+  // log p(y_t|y_{1:t-1}), the ESS and the expectations
+  float_t maxNumer = kernels::max(m_logUnNormWeights.data(), nparts);
+  float_t sumWts = kernels::expShift(m_logUnNormWeights.data(), m_expWts.data(),
+                                     nparts, maxNumer);
+  m_logLastCondLike = maxNumer + std::log(sumWts) - m_logOldWtSum;
+  m_ess = kernels::ess(m_expWts.data(), nparts, sumWts);
+
+  // fs may be a different size than last time (or than at time 1)
+  if (m_expectations.size() != fs.size())
+    m_expectations.resize(fs.size());
+
+  // calculate expectations before you resample
+  unsigned int fId(0);
+  for (auto &h : fs) {
+
+    Mat numer = h(m_particles.col(0)) * m_expWts(0);
+    for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+      numer += h(m_particles.col(prtcl)) * m_expWts(prtcl);
+    m_expectations[fId] = numer / sumWts;
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+    if constexpr (debug)
+      std::cout << "transposed expectation " << fId << ": "
+                << m_expectations[fId].transpose() << "\n";
+#endif
+
+    fId++;
+  }
+
+  // resample if you should (this sets all the log weights to 0)
+  m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                : (m_now + 1) % m_resampSched == 0;
+  if (m_resampled) {
+    m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+    m_numResamps++;
+    m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+  } else {
+    m_logOldWtSum = maxNumer + std::log(sumWts);
+  }
+
+  // advance time
+  m_now += 1;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+float_t BSFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                    debug>::getLogCondLike() const {
+  return m_logLastCondLike;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+float_t BSFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                    debug>::getESS() const {
+  return m_ess;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+bool BSFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                 debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+unsigned int BSFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                         debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void BSFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                 debug>::reseedGenerators(unsigned long seed) {
+  m_resampler.seed(seed);
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void BSFilterSoA<nparts, dimx, dimy, resamp_t, float_t, debug>::reset() {
+  m_now = 0;
+  m_logLastCondLike = 0.0;
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
+  m_ess = static_cast<float_t>(nparts);
+  m_resampled = false;
+  m_numResamps = 0;
+  m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+auto BSFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                 debug>::getExpectations() const -> std::vector<Mat> {
+  return m_expectations;
+}
+
+//! A base class for the bootstrap particle filter whose number of particles is
+//! chosen at run time.
+/**
+ * @class BSFilterDyn
  * @author taylor
  * @file bootstrap_filter.h
- * @brief bootstrap particle filter
- * @tparam nparts the number of particles
+ * @brief bootstrap particle filter where the number of particles is a
+ * constructor argument instead of a template parameter. Like BSFilterSoA, the
+ * particles are the columns of one matrix, and that matrix, the weights and
+ * every temporary live on the heap, are allocated once and are reused at every
+ * time step, so very large particle counts do not touch the stack. The number
+ * of particles can also be changed between time steps with setNumParts(). The
+ * resampler must provide resampLogWts(soaMat&, wtArray&, size_t nout), which
+ * mn_resampler_dyn and systematic_resampler_dyn in resamplers.h do.
  * @tparam dimx the dimension of the state
  * @tparam dimy the dimension of the observations
  * @tparam resamp_t the type of resampler
+ * @tparam float_t the type of floating point numbers (e.g. float or double)
+ * @tparam debug whether to print debugging information
  */
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug = false>
-class BSFilter : public bases::pf_base<float_t, dimy, dimx> {
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug = false>
+class BSFilterDyn : public bases::pf_base<float_t, dimy, dimx> {
 private:
   /** "state size vector" type alias for linear algebra stuff */
   using ssv = Eigen::Matrix<float_t, dimx, 1>;
@@ -38,22 +1359,44 @@ private:
   using osv = Eigen::Matrix<float_t, dimy, 1>; // obs size vec
   /** type alias for dynamically sized matrix */
   using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
-  /** type alias for linear algebra stuff */
-  using arrayStates = std::array<ssv, nparts>;
-  /** type alias for array of floating points */
-  using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for all particles (one per column) */
+  using soaStates = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+  /** type alias for a read-only view of one particle */
+  using ssvRef = Eigen::Ref<const ssv>;
+  /** type alias for the weights */
+  using wtArray = Eigen::Array<float_t, Eigen::Dynamic, 1>;
 
 public:
   /**
    * @brief The constructor
+   * @param numParts the number of particles
    * @param rs the resampling schedule (e.g. every rs time point)
+   * @param essFrac if positive, rs is ignored and the particles are resampled
+   * whenever the effective sample size drops below essFrac * numParts
    */
-  BSFilter(const unsigned int &rs = 1);
+  BSFilterDyn(size_t numParts, const unsigned int &rs = 1,
+              const float_t &essFrac = 0.0);
 
   /**
    * @brief The (virtual) destructor
    */
-  virtual ~BSFilter();
+  virtual ~BSFilterDyn();
+
+  /**
+   * @brief The current number of particles.
+   * @return the number of particles
+   */
+  size_t getNumParts() const;
+
+  /**
+   * @brief Changes the number of particles. Before the first time step this
+   * only changes the size of the buffers. Afterwards, the current particles
+   * are resampled into numParts equally-weighted particles, so the filtering
+   * distribution (and the likelihood of the next step) stays the same. That
+   * resampling counts towards getNumResamps() and getResampled().
+   * @param numParts the new number of particles
+   */
+  void setNumParts(size_t numParts);
 
   /**
    * @brief Returns the most recent (log-) conditional likelihood.
@@ -61,6 +1404,40 @@ public:
    */
   float_t getLogCondLike() const;
 
+  /**
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
+   */
+  float_t getESS() const;
+
+  /**
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
+   */
+  bool getResampled() const;
+
+  /**
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
+   */
+  unsigned int getNumResamps() const;
+
+  /**
+   * @brief Reseeds the generator of the resampler. Generators that belong to
+   * the model are left alone. island_filter calls this on every island it
+   * copies, so a copy does not resample exactly like its ancestor.
+   * @param seed the new seed
+   */
+  void reseedGenerators(unsigned long seed);
+
+  /**
+   * @brief Takes the filter back to before its first time step, so it can be
+   * run again (e.g. on new parameters) without being rebuilt. The particle
+   * storage, the resampler and any generators are kept as they are.
+   */
+  void reset();
+
   /**
    * @brief updates filtering distribution on a new datapoint.
    * Optionally stores expectations of functionals.
@@ -81,10 +1458,10 @@ public:
 
   /**
    * @brief  Calculate muEv or logmuEv
-   * @param x1 is a const Vec& describing the state sample
+   * @param x1 is a view of the state sample
    * @return the density or log-density evaluation
    */
-  virtual float_t logMuEv(const ssv &x1) = 0;
+  virtual float_t logMuEv(const ssvRef &x1) = 0;
 
   /**
    * @brief Samples from time 1 proposal
@@ -95,33 +1472,33 @@ public:
 
   /**
    * @brief Calculate q1Ev or log q1Ev
-   * @param x1 is a const Vec& describing the time 1 state sample
+   * @param x1 is a view of the time 1 state sample
    * @param y1 is a const Vec& describing the time 1 datum
    * @return the density or log-density evaluation
    */
-  virtual float_t logQ1Ev(const ssv &x1, const osv &y1) = 0;
+  virtual float_t logQ1Ev(const ssvRef &x1, const osv &y1) = 0;
 
   /**
    * @brief Calculate gEv or logGEv
    * @param yt is a const Vec& describing the time t datum
-   * @param xt is a const Vec& describing the time t state
+   * @param xt is a view of the time t state
    * @return the density or log-density evaluation
    */
-  virtual float_t logGEv(const osv &yt, const ssv &xt) = 0;
+  virtual float_t logGEv(const osv &yt, const ssvRef &xt) = 0;
 
   /**
    * @brief Sample from the state transition distribution
-   * @param xtm1 is a const Vec& describing the time t-1 state
+   * @param xtm1 is a view of the time t-1 state
    * @return the sample as a Vec
    */
-  virtual ssv fSamp(const ssv &xtm1) = 0;
+  virtual ssv fSamp(const ssvRef &xtm1) = 0;
 
 protected:
-  /** @brief particle samples */
-  arrayStates m_particles;
+  /** @brief particle samples (one per column) */
+  soaStates m_particles;
 
   /** @brief particle unnormalized weights */
-  arrayFloat m_logUnNormWeights;
+  wtArray m_logUnNormWeights;
 
   /** @brief time point */
   unsigned int m_now;
@@ -137,177 +1514,193 @@ protected:
 
   /** @brief resampling schedule (e.g. resample every __ time points) */
   unsigned int m_resampSched;
-};
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-BSFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::BSFilter(
-    const unsigned int &rs)
-    : m_now(0), m_logLastCondLike(0.0), m_resampSched(rs)
+  /** @brief resample when the ESS drops below this fraction of the number of
+   * particles (if positive) */
+  float_t m_essFrac;
 
-{
-  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
-}
+  /** @brief the most recent effective sample size */
+  float_t m_ess;
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-BSFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::~BSFilter() {}
+  /** @brief whether the most recent step resampled */
+  bool m_resampled;
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-void BSFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
-    const osv &dat,
-    const std::vector<std::function<const Mat(const ssv &)>> &fs) {
+  /** @brief how many times the particles have been resampled */
+  unsigned int m_numResamps;
 
-  if (m_now > 0) {
+  /** @brief exp(log weight - max log weight), filled once per time step */
+  wtArray m_expWts;
 
-    // try to iterate over particles all at once
-    ssv newSamp;
-    float_t maxOldLogUnNormWts(-std::numeric_limits<float_t>::infinity());
-    arrayFloat oldLogUnNormWts = m_logUnNormWeights;
-    for (size_t ii = 0; ii < nparts; ++ii) {
-      // update max of old logUnNormWts
-      if (m_logUnNormWeights[ii] > maxOldLogUnNormWts)
-        maxOldLogUnNormWts = m_logUnNormWeights[ii];
+  /** @brief log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
+};
 
-      // sample and get weight adjustments
-      newSamp = fSamp(m_particles[ii]);
-      m_logUnNormWeights[ii] += logGEv(dat, newSamp);
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
+BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::BSFilterDyn(
+    size_t numParts, const unsigned int &rs, const float_t &essFrac)
+    : m_particles(soaStates::Zero(dimx, numParts)),
+      m_logUnNormWeights(wtArray::Zero(numParts)), m_now(0),
+      m_logLastCondLike(0.0), m_resampSched(rs), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(numParts)), m_resampled(false),
+      m_numResamps(0), m_expWts(numParts),
+      m_logOldWtSum(std::log(static_cast<float_t>(numParts))) {}
 
-      // overwrite stuff
-      m_particles[ii] = newSamp;
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
+BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::~BSFilterDyn() {}
 
-// print stuff if debug mode is on
-#ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "time: " << m_now
-                  << ", transposed sample: " << m_particles[ii].transpose()
-                  << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
-#endif
-    }
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
+size_t BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::getNumParts() const {
+  return m_particles.cols();
+}
 
-    // compute estimate of log p(y_t|y_{1:t-1}) with log-exp-sum trick
-    float_t maxNumer = *std::max_element(
-        m_logUnNormWeights.begin(),
-        m_logUnNormWeights.end()); // because you added log adjustments
-    float_t sumExp1(0.0);
-    float_t sumExp2(0.0);
-    for (size_t i = 0; i < nparts; ++i) {
-      sumExp1 += std::exp(m_logUnNormWeights[i] - maxNumer);
-      sumExp2 += std::exp(oldLogUnNormWts[i] - maxOldLogUnNormWts); // 1
-    }
-    m_logLastCondLike =
-        maxNumer + std::log(sumExp1) - maxOldLogUnNormWts - std::log(sumExp2);
-
-    // calculate expectations before you resample
-    int fId(0);
-    for (auto &h : fs) {
-
-      Mat testOutput = h(m_particles[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t weightNormConst(0.0);
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
-        numer += h(m_particles[prtcl]) *
-                 std::exp(m_logUnNormWeights[prtcl] - maxNumer);
-        weightNormConst += std::exp(m_logUnNormWeights[prtcl] - maxNumer);
-      }
-      m_expectations[fId] = numer / weightNormConst;
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
+void BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::setNumParts(
+    size_t numParts) {
 
-// print stuff if debug mode is on
-#ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "transposed expectation " << fId << ": "
-                  << m_expectations[fId].transpose() << "\n";
-#endif
+  if (m_now > 0) {
+    m_resampler.resampLogWts(m_particles, m_logUnNormWeights, numParts);
+    m_resampled = true;
+    m_numResamps++;
+  } else {
+    m_particles.setZero(dimx, numParts);
+    m_logUnNormWeights.setZero(numParts);
+  }
+  m_expWts.resize(numParts);
+  m_logOldWtSum = std::log(static_cast<float_t>(numParts));
+}
 
-      fId++;
-    }
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
+void BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::filter(
+    const osv &dat,
+    const std::vector<std::function<const Mat(const ssv &)>> &fs) {
 
-    // resample if you should
-    if ((m_now + 1) % m_resampSched == 0)
-      m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+  size_t nparts = m_particles.cols();
+  if (m_now > 0) {
 
-    // advance time
-    m_now += 1;
-  } else //  (m_now == 0) //time 1
-  {
-    // only need to iterate over particles once
+    // sample and get weight adjustments
+    for (size_t ii = 0; ii < nparts; ++ii) {
+      m_particles.col(ii) = fSamp(m_particles.col(ii));
+      m_logUnNormWeights(ii) += logGEv(dat, m_particles.col(ii));
+    }
+  } else {
+    // sample from the time 1 proposal
     for (size_t ii = 0; ii < nparts; ++ii) {
-      // sample particles
-      m_particles[ii] = q1Samp(dat);
-      m_logUnNormWeights[ii] = logMuEv(m_particles[ii]);
-      m_logUnNormWeights[ii] += logGEv(dat, m_particles[ii]);
-      m_logUnNormWeights[ii] -= logQ1Ev(m_particles[ii], dat);
+      m_particles.col(ii) = q1Samp(dat);
+      m_logUnNormWeights(ii) = logMuEv(m_particles.col(ii)) +
+                               logGEv(dat, m_particles.col(ii)) -
+                               logQ1Ev(m_particles.col(ii), dat);
+    }
+  }
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "time: " << m_now
-                  << ", transposed sample: " << m_particles[ii].transpose()
-                  << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
+  if constexpr (debug)
+    for (size_t ii = 0; ii < nparts; ++ii)
+      std::cout << "time: " << m_now
+                << ", transposed sample: " << m_particles.col(ii).transpose()
+                << ", log unnorm weight: " << m_logUnNormWeights(ii) << "\n";
 #endif
-    }
 
-    // calculate log cond likelihood with log-exp-sum trick
-    float_t max =
-        *std::max_element(m_logUnNormWeights.begin(), m_logUnNormWeights.end());
-    float_t sumExp(0.0);
-    for (size_t i = 0; i < nparts; ++i) {
-      sumExp += std::exp(m_logUnNormWeights[i] - max);
-    }
-    m_logLastCondLike = -std::log(nparts) + max + std::log(sumExp);
+  // exponentiate the weights once (log-exp-sum trick) and use them for
+  // log p(y_t|y_{1:t-1}), the ESS and the expectations
+  float_t maxNumer = kernels::max(m_logUnNormWeights.data(), nparts);
+  float_t sumWts = kernels::expShift(m_logUnNormWeights.data(), m_expWts.data(),
+                                     nparts, maxNumer);
+  m_logLastCondLike = maxNumer + std::log(sumWts) - m_logOldWtSum;
+  m_ess = kernels::ess(m_expWts.data(), nparts, sumWts);
 
-    // calculate expectations before you resample
-    // paying mind to underflow
+  // fs may be a different size than last time (or than at time 1)
+  if (m_expectations.size() != fs.size())
     m_expectations.resize(fs.size());
-    unsigned int fId(0);
-    for (auto &h : fs) {
-
-      Mat testOutput = h(m_particles[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t weightNormConst(0.0);
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
-        numer +=
-            h(m_particles[prtcl]) * std::exp(m_logUnNormWeights[prtcl] - (max));
-        weightNormConst += std::exp(m_logUnNormWeights[prtcl] - (max));
-      }
-      m_expectations[fId] = numer / weightNormConst;
+
+  // calculate expectations before you resample
+  unsigned int fId(0);
+  for (auto &h : fs) {
+
+    Mat numer = h(m_particles.col(0)) * m_expWts(0);
+    for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+      numer += h(m_particles.col(prtcl)) * m_expWts(prtcl);
+    m_expectations[fId] = numer / sumWts;
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "transposed expectation " << fId << ": "
-                  << m_expectations[fId].transpose() << "\n";
+    if constexpr (debug)
+      std::cout << "transposed expectation " << fId << ": "
+                << m_expectations[fId].transpose() << "\n";
 #endif
 
-      fId++;
-    }
-
-    // resample if you should
-    if ((m_now + 1) % m_resampSched == 0) {
-      m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
-    }
+    fId++;
+  }
 
-    // advance time step
-    m_now += 1;
+  // resample if you should (this sets all the log weights to 0)
+  m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                : (m_now + 1) % m_resampSched == 0;
+  if (m_resampled) {
+    m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+    m_numResamps++;
+    m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+  } else {
+    m_logOldWtSum = maxNumer + std::log(sumWts);
   }
+
+  // advance time
+  m_now += 1;
 }
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
 float_t
-BSFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::getLogCondLike() const {
+BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::getLogCondLike() const {
   return m_logLastCondLike;
 }
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-auto BSFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::getExpectations()
-    const -> std::vector<Mat> {
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
+float_t BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::getESS() const {
+  return m_ess;
+}
+
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
+bool BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
+unsigned int
+BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
+void BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::reseedGenerators(
+    unsigned long seed) {
+  m_resampler.seed(seed);
+}
+
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
+void BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::reset() {
+  m_now = 0;
+  m_logLastCondLike = 0.0;
+  m_logUnNormWeights.setZero();
+  m_ess = static_cast<float_t>(m_particles.cols());
+  m_resampled = false;
+  m_numResamps = 0;
+  m_logOldWtSum = std::log(static_cast<float_t>(m_particles.cols()));
+}
+
+template <size_t dimx, size_t dimy, typename resamp_t, typename float_t,
+          bool debug>
+auto BSFilterDyn<dimx, dimy, resamp_t, float_t, debug>::getExpectations() const
+    -> std::vector<Mat> {
   return m_expectations;
 }
 
@@ -15,6 +15,7 @@
 #include <iostream>
 
 #include "pf_base.h"
+#include "weight_kernels.h"
 
 namespace pf {
 
@@ -53,8 +54,10 @@ public:
   /**
    * @brief The constructor
    * @param rs the resampling schedule (e.g. every rs time point)
+   * @param essFrac if positive, rs is ignored and the particles are resampled
+   * whenever the effective sample size drops below essFrac * nparts
    */
-  BSFilterWC(const unsigned int &rs = 1);
+  BSFilterWC(const unsigned int &rs = 1, const float_t &essFrac = 0.0);
 
   /**
    * @brief The (virtual) destructor
@@ -67,6 +70,25 @@ public:
    */
   float_t getLogCondLike() const;
 
+  /**
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
+   */
+  float_t getESS() const;
+
+  /**
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
+   */
+  bool getResampled() const;
+
+  /**
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
+   */
+  unsigned int getNumResamps() const;
+
   /**
    * @brief updates filtering distribution on a new datapoint.
    * Optionally stores expectations of functionals.
@@ -152,6 +174,25 @@ protected:
 
   /** @brief resampling schedule (e.g. resample every __ time points) */
   unsigned int m_resampSched;
+
+  /** @brief resample when the ESS drops below this fraction of nparts (if
+   * positive) */
+  float_t m_essFrac;
+
+  /** @brief the most recent effective sample size */
+  float_t m_ess;
+
+  /** @brief whether the most recent step resampled */
+  bool m_resampled;
+
+  /** @brief how many times the particles have been resampled */
+  unsigned int m_numResamps;
+
+  /** @brief exp(log weight - max log weight), filled once per time step */
+  arrayfloat_t m_expWts;
+
+  /** @brief log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
 };
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -162,8 +203,10 @@ protected:
 template <size_t nparts, size_t dimx, size_t dimy, size_t dimcov,
           typename resamp_t, typename float_t, bool debug>
 BSFilterWC<nparts, dimx, dimy, dimcov, resamp_t, float_t, debug>::BSFilterWC(
-    const unsigned int &rs)
-    : m_now(0), m_logLastCondLike(0.0), m_resampSched(rs)
+    const unsigned int &rs, const float_t &essFrac)
+    : m_now(0), m_logLastCondLike(0.0), m_resampSched(rs), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nparts)), m_resampled(false), m_numResamps(0),
+      m_logOldWtSum(std::log(static_cast<float_t>(nparts)))
 
 {
   std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(),
@@ -185,13 +228,7 @@ void BSFilterWC<nparts, dimx, dimy, dimcov, resamp_t, float_t, debug>::filter(
 
     // try to iterate over particles all at once
     ssv newSamp;
-    float_t maxOldLogUnNormWts(-std::numeric_limits<float_t>::infinity());
-    arrayfloat_t oldLogUnNormWts = m_logUnNormWeights;
     for (size_t ii = 0; ii < nparts; ++ii) {
-      // update max of old logUnNormWts
-      if (m_logUnNormWeights[ii] > maxOldLogUnNormWts)
-        maxOldLogUnNormWts = m_logUnNormWeights[ii];
-
       // sample and get weight adjustments
       newSamp = fSamp(m_particles[ii], covData);
       m_logUnNormWeights[ii] += logGEv(dat, newSamp, covData);
@@ -208,34 +245,21 @@ void BSFilterWC<nparts, dimx, dimy, dimcov, resamp_t, float_t, debug>::filter(
     }
 
     // compute estimate of log p(y_t|y_{1:t-1}) with log-exp-sum trick
-    float_t maxNumer = *std::max_element(
-        m_logUnNormWeights.begin(),
-        m_logUnNormWeights.end()); // because you added log adjustments
-    float_t sumExp1(0.0);
-    float_t sumExp2(0.0);
-    for (size_t i = 0; i < nparts; ++i) {
-      sumExp1 += std::exp(m_logUnNormWeights[i] - maxNumer);
-      sumExp2 += std::exp(oldLogUnNormWts[i] - maxOldLogUnNormWts); // 1
-    }
-    m_logLastCondLike =
-        maxNumer + std::log(sumExp1) - maxOldLogUnNormWts - std::log(sumExp2);
+    float_t maxNumer = kernels::max(m_logUnNormWeights.data(), nparts);
+    // (the exponentiated weights are reused for the ESS and the expectations)
+    float_t sumExp1 = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, maxNumer);
+    m_logLastCondLike = maxNumer + std::log(sumExp1) - m_logOldWtSum;
+    m_ess = kernels::ess(m_expWts.data(), nparts, sumExp1);
 
     // calculate expectations before you resample
     int fId(0);
     for (auto &h : fs) { // iterate over all functions
 
-      Mat testOutput = h(m_particles[0], covData);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t weightNormConst(0.0);
-      for (size_t prtcl = 0; prtcl < nparts;
-           ++prtcl) { // iterate over all particles
-        numer += h(m_particles[prtcl], covData) *
-                 std::exp(m_logUnNormWeights[prtcl] - maxNumer);
-        weightNormConst += std::exp(m_logUnNormWeights[prtcl] - maxNumer);
-      }
-      m_expectations[fId] = numer / weightNormConst;
+      Mat numer = h(m_particles[0], covData) * m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+        numer += h(m_particles[prtcl], covData) * m_expWts[prtcl];
+      m_expectations[fId] = numer / sumExp1;
 
 #ifndef DROPPINGTHISINRPACKAGE
       if constexpr (debug)
@@ -247,8 +271,15 @@ void BSFilterWC<nparts, dimx, dimy, dimcov, resamp_t, float_t, debug>::filter(
     }
 
     // resample if you should
-    if ((m_now + 1) % m_resampSched == 0)
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_resampSched == 0;
+    if (m_resampled) {
       m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = maxNumer + std::log(sumExp1);
+    }
 
     // advance time
     m_now += 1;
@@ -271,13 +302,12 @@ void BSFilterWC<nparts, dimx, dimy, dimcov, resamp_t, float_t, debug>::filter(
     }
 
     // calculate log cond likelihood with log-exp-sum trick
-    float_t max =
-        *std::max_element(m_logUnNormWeights.begin(), m_logUnNormWeights.end());
-    float_t sumExp(0.0);
-    for (size_t i = 0; i < nparts; ++i) {
-      sumExp += std::exp(m_logUnNormWeights[i] - max);
-    }
+    float_t max = kernels::max(m_logUnNormWeights.data(), nparts);
+    // (the exponentiated weights are reused for the ESS and the expectations)
+    float_t sumExp = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, max);
     m_logLastCondLike = -std::log(nparts) + max + std::log(sumExp);
+    m_ess = kernels::ess(m_expWts.data(), nparts, sumExp);
 
     // calculate expectations before you resample
     // paying mind to underflow
@@ -285,24 +315,22 @@ void BSFilterWC<nparts, dimx, dimy, dimcov, resamp_t, float_t, debug>::filter(
     unsigned int fId(0);
     for (auto &h : fs) {
 
-      Mat testOutput = h(m_particles[0], covData);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t weightNormConst(0.0);
-      for (size_t prtcl = 0; prtcl < nparts;
-           ++prtcl) { // iterate over all particles
-        numer += h(m_particles[prtcl], covData) *
-                 std::exp(m_logUnNormWeights[prtcl] - max);
-        weightNormConst += std::exp(m_logUnNormWeights[prtcl] - max);
-      }
-      m_expectations[fId] = numer / weightNormConst;
+      Mat numer = h(m_particles[0], covData) * m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+        numer += h(m_particles[prtcl], covData) * m_expWts[prtcl];
+      m_expectations[fId] = numer / sumExp;
       fId++;
     }
 
     // resample if you should
-    if ((m_now + 1) % m_resampSched == 0) {
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_resampSched == 0;
+    if (m_resampled) {
       m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = max + std::log(sumExp);
     }
 
     // advance time step
@@ -317,6 +345,27 @@ float_t BSFilterWC<nparts, dimx, dimy, dimcov, resamp_t, float_t,
   return m_logLastCondLike;
 }
 
+template <size_t nparts, size_t dimx, size_t dimy, size_t dimcov,
+          typename resamp_t, typename float_t, bool debug>
+float_t BSFilterWC<nparts, dimx, dimy, dimcov, resamp_t, float_t,
+                   debug>::getESS() const {
+  return m_ess;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, size_t dimcov,
+          typename resamp_t, typename float_t, bool debug>
+bool BSFilterWC<nparts, dimx, dimy, dimcov, resamp_t, float_t,
+                debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, size_t dimcov,
+          typename resamp_t, typename float_t, bool debug>
+unsigned int BSFilterWC<nparts, dimx, dimy, dimcov, resamp_t, float_t,
+                        debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
 template <size_t nparts, size_t dimx, size_t dimy, size_t dimcov,
           typename resamp_t, typename float_t, bool debug>
 auto BSFilterWC<nparts, dimx, dimy, dimcov, resamp_t, float_t,
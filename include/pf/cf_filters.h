@@ -9,9 +9,11 @@
 #endif
 
 #include <math.h> /* log */
+#include <memory> // shared_ptr
 
 #include "pf_base.h"
 #include "rv_eval.h"
+#include "weight_kernels.h"
 
 namespace pf {
 
@@ -130,16 +132,14 @@ public:
               const osMat &cholObsVar);
 
 private:
-  /** @brief predictive state mean */
-  ssv m_predMean;
-
-  /** @brief filter mean */
+  /**
+   * @brief filter mean (the initial state mean until the first update). The
+   * predictive moments only live during update(), so copying a kalman (e.g.
+   * when an RBPF resamples) only copies the filtering moments.
+   */
   ssv m_filtMean;
 
-  /** @brief predictive var matrix */
-  ssMat m_predVar;
-
-  /** @brief filter var matrix */
+  /** @brief filter var matrix (the initial state variance until then) */
   ssMat m_filtVar;
 
   /** @brief latest log conditional likelihood */
@@ -162,19 +162,25 @@ private:
    * @param cholStateVar
    * @param stateInptAffector
    * @param inputData
+   * @param predMean where the predictive state mean is written
+   * @param predVar where the predictive state variance is written
    */
   void updatePrior(const ssMat &stateTransMat, const ssMat &cholStateVar,
-                   const siMat &stateInptAffector, const isv &inputData);
+                   const siMat &stateInptAffector, const isv &inputData,
+                   ssv &predMean, ssMat &predVar) const;
 
   /**
    * @brief Turns prediction into new filtering distribution.
+   * @param predMean the predictive state mean
+   * @param predVar the predictive state variance
    * @param yt
    * @param obsMat
    * @param obsInptAffector
    * @param inputData
    * @param cholObsVar
    */
-  void updatePosterior(const osv &yt, const obsStateSizeMat &obsMat,
+  void updatePosterior(const ssv &predMean, const ssMat &predVar,
+                       const osv &yt, const obsStateSizeMat &obsMat,
                        const oiMat &obsInptAffector, const isv &inputData,
                        const osMat &cholObsVar);
 };
@@ -182,15 +188,15 @@ private:
 template <size_t dimstate, size_t dimobs, size_t diminput, typename float_t,
           bool debug>
 kalman<dimstate, dimobs, diminput, float_t, debug>::kalman()
-    : bases::cf_filter<dimstate, dimobs, float_t>(), m_predMean(ssv::Zero()),
-      m_predVar(ssMat::Zero()), m_fresh(true), m_pi(3.14159265358979) {}
+    : bases::cf_filter<dimstate, dimobs, float_t>(), m_filtMean(ssv::Zero()),
+      m_filtVar(ssMat::Zero()), m_fresh(true), m_pi(3.14159265358979) {}
 
 template <size_t dimstate, size_t dimobs, size_t diminput, typename float_t,
           bool debug>
 kalman<dimstate, dimobs, diminput, float_t, debug>::kalman(
     const ssv &initStateMean, const ssMat &initStateVar)
-    : bases::cf_filter<dimstate, dimobs, float_t>(), m_predMean(initStateMean),
-      m_predVar(initStateVar), m_fresh(true), m_pi(3.14159265358979) {}
+    : bases::cf_filter<dimstate, dimobs, float_t>(), m_filtMean(initStateMean),
+      m_filtVar(initStateVar), m_fresh(true), m_pi(3.14159265358979) {}
 
 template <size_t dimstate, size_t dimobs, size_t diminput, typename float_t,
           bool debug>
@@ -200,26 +206,28 @@ template <size_t dimstate, size_t dimobs, size_t diminput, typename float_t,
           bool debug>
 void kalman<dimstate, dimobs, diminput, float_t, debug>::updatePrior(
     const ssMat &stateTransMat, const ssMat &cholStateVar,
-    const siMat &stateInptAffector, const isv &inputData) {
+    const siMat &stateInptAffector, const isv &inputData, ssv &predMean,
+    ssMat &predVar) const {
   ssMat Q = cholStateVar.transpose() * cholStateVar;
-  m_predMean = stateTransMat * m_filtMean + stateInptAffector * inputData;
-  m_predVar = stateTransMat * m_filtVar * stateTransMat.transpose() + Q;
+  predMean = stateTransMat * m_filtMean + stateInptAffector * inputData;
+  predVar = stateTransMat * m_filtVar * stateTransMat.transpose() + Q;
 }
 
 template <size_t dimstate, size_t dimobs, size_t diminput, typename float_t,
           bool debug>
 void kalman<dimstate, dimobs, diminput, float_t, debug>::updatePosterior(
-    const osv &yt, const obsStateSizeMat &obsMat, const oiMat &obsInptAffector,
+    const ssv &predMean, const ssMat &predVar, const osv &yt,
+    const obsStateSizeMat &obsMat, const oiMat &obsInptAffector,
     const isv &inputData, const osMat &cholObsVar) {
-  osMat R = cholObsVar.transpose() * cholObsVar;             // obs
-  osMat sigma = obsMat * m_predVar * obsMat.transpose() + R; // pred or APA' + R
-  osMat symSigma = (sigma.transpose() + sigma) / 2.0;        // ensure symmetric
+  osMat R = cholObsVar.transpose() * cholObsVar;           // obs
+  osMat sigma = obsMat * predVar * obsMat.transpose() + R; // pred or APA' + R
+  osMat symSigma = (sigma.transpose() + sigma) / 2.0;      // ensure symmetric
   osMat siginv = symSigma.inverse();
-  stateObsSizeMat K = m_predVar * obsMat.transpose() * siginv;
-  osv obsPred = obsMat * m_predMean + obsInptAffector * inputData;
+  stateObsSizeMat K = predVar * obsMat.transpose() * siginv;
+  osv obsPred = obsMat * predMean + obsInptAffector * inputData;
   osv innov = yt - obsPred;
-  m_filtMean = m_predMean + K * innov;
-  m_filtVar = m_predVar - K * obsMat * m_predVar;
+  m_filtMean = predMean + K * innov;
+  m_filtVar = predVar - K * obsMat * predVar;
 
   // conditional likelihood stuff
   osMat quadForm = innov.transpose() * siginv * innov;
@@ -267,14 +275,19 @@ void kalman<dimstate, dimobs, diminput, float_t, debug>::update(
     const osMat &cholObsVar) {
   // this assumes that we have latent states x_{1:...} and y_{1:...} (NOT
   // x_{0:...}) for that reason, we don't have to run updatePrior() on the first
-  // iteration
+  // iteration: the filtering moments still hold the prior
+  ssv predMean;
+  ssMat predVar;
   if (m_fresh == true) {
-    this->updatePosterior(yt, obsMat, obsInptAffector, inData, cholObsVar);
+    predMean = m_filtMean;
+    predVar = m_filtVar;
     m_fresh = false;
   } else {
-    this->updatePrior(stateTrans, cholStateVar, stateInptAffector, inData);
-    this->updatePosterior(yt, obsMat, obsInptAffector, inData, cholObsVar);
+    this->updatePrior(stateTrans, cholStateVar, stateInptAffector, inData,
+                      predMean, predVar);
   }
+  this->updatePosterior(predMean, predVar, yt, obsMat, obsInptAffector, inData,
+                        cholObsVar);
 }
 
 template <size_t dimstate, size_t dimobs, size_t diminput, typename float_t,
@@ -305,7 +318,10 @@ auto kalman<dimstate, dimobs, diminput, float_t, debug>::getPredYVar(
  * @class hmm
  * @author taylor
  * @file cf_filters.h
- * @brief Inherit from this for a model that admits HMM filtering.
+ * @brief Inherit from this for a model that admits HMM filtering. The
+ * transition matrix never changes after construction, so copies share one
+ * (immutable) matrix, and copying an hmm (e.g. when an RBPF resamples) only
+ * copies its filter vector.
  */
 template <size_t dimstate, size_t dimobs, typename float_t, bool debug = false>
 class hmm : public bases::cf_filter<dimstate, dimobs, float_t> {
@@ -382,8 +398,8 @@ private:
   /** @brief filter vector */
   ssv m_filtVecLogProbs;
 
-  /** @brief transition matrix */
-  ssMat m_transMatLogProbsTranspose;
+  /** @brief transition matrix (shared by every copy of this model) */
+  std::shared_ptr<const ssMat> m_transMatLogProbsTranspose;
 
   /** @brief last log conditional likelihood */
   float_t m_lastLogCondLike;
@@ -395,14 +411,20 @@ private:
 template <size_t dimstate, size_t dimobs, typename float_t, bool debug>
 hmm<dimstate, dimobs, float_t, debug>::hmm()
     : bases::cf_filter<dimstate, dimobs, float_t>::cf_filter(),
-      m_lastLogCondLike(0.0), m_fresh(true) {}
+      m_filtVecLogProbs(ssv::Zero()), m_lastLogCondLike(0.0), m_fresh(true) {
+  // every default-constructed model shares the same matrix of zeros
+  static const std::shared_ptr<const ssMat> zeros =
+      std::make_shared<const ssMat>(ssMat::Zero());
+  m_transMatLogProbsTranspose = zeros;
+}
 
 template <size_t dimstate, size_t dimobs, typename float_t, bool debug>
 hmm<dimstate, dimobs, float_t, debug>::hmm(const ssv &initStateDistrLogProbs,
                                            const ssMat &transMatLogProbs)
     : bases::cf_filter<dimstate, dimobs, float_t>(),
       m_filtVecLogProbs(initStateDistrLogProbs),
-      m_transMatLogProbsTranspose(transMatLogProbs.transpose()),
+      m_transMatLogProbsTranspose(
+          std::make_shared<const ssMat>(transMatLogProbs.transpose())),
       m_lastLogCondLike(0.0), m_fresh(true) {
   // check initial probabilities
   if (std::abs(this->log_sum_exp(m_filtVecLogProbs)) > .001)
@@ -412,12 +434,12 @@ hmm<dimstate, dimobs, float_t, debug>::hmm(const ssv &initStateDistrLogProbs,
         "Initial probabilities cannot be greater than 1.0.");
 
   // check transition matrix (with log probs)
-  if (m_transMatLogProbsTranspose.maxCoeff() > 0.0)
+  const ssMat &transMatT = *m_transMatLogProbsTranspose;
+  if (transMatT.maxCoeff() > 0.0)
     throw std::invalid_argument(
         "Initial transition probabilities cannot be greater than 1.");
   for (size_t icol = 0; icol < dimstate; ++icol) {
-    if (std::abs(this->log_sum_exp(m_transMatLogProbsTranspose.col(icol))) >
-        .001)
+    if (std::abs(this->log_sum_exp(transMatT.col(icol))) > .001)
       throw std::invalid_argument(
           "Initial transition probabilities must sum to 1.");
   }
@@ -441,8 +463,7 @@ template <size_t dimstate, size_t dimobs, typename float_t, bool debug>
 float_t
 hmm<dimstate, dimobs, float_t, debug>::log_sum_exp(const ssv &logProbVec) {
 
-  float_t m = logProbVec.maxCoeff();
-  return std::log((logProbVec.array() - m).exp().sum()) + m;
+  return kernels::logSumExp(logProbVec.data(), dimstate);
 }
 
 template <size_t dimstate, size_t dimobs, typename float_t, bool debug>
@@ -465,7 +486,7 @@ template <size_t dimstate, size_t dimobs, typename float_t, bool debug>
 void hmm<dimstate, dimobs, float_t, debug>::update(const ssv &logCondDensVec) {
   if (!m_fresh) { // has seen data before
     m_filtVecLogProbs =
-        this->log_product(m_transMatLogProbsTranspose,
+        this->log_product(*m_transMatLogProbsTranspose,
                           m_filtVecLogProbs); // now log p(x_t |y_{1:t-1})
     m_filtVecLogProbs =
         m_filtVecLogProbs + logCondDensVec; // now log p(y_t,x_t|y_{1:t-1})
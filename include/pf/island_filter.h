@@ -0,0 +1,392 @@
+#ifndef ISLAND_FILTER_H
+#define ISLAND_FILTER_H
+
+#include <array>
+#include <chrono>     // for seeding with the clock
+#include <cmath>      // log
+#include <cstdint>    // uint32_t
+#include <functional> // function
+#include <memory>     // unique_ptr
+#include <random>     // mt19937
+#include <type_traits> // void_t
+#include <utility>     // declval
+#include <vector>
+
+#ifdef DROPPINGTHISINRPACKAGE
+#include <RcppEigen.h>
+// [[Rcpp::depends(RcppEigen)]]
+#else
+#include <Eigen/Dense>
+#endif
+
+#include "pf_base.h"
+#include "resamplers.h" // for arrangeAncestors()
+#include "thread_pool.h"
+#include "weight_kernels.h"
+
+namespace pf {
+
+namespace filters {
+
+/**
+ * @brief whether T has a member function reseedGenerators(unsigned long),
+ * which every filter in this library that resamples has
+ * @tparam T the filter type
+ */
+template <typename T, typename = void>
+struct has_reseed_generators : std::false_type {};
+
+/**
+ * @brief whether T has a member function reseedGenerators(unsigned long)
+ * @tparam T the filter type
+ */
+template <typename T>
+struct has_reseed_generators<
+    T, std::void_t<decltype(std::declval<T &>().reseedGenerators(0ul))>>
+    : std::true_type {};
+
+/**
+ * @brief whether T has a member function reseed(unsigned long), which a model
+ * can provide to reseed the generators it samples from
+ * @tparam T the model type
+ */
+template <typename T, typename = void> struct has_reseed : std::false_type {};
+
+/**
+ * @brief whether T has a member function reseed(unsigned long)
+ * @tparam T the model type
+ */
+template <typename T>
+struct has_reseed<T, std::void_t<decltype(std::declval<T &>().reseed(0ul))>>
+    : std::true_type {};
+
+/**
+ * @brief the seed of an island_filter. Wrapping it keeps it from being
+ * mistaken for one of the islands' constructor arguments.
+ */
+struct island_seed {
+  /** the seed */
+  unsigned long value;
+};
+
+//! Runs several independent copies of a particle filter on their own threads.
+/**
+ * @class island_filter
+ * @author taylor
+ * @file island_filter.h
+ * @brief An island particle filter. Each of the nislands islands is a
+ * complete copy of filter_t (any filter derived from pf_base, with its own
+ * particles, resampler and model), and every call to filter() runs each
+ * island's own filter() on one of the threads, so the islands never wait for
+ * each other within a time step. Island k carries a log weight: the sum of
+ * its log conditional likelihoods since the islands were last resampled. The
+ * combined log p(y_t|y_{1:t-1}) is the log of the island weight-averaged
+ * island estimates, and the combined expectations are the island
+ * weight-averaged island expectations. When the effective sample size of the
+ * island weights drops below essFrac * nislands, the islands are resampled
+ * systematically: each island is overwritten with a copy (copy assignment)
+ * of its ancestor island, and the island weights are reset. Copy assignment
+ * also copies the ancestor's random number generators, so every copy is then
+ * given fresh seeds drawn from the island filter's own generator: the
+ * library's filters reseed their resampler (and BSFilterMT its per-thread
+ * generators) with reseedGenerators(), and a model that defines
+ * reseed(unsigned long) has its own generators reseeded too. Models without
+ * reseed() work unchanged; a copy then draws the same model noise as its
+ * ancestor, but it resamples differently, so the two part ways after the
+ * next resampling step.
+ * @tparam filter_t the filter type (e.g. a model class deriving from
+ * BSFilter). It must be copy assignable, and filter() and getExpectations()
+ * must be safe to call on different objects from different threads.
+ * @tparam nislands the number of islands
+ * @tparam nthreads the number of threads (including the calling thread)
+ */
+template <typename filter_t, size_t nislands, size_t nthreads = nislands>
+class island_filter
+    : public bases::pf_base<typename filter_t::float_type, filter_t::dim_obs,
+                            filter_t::dim_state> {
+public:
+  /** the floating point type of the islands */
+  using float_t = typename filter_t::float_type;
+  /** "obs size vector" type alias for linear algebra stuff */
+  using osv = Eigen::Matrix<float_t, filter_t::dim_obs, 1>;
+  /** "state size vector" type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, filter_t::dim_state, 1>;
+  /** type alias for dynamically sized matrix */
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** type alias for array of floating points, one per island */
+  using arrayFloat = std::array<float_t, nislands>;
+
+  static_assert(nislands > 0, "need at least one island");
+  static_assert(nthreads > 0, "need at least one thread");
+
+  /**
+   * @brief The constructor builds every island from the same arguments.
+   * @param essFrac the islands are resampled whenever the effective sample
+   * size of their weights drops below essFrac * nislands (so 0 never
+   * resamples them, and 1 resamples them whenever the weights are uneven)
+   * @param args the arguments of filter_t's constructor
+   */
+  template <typename... Args>
+  island_filter(const float_t &essFrac, const Args &...args);
+
+  /**
+   * @brief The constructor that sets the seed of the island resampling (and
+   * of the reseeding of copied islands) deterministically.
+   * @param essFrac the islands are resampled whenever the effective sample
+   * size of their weights drops below essFrac * nislands
+   * @param seed the seed
+   * @param args the arguments of filter_t's constructor
+   */
+  template <typename... Args>
+  island_filter(const float_t &essFrac, island_seed seed,
+                const Args &...args);
+
+  /**
+   * @brief updates every island on a new datapoint, and optionally stores
+   * the combined expectations of functionals.
+   * @param data the most recent data point
+   * @param fs a vector of functions if you want to calculate expectations.
+   * They are called from several threads at once.
+   */
+  void filter(const osv &data,
+              const std::vector<std::function<const Mat(const ssv &)>> &fs =
+                  std::vector<std::function<const Mat(const ssv &)>>());
+
+  /**
+   * @brief Returns the most recent (log-) conditional likelihood.
+   * @return log p(y_t | y_{1:t-1})
+   */
+  float_t getLogCondLike() const;
+
+  /**
+   * @brief return all stored expectations (taken with respect to
+   * $p(x_t|y_{1:t})$), combined across islands
+   * @return a std::vector<Mat> of expectations, one for each function
+   */
+  auto getExpectations() const -> std::vector<Mat>;
+
+  /**
+   * @brief Returns the effective sample size of the most recent island
+   * weights (before any island resampling).
+   * @return (sum_k W_k)^2 / sum_k W_k^2
+   */
+  float_t getESS() const;
+
+  /**
+   * @brief Whether the most recent call to filter() resampled the islands.
+   * @return true if the islands were resampled
+   */
+  bool getResampled() const;
+
+  /**
+   * @brief The number of times the islands have been resampled so far.
+   * @return the number of island resampling steps
+   */
+  unsigned int getNumResamps() const;
+
+  /**
+   * @brief one of the islands.
+   * @param k which island (0, 1, ..., nislands - 1)
+   * @return a reference to island k's filter
+   */
+  const filter_t &getIsland(size_t k) const;
+
+private:
+  /**
+   * @brief overwrites every island with a copy of an island picked
+   * systematically from the island weights (in m_expWts).
+   * @param sumExp the sum of m_expWts
+   */
+  void resampleIslands(float_t sumExp);
+
+  /** @brief the islands */
+  std::array<std::unique_ptr<filter_t>, nislands> m_islands;
+
+  /** @brief the log weight of each island */
+  arrayFloat m_logIslandWts;
+
+  /** @brief exp(log weight - max log weight), filled once per time step */
+  arrayFloat m_expWts;
+
+  /** @brief each island's most recent log conditional likelihood */
+  arrayFloat m_logCondLikes;
+
+  /** @brief which island each island is copied from */
+  std::array<unsigned int, nislands> m_ancestors;
+
+  /** @brief the new seeds of each copied island (filter, then model) */
+  std::array<unsigned long, 2 * nislands> m_seeds;
+
+  /** @brief log p(y_t|y_{1:t-1}) or log p(y1) */
+  float_t m_logLastCondLike;
+
+  /** @brief expectations E[h(x_t) | y_{1:t}] for user defined "h"s */
+  std::vector<Mat> m_expectations;
+
+  /** @brief resample the islands when the ESS drops below this fraction of
+   * nislands */
+  float_t m_essFrac;
+
+  /** @brief the most recent effective sample size of the island weights */
+  float_t m_ess;
+
+  /** @brief whether the most recent step resampled the islands */
+  bool m_resampled;
+
+  /** @brief how many times the islands have been resampled */
+  unsigned int m_numResamps;
+
+  /** @brief prng for resampling the islands */
+  std::mt19937 m_gen;
+
+  /** @brief the worker threads */
+  parallel::thread_pool m_pool;
+};
+
+template <typename filter_t, size_t nislands, size_t nthreads>
+template <typename... Args>
+island_filter<filter_t, nislands, nthreads>::island_filter(
+    const float_t &essFrac, const Args &...args)
+    : island_filter(essFrac,
+                    island_seed{static_cast<unsigned long>(
+                        std::chrono::high_resolution_clock::now()
+                            .time_since_epoch()
+                            .count())},
+                    args...) {}
+
+template <typename filter_t, size_t nislands, size_t nthreads>
+template <typename... Args>
+island_filter<filter_t, nislands, nthreads>::island_filter(
+    const float_t &essFrac, island_seed seed, const Args &...args)
+    : m_logLastCondLike(0.0), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nislands)), m_resampled(false),
+      m_numResamps(0), m_gen{static_cast<std::uint32_t>(seed.value)},
+      m_pool(nthreads) {
+  for (auto &island : m_islands)
+    island = std::make_unique<filter_t>(args...);
+  m_logIslandWts.fill(0.0);
+}
+
+template <typename filter_t, size_t nislands, size_t nthreads>
+void island_filter<filter_t, nislands, nthreads>::filter(
+    const osv &data,
+    const std::vector<std::function<const Mat(const ssv &)>> &fs) {
+
+  // every island takes its own step
+  m_pool.run([this, &data, &fs](unsigned int tid) {
+    auto range = parallel::block_range(nislands, nthreads, tid);
+    for (size_t k = range.first; k < range.second; ++k) {
+      m_islands[k]->filter(data, fs);
+      m_logCondLikes[k] = m_islands[k]->getLogCondLike();
+    }
+  });
+
+  // log p(y_t|y_{1:t-1}) = log sum_k W_k p_k(y_t|y_{1:t-1}) / sum_k W_k
+  float_t logOldWtSum = kernels::logSumExp(m_logIslandWts.data(), nislands);
+  for (size_t k = 0; k < nislands; ++k)
+    m_logIslandWts[k] += m_logCondLikes[k];
+  float_t maxNumer = kernels::max(m_logIslandWts.data(), nislands);
+  float_t sumExp = kernels::expShift(m_logIslandWts.data(), m_expWts.data(),
+                                     nislands, maxNumer);
+  m_logLastCondLike = maxNumer + std::log(sumExp) - logOldWtSum;
+  m_ess = kernels::ess(m_expWts.data(), nislands, sumExp);
+
+  // only the differences between island weights matter
+  for (auto &logWt : m_logIslandWts)
+    logWt -= maxNumer;
+
+  // island weight-averaged expectations
+  m_expectations.resize(fs.size());
+  for (size_t k = 0; k < nislands && !fs.empty(); ++k) {
+    std::vector<Mat> islandExps = m_islands[k]->getExpectations();
+    for (size_t i = 0; i < fs.size(); ++i) {
+      if (k == 0)
+        m_expectations[i] = islandExps[i] * (m_expWts[k] / sumExp);
+      else
+        m_expectations[i] += islandExps[i] * (m_expWts[k] / sumExp);
+    }
+  }
+
+  // resample the islands if their weights are too uneven
+  m_resampled = m_ess < m_essFrac * nislands;
+  if (m_resampled) {
+    resampleIslands(sumExp);
+    m_logIslandWts.fill(0.0);
+    m_numResamps++;
+  }
+}
+
+template <typename filter_t, size_t nislands, size_t nthreads>
+void island_filter<filter_t, nislands, nthreads>::resampleIslands(
+    float_t sumExp) {
+
+  // systematic resampling of the island indexes
+  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0);
+  float_t u0 = u_sampler(m_gen);
+  float_t cumsum = m_expWts[0];
+  unsigned int j = 0;
+  for (size_t k = 0; k < nislands; ++k) {
+    float_t u = (k + u0) / nislands * sumExp;
+    while (j < nislands - 1 && cumsum < u)
+      cumsum += m_expWts[++j];
+    m_ancestors[k] = j;
+  }
+
+  // surviving islands stay put, so every copy reads an island that is never
+  // overwritten, and the copies can run side by side
+  resamplers::arrangeAncestors<nislands>(m_ancestors);
+  for (auto &seed : m_seeds)
+    seed = m_gen();
+  m_pool.run([this](unsigned int tid) {
+    auto range = parallel::block_range(nislands, nthreads, tid);
+    for (size_t k = range.first; k < range.second; ++k) {
+      if (m_ancestors[k] != k) {
+        *m_islands[k] = *m_islands[m_ancestors[k]];
+        if constexpr (has_reseed_generators<filter_t>::value)
+          m_islands[k]->reseedGenerators(m_seeds[2 * k]);
+        if constexpr (has_reseed<filter_t>::value)
+          m_islands[k]->reseed(m_seeds[2 * k + 1]);
+      }
+    }
+  });
+}
+
+template <typename filter_t, size_t nislands, size_t nthreads>
+auto island_filter<filter_t, nislands, nthreads>::getLogCondLike() const
+    -> float_t {
+  return m_logLastCondLike;
+}
+
+template <typename filter_t, size_t nislands, size_t nthreads>
+auto island_filter<filter_t, nislands, nthreads>::getExpectations() const
+    -> std::vector<Mat> {
+  return m_expectations;
+}
+
+template <typename filter_t, size_t nislands, size_t nthreads>
+auto island_filter<filter_t, nislands, nthreads>::getESS() const -> float_t {
+  return m_ess;
+}
+
+template <typename filter_t, size_t nislands, size_t nthreads>
+bool island_filter<filter_t, nislands, nthreads>::getResampled() const {
+  return m_resampled;
+}
+
+template <typename filter_t, size_t nislands, size_t nthreads>
+unsigned int
+island_filter<filter_t, nislands, nthreads>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <typename filter_t, size_t nislands, size_t nthreads>
+auto island_filter<filter_t, nislands, nthreads>::getIsland(size_t k) const
+    -> const filter_t & {
+  return *m_islands[k];
+}
+
+} // namespace filters
+
+} // namespace pf
+
+#endif // ISLAND_FILTER_H
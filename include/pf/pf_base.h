@@ -3,6 +3,7 @@
 
 #include <map>
 #include <string>
+#include <type_traits> // invoke_result_t, void_t
 #include <vector>
 
 #ifdef DROPPINGTHISINRPACKAGE
@@ -16,6 +17,35 @@ namespace pf {
 
 namespace bases {
 
+/**
+ * @brief the type used to store an expectation of h(x): whatever h returns,
+ * except that Eigen expressions are replaced by the matrix they evaluate to
+ * @tparam T the return type of h
+ */
+template <typename T, typename = void> struct plain_type {
+  /** scalars and other non-Eigen types are kept as they are */
+  using type = T;
+};
+
+/**
+ * @brief the type used to store an expectation of h(x) (Eigen version)
+ * @tparam T the return type of h
+ */
+template <typename T>
+struct plain_type<T, std::void_t<typename T::PlainObject>> {
+  /** the matrix the expression evaluates to */
+  using type = typename T::PlainObject;
+};
+
+/**
+ * @brief the type of E[h(x)] for a functor h called with a state
+ * @tparam H the type of the functor
+ * @tparam state_t the type of the state
+ */
+template <typename H, typename state_t>
+using expectation_t = typename plain_type<std::decay_t<
+    std::invoke_result_t<const H &, const state_t &>>>::type;
+
 /************************************************************************************************************/
 
 /**
@@ -0,0 +1,429 @@
+#ifndef PMMH_H
+#define PMMH_H
+
+#include <array>
+#include <chrono>     // timing and seeding with the clock
+#include <cmath>      // log
+#include <functional> // function
+#include <limits>     // infinity
+#include <memory>     // unique_ptr
+#include <vector>
+
+#ifdef DROPPINGTHISINRPACKAGE
+#include <RcppEigen.h>
+// [[Rcpp::depends(RcppEigen)]]
+#else
+#include <Eigen/Dense>
+#include <iostream>
+#endif
+
+#include "rv_samp.h" // for rvsamp::counter_rng
+#include "thread_pool.h"
+
+namespace pf {
+
+namespace mcmc {
+
+//! Particle marginal Metropolis-Hastings with several chains at once.
+/**
+ * @class pmmh
+ * @author taylor
+ * @file pmmh.h
+ * @brief Runs nchains independent particle marginal Metropolis-Hastings
+ * chains on a thread pool. Every iteration of every chain proposes new
+ * parameters, runs a filter with them through the whole data set, and accepts
+ * or rejects the proposal with the filter's log-likelihood estimate in place
+ * of the exact one. Each chain builds one filter, once, with the factory (its
+ * return value is constructed directly on the heap, so filter_t need not be
+ * movable). Every later proposal reuses that filter: the reset callback gives
+ * it the new parameters and takes it back to time 0 (e.g. with the reset()
+ * of BSFilter, BSFilterMT, BSFilterSoA, BSFilterDyn, SISRFilter,
+ * SISRFilterSoA or APF), so its particles, resampler and generators are never
+ * rebuilt. The generators keep advancing from one proposal to the next, which
+ * PMMH needs: an estimate that reused the same random numbers for every
+ * proposal would not give a valid chain. For the same reason the driver hands
+ * the factory a seed from the chain's own stream, and the factory should seed
+ * every generator of the filter from it, so no two chains share random
+ * numbers. Proposals with a log prior of -infinity are rejected without
+ * running the filter. Each chain draws its proposals and uniforms from its own
+ * counter_rng stream.
+ * @tparam filter_t the filter type (e.g. a model class deriving from
+ * BSFilter). Filters for different chains are run from different threads at
+ * once. The Rao-Blackwellized filters in rbpf.h are not supported: they do
+ * not derive from pf_base, and they have no reset().
+ * @tparam param_t the type of the parameters (e.g. an Eigen vector)
+ * @tparam nchains the number of chains
+ * @tparam nthreads the number of threads (including the calling thread)
+ * @tparam debug whether to print debugging information
+ */
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads = nchains, bool debug = false>
+class pmmh {
+public:
+  /** the floating point type of the filters */
+  using float_t = typename filter_t::float_type;
+  /** "obs size vector" type alias for linear algebra stuff */
+  using osv = Eigen::Matrix<float_t, filter_t::dim_obs, 1>;
+  /** the random number generator handed to the proposal */
+  using rng_t = rvsamp::counter_rng;
+  /** builds a chain's filter for some parameters, seeding all of its
+   * generators from the seed */
+  using factory_t = std::function<filter_t(const param_t &, unsigned long)>;
+  /** gives an existing filter new parameters and resets it to time 0 */
+  using reset_t = std::function<void(filter_t &, const param_t &)>;
+  /** evaluates the log prior density (up to a constant) */
+  using log_prior_t = std::function<float_t(const param_t &)>;
+  /** draws new parameters given the current ones */
+  using proposal_t = std::function<param_t(const param_t &, rng_t &)>;
+  /** evaluates the log proposal density of the first argument given the
+   * second (up to a constant) */
+  using log_prop_dens_t =
+      std::function<float_t(const param_t &, const param_t &)>;
+
+  static_assert(nchains > 0, "need at least one chain");
+  static_assert(nthreads > 0, "need at least one thread");
+
+  /**
+   * @brief The constructor. Seeds from the clock.
+   * @param factory builds a chain's filter for some parameters and a seed
+   * @param reset gives a filter new parameters and resets it
+   * @param data the observations, in order
+   * @param logPrior the log prior density
+   * @param propose draws a proposal given the current parameters
+   * @param logPropDens the log proposal density; leave it empty if the
+   * proposal is symmetric
+   */
+  pmmh(const factory_t &factory, const reset_t &reset,
+       const std::vector<osv> &data,
+       const log_prior_t &logPrior, const proposal_t &propose,
+       const log_prop_dens_t &logPropDens = log_prop_dens_t());
+
+  /**
+   * @brief The constructor.
+   * @param factory builds a chain's filter for some parameters and a seed
+   * @param reset gives a filter new parameters and resets it
+   * @param data the observations, in order
+   * @param logPrior the log prior density
+   * @param propose draws a proposal given the current parameters
+   * @param logPropDens the log proposal density (empty if it is symmetric)
+   * @param seed the key of every chain's counter_rng stream (which also
+   * seeds the filters)
+   */
+  pmmh(const factory_t &factory, const reset_t &reset,
+       const std::vector<osv> &data,
+       const log_prior_t &logPrior, const proposal_t &propose,
+       const log_prop_dens_t &logPropDens, unsigned long seed);
+
+  /**
+   * @brief Runs every chain for numIters iterations, overwriting the results
+   * of any earlier run. The chains keep the capacity of their storage between
+   * runs.
+   * @param starts the starting parameters of each chain (their log prior
+   * must be finite)
+   * @param numIters the number of Metropolis-Hastings iterations per chain
+   */
+  void run(const std::array<param_t, nchains> &starts, unsigned int numIters);
+
+  /**
+   * @brief one chain's draws.
+   * @param chain which chain (0, 1, ..., nchains - 1)
+   * @return numIters + 1 parameters, starting with the starting point
+   */
+  auto getDraws(size_t chain) const -> const std::vector<param_t> &;
+
+  /**
+   * @brief the log-likelihood estimates that go with one chain's draws.
+   * @param chain which chain (0, 1, ..., nchains - 1)
+   * @return the estimate of log p(y_{1:T}) at every draw
+   */
+  auto getLogLikes(size_t chain) const -> const std::vector<float_t> &;
+
+  /**
+   * @brief how many proposals one chain accepted during the last run.
+   * @param chain which chain (0, 1, ..., nchains - 1)
+   * @return the number of accepted proposals
+   */
+  unsigned int getNumAccepted(size_t chain) const;
+
+  /**
+   * @brief the fraction of one chain's proposals that were accepted.
+   * @param chain which chain (0, 1, ..., nchains - 1)
+   * @return the acceptance rate of the last run
+   */
+  float_t getAcceptanceRate(size_t chain) const;
+
+  /**
+   * @brief how many times one chain ran its filter during the last run (once
+   * for the starting point, and once for every proposal with a finite log
+   * prior).
+   * @param chain which chain (0, 1, ..., nchains - 1)
+   * @return the number of log-likelihood estimates
+   */
+  unsigned int getNumFilterRuns(size_t chain) const;
+
+  /**
+   * @brief the time one chain spent building, resetting and running its
+   * filter during the last run.
+   * @param chain which chain (0, 1, ..., nchains - 1)
+   * @return seconds
+   */
+  double getFilterSeconds(size_t chain) const;
+
+  /**
+   * @brief the wall clock time of the last run.
+   * @return seconds
+   */
+  double getRunSeconds() const;
+
+private:
+  /**
+   * @brief builds a chain's filter for theta (the first time) or resets it
+   * with theta (every other time), and runs it through all of the data.
+   * @param chain which chain
+   * @param theta the parameters
+   * @return the estimate of log p(y_{1:T} | theta)
+   */
+  float_t logLike(size_t chain, const param_t &theta);
+
+  /**
+   * @brief runs one chain for numIters iterations.
+   * @param chain which chain
+   * @param start its starting parameters
+   * @param numIters the number of iterations
+   */
+  void runChain(size_t chain, const param_t &start, unsigned int numIters);
+
+  /** @brief builds filters */
+  factory_t m_factory;
+
+  /** @brief re-parameterizes and resets filters */
+  reset_t m_reset;
+
+  /** @brief the observations */
+  std::vector<osv> m_data;
+
+  /** @brief the log prior density */
+  log_prior_t m_logPrior;
+
+  /** @brief draws proposals */
+  proposal_t m_propose;
+
+  /** @brief the log proposal density (empty if it is symmetric) */
+  log_prop_dens_t m_logPropDens;
+
+  /** @brief each chain's filter (empty until it is first needed) */
+  std::array<std::unique_ptr<filter_t>, nchains> m_filters;
+
+  /** @brief each chain's draws */
+  std::array<std::vector<param_t>, nchains> m_draws;
+
+  /** @brief each chain's log-likelihood estimates */
+  std::array<std::vector<float_t>, nchains> m_logLikes;
+
+  /** @brief how many proposals each chain accepted */
+  std::array<unsigned int, nchains> m_numAccepted;
+
+  /** @brief how many times each chain ran its filter */
+  std::array<unsigned int, nchains> m_numFilterRuns;
+
+  /** @brief how long each chain spent on its filter */
+  std::array<double, nchains> m_filterSeconds;
+
+  /** @brief the wall clock time of the last run */
+  double m_runSeconds;
+
+  /** @brief the generator of each chain */
+  std::vector<rng_t> m_gens;
+
+  /** @brief the worker threads */
+  parallel::thread_pool m_pool;
+};
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+pmmh<filter_t, param_t, nchains, nthreads, debug>::pmmh(
+    const factory_t &factory, const reset_t &reset,
+    const std::vector<osv> &data, const log_prior_t &logPrior,
+    const proposal_t &propose, const log_prop_dens_t &logPropDens)
+    : pmmh(factory, reset, data, logPrior, propose, logPropDens,
+           static_cast<unsigned long>(std::chrono::high_resolution_clock::now()
+                                          .time_since_epoch()
+                                          .count())) {}
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+pmmh<filter_t, param_t, nchains, nthreads, debug>::pmmh(
+    const factory_t &factory, const reset_t &reset,
+    const std::vector<osv> &data, const log_prior_t &logPrior,
+    const proposal_t &propose, const log_prop_dens_t &logPropDens,
+    unsigned long seed)
+    : m_factory(factory), m_reset(reset), m_data(data), m_logPrior(logPrior),
+      m_propose(propose), m_logPropDens(logPropDens), m_runSeconds(0.0),
+      m_pool(nthreads) {
+  for (size_t k = 0; k < nchains; ++k) {
+    m_numAccepted[k] = 0;
+    m_numFilterRuns[k] = 0;
+    m_filterSeconds[k] = 0.0;
+    m_gens.emplace_back(seed, k);
+  }
+}
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+void pmmh<filter_t, param_t, nchains, nthreads, debug>::run(
+    const std::array<param_t, nchains> &starts, unsigned int numIters) {
+
+  // each thread takes a block of chains all the way through
+  auto start = std::chrono::steady_clock::now();
+  m_pool.run([this, &starts, numIters](unsigned int tid) {
+    auto range = parallel::block_range(nchains, nthreads, tid);
+    for (size_t k = range.first; k < range.second; ++k)
+      runChain(k, starts[k], numIters);
+  });
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  m_runSeconds = elapsed.count();
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+  if constexpr (debug) {
+    for (size_t k = 0; k < nchains; ++k)
+      std::cout << "chain: " << k
+                << ", acceptance rate: " << getAcceptanceRate(k)
+                << ", filter runs: " << m_numFilterRuns[k]
+                << ", filter seconds: " << m_filterSeconds[k] << "\n";
+    std::cout << "run seconds: " << m_runSeconds << "\n";
+  }
+#endif
+}
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+void pmmh<filter_t, param_t, nchains, nthreads, debug>::runChain(
+    size_t k, const param_t &start, unsigned int numIters) {
+
+  rng_t &gen = m_gens[k];
+  m_draws[k].clear();
+  m_logLikes[k].clear();
+  m_draws[k].reserve(numIters + 1);
+  m_logLikes[k].reserve(numIters + 1);
+  m_numAccepted[k] = 0;
+  m_numFilterRuns[k] = 0;
+  m_filterSeconds[k] = 0.0;
+
+  param_t current = start;
+  float_t currLogPrior = m_logPrior(current);
+  float_t currLogLike = logLike(k, current);
+  m_draws[k].push_back(current);
+  m_logLikes[k].push_back(currLogLike);
+
+  for (unsigned int iter = 0; iter < numIters; ++iter) {
+
+    // proposals outside the prior's support never need a filter
+    param_t proposal = m_propose(current, gen);
+    float_t propLogPrior = m_logPrior(proposal);
+    if (propLogPrior > -std::numeric_limits<float_t>::infinity()) {
+      float_t propLogLike = logLike(k, proposal);
+      float_t logRatio =
+          propLogPrior + propLogLike - currLogPrior - currLogLike;
+      if (m_logPropDens)
+        logRatio += m_logPropDens(current, proposal) -
+                    m_logPropDens(proposal, current);
+
+      // a NaN ratio is never accepted
+      if (std::log(gen.unif()) < logRatio) {
+        current = proposal;
+        currLogPrior = propLogPrior;
+        currLogLike = propLogLike;
+        m_numAccepted[k]++;
+      }
+    }
+    m_draws[k].push_back(current);
+    m_logLikes[k].push_back(currLogLike);
+  }
+}
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+auto pmmh<filter_t, param_t, nchains, nthreads, debug>::logLike(
+    size_t k, const param_t &theta) -> float_t {
+
+  auto start = std::chrono::steady_clock::now();
+
+  // the filter is built once, and reset for every later proposal
+  if (m_filters[k])
+    m_reset(*m_filters[k], theta);
+  else
+    m_filters[k].reset(new filter_t(m_factory(theta, m_gens[k]())));
+
+  float_t ans = 0.0;
+  for (const auto &yt : m_data) {
+    m_filters[k]->filter(yt);
+    ans += m_filters[k]->getLogCondLike();
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  m_filterSeconds[k] += elapsed.count();
+  m_numFilterRuns[k]++;
+  return ans;
+}
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+auto pmmh<filter_t, param_t, nchains, nthreads, debug>::getDraws(
+    size_t chain) const -> const std::vector<param_t> & {
+  return m_draws[chain];
+}
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+auto pmmh<filter_t, param_t, nchains, nthreads, debug>::getLogLikes(
+    size_t chain) const -> const std::vector<float_t> & {
+  return m_logLikes[chain];
+}
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+unsigned int pmmh<filter_t, param_t, nchains, nthreads, debug>::getNumAccepted(
+    size_t chain) const {
+  return m_numAccepted[chain];
+}
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+auto pmmh<filter_t, param_t, nchains, nthreads, debug>::getAcceptanceRate(
+    size_t chain) const -> float_t {
+  if (m_draws[chain].size() < 2)
+    return 0.0;
+  return static_cast<float_t>(m_numAccepted[chain]) /
+         (m_draws[chain].size() - 1);
+}
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+unsigned int
+pmmh<filter_t, param_t, nchains, nthreads, debug>::getNumFilterRuns(
+    size_t chain) const {
+  return m_numFilterRuns[chain];
+}
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+double pmmh<filter_t, param_t, nchains, nthreads, debug>::getFilterSeconds(
+    size_t chain) const {
+  return m_filterSeconds[chain];
+}
+
+template <typename filter_t, typename param_t, size_t nchains,
+          size_t nthreads, bool debug>
+double pmmh<filter_t, param_t, nchains, nthreads, debug>::getRunSeconds()
+    const {
+  return m_runSeconds;
+}
+
+} // namespace mcmc
+
+} // namespace pf
+
+#endif // PMMH_H
@@ -16,26 +16,35 @@
 
 #include "cf_filters.h" // for closed form filter objects
 #include "pf_base.h"
+#include "weight_kernels.h"
 
 namespace pf {
 
 namespace filters {
 
-//! Rao-Blackwellized/Marginal Particle Filter with inner HMMs
+//! CRTP (static dispatch) version of rbpf_hmm.
 /**
- * @class rbpf_hmm
+ * @class static_rbpf_hmm
  * @author t
  * @file rbpf.h
  * @brief Rao-Blackwellized/Marginal Particle Filter with inner HMMs
+ *
+ * The model hooks are resolved at compile time: Derived inherits from this
+ * class and provides logMuEv, q1Samp, initHMMLogProbVec, initHMMLogTransMat,
+ * qSamp, logQ1Ev, logFEv, logQEv and updateHMM as public member functions with
+ * the same signatures as the pure virtual ones in rbpf_hmm, so they can be
+ * inlined into the particle loops.
+ * @tparam Derived the model class
  * @tparam nparts the number of particles
  * @tparam dimnss dimension of "not sampled state"
  * @tparam dimss dimension of "sampled state"
  * @tparam dimy the dimension of the observations
  * @tparam resamp_t the resampler type (e.g. multinomial, etc.)
  */
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug = false>
-class rbpf_hmm : public bases::rbpf_base<float_t, dimss, dimnss, dimy> {
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug = false>
+class static_rbpf_hmm
+    : public bases::rbpf_base<float_t, dimss, dimnss, dimy> {
 public:
   /** "sampled state size vector" */
   using sssv = Eigen::Matrix<float_t, dimss, 1>;
@@ -61,13 +70,16 @@ public:
    * @brief constructor.
    * @param resamp_sched how often to resample (e.g. once every resamp_sched
    * time periods)
+   * @param essFrac if positive, resamp_sched is ignored and the particles are
+   * resampled whenever the effective sample size drops below essFrac * nparts
    */
-  rbpf_hmm(const unsigned int &resamp_sched = 1);
+  static_rbpf_hmm(const unsigned int &resamp_sched = 1,
+                  const float_t &essFrac = 0.0);
 
   /**
    * @brief The (virtual) destructor.
    */
-  virtual ~rbpf_hmm();
+  virtual ~static_rbpf_hmm();
 
   //! Filter.
   /**
@@ -93,94 +105,31 @@ public:
    */
   float_t getLogCondLike() const;
 
-  //!
-  /**
-   * @brief Get vector of expectations.
-   * @return vector of expectations
-   */
-  std::vector<Mat> getExpectations() const;
-
-  //! Evaluates the first time state density.
-  /**
-   * @brief evaluates mu.
-   * @param x21 component two at time 1
-   * @return a float_t evaluation
-   */
-  virtual float_t logMuEv(const sssv &x21) = 0;
-
-  //! Sample from the first sampler.
-  /**
-   * @brief samples the second component of the state at time 1.
-   * @param y1 most recent datum.
-   * @return a sssv sample for x21.
-   */
-  virtual sssv q1Samp(const osv &y1) = 0;
-
-  //! Provides the initial mean vector for each HMM filter object.
-  /**
-   * @brief provides the initial probability vector for each HMM filter object.
-   * @param x21 the second state componenent at time 1.
-   * @return a Vec representing the probability of each state element.
-   */
-  virtual nsssv initHMMLogProbVec(const sssv &x21) = 0;
-
-  //! Provides the transition matrix for each HMM filter object.
-  /**
-   * @brief provides the transition matrix for each HMM filter object.
-   * @param x21 the second state component at time 1.
-   * @return a transition matrix where element (ij) is the probability of
-   * transitioning from state i to state j.
-   */
-  virtual nsssMat initHMMLogTransMat(const sssv &x21) = 0;
-
-  //! Samples the time t second component.
-  /**
-   * @brief Samples the time t second component.
-   * @param x2tm1 the previous time's second state component.
-   * @param yt the current observation.
-   * @return a Vec sample of the second state component at the current time.
-   */
-  virtual sssv qSamp(const sssv &x2tm1, const osv &yt) = 0;
-
-  //! Evaluates the proposal density of the second state component at time 1.
   /**
-   * @brief Evaluates the proposal density of the second state component at
-   * time 1.
-   * @param x21 the second state component at time 1 you sampled.
-   * @param y1 time 1 observation.
-   * @return a float_t evaluation of the density.
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
    */
-  virtual float_t logQ1Ev(const sssv &x21, const osv &y1) = 0;
+  float_t getESS() const;
 
-  //! Evaluates the state transition density for the second state component.
   /**
-   * @brief Evaluates the state transition density for the second state
-   * component.
-   * @param x2t the current second state component.
-   * @param x2tm1 the previous second state component.
-   * @return a float_t evaluation.
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
    */
-  virtual float_t logFEv(const sssv &x2t, const sssv &x2tm1) = 0;
+  bool getResampled() const;
 
-  //! Evaluates the proposal density at time t > 1.
   /**
-   * @brief Evaluates the proposal density at time t > 1.
-   * @param x2t the current second state component.
-   * @param x2tm1 the previous second state component.
-   * @param yt the current time series observation.
-   * @return a float_t evaluation.
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
    */
-  virtual float_t logQEv(const sssv &x2t, const sssv &x2tm1, const osv &yt) = 0;
+  unsigned int getNumResamps() const;
 
-  //! How to update your inner HMM filter object at each time.
+  //!
   /**
-   * @brief How to update your inner HMM filter object at each time.
-   * @param aModel a HMM filter object describing the conditional closed-form
-   * model.
-   * @param yt the current time series observation.
-   * @param x2t the current second state component.
+   * @brief Get vector of expectations.
+   * @return vector of expectations
    */
-  virtual void updateHMM(cfModType &aModel, const osv &yt, const sssv &x2t) = 0;
+  std::vector<Mat> getExpectations() const;
 
 private:
   /** the current time period */
@@ -189,6 +138,18 @@ private:
   float_t m_lastLogCondLike;
   /** resampling schedue */
   unsigned int m_rs;
+  /** resample when the ESS drops below this fraction of nparts (if positive) */
+  float_t m_essFrac;
+  /** the most recent effective sample size */
+  float_t m_ess;
+  /** whether the most recent step resampled */
+  bool m_resampled;
+  /** how many times the particles have been resampled */
+  unsigned int m_numResamps;
+  /** exp(log weight - max log weight), filled once per time step */
+  arrayfloat_t m_expWts;
+  /** log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
   /** the array of inner closed-form models */
   arrayMod m_p_innerMods;
   /** the array of samples for the second state portion */
@@ -199,23 +160,35 @@ private:
   resamp_t m_resampler;
   /** the vector of expectations */
   std::vector<Mat> m_expectations;
+
+protected:
+  /**
+   * @brief this object as the model class (the CRTP cast)
+   * @return a reference to the model
+   */
+  Derived &derived();
 };
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::rbpf_hmm(
-    const unsigned int &resamp_sched)
-    : m_now(0), m_lastLogCondLike(0.0), m_rs(resamp_sched) {
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+static_rbpf_hmm<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                debug>::static_rbpf_hmm(const unsigned int &resamp_sched,
+                                        const float_t &essFrac)
+    : m_now(0), m_lastLogCondLike(0.0), m_rs(resamp_sched), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nparts)), m_resampled(false),
+      m_numResamps(0), m_logOldWtSum(std::log(static_cast<float_t>(nparts))) {
   std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
 }
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::~rbpf_hmm() {}
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+static_rbpf_hmm<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                debug>::~static_rbpf_hmm() {}
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-void rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+void static_rbpf_hmm<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                     debug>::filter(
     const osv &data,
     const std::vector<std::function<const Mat(const nsssv &x1tLogProbs,
                                               const sssv &x2t)>> &fs) {
@@ -224,20 +197,17 @@ void rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
 
     // update
     sssv newX2Samp;
-    float_t sumexpdenom(0.0);
     float_t m1(
         -std::numeric_limits<float_t>::infinity()); // for revised log weights
-    float_t m2 =
-        *std::max_element(m_logUnNormWeights.begin(), m_logUnNormWeights.end());
     for (size_t ii = 0; ii < nparts; ++ii) {
 
-      newX2Samp = qSamp(m_p_samps[ii], data);
-      updateHMM(m_p_innerMods[ii], data, newX2Samp);
-      sumexpdenom += std::exp(m_logUnNormWeights[ii] - m2);
+      newX2Samp = derived().qSamp(m_p_samps[ii], data);
+      derived().updateHMM(m_p_innerMods[ii], data, newX2Samp);
 
-      m_logUnNormWeights[ii] += m_p_innerMods[ii].getLogCondLike() +
-                                logFEv(newX2Samp, m_p_samps[ii]) -
-                                logQEv(newX2Samp, m_p_samps[ii], data);
+      m_logUnNormWeights[ii] +=
+          m_p_innerMods[ii].getLogCondLike() +
+          derived().logFEv(newX2Samp, m_p_samps[ii]) -
+          derived().logQEv(newX2Samp, m_p_samps[ii], data);
 
       // update a max
       if (m_logUnNormWeights[ii] > m1)
@@ -254,11 +224,12 @@ void rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
       m_p_samps[ii] = newX2Samp;
     }
 
-    // calculate log p(y_t | y_{1:t-1})
-    float_t sumexpnumer(0.0);
-    for (size_t p = 0; p < nparts; ++p)
-      sumexpnumer += std::exp(m_logUnNormWeights[p] - m1);
-    m_lastLogCondLike = m1 + std::log(sumexpnumer) - m2 - std::log(sumexpdenom);
+    // calculate log p(y_t | y_{1:t-1}) (the exponentiated weights are reused
+    // for the ESS and the expectations)
+    float_t sumexpnumer = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, m1);
+    m_lastLogCondLike = m1 + std::log(sumexpnumer) - m_logOldWtSum;
+    m_ess = kernels::ess(m_expWts.data(), nparts, sumexpnumer);
 
     // calculate expectations before you resample
     unsigned int fId(0);
@@ -266,18 +237,13 @@ void rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     // m_logUnNormWeights.end());
     for (auto &h : fs) {
 
-      Mat testOutput = h(m_p_innerMods[0].getFilterVecLogProbs(), m_p_samps[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
+      Mat numer = h(m_p_innerMods[0].getFilterVecLogProbs(), m_p_samps[0]) *
+                  m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
         numer +=
             h(m_p_innerMods[prtcl].getFilterVecLogProbs(), m_p_samps[prtcl]) *
-            std::exp(m_logUnNormWeights[prtcl] - m1);
-        denom += std::exp(m_logUnNormWeights[prtcl] - m1);
-      }
-      m_expectations[fId] = numer / denom;
+            m_expWts[prtcl];
+      m_expectations[fId] = numer / sumexpnumer;
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
@@ -290,8 +256,15 @@ void rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     }
 
     // resample (unnormalized weights ok)
-    if ((m_now + 1) % m_rs == 0)
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_rs == 0;
+    if (m_resampled) {
       m_resampler.resampLogWts(m_p_innerMods, m_p_samps, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = m1 + std::log(sumexpnumer);
+    }
 
     // update time step
     m_now++;
@@ -304,14 +277,14 @@ void rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     float_t m1(-std::numeric_limits<float_t>::infinity());
     for (size_t ii = 0; ii < nparts; ++ii) {
 
-      m_p_samps[ii] = q1Samp(data);
-      tmpLogProbs = initHMMLogProbVec(m_p_samps[ii]);
-      tmpLogTransMat = initHMMLogTransMat(m_p_samps[ii]);
+      m_p_samps[ii] = derived().q1Samp(data);
+      tmpLogProbs = derived().initHMMLogProbVec(m_p_samps[ii]);
+      tmpLogTransMat = derived().initHMMLogTransMat(m_p_samps[ii]);
       m_p_innerMods[ii] = cfModType(tmpLogProbs, tmpLogTransMat);
-      this->updateHMM(m_p_innerMods[ii], data, m_p_samps[ii]);
+      derived().updateHMM(m_p_innerMods[ii], data, m_p_samps[ii]);
       m_logUnNormWeights[ii] = m_p_innerMods[ii].getLogCondLike() +
-                               logMuEv(m_p_samps[ii]) -
-                               logQ1Ev(m_p_samps[ii], data);
+                               derived().logMuEv(m_p_samps[ii]) -
+                               derived().logQ1Ev(m_p_samps[ii], data);
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
@@ -327,11 +300,11 @@ void rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     }
 
     // calc log p(y1)
-    float_t sumexp(0.0);
-    for (size_t p = 0; p < nparts; ++p)
-      sumexp += std::exp(m_logUnNormWeights[p] - m1);
+    float_t sumexp = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, m1);
     m_lastLogCondLike =
         m1 + std::log(sumexp) - std::log(static_cast<float_t>(nparts));
+    m_ess = kernels::ess(m_expWts.data(), nparts, sumexp);
 
     // calculate expectations before you resample
     m_expectations.resize(fs.size());
@@ -340,18 +313,13 @@ void rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     // m_logUnNormWeights.end());
     for (auto &h : fs) {
 
-      Mat testOutput = h(m_p_innerMods[0].getFilterVecLogProbs(), m_p_samps[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
+      Mat numer = h(m_p_innerMods[0].getFilterVecLogProbs(), m_p_samps[0]) *
+                  m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
         numer +=
             h(m_p_innerMods[prtcl].getFilterVecLogProbs(), m_p_samps[prtcl]) *
-            std::exp(m_logUnNormWeights[prtcl] - m1);
-        denom += std::exp(m_logUnNormWeights[prtcl] - m1);
-      }
-      m_expectations[fId] = numer / denom;
+            m_expWts[prtcl];
+      m_expectations[fId] = numer / sumexp;
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
@@ -364,34 +332,69 @@ void rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     }
 
     // resample (unnormalized weights ok)
-    if ((m_now + 1) % m_rs == 0)
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_rs == 0;
+    if (m_resampled) {
       m_resampler.resampLogWts(m_p_innerMods, m_p_samps, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = m1 + std::log(sumexp);
+    }
 
     // advance time step
     m_now++;
   }
 }
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-float_t rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t,
-                 debug>::getLogCondLike() const {
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+float_t static_rbpf_hmm<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                        debug>::getLogCondLike() const {
   return m_lastLogCondLike;
 }
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-auto rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t,
-              debug>::getExpectations() const -> std::vector<Mat> {
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+float_t static_rbpf_hmm<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                        debug>::getESS() const {
+  return m_ess;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+bool static_rbpf_hmm<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                     debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+unsigned int static_rbpf_hmm<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                             float_t, debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+auto static_rbpf_hmm<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                     debug>::getExpectations() const -> std::vector<Mat> {
   return m_expectations;
 }
 
-//! Rao-Blackwellized/Marginal Bootstrap Filter with inner HMMs
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+Derived &static_rbpf_hmm<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                         float_t, debug>::derived() {
+  return static_cast<Derived &>(*this);
+}
+
+//! Rao-Blackwellized/Marginal Particle Filter with inner HMMs
 /**
- * @class rbpf_hmm_bs
+ * @class rbpf_hmm
  * @author t
  * @file rbpf.h
- * @brief Rao-Blackwellized/Marginal Bootstrap Filter with inner HMMs
+ * @brief Rao-Blackwellized/Marginal Particle Filter with inner HMMs
  * @tparam nparts the number of particles
  * @tparam dimnss dimension of "not sampled state"
  * @tparam dimss dimension of "sampled state"
@@ -400,7 +403,16 @@ auto rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t,
  */
 template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
           typename resamp_t, typename float_t, bool debug = false>
-class rbpf_hmm_bs : public bases::rbpf_base<float_t, dimss, dimnss, dimy> {
+class rbpf_hmm
+    : public static_rbpf_hmm<
+          rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>,
+          nparts, dimnss, dimss, dimy, resamp_t, float_t, debug> {
+private:
+  /** the static base class that runs the filter */
+  using base_t =
+      static_rbpf_hmm<rbpf_hmm, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                      debug>;
+
 public:
   /** "sampled state size vector" */
   using sssv = Eigen::Matrix<float_t, dimss, 1>;
@@ -412,81 +424,61 @@ public:
   using nsssMat = Eigen::Matrix<float_t, dimnss, dimnss>;
   /** Dynamic size matrix*/
   using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
-  /** closed-form model type*/
-  using cfModType = hmm<dimnss, dimy, float_t, debug>;
-  /** array of model objects */
-  using arrayMod = std::array<cfModType, nparts>;
   /** array of samples */
   using arrayVec = std::array<sssv, nparts>;
   /** array of weights */
   using arrayfloat_t = std::array<float_t, nparts>;
+  /** closed-form model type */
+  using cfModType = hmm<dimnss, dimy, float_t, debug>;
+  /** array of model objects */
+  using arrayMod = std::array<cfModType, nparts>;
 
   //! The constructor.
   /**
    * @brief constructor.
    * @param resamp_sched how often to resample (e.g. once every resamp_sched
    * time periods)
+   * @param essFrac if positive, resamp_sched is ignored and the particles are
+   * resampled whenever the effective sample size drops below essFrac * nparts
    */
-  rbpf_hmm_bs(const unsigned int &resamp_sched = 1);
+  rbpf_hmm(const unsigned int &resamp_sched = 1,
+           const float_t &essFrac = 0.0);
 
   /**
    * @brief The (virtual) destructor.
    */
-  virtual ~rbpf_hmm_bs();
-
-  //! Filter.
-  /**
-   * @brief filters everything based on a new data point.
-   * @param data the most recent time series observation.
-   * @param fs a vector of functions computing E[h(x_1t, x_2t^i)| x_2t^i,y_1:t]
-   * to be averaged to yield E[h(x_1t, x_2t)|,y_1:t]. Will access the
-   * probability vector of x_1t
-   */
-  void filter(
-      const osv &data,
-      const std::vector<
-          std::function<const Mat(const nsssv &x1tLogProbs, const sssv &x2t)>>
-          &fs = std::vector<std::function<const Mat(
-              const nsssv &, const sssv &)>>()); //, const
-                                                 //std::vector<std::function<const
-                                                 //Mat(const Vec&)> >& fs);
-
-  //! Get the latest conditional likelihood.
-  /**
-   * @brief Get the latest conditional likelihood.
-   * @return the latest conditional likelihood.
-   */
-  float_t getLogCondLike() const;
+  virtual ~rbpf_hmm();
 
-  //!
+  //! Evaluates the first time state density.
   /**
-   * @brief Get vector of expectations.
-   * @return vector of expectations
+   * @brief evaluates mu.
+   * @param x21 component two at time 1
+   * @return a float_t evaluation
    */
-  std::vector<Mat> getExpectations() const;
+  virtual float_t logMuEv(const sssv &x21) = 0;
 
   //! Sample from the first sampler.
   /**
    * @brief samples the second component of the state at time 1.
+   * @param y1 most recent datum.
    * @return a sssv sample for x21.
    */
-  virtual sssv muSamp() = 0;
+  virtual sssv q1Samp(const osv &y1) = 0;
 
-  //! Provides the initial log probability vector for each HMM filter object.
+  //! Provides the initial mean vector for each HMM filter object.
   /**
-   * @brief provides the initial log probability vector for each HMM filter
-   * object.
+   * @brief provides the initial probability vector for each HMM filter object.
    * @param x21 the second state componenent at time 1.
-   * @return a Vec representing the log probability of each state element.
+   * @return a Vec representing the probability of each state element.
    */
   virtual nsssv initHMMLogProbVec(const sssv &x21) = 0;
 
-  //! Provides the log transition matrix for each HMM filter object.
+  //! Provides the transition matrix for each HMM filter object.
   /**
-   * @brief provides the log transition matrix for each HMM filter object.
+   * @brief provides the transition matrix for each HMM filter object.
    * @param x21 the second state component at time 1.
-   * @return a (log) transition matrix where element (ij) is the log of the
-   * probability of transitioning from state i to state j.
+   * @return a transition matrix where element (ij) is the probability of
+   * transitioning from state i to state j.
    */
   virtual nsssMat initHMMLogTransMat(const sssv &x21) = 0;
 
@@ -494,9 +486,40 @@ public:
   /**
    * @brief Samples the time t second component.
    * @param x2tm1 the previous time's second state component.
-   * @return a sssv sample of the second state component at the current time.
+   * @param yt the current observation.
+   * @return a Vec sample of the second state component at the current time.
    */
-  virtual sssv fSamp(const sssv &x2tm1) = 0;
+  virtual sssv qSamp(const sssv &x2tm1, const osv &yt) = 0;
+
+  //! Evaluates the proposal density of the second state component at time 1.
+  /**
+   * @brief Evaluates the proposal density of the second state component at
+   * time 1.
+   * @param x21 the second state component at time 1 you sampled.
+   * @param y1 time 1 observation.
+   * @return a float_t evaluation of the density.
+   */
+  virtual float_t logQ1Ev(const sssv &x21, const osv &y1) = 0;
+
+  //! Evaluates the state transition density for the second state component.
+  /**
+   * @brief Evaluates the state transition density for the second state
+   * component.
+   * @param x2t the current second state component.
+   * @param x2tm1 the previous second state component.
+   * @return a float_t evaluation.
+   */
+  virtual float_t logFEv(const sssv &x2t, const sssv &x2tm1) = 0;
+
+  //! Evaluates the proposal density at time t > 1.
+  /**
+   * @brief Evaluates the proposal density at time t > 1.
+   * @param x2t the current second state component.
+   * @param x2tm1 the previous second state component.
+   * @param yt the current time series observation.
+   * @return a float_t evaluation.
+   */
+  virtual float_t logQEv(const sssv &x2t, const sssv &x2tm1, const osv &yt) = 0;
 
   //! How to update your inner HMM filter object at each time.
   /**
@@ -507,61 +530,199 @@ public:
    * @param x2t the current second state component.
    */
   virtual void updateHMM(cfModType &aModel, const osv &yt, const sssv &x2t) = 0;
-
-private:
-  /** the current time period */
-  unsigned int m_now;
-  /** last conditional likelihood */
-  float_t m_lastLogCondLike;
-  /** resampling schedue */
-  unsigned int m_rs;
-  /** the array of inner closed-form models */
-  arrayMod m_p_innerMods;
-  /** the array of samples for the second state portion */
-  arrayVec m_p_samps;
-  /** the array of unnormalized log-weights */
-  arrayfloat_t m_logUnNormWeights;
-  /** the resampler object */
-  resamp_t m_resampler;
-  /** the vector of expectations */
-  std::vector<Mat> m_expectations;
 };
 
 template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
           typename resamp_t, typename float_t, bool debug>
-rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::rbpf_hmm_bs(
-    const unsigned int &resamp_sched)
-    : m_now(0), m_lastLogCondLike(0.0), m_rs(resamp_sched) {
-  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
-}
-
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t,
-            debug>::~rbpf_hmm_bs() {}
+rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::rbpf_hmm(
+    const unsigned int &rs, const float_t &essFrac)
+    : base_t(rs, essFrac) {}
 
 template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
           typename resamp_t, typename float_t, bool debug>
-void rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
-    const osv &data,
-    const std::vector<std::function<const Mat(const nsssv &x1tLogProbs,
-                                              const sssv &x2t)>> &fs) {
-
-  if (m_now > 0) {
-    // update
-    sssv newX2Samp;
-    float_t sumexpdenom(0.0);
-    float_t m1(
-        -std::numeric_limits<float_t>::infinity()); // for revised log weights
-    float_t m2 =
-        *std::max_element(m_logUnNormWeights.begin(), m_logUnNormWeights.end());
-    for (size_t ii = 0; ii < nparts; ++ii) {
-
-      newX2Samp = fSamp(m_p_samps[ii]);
-      updateHMM(m_p_innerMods[ii], data, newX2Samp);
-      sumexpdenom += std::exp(m_logUnNormWeights[ii] - m2);
-
-      m_logUnNormWeights[ii] += m_p_innerMods[ii].getLogCondLike();
+rbpf_hmm<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::~rbpf_hmm() {}
+
+//! CRTP (static dispatch) version of rbpf_hmm_bs.
+/**
+ * @class static_rbpf_hmm_bs
+ * @author t
+ * @file rbpf.h
+ * @brief Rao-Blackwellized/Marginal Bootstrap Filter with inner HMMs
+ *
+ * The model hooks are resolved at compile time: Derived inherits from this
+ * class and provides muSamp, initHMMLogProbVec, initHMMLogTransMat, fSamp and
+ * updateHMM as public member functions with the same signatures as the pure
+ * virtual ones in rbpf_hmm_bs, so they can be inlined into the particle loops.
+ * @tparam Derived the model class
+ * @tparam nparts the number of particles
+ * @tparam dimnss dimension of "not sampled state"
+ * @tparam dimss dimension of "sampled state"
+ * @tparam dimy the dimension of the observations
+ * @tparam resamp_t the resampler type (e.g. multinomial, etc.)
+ */
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug = false>
+class static_rbpf_hmm_bs
+    : public bases::rbpf_base<float_t, dimss, dimnss, dimy> {
+public:
+  /** "sampled state size vector" */
+  using sssv = Eigen::Matrix<float_t, dimss, 1>;
+  /** "not sampled state size vector" */
+  using nsssv = Eigen::Matrix<float_t, dimnss, 1>;
+  /** "observation size vector" */
+  using osv = Eigen::Matrix<float_t, dimy, 1>;
+  /** "not sampled state size matrix" */
+  using nsssMat = Eigen::Matrix<float_t, dimnss, dimnss>;
+  /** Dynamic size matrix*/
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** closed-form model type*/
+  using cfModType = hmm<dimnss, dimy, float_t, debug>;
+  /** array of model objects */
+  using arrayMod = std::array<cfModType, nparts>;
+  /** array of samples */
+  using arrayVec = std::array<sssv, nparts>;
+  /** array of weights */
+  using arrayfloat_t = std::array<float_t, nparts>;
+
+  //! The constructor.
+  /**
+   * @brief constructor.
+   * @param resamp_sched how often to resample (e.g. once every resamp_sched
+   * time periods)
+   * @param essFrac if positive, resamp_sched is ignored and the particles are
+   * resampled whenever the effective sample size drops below essFrac * nparts
+   */
+  static_rbpf_hmm_bs(const unsigned int &resamp_sched = 1,
+                     const float_t &essFrac = 0.0);
+
+  /**
+   * @brief The (virtual) destructor.
+   */
+  virtual ~static_rbpf_hmm_bs();
+
+  //! Filter.
+  /**
+   * @brief filters everything based on a new data point.
+   * @param data the most recent time series observation.
+   * @param fs a vector of functions computing E[h(x_1t, x_2t^i)| x_2t^i,y_1:t]
+   * to be averaged to yield E[h(x_1t, x_2t)|,y_1:t]. Will access the
+   * probability vector of x_1t
+   */
+  void filter(
+      const osv &data,
+      const std::vector<
+          std::function<const Mat(const nsssv &x1tLogProbs, const sssv &x2t)>>
+          &fs = std::vector<std::function<const Mat(
+              const nsssv &, const sssv &)>>()); //, const
+                                                 //std::vector<std::function<const
+                                                 //Mat(const Vec&)> >& fs);
+
+  //! Get the latest conditional likelihood.
+  /**
+   * @brief Get the latest conditional likelihood.
+   * @return the latest conditional likelihood.
+   */
+  float_t getLogCondLike() const;
+
+  /**
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
+   */
+  float_t getESS() const;
+
+  /**
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
+   */
+  bool getResampled() const;
+
+  /**
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
+   */
+  unsigned int getNumResamps() const;
+
+  //!
+  /**
+   * @brief Get vector of expectations.
+   * @return vector of expectations
+   */
+  std::vector<Mat> getExpectations() const;
+
+private:
+  /** the current time period */
+  unsigned int m_now;
+  /** last conditional likelihood */
+  float_t m_lastLogCondLike;
+  /** resampling schedue */
+  unsigned int m_rs;
+  /** resample when the ESS drops below this fraction of nparts (if positive) */
+  float_t m_essFrac;
+  /** the most recent effective sample size */
+  float_t m_ess;
+  /** whether the most recent step resampled */
+  bool m_resampled;
+  /** how many times the particles have been resampled */
+  unsigned int m_numResamps;
+  /** exp(log weight - max log weight), filled once per time step */
+  arrayfloat_t m_expWts;
+  /** log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
+  /** the array of inner closed-form models */
+  arrayMod m_p_innerMods;
+  /** the array of samples for the second state portion */
+  arrayVec m_p_samps;
+  /** the array of unnormalized log-weights */
+  arrayfloat_t m_logUnNormWeights;
+  /** the resampler object */
+  resamp_t m_resampler;
+  /** the vector of expectations */
+  std::vector<Mat> m_expectations;
+
+protected:
+  /**
+   * @brief this object as the model class (the CRTP cast)
+   * @return a reference to the model
+   */
+  Derived &derived();
+};
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+static_rbpf_hmm_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                   debug>::static_rbpf_hmm_bs(const unsigned int &resamp_sched,
+                                              const float_t &essFrac)
+    : m_now(0), m_lastLogCondLike(0.0), m_rs(resamp_sched), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nparts)), m_resampled(false),
+      m_numResamps(0), m_logOldWtSum(std::log(static_cast<float_t>(nparts))) {
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+static_rbpf_hmm_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                   debug>::~static_rbpf_hmm_bs() {}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+void static_rbpf_hmm_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                        debug>::filter(
+    const osv &data,
+    const std::vector<std::function<const Mat(const nsssv &x1tLogProbs,
+                                              const sssv &x2t)>> &fs) {
+
+  if (m_now > 0) {
+    // update
+    sssv newX2Samp;
+    float_t m1(
+        -std::numeric_limits<float_t>::infinity()); // for revised log weights
+    for (size_t ii = 0; ii < nparts; ++ii) {
+
+      newX2Samp = derived().fSamp(m_p_samps[ii]);
+      derived().updateHMM(m_p_innerMods[ii], data, newX2Samp);
+
+      m_logUnNormWeights[ii] += m_p_innerMods[ii].getLogCondLike();
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
@@ -578,11 +739,12 @@ void rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
       m_p_samps[ii] = newX2Samp;
     }
 
-    // calculate log p(y_t | y_{1:t-1})
-    float_t sumexpnumer(0.0);
-    for (size_t p = 0; p < nparts; ++p)
-      sumexpnumer += std::exp(m_logUnNormWeights[p] - m1);
-    m_lastLogCondLike = m1 + std::log(sumexpnumer) - m2 - std::log(sumexpdenom);
+    // calculate log p(y_t | y_{1:t-1}) (the exponentiated weights are reused
+    // for the ESS and the expectations)
+    float_t sumexpnumer = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, m1);
+    m_lastLogCondLike = m1 + std::log(sumexpnumer) - m_logOldWtSum;
+    m_ess = kernels::ess(m_expWts.data(), nparts, sumexpnumer);
 
     // calculate expectations before you resample
     unsigned int fId(0);
@@ -590,18 +752,13 @@ void rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     // m_logUnNormWeights.end());
     for (auto &h : fs) {
 
-      Mat testOutput = h(m_p_innerMods[0].getFilterVecLogProbs(), m_p_samps[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
+      Mat numer = h(m_p_innerMods[0].getFilterVecLogProbs(), m_p_samps[0]) *
+                  m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
         numer +=
             h(m_p_innerMods[prtcl].getFilterVecLogProbs(), m_p_samps[prtcl]) *
-            std::exp(m_logUnNormWeights[prtcl] - m1);
-        denom += std::exp(m_logUnNormWeights[prtcl] - m1);
-      }
-      m_expectations[fId] = numer / denom;
+            m_expWts[prtcl];
+      m_expectations[fId] = numer / sumexpnumer;
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
@@ -614,8 +771,15 @@ void rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     }
 
     // resample (unnormalized weights ok)
-    if ((m_now + 1) % m_rs == 0)
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_rs == 0;
+    if (m_resampled) {
       m_resampler.resampLogWts(m_p_innerMods, m_p_samps, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = m1 + std::log(sumexpnumer);
+    }
 
     // update time step
     m_now++;
@@ -627,11 +791,11 @@ void rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     float_t m1(-std::numeric_limits<float_t>::infinity());
     for (size_t ii = 0; ii < nparts; ++ii) {
 
-      m_p_samps[ii] = muSamp();
-      tmpLogProbs = initHMMLogProbVec(m_p_samps[ii]);
-      tmpLogTransMat = initHMMLogTransMat(m_p_samps[ii]);
+      m_p_samps[ii] = derived().muSamp();
+      tmpLogProbs = derived().initHMMLogProbVec(m_p_samps[ii]);
+      tmpLogTransMat = derived().initHMMLogTransMat(m_p_samps[ii]);
       m_p_innerMods[ii] = cfModType(tmpLogProbs, tmpLogTransMat);
-      this->updateHMM(m_p_innerMods[ii], data, m_p_samps[ii]);
+      derived().updateHMM(m_p_innerMods[ii], data, m_p_samps[ii]);
       m_logUnNormWeights[ii] = m_p_innerMods[ii].getLogCondLike();
 
 // print stuff if debug mode is on
@@ -648,11 +812,11 @@ void rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     }
 
     // calc log p(y1)
-    float_t sumexp(0.0);
-    for (size_t p = 0; p < nparts; ++p)
-      sumexp += std::exp(m_logUnNormWeights[p] - m1);
+    float_t sumexp = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, m1);
     m_lastLogCondLike =
         m1 + std::log(sumexp) - std::log(static_cast<float_t>(nparts));
+    m_ess = kernels::ess(m_expWts.data(), nparts, sumexp);
 
     // calculate expectations before you resample
     m_expectations.resize(fs.size());
@@ -661,18 +825,13 @@ void rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     // m_logUnNormWeights.end()); /// TODO: can we just use m1?
     for (auto &h : fs) {
 
-      Mat testOutput = h(m_p_innerMods[0].getFilterVecLogProbs(), m_p_samps[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
+      Mat numer = h(m_p_innerMods[0].getFilterVecLogProbs(), m_p_samps[0]) *
+                  m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
         numer +=
             h(m_p_innerMods[prtcl].getFilterVecLogProbs(), m_p_samps[prtcl]) *
-            std::exp(m_logUnNormWeights[prtcl] - m1);
-        denom += std::exp(m_logUnNormWeights[prtcl] - m1);
-      }
-      m_expectations[fId] = numer / denom;
+            m_expWts[prtcl];
+      m_expectations[fId] = numer / sumexp;
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
@@ -685,44 +844,202 @@ void rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     }
 
     // resample (unnormalized weights ok)
-    if ((m_now + 1) % m_rs == 0)
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_rs == 0;
+    if (m_resampled) {
       m_resampler.resampLogWts(m_p_innerMods, m_p_samps, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = m1 + std::log(sumexp);
+    }
 
     // advance time step
     m_now++;
   }
 }
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-float_t rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t,
-                    debug>::getLogCondLike() const {
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+float_t static_rbpf_hmm_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                           float_t, debug>::getLogCondLike() const {
   return m_lastLogCondLike;
 }
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-auto rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t,
-                 debug>::getExpectations() const -> std::vector<Mat> {
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+float_t static_rbpf_hmm_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                           float_t, debug>::getESS() const {
+  return m_ess;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+bool static_rbpf_hmm_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                        debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+unsigned int static_rbpf_hmm_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                                float_t, debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+auto static_rbpf_hmm_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                        debug>::getExpectations() const -> std::vector<Mat> {
   return m_expectations;
 }
 
-//! Rao-Blackwellized/Marginal Particle Filter with inner Kalman Filter objectss
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+Derived &static_rbpf_hmm_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                            float_t, debug>::derived() {
+  return static_cast<Derived &>(*this);
+}
+
+//! Rao-Blackwellized/Marginal Bootstrap Filter with inner HMMs
 /**
- * @class rbpf_kalman
+ * @class rbpf_hmm_bs
+ * @author t
+ * @file rbpf.h
+ * @brief Rao-Blackwellized/Marginal Bootstrap Filter with inner HMMs
+ * @tparam nparts the number of particles
+ * @tparam dimnss dimension of "not sampled state"
+ * @tparam dimss dimension of "sampled state"
+ * @tparam dimy the dimension of the observations
+ * @tparam resamp_t the resampler type (e.g. multinomial, etc.)
+ */
+template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
+          typename resamp_t, typename float_t, bool debug = false>
+class rbpf_hmm_bs
+    : public static_rbpf_hmm_bs<
+          rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>,
+          nparts, dimnss, dimss, dimy, resamp_t, float_t, debug> {
+private:
+  /** the static base class that runs the filter */
+  using base_t =
+      static_rbpf_hmm_bs<rbpf_hmm_bs, nparts, dimnss, dimss, dimy, resamp_t,
+                         float_t, debug>;
+
+public:
+  /** "sampled state size vector" */
+  using sssv = Eigen::Matrix<float_t, dimss, 1>;
+  /** "not sampled state size vector" */
+  using nsssv = Eigen::Matrix<float_t, dimnss, 1>;
+  /** "observation size vector" */
+  using osv = Eigen::Matrix<float_t, dimy, 1>;
+  /** "not sampled state size matrix" */
+  using nsssMat = Eigen::Matrix<float_t, dimnss, dimnss>;
+  /** Dynamic size matrix*/
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** closed-form model type*/
+  using cfModType = hmm<dimnss, dimy, float_t, debug>;
+  /** array of model objects */
+  using arrayMod = std::array<cfModType, nparts>;
+  /** array of samples */
+  using arrayVec = std::array<sssv, nparts>;
+  /** array of weights */
+  using arrayfloat_t = std::array<float_t, nparts>;
+
+  //! The constructor.
+  /**
+   * @brief constructor.
+   * @param resamp_sched how often to resample (e.g. once every resamp_sched
+   * time periods)
+   * @param essFrac if positive, resamp_sched is ignored and the particles are
+   * resampled whenever the effective sample size drops below essFrac * nparts
+   */
+  rbpf_hmm_bs(const unsigned int &resamp_sched = 1,
+              const float_t &essFrac = 0.0);
+
+  /**
+   * @brief The (virtual) destructor.
+   */
+  virtual ~rbpf_hmm_bs();
+
+  //! Sample from the first sampler.
+  /**
+   * @brief samples the second component of the state at time 1.
+   * @return a sssv sample for x21.
+   */
+  virtual sssv muSamp() = 0;
+
+  //! Provides the initial log probability vector for each HMM filter object.
+  /**
+   * @brief provides the initial log probability vector for each HMM filter
+   * object.
+   * @param x21 the second state componenent at time 1.
+   * @return a Vec representing the log probability of each state element.
+   */
+  virtual nsssv initHMMLogProbVec(const sssv &x21) = 0;
+
+  //! Provides the log transition matrix for each HMM filter object.
+  /**
+   * @brief provides the log transition matrix for each HMM filter object.
+   * @param x21 the second state component at time 1.
+   * @return a (log) transition matrix where element (ij) is the log of the
+   * probability of transitioning from state i to state j.
+   */
+  virtual nsssMat initHMMLogTransMat(const sssv &x21) = 0;
+
+  //! Samples the time t second component.
+  /**
+   * @brief Samples the time t second component.
+   * @param x2tm1 the previous time's second state component.
+   * @return a sssv sample of the second state component at the current time.
+   */
+  virtual sssv fSamp(const sssv &x2tm1) = 0;
+
+  //! How to update your inner HMM filter object at each time.
+  /**
+   * @brief How to update your inner HMM filter object at each time.
+   * @param aModel a HMM filter object describing the conditional closed-form
+   * model.
+   * @param yt the current time series observation.
+   * @param x2t the current second state component.
+   */
+  virtual void updateHMM(cfModType &aModel, const osv &yt, const sssv &x2t) = 0;
+};
+
+template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::rbpf_hmm_bs(
+    const unsigned int &rs, const float_t &essFrac)
+    : base_t(rs, essFrac) {}
+
+template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+rbpf_hmm_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t,
+            debug>::~rbpf_hmm_bs() {}
+
+//! CRTP (static dispatch) version of rbpf_kalman.
+/**
+ * @class static_rbpf_kalman
  * @author t
  * @file rbpf.h
  * @brief Rao-Blackwellized/Marginal Particle Filter with inner Kalman Filter
  * objectss
+ *
+ * The model hooks are resolved at compile time: Derived inherits from this
+ * class and provides logMuEv, q1Samp, initKalmanMean, initKalmanVar, qSamp,
+ * logQ1Ev, logFEv, logQEv and updateKalman as public member functions with the
+ * same signatures as the pure virtual ones in rbpf_kalman, so they can be
+ * inlined into the particle loops.
+ * @tparam Derived the model class
  * @tparam nparts the number of particles
  * @tparam dimnss dimension of not-sampled-state vector
  * @tparam dimss dimension of sampled-state vector
  * @tparam dimy the dimension of the observations
  * @tparam resamp_t the resampler type
  */
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug = false>
-class rbpf_kalman : public bases::rbpf_base<float_t, dimss, dimnss, dimy> {
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug = false>
+class static_rbpf_kalman
+    : public bases::rbpf_base<float_t, dimss, dimnss, dimy> {
 
 public:
   /** "sampled state size vector" */
@@ -748,13 +1065,16 @@ public:
   /**
    \param resamp_sched how often you want to resample (e.g once every
    resamp_sched time points)
+   \param essFrac if positive, resamp_sched is ignored and the particles are
+   resampled whenever the effective sample size drops below essFrac * nparts
    */
-  rbpf_kalman(const unsigned int &resamp_sched = 1);
+  static_rbpf_kalman(const unsigned int &resamp_sched = 1,
+                     const float_t &essFrac = 0.0);
 
   /**
    * @brief
    */
-  virtual ~rbpf_kalman();
+  virtual ~static_rbpf_kalman();
 
   //! Filter!
   /**
@@ -776,30 +1096,366 @@ public:
    */
   float_t getLogCondLike() const;
 
-  //! Get the latest filtered expectation E[h(x_1t, x_2t) | y_{1:t}]
   /**
-   * @brief Get the expectations you're keeping track of.
-   * @return a vector of Mats
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
    */
-  std::vector<Mat> getExpectations() const;
+  float_t getESS() const;
 
-  //! Evaluates the first time state density.
   /**
-   * @brief evaluates log mu(x21).
-   * @param x21 component two at time 1
-   * @return a float_t evaluation
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
    */
-  virtual float_t logMuEv(const sssv &x21) = 0;
+  bool getResampled() const;
 
-  //! Sample from the first time's proposal distribution.
   /**
-   * @brief samples the second component of the state at time 1.
-   * @param y1 most recent datum.
-   * @return a Vec sample for x21.
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
    */
-  virtual sssv q1Samp(const osv &y1) = 0;
+  unsigned int getNumResamps() const;
 
-  //! Provides the initial mean vector for each Kalman filter object.
+  //! Get the latest filtered expectation E[h(x_1t, x_2t) | y_{1:t}]
+  /**
+   * @brief Get the expectations you're keeping track of.
+   * @return a vector of Mats
+   */
+  std::vector<Mat> getExpectations() const;
+
+private:
+  /** the resamplign schedule */
+  unsigned int m_rs;
+  /** resample when the ESS drops below this fraction of nparts (if positive) */
+  float_t m_essFrac;
+  /** the most recent effective sample size */
+  float_t m_ess;
+  /** whether the most recent step resampled */
+  bool m_resampled;
+  /** how many times the particles have been resampled */
+  unsigned int m_numResamps;
+  /** exp(log weight - max log weight), filled once per time step */
+  arrayfloat_t m_expWts;
+  /** log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
+  /** the array of inner Kalman filter objects */
+  arrayMod m_p_innerMods;
+  /** the array of particle samples */
+  arrayVec m_p_samps;
+  /** the array of the (log of) unnormalized weights */
+  arrayfloat_t m_logUnNormWeights;
+  /** the current time period */
+  unsigned int m_now;
+  /** log p(y_t|y_{1:t-1}) or log p(y1) */
+  float_t m_lastLogCondLike;
+  /** resampler object */
+  resamp_t m_resampler;
+  /** expectations */
+  std::vector<Mat> m_expectations;
+
+protected:
+  /**
+   * @brief this object as the model class (the CRTP cast)
+   * @return a reference to the model
+   */
+  Derived &derived();
+};
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+static_rbpf_kalman<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                   debug>::static_rbpf_kalman(const unsigned int &resamp_sched,
+                                              const float_t &essFrac)
+    : m_now(0), m_lastLogCondLike(0.0), m_rs(resamp_sched), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nparts)), m_resampled(false),
+      m_numResamps(0), m_logOldWtSum(std::log(static_cast<float_t>(nparts))) {
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+static_rbpf_kalman<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                   debug>::~static_rbpf_kalman() {}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+void static_rbpf_kalman<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                        debug>::filter(
+    const osv &data,
+    const std::vector<
+        std::function<const Mat(const nsssv &x1t, const sssv &x2t)>> &fs) {
+
+  if (m_now > 0) {
+
+    // update
+    sssv newX2Samp;
+    float_t m1(
+        -std::numeric_limits<float_t>::infinity()); // for updated weights
+    for (size_t ii = 0; ii < nparts; ++ii) {
+      newX2Samp = derived().qSamp(m_p_samps[ii], data);
+      derived().updateKalman(m_p_innerMods[ii], data, newX2Samp);
+
+      // update the weights
+      m_logUnNormWeights[ii] +=
+          m_p_innerMods[ii].getLogCondLike() +
+          derived().logFEv(newX2Samp, m_p_samps[ii]) -
+          derived().logQEv(newX2Samp, m_p_samps[ii], data);
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+      if constexpr (debug)
+        std::cout << "time: " << m_now
+                  << ", transposed x2 sample: " << newX2Samp.transpose()
+                  << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
+#endif
+
+      // update a max
+      if (m_logUnNormWeights[ii] > m1)
+        m1 = m_logUnNormWeights[ii];
+
+      m_p_samps[ii] = newX2Samp;
+    }
+
+    // calc log p(y_t | y_{1:t-1}) (the exponentiated weights are reused
+    // for the ESS and the expectations)
+    float_t sumexpnumer = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, m1);
+    m_lastLogCondLike = m1 + std::log(sumexpnumer) - m_logOldWtSum;
+    m_ess = kernels::ess(m_expWts.data(), nparts, sumexpnumer);
+
+    // calculate expectations before you resample
+    unsigned int fId(0);
+    // float_t m = *std::max_element(m_logUnNormWeights.begin(),
+    // m_logUnNormWeights.end());
+    for (auto &h : fs) {
+
+      Mat numer = h(m_p_innerMods[0].getFilterVec(), m_p_samps[0]) *
+                  m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+        numer += h(m_p_innerMods[prtcl].getFilterVec(), m_p_samps[prtcl]) *
+                 m_expWts[prtcl];
+      m_expectations[fId] = numer / sumexpnumer;
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+      if constexpr (debug)
+        std::cout << "transposed expec " << fId << ": "
+                  << m_expectations[fId].transpose() << "\n";
+#endif
+
+      fId++;
+    }
+
+    // resample (unnormalized weights ok)
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_rs == 0;
+    if (m_resampled) {
+      m_resampler.resampLogWts(m_p_innerMods, m_p_samps, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = m1 + std::log(sumexpnumer);
+    }
+
+    // update time step
+    m_now++;
+  } else //( m_now == 0) // first data point coming
+  {
+    // initialize and update the closed-form mods
+    nsssv tmpMean;
+    nsssMat tmpVar;
+    float_t m1(-std::numeric_limits<float_t>::infinity());
+    for (size_t ii = 0; ii < nparts; ++ii) {
+      m_p_samps[ii] = derived().q1Samp(data);
+      tmpMean = derived().initKalmanMean(m_p_samps[ii]);
+      tmpVar = derived().initKalmanVar(m_p_samps[ii]);
+      m_p_innerMods[ii] =
+          cfModType(tmpMean, tmpVar); // TODO: allow for input or check to make
+                                      // sure this doesn't break anything else
+      derived().updateKalman(m_p_innerMods[ii], data, m_p_samps[ii]);
+
+      m_logUnNormWeights[ii] = m_p_innerMods[ii].getLogCondLike() +
+                               derived().logMuEv(m_p_samps[ii]) -
+                               derived().logQ1Ev(m_p_samps[ii], data);
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+      if constexpr (debug)
+        std::cout << "time: " << m_now
+                  << ", transposed x2 sample: " << m_p_samps[ii].transpose()
+                  << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
+#endif
+
+      // update a max
+      if (m_logUnNormWeights[ii] > m1)
+        m1 = m_logUnNormWeights[ii];
+    }
+
+    // calculate log p(y1)
+    float_t sumexp = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, m1);
+    m_lastLogCondLike =
+        m1 + std::log(sumexp) - std::log(static_cast<float_t>(nparts));
+    m_ess = kernels::ess(m_expWts.data(), nparts, sumexp);
+
+    // calculate expectations before you resample
+    m_expectations.resize(fs.size());
+    unsigned int fId(0);
+    // float_t m = *std::max_element(m_logUnNormWeights.begin(),
+    // m_logUnNormWeights.end());
+    for (auto &h : fs) {
+
+      Mat numer = h(m_p_innerMods[0].getFilterVec(), m_p_samps[0]) *
+                  m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+        numer += h(m_p_innerMods[prtcl].getFilterVec(), m_p_samps[prtcl]) *
+                 m_expWts[prtcl];
+      m_expectations[fId] = numer / sumexp;
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+      if constexpr (debug)
+        std::cout << "transposed expec " << fId << ": "
+                  << m_expectations[fId].transpose() << "\n";
+#endif
+
+      fId++;
+    }
+
+    // resample (unnormalized weights ok)
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_rs == 0;
+    if (m_resampled) {
+      m_resampler.resampLogWts(m_p_innerMods, m_p_samps, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = m1 + std::log(sumexp);
+    }
+
+    // advance time step
+    m_now++;
+  }
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+float_t static_rbpf_kalman<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                           float_t, debug>::getLogCondLike() const {
+  return m_lastLogCondLike;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+float_t static_rbpf_kalman<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                           float_t, debug>::getESS() const {
+  return m_ess;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+bool static_rbpf_kalman<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                        debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+unsigned int static_rbpf_kalman<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                                float_t, debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+auto static_rbpf_kalman<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                        debug>::getExpectations() const -> std::vector<Mat> {
+  return m_expectations;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+Derived &static_rbpf_kalman<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                            float_t, debug>::derived() {
+  return static_cast<Derived &>(*this);
+}
+
+//! Rao-Blackwellized/Marginal Particle Filter with inner Kalman Filter objectss
+/**
+ * @class rbpf_kalman
+ * @author t
+ * @file rbpf.h
+ * @brief Rao-Blackwellized/Marginal Particle Filter with inner Kalman Filter
+ * objectss
+ * @tparam nparts the number of particles
+ * @tparam dimnss dimension of not-sampled-state vector
+ * @tparam dimss dimension of sampled-state vector
+ * @tparam dimy the dimension of the observations
+ * @tparam resamp_t the resampler type
+ */
+template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
+          typename resamp_t, typename float_t, bool debug = false>
+class rbpf_kalman
+    : public static_rbpf_kalman<
+          rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>,
+          nparts, dimnss, dimss, dimy, resamp_t, float_t, debug> {
+private:
+  /** the static base class that runs the filter */
+  using base_t =
+      static_rbpf_kalman<rbpf_kalman, nparts, dimnss, dimss, dimy, resamp_t,
+                         float_t, debug>;
+
+public:
+  /** "sampled state size vector" */
+  using sssv = Eigen::Matrix<float_t, dimss, 1>;
+  /** "not sampled state size vector" */
+  using nsssv = Eigen::Matrix<float_t, dimnss, 1>;
+  /** "observation size vector" */
+  using osv = Eigen::Matrix<float_t, dimy, 1>;
+  /** dynamic size matrices */
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** "not sampled state size matrix" */
+  using nsssMat = Eigen::Matrix<float_t, dimnss, dimnss>;
+  /** closed-form model type*/
+  using cfModType = kalman<dimnss, dimy, 0, float_t, debug>;
+  /** array of model objects */
+  using arrayMod = std::array<cfModType, nparts>;
+  /** array of samples */
+  using arrayVec = std::array<sssv, nparts>;
+  /** array of weights */
+  using arrayfloat_t = std::array<float_t, nparts>;
+
+  //! The constructor.
+  /**
+   \param resamp_sched how often you want to resample (e.g once every
+   resamp_sched time points)
+   \param essFrac if positive, resamp_sched is ignored and the particles are
+   resampled whenever the effective sample size drops below essFrac * nparts
+   */
+  rbpf_kalman(const unsigned int &resamp_sched = 1,
+              const float_t &essFrac = 0.0);
+
+  /**
+   * @brief
+   */
+  virtual ~rbpf_kalman();
+
+  //! Evaluates the first time state density.
+  /**
+   * @brief evaluates log mu(x21).
+   * @param x21 component two at time 1
+   * @return a float_t evaluation
+   */
+  virtual float_t logMuEv(const sssv &x21) = 0;
+
+  //! Sample from the first time's proposal distribution.
+  /**
+   * @brief samples the second component of the state at time 1.
+   * @param y1 most recent datum.
+   * @return a Vec sample for x21.
+   */
+  virtual sssv q1Samp(const osv &y1) = 0;
+
+  //! Provides the initial mean vector for each Kalman filter object.
   /**
    * @brief provides the initial mean vector for each Kalman filter object.
    * @param x21 the second state componenent at time 1.
@@ -816,59 +1472,190 @@ public:
    */
   virtual nsssMat initKalmanVar(const sssv &x21) = 0;
 
-  //! Samples the time t second component.
+  //! Samples the time t second component.
+  /**
+   * @brief Samples the time t second component.
+   * @param x2tm1 the previous time's second state component.
+   * @param yt the current observation.
+   * @return a sssv sample of the second state component at the current time.
+   */
+  virtual sssv qSamp(const sssv &x2tm1, const osv &yt) = 0;
+
+  //! Evaluates the proposal density of the second state component at time 1.
+  /**
+   * @brief Evaluates the proposal density of the second state component at
+   * time 1.
+   * @param x21 the second state component at time 1 you sampled.
+   * @param y1 time 1 observation.
+   * @return a float_t evaluation of the density.
+   */
+  virtual float_t logQ1Ev(const sssv &x21, const osv &y1) = 0;
+
+  //! Evaluates the state transition density for the second state component.
+  /**
+   * @brief Evaluates the state transition density for the second state
+   * component.
+   * @param x2t the current second state component.
+   * @param x2tm1 the previous second state component.
+   * @return a float_t evaluation.
+   */
+  virtual float_t logFEv(const sssv &x2t, const sssv &x2tm1) = 0;
+
+  //! Evaluates the proposal density at time t > 1.
+  /**
+   * @brief Evaluates the proposal density at time t > 1.
+   * @param x2t the current second state component.
+   * @param x2tm1 the previous second state component.
+   * @param yt the current time series observation.
+   * @return a float_t evaluation.
+   */
+  virtual float_t logQEv(const sssv &x2t, const sssv &x2tm1, const osv &yt) = 0;
+
+  //! How to update your inner Kalman filter object at each time.
+  /**
+   * @brief How to update your inner Kalman filter object at each time.
+   * @param kMod a Kalman filter object describing the conditional closed-form
+   * model.
+   * @param yt the current time series observation.
+   * @param x2t the current second state component.
+   */
+  virtual void updateKalman(cfModType &kMod, const osv &yt,
+                            const sssv &x2t) = 0;
+};
+
+template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::rbpf_kalman(
+    const unsigned int &rs, const float_t &essFrac)
+    : base_t(rs, essFrac) {}
+
+template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t,
+            debug>::~rbpf_kalman() {}
+
+//! Rao-Blackwellized/Marginal Bootstrap Filter with inner Kalman Filter
+//! CRTP (static dispatch) version of rbpf_kalman_bs.
+/**
+ * @class static_rbpf_kalman_bs
+ * @author t
+ * @file rbpf.h
+ * @brief Rao-Blackwellized/Marginal Bootstrap Filter with inner Kalman Filter
+ * objectss
+ *
+ * The model hooks are resolved at compile time: Derived inherits from this
+ * class and provides muSamp, initKalmanMean, initKalmanVar, fSamp and
+ * updateKalman as public member functions with the same signatures as the pure
+ * virtual ones in rbpf_kalman_bs, so they can be inlined into the particle
+ * loops.
+ * @tparam Derived the model class
+ * @tparam nparts the number of particles
+ * @tparam dimnss dimension of not-sampled-state vector
+ * @tparam dimss dimension of sampled-state vector
+ * @tparam dimy the dimension of the observations
+ * @tparam resamp_t the resampler type
+ */
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug = false>
+class static_rbpf_kalman_bs
+    : public bases::rbpf_base<float_t, dimss, dimnss, dimy> {
+
+public:
+  /** "sampled state size vector" */
+  using sssv = Eigen::Matrix<float_t, dimss, 1>;
+  /** "not sampled state size vector" */
+  using nsssv = Eigen::Matrix<float_t, dimnss, 1>;
+  /** "observation size vector" */
+  using osv = Eigen::Matrix<float_t, dimy, 1>;
+  /** dynamic size matrices */
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** "not sampled state size matrix" */
+  using nsssMat = Eigen::Matrix<float_t, dimnss, dimnss>;
+  /** closed-form model type*/
+  using cfModType = kalman<dimnss, dimy, 0, float_t, debug>;
+  /** array of model objects */
+  using arrayMod = std::array<cfModType, nparts>;
+  /** array of samples */
+  using arrayVec = std::array<sssv, nparts>;
+  /** array of weights */
+  using arrayfloat_t = std::array<float_t, nparts>;
+
+  //! The constructor.
+  /**
+   \param resamp_sched how often you want to resample (e.g once every
+   resamp_sched time points)
+   \param essFrac if positive, resamp_sched is ignored and the particles are
+   resampled whenever the effective sample size drops below essFrac * nparts
+   */
+  static_rbpf_kalman_bs(const unsigned int &resamp_sched = 1,
+                        const float_t &essFrac = 0.0);
+
+  /**
+   * @brief The (virtual) destructor.
+   */
+  virtual ~static_rbpf_kalman_bs();
+
+  //! Filter!
+  /**
+   * \brief The workhorse function
+   * \param data the most recent observable portion of the time series.
+   * \param fs a vector of functions computing E[h(x_1t, x_2t^i)| x_2t^i,y_1:t].
+   * to be averaged to yield E[h(x_1t, x_2t)|,y_1:t]
+   */
+  void filter(
+      const osv &data,
+      const std::vector<
+          std::function<const Mat(const nsssv &x1t, const sssv &x2t)>> &fs =
+          std::vector<
+              std::function<const Mat(const nsssv &x1t, const sssv &x2t)>>());
+
+  //! Get the latest log conditional likelihood.
   /**
-   * @brief Samples the time t second component.
-   * @param x2tm1 the previous time's second state component.
-   * @param yt the current observation.
-   * @return a sssv sample of the second state component at the current time.
+   * \return the latest log conditional likelihood.
    */
-  virtual sssv qSamp(const sssv &x2tm1, const osv &yt) = 0;
+  float_t getLogCondLike() const;
 
-  //! Evaluates the proposal density of the second state component at time 1.
   /**
-   * @brief Evaluates the proposal density of the second state component at
-   * time 1.
-   * @param x21 the second state component at time 1 you sampled.
-   * @param y1 time 1 observation.
-   * @return a float_t evaluation of the density.
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
    */
-  virtual float_t logQ1Ev(const sssv &x21, const osv &y1) = 0;
+  float_t getESS() const;
 
-  //! Evaluates the state transition density for the second state component.
   /**
-   * @brief Evaluates the state transition density for the second state
-   * component.
-   * @param x2t the current second state component.
-   * @param x2tm1 the previous second state component.
-   * @return a float_t evaluation.
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
    */
-  virtual float_t logFEv(const sssv &x2t, const sssv &x2tm1) = 0;
+  bool getResampled() const;
 
-  //! Evaluates the proposal density at time t > 1.
   /**
-   * @brief Evaluates the proposal density at time t > 1.
-   * @param x2t the current second state component.
-   * @param x2tm1 the previous second state component.
-   * @param yt the current time series observation.
-   * @return a float_t evaluation.
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
    */
-  virtual float_t logQEv(const sssv &x2t, const sssv &x2tm1, const osv &yt) = 0;
+  unsigned int getNumResamps() const;
 
-  //! How to update your inner Kalman filter object at each time.
+  //! Get the latest filtered expectation E[h(x_1t, x_2t) | y_{1:t}]
   /**
-   * @brief How to update your inner Kalman filter object at each time.
-   * @param kMod a Kalman filter object describing the conditional closed-form
-   * model.
-   * @param yt the current time series observation.
-   * @param x2t the current second state component.
+   * @brief Get the expectations you're keeping track of.
+   * @return a vector of Mats
    */
-  virtual void updateKalman(cfModType &kMod, const osv &yt,
-                            const sssv &x2t) = 0;
+  std::vector<Mat> getExpectations() const;
 
 private:
   /** the resamplign schedule */
   unsigned int m_rs;
+  /** resample when the ESS drops below this fraction of nparts (if positive) */
+  float_t m_essFrac;
+  /** the most recent effective sample size */
+  float_t m_ess;
+  /** whether the most recent step resampled */
+  bool m_resampled;
+  /** how many times the particles have been resampled */
+  unsigned int m_numResamps;
+  /** exp(log weight - max log weight), filled once per time step */
+  arrayfloat_t m_expWts;
+  /** log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
   /** the array of inner Kalman filter objects */
   arrayMod m_p_innerMods;
   /** the array of particle samples */
@@ -883,27 +1670,39 @@ private:
   resamp_t m_resampler;
   /** expectations */
   std::vector<Mat> m_expectations;
+
+protected:
+  /**
+   * @brief this object as the model class (the CRTP cast)
+   * @return a reference to the model
+   */
+  Derived &derived();
 };
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::rbpf_kalman(
-    const unsigned int &resamp_sched)
-    : m_now(0), m_lastLogCondLike(0.0), m_rs(resamp_sched) {
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+static_rbpf_kalman_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                      debug>::static_rbpf_kalman_bs(
+    const unsigned int &resamp_sched, const float_t &essFrac)
+    : m_now(0), m_lastLogCondLike(0.0), m_rs(resamp_sched), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nparts)), m_resampled(false),
+      m_numResamps(0), m_logOldWtSum(std::log(static_cast<float_t>(nparts))) {
   std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
 }
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t,
-            debug>::~rbpf_kalman() {}
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+static_rbpf_kalman_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t, float_t,
+                      debug>::~static_rbpf_kalman_bs() {}
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-void rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
-    const osv &data,
-    const std::vector<
-        std::function<const Mat(const nsssv &x1t, const sssv &x2t)>> &fs) {
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+void static_rbpf_kalman_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                           float_t, debug>::
+    filter(
+        const osv &data,
+        const std::vector<
+            std::function<const Mat(const nsssv &x1t, const sssv &x2t)>> &fs) {
 
   if (m_now > 0) {
 
@@ -911,20 +1710,13 @@ void rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     sssv newX2Samp;
     float_t m1(
         -std::numeric_limits<float_t>::infinity()); // for updated weights
-    float_t m2 =
-        *std::max_element(m_logUnNormWeights.begin(), m_logUnNormWeights.end());
-    float_t sumexpdenom(0.0);
     for (size_t ii = 0; ii < nparts; ++ii) {
-      newX2Samp = qSamp(m_p_samps[ii], data);
-      this->updateKalman(m_p_innerMods[ii], data, newX2Samp);
 
-      // before you update the weights
-      sumexpdenom += std::exp(m_logUnNormWeights[ii] - m2);
+      newX2Samp = derived().fSamp(m_p_samps[ii], data);
+      derived().updateKalman(m_p_innerMods[ii], data, newX2Samp);
 
       // update the weights
-      m_logUnNormWeights[ii] += m_p_innerMods[ii].getLogCondLike() +
-                                logFEv(newX2Samp, m_p_samps[ii]) -
-                                logQEv(newX2Samp, m_p_samps[ii], data);
+      m_logUnNormWeights[ii] += m_p_innerMods[ii].getLogCondLike();
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
@@ -941,11 +1733,12 @@ void rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
       m_p_samps[ii] = newX2Samp;
     }
 
-    // calc log p(y_t | y_{1:t-1})
-    float_t sumexpnumer(0.0);
-    for (size_t p = 0; p < nparts; ++p)
-      sumexpnumer += std::exp(m_logUnNormWeights[p] - m1);
-    m_lastLogCondLike = m1 + std::log(sumexpnumer) - m2 - std::log(sumexpdenom);
+    // calc log p(y_t | y_{1:t-1}) (the exponentiated weights are reused
+    // for the ESS and the expectations)
+    float_t sumexpnumer = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, m1);
+    m_lastLogCondLike = m1 + std::log(sumexpnumer) - m_logOldWtSum;
+    m_ess = kernels::ess(m_expWts.data(), nparts, sumexpnumer);
 
     // calculate expectations before you resample
     unsigned int fId(0);
@@ -953,17 +1746,12 @@ void rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     // m_logUnNormWeights.end());
     for (auto &h : fs) {
 
-      Mat testOutput = h(m_p_innerMods[0].getFilterVec(), m_p_samps[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
+      Mat numer = h(m_p_innerMods[0].getFilterVec(), m_p_samps[0]) *
+                  m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
         numer += h(m_p_innerMods[prtcl].getFilterVec(), m_p_samps[prtcl]) *
-                 std::exp(m_logUnNormWeights[prtcl] - m1);
-        denom += std::exp(m_logUnNormWeights[prtcl] - m1);
-      }
-      m_expectations[fId] = numer / denom;
+                 m_expWts[prtcl];
+      m_expectations[fId] = numer / sumexpnumer;
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
@@ -976,29 +1764,34 @@ void rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     }
 
     // resample (unnormalized weights ok)
-    if ((m_now + 1) % m_rs == 0)
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_rs == 0;
+    if (m_resampled) {
       m_resampler.resampLogWts(m_p_innerMods, m_p_samps, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = m1 + std::log(sumexpnumer);
+    }
 
     // update time step
     m_now++;
-  } else //( m_now == 0) // first data point coming
+  } else // ( m_now == 0) // first data point coming
   {
     // initialize and update the closed-form mods
     nsssv tmpMean;
     nsssMat tmpVar;
     float_t m1(-std::numeric_limits<float_t>::infinity());
     for (size_t ii = 0; ii < nparts; ++ii) {
-      m_p_samps[ii] = q1Samp(data);
-      tmpMean = initKalmanMean(m_p_samps[ii]);
-      tmpVar = initKalmanVar(m_p_samps[ii]);
+      m_p_samps[ii] = derived().muSamp(data);
+      tmpMean = derived().initKalmanMean(m_p_samps[ii]);
+      tmpVar = derived().initKalmanVar(m_p_samps[ii]);
       m_p_innerMods[ii] =
           cfModType(tmpMean, tmpVar); // TODO: allow for input or check to make
                                       // sure this doesn't break anything else
-      this->updateKalman(m_p_innerMods[ii], data, m_p_samps[ii]);
+      derived().updateKalman(m_p_innerMods[ii], data, m_p_samps[ii]);
 
-      m_logUnNormWeights[ii] = m_p_innerMods[ii].getLogCondLike() +
-                               logMuEv(m_p_samps[ii]) -
-                               logQ1Ev(m_p_samps[ii], data);
+      m_logUnNormWeights[ii] = m_p_innerMods[ii].getLogCondLike();
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
@@ -1014,11 +1807,11 @@ void rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     }
 
     // calculate log p(y1)
-    float_t sumexp(0.0);
-    for (size_t p = 0; p < nparts; ++p)
-      sumexp += std::exp(m_logUnNormWeights[p] - m1);
+    float_t sumexp = kernels::expShift(
+        m_logUnNormWeights.data(), m_expWts.data(), nparts, m1);
     m_lastLogCondLike =
         m1 + std::log(sumexp) - std::log(static_cast<float_t>(nparts));
+    m_ess = kernels::ess(m_expWts.data(), nparts, sumexp);
 
     // calculate expectations before you resample
     m_expectations.resize(fs.size());
@@ -1027,17 +1820,12 @@ void rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     // m_logUnNormWeights.end());
     for (auto &h : fs) {
 
-      Mat testOutput = h(m_p_innerMods[0].getFilterVec(), m_p_samps[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
+      Mat numer = h(m_p_innerMods[0].getFilterVec(), m_p_samps[0]) *
+                  m_expWts[0];
+      for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
         numer += h(m_p_innerMods[prtcl].getFilterVec(), m_p_samps[prtcl]) *
-                 std::exp(m_logUnNormWeights[prtcl] - m1);
-        denom += std::exp(m_logUnNormWeights[prtcl] - m1);
-      }
-      m_expectations[fId] = numer / denom;
+                 m_expWts[prtcl];
+      m_expectations[fId] = numer / sumexp;
 
 // print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
@@ -1050,29 +1838,65 @@ void rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::filter(
     }
 
     // resample (unnormalized weights ok)
-    if ((m_now + 1) % m_rs == 0)
+    m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                  : (m_now + 1) % m_rs == 0;
+    if (m_resampled) {
       m_resampler.resampLogWts(m_p_innerMods, m_p_samps, m_logUnNormWeights);
+      m_numResamps++;
+      m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+    } else {
+      m_logOldWtSum = m1 + std::log(sumexp);
+    }
 
     // advance time step
     m_now++;
   }
 }
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-float_t rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t,
-                    debug>::getLogCondLike() const {
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+float_t static_rbpf_kalman_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                              float_t, debug>::getLogCondLike() const {
   return m_lastLogCondLike;
 }
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-auto rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t,
-                 debug>::getExpectations() const -> std::vector<Mat> {
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+float_t static_rbpf_kalman_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                              float_t, debug>::getESS() const {
+  return m_ess;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+bool static_rbpf_kalman_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                           float_t, debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+unsigned int static_rbpf_kalman_bs<Derived, nparts, dimnss, dimss, dimy,
+                                   resamp_t, float_t,
+                                   debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+auto static_rbpf_kalman_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                           float_t,
+                           debug>::getExpectations() const -> std::vector<Mat> {
   return m_expectations;
 }
 
-//! Rao-Blackwellized/Marginal Bootstrap Filter with inner Kalman Filter
+template <typename Derived, size_t nparts, size_t dimnss, size_t dimss,
+          size_t dimy, typename resamp_t, typename float_t, bool debug>
+Derived &static_rbpf_kalman_bs<Derived, nparts, dimnss, dimss, dimy, resamp_t,
+                               float_t, debug>::derived() {
+  return static_cast<Derived &>(*this);
+}
+
 //! objectss
 /**
  * @class rbpf_kalman_bs
@@ -1088,7 +1912,15 @@ auto rbpf_kalman<nparts, dimnss, dimss, dimy, resamp_t, float_t,
  */
 template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
           typename resamp_t, typename float_t, bool debug = false>
-class rbpf_kalman_bs : public bases::rbpf_base<float_t, dimss, dimnss, dimy> {
+class rbpf_kalman_bs
+    : public static_rbpf_kalman_bs<
+          rbpf_kalman_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>,
+          nparts, dimnss, dimss, dimy, resamp_t, float_t, debug> {
+private:
+  /** the static base class that runs the filter */
+  using base_t =
+      static_rbpf_kalman_bs<rbpf_kalman_bs, nparts, dimnss, dimss, dimy,
+                            resamp_t, float_t, debug>;
 
 public:
   /** "sampled state size vector" */
@@ -1114,41 +1946,17 @@ public:
   /**
    \param resamp_sched how often you want to resample (e.g once every
    resamp_sched time points)
+   \param essFrac if positive, resamp_sched is ignored and the particles are
+   resampled whenever the effective sample size drops below essFrac * nparts
    */
-  rbpf_kalman_bs(const unsigned int &resamp_sched = 1);
+  rbpf_kalman_bs(const unsigned int &resamp_sched = 1,
+                 const float_t &essFrac = 0.0);
 
   /**
    * @brief The (virtual) destructor.
    */
   virtual ~rbpf_kalman_bs();
 
-  //! Filter!
-  /**
-   * \brief The workhorse function
-   * \param data the most recent observable portion of the time series.
-   * \param fs a vector of functions computing E[h(x_1t, x_2t^i)| x_2t^i,y_1:t].
-   * to be averaged to yield E[h(x_1t, x_2t)|,y_1:t]
-   */
-  void filter(
-      const osv &data,
-      const std::vector<
-          std::function<const Mat(const nsssv &x1t, const sssv &x2t)>> &fs =
-          std::vector<
-              std::function<const Mat(const nsssv &x1t, const sssv &x2t)>>());
-
-  //! Get the latest log conditional likelihood.
-  /**
-   * \return the latest log conditional likelihood.
-   */
-  float_t getLogCondLike() const;
-
-  //! Get the latest filtered expectation E[h(x_1t, x_2t) | y_{1:t}]
-  /**
-   * @brief Get the expectations you're keeping track of.
-   * @return a vector of Mats
-   */
-  std::vector<Mat> getExpectations() const;
-
   //! Sample from the first time's proposal distribution.
   /**
    * @brief samples the second component of the state at time 1.
@@ -1191,211 +1999,20 @@ public:
    */
   virtual void updateKalman(cfModType &kMod, const osv &yt,
                             const sssv &x2t) = 0;
-
-private:
-  /** the resamplign schedule */
-  unsigned int m_rs;
-  /** the array of inner Kalman filter objects */
-  arrayMod m_p_innerMods;
-  /** the array of particle samples */
-  arrayVec m_p_samps;
-  /** the array of the (log of) unnormalized weights */
-  arrayfloat_t m_logUnNormWeights;
-  /** the current time period */
-  unsigned int m_now;
-  /** log p(y_t|y_{1:t-1}) or log p(y1) */
-  float_t m_lastLogCondLike;
-  /** resampler object */
-  resamp_t m_resampler;
-  /** expectations */
-  std::vector<Mat> m_expectations;
 };
 
 template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
           typename resamp_t, typename float_t, bool debug>
 rbpf_kalman_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t,
-               debug>::rbpf_kalman_bs(const unsigned int &resamp_sched)
-    : m_now(0), m_lastLogCondLike(0.0), m_rs(resamp_sched) {
-  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
-}
+               debug>::rbpf_kalman_bs(const unsigned int &rs,
+                                      const float_t &essFrac)
+    : base_t(rs, essFrac) {}
 
 template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
           typename resamp_t, typename float_t, bool debug>
 rbpf_kalman_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t,
                debug>::~rbpf_kalman_bs() {}
 
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-void rbpf_kalman_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t, debug>::
-    filter(
-        const osv &data,
-        const std::vector<
-            std::function<const Mat(const nsssv &x1t, const sssv &x2t)>> &fs) {
-
-  if (m_now > 0) {
-
-    // update
-    sssv newX2Samp;
-    float_t m1(
-        -std::numeric_limits<float_t>::infinity()); // for updated weights
-    float_t m2 =
-        *std::max_element(m_logUnNormWeights.begin(), m_logUnNormWeights.end());
-    float_t sumexpdenom(0.0);
-    for (size_t ii = 0; ii < nparts; ++ii) {
-
-      newX2Samp = fSamp(m_p_samps[ii], data);
-      this->updateKalman(m_p_innerMods[ii], data, newX2Samp);
-
-      // before you update the weights
-      sumexpdenom += std::exp(m_logUnNormWeights[ii] - m2);
-
-      // update the weights
-      m_logUnNormWeights[ii] += m_p_innerMods[ii].getLogCondLike();
-
-// print stuff if debug mode is on
-#ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "time: " << m_now
-                  << ", transposed x2 sample: " << newX2Samp.transpose()
-                  << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
-#endif
-
-      // update a max
-      if (m_logUnNormWeights[ii] > m1)
-        m1 = m_logUnNormWeights[ii];
-
-      m_p_samps[ii] = newX2Samp;
-    }
-
-    // calc log p(y_t | y_{1:t-1})
-    float_t sumexpnumer(0.0);
-    for (size_t p = 0; p < nparts; ++p)
-      sumexpnumer += std::exp(m_logUnNormWeights[p] - m1);
-    m_lastLogCondLike = m1 + std::log(sumexpnumer) - m2 - std::log(sumexpdenom);
-
-    // calculate expectations before you resample
-    unsigned int fId(0);
-    // float_t m = *std::max_element(m_logUnNormWeights.begin(),
-    // m_logUnNormWeights.end());
-    for (auto &h : fs) {
-
-      Mat testOutput = h(m_p_innerMods[0].getFilterVec(), m_p_samps[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
-        numer += h(m_p_innerMods[prtcl].getFilterVec(), m_p_samps[prtcl]) *
-                 std::exp(m_logUnNormWeights[prtcl] - m1);
-        denom += std::exp(m_logUnNormWeights[prtcl] - m1);
-      }
-      m_expectations[fId] = numer / denom;
-
-// print stuff if debug mode is on
-#ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "transposed expec " << fId << ": "
-                  << m_expectations[fId].transpose() << "\n";
-#endif
-
-      fId++;
-    }
-
-    // resample (unnormalized weights ok)
-    if ((m_now + 1) % m_rs == 0)
-      m_resampler.resampLogWts(m_p_innerMods, m_p_samps, m_logUnNormWeights);
-
-    // update time step
-    m_now++;
-  } else // ( m_now == 0) // first data point coming
-  {
-    // initialize and update the closed-form mods
-    nsssv tmpMean;
-    nsssMat tmpVar;
-    float_t m1(-std::numeric_limits<float_t>::infinity());
-    for (size_t ii = 0; ii < nparts; ++ii) {
-      m_p_samps[ii] = muSamp(data);
-      tmpMean = initKalmanMean(m_p_samps[ii]);
-      tmpVar = initKalmanVar(m_p_samps[ii]);
-      m_p_innerMods[ii] =
-          cfModType(tmpMean, tmpVar); // TODO: allow for input or check to make
-                                      // sure this doesn't break anything else
-      this->updateKalman(m_p_innerMods[ii], data, m_p_samps[ii]);
-
-      m_logUnNormWeights[ii] = m_p_innerMods[ii].getLogCondLike();
-
-// print stuff if debug mode is on
-#ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "time: " << m_now
-                  << ", transposed x2 sample: " << m_p_samps[ii].transpose()
-                  << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
-#endif
-
-      // update a max
-      if (m_logUnNormWeights[ii] > m1)
-        m1 = m_logUnNormWeights[ii];
-    }
-
-    // calculate log p(y1)
-    float_t sumexp(0.0);
-    for (size_t p = 0; p < nparts; ++p)
-      sumexp += std::exp(m_logUnNormWeights[p] - m1);
-    m_lastLogCondLike =
-        m1 + std::log(sumexp) - std::log(static_cast<float_t>(nparts));
-
-    // calculate expectations before you resample
-    m_expectations.resize(fs.size());
-    unsigned int fId(0);
-    // float_t m = *std::max_element(m_logUnNormWeights.begin(),
-    // m_logUnNormWeights.end());
-    for (auto &h : fs) {
-
-      Mat testOutput = h(m_p_innerMods[0].getFilterVec(), m_p_samps[0]);
-      unsigned int rows = testOutput.rows();
-      unsigned int cols = testOutput.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
-        numer += h(m_p_innerMods[prtcl].getFilterVec(), m_p_samps[prtcl]) *
-                 std::exp(m_logUnNormWeights[prtcl] - m1);
-        denom += std::exp(m_logUnNormWeights[prtcl] - m1);
-      }
-      m_expectations[fId] = numer / denom;
-
-// print stuff if debug mode is on
-#ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "transposed expec " << fId << ": "
-                  << m_expectations[fId].transpose() << "\n";
-#endif
-
-      fId++;
-    }
-
-    // resample (unnormalized weights ok)
-    if ((m_now + 1) % m_rs == 0)
-      m_resampler.resampLogWts(m_p_innerMods, m_p_samps, m_logUnNormWeights);
-
-    // advance time step
-    m_now++;
-  }
-}
-
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-float_t rbpf_kalman_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t,
-                       debug>::getLogCondLike() const {
-  return m_lastLogCondLike;
-}
-
-template <size_t nparts, size_t dimnss, size_t dimss, size_t dimy,
-          typename resamp_t, typename float_t, bool debug>
-auto rbpf_kalman_bs<nparts, dimnss, dimss, dimy, resamp_t, float_t,
-                    debug>::getExpectations() const -> std::vector<Mat> {
-  return m_expectations;
-}
-
 } // namespace filters
 } // namespace pf
 
@@ -4,8 +4,11 @@
 #include <array>
 #include <chrono>
 #include <cmath>   //floor
+#include <cstdint> // uint32_t, uint64_t
+#include <limits>  // numeric_limits
 #include <numeric> // accumulate, partial_sum
 #include <random>
+#include <vector>
 
 #ifdef DROPPINGTHISINRPACKAGE
 #include <RcppEigen.h>
@@ -14,15 +17,57 @@
 #include <Eigen/Dense>
 #endif
 
-#include <algorithm> // sort
-#include <bitset>    // bitset
+#include <algorithm>   // copy, min, sort
+#include <bitset>      // bitset
+#include <type_traits> // conditional_t
+
+#ifdef __BMI2__
+#include <immintrin.h> // _pdep_u64
+#endif
 
 #include "rv_eval.h" // for rveval::evalUnivStdNormCDF<float_t>()
+#include "rv_samp.h" // for rvsamp::alias_sampler, rvsamp::counter_rng
+#include "thread_pool.h"
+#include "weight_kernels.h"
 
 namespace pf {
 
 namespace resamplers {
 
+/**
+ * @brief rearranges ancestor indexes so that resampling can happen in place.
+ * Every particle that has at least one offspring keeps its own slot
+ * (idx[j] = j), and its remaining offspring go to the slots of particles that
+ * have none. Afterwards, overwriting particle i with particle idx[i] for every
+ * i with idx[i] != i only ever reads particles that are never overwritten, so
+ * no temporary copy of the particles is needed and each particle is copied at
+ * most once. The multiset of ancestors does not change, only their order.
+ * @file resamplers.h
+ * @tparam nparts the number of particles
+ * @param idx the ancestor indexes (changed in place)
+ */
+template <size_t nparts>
+void arrangeAncestors(std::array<unsigned int, nparts> &idx) {
+
+  // count the offspring of every particle
+  std::array<unsigned int, nparts> counts{};
+  for (size_t i = 0; i < nparts; ++i)
+    counts[idx[i]]++;
+
+  // survivors stay put, extra offspring fill the empty slots
+  size_t empty = 0;
+  for (size_t j = 0; j < nparts; ++j) {
+    if (counts[j] == 0)
+      continue;
+    idx[j] = j;
+    for (unsigned int c = 1; c < counts[j]; ++c) {
+      while (counts[empty] > 0)
+        empty++;
+      idx[empty++] = j;
+    }
+  }
+}
+
 //! Base class for all resampler types.
 /**
  * @class rbase
@@ -43,6 +88,10 @@ public:
   using arrayVec = std::array<ssv, nparts>;
   /** type alias for array of float_ts */
   using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for array of integers */
+  using arrayInt = std::array<unsigned int, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
 
   /**
    * @brief The default constructor gets called by default, and it sets the seed
@@ -64,20 +113,85 @@ public:
   virtual void resampLogWts(arrayVec &oldParts,
                             arrayFloat &oldLogUnNormWts) = 0;
 
+  /**
+   * @brief the ancestors picked by the most recent resampling step: particle i
+   * is a copy of old particle getAncestors()[i].
+   * @return the ancestor indexes
+   */
+  const arrayInt &getAncestors() const;
+
+  /**
+   * @brief Reseeds the generator, e.g. so that a copy of a filter does not
+   * draw the same numbers as the filter it was copied from.
+   * @param seed the new seed
+   */
+  void seed(unsigned long seed);
+
 protected:
+  /**
+   * @brief overwrites particle i with old particle idx[i], in place. idx is
+   * rearranged first (see arrangeAncestors()), so it holds the ancestors of
+   * the rearranged particles afterwards.
+   * @param parts the particles
+   * @param idx the ancestor indexes
+   */
+  static void gatherParts(arrayVec &parts, arrayInt &idx);
+
+  /**
+   * @brief overwrites column i with old column idx[i], in place. idx is
+   * rearranged first (see arrangeAncestors()), so it holds the ancestors of
+   * the rearranged particles afterwards.
+   * @param parts the particles (one per column)
+   * @param idx the ancestor indexes
+   */
+  static void gatherParts(soaMat &parts, arrayInt &idx);
+
   /** @brief prng */
   std::mt19937 m_gen;
+
+  /** @brief ancestor indexes from the most recent resampling step */
+  arrayInt m_ancestors;
 };
 
+template <size_t nparts, size_t dimx, typename float_t>
+void rbase<nparts, dimx, float_t>::gatherParts(arrayVec &parts, arrayInt &idx) {
+  arrangeAncestors<nparts>(idx);
+  for (size_t i = 0; i < nparts; ++i)
+    if (idx[i] != i)
+      parts[i] = parts[idx[i]];
+}
+
+template <size_t nparts, size_t dimx, typename float_t>
+void rbase<nparts, dimx, float_t>::gatherParts(soaMat &parts, arrayInt &idx) {
+  arrangeAncestors<nparts>(idx);
+  for (size_t i = 0; i < nparts; ++i)
+    if (idx[i] != i)
+      parts.col(i) = parts.col(idx[i]);
+}
+
 template <size_t nparts, size_t dimx, typename float_t>
 rbase<nparts, dimx, float_t>::rbase()
     : m_gen{static_cast<std::uint32_t>(std::chrono::high_resolution_clock::now()
                                            .time_since_epoch()
-                                           .count())} {}
+                                           .count())} {
+  std::iota(m_ancestors.begin(), m_ancestors.end(), 0);
+}
 
 template <size_t nparts, size_t dimx, typename float_t>
 rbase<nparts, dimx, float_t>::rbase(unsigned long seed)
-    : m_gen{static_cast<std::uint32_t>(seed)} {}
+    : m_gen{static_cast<std::uint32_t>(seed)} {
+  std::iota(m_ancestors.begin(), m_ancestors.end(), 0);
+}
+
+template <size_t nparts, size_t dimx, typename float_t>
+auto rbase<nparts, dimx, float_t>::getAncestors() const -> const arrayInt & {
+  return m_ancestors;
+}
+
+template <size_t nparts, size_t dimx, typename float_t>
+void rbase<nparts, dimx, float_t>::seed(unsigned long seed) {
+  m_gen.seed(static_cast<std::uint32_t>(seed));
+}
 
 /**
  * @class mn_resampler
@@ -99,6 +213,8 @@ public:
   using arrayFloat = std::array<float_t, nparts>;
   /** type alias for array of integers */
   using arrayInt = std::array<unsigned int, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
 
   /**
    * @brief Default constructor.
@@ -117,6 +233,30 @@ public:
    * @param oldLogUnNormWts the old log unnormalized weights
    */
   void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /**
+   * @brief draws ancestor indexes from the log unnormalized weights.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   * @param idx where the ancestor indexes are written
+   */
+  void sampleIdx(arrayFloat &oldLogUnNormWts, arrayInt &idx);
+
+  /** @brief samples ancestor indexes */
+  rvsamp::alias_sampler<nparts, float_t> m_idxSampler;
 };
 
 template <size_t nparts, size_t dimx, typename float_t>
@@ -126,31 +266,33 @@ mn_resampler<nparts, dimx, float_t>::mn_resampler(unsigned long seed)
 template <size_t nparts, size_t dimx, typename float_t>
 void mn_resampler<nparts, dimx, float_t>::resampLogWts(
     arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t>
+void mn_resampler<nparts, dimx, float_t>::resampLogWts(
+    soaMat &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t>
+void mn_resampler<nparts, dimx, float_t>::sampleIdx(
+    arrayFloat &oldLogUnNormWts, arrayInt &idx) {
   // these log weights may be very negative. If that's the case, exponentiating
   // them may cause underflow so we use the "log-exp-sum" trick actually not
   // quite...we just shift the log-weights because after they're exponentiated
   // they have the same normalized probabilities
 
   // Create the distribution with exponentiated log-weights
-  arrayFloat w;
-  float_t m = *std::max_element(oldLogUnNormWts.begin(), oldLogUnNormWts.end());
-  std::transform(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), w.begin(),
-                 [&m](float_t &d) -> float_t { return std::exp(d - m); });
-  std::discrete_distribution<> idxSampler(w.begin(), w.end());
-
-  // create temporary particle vector and weight vector
-  arrayVec tmpPartics = oldParts;
-
-  // sample from the original parts and store in tmpParts
-  unsigned int whichPart;
-  for (size_t part = 0; part < nparts; ++part) {
-    whichPart = idxSampler(this->m_gen);
-    tmpPartics[part] = oldParts[whichPart];
-  }
+  m_idxSampler.setLogWeights(oldLogUnNormWts.data());
 
-  // overwrite olds with news
-  oldParts = std::move(tmpPartics);
-  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+  // sample from the original parts
+  for (size_t part = 0; part < nparts; ++part)
+    idx[part] = m_idxSampler.sample(this->m_gen);
 }
 
 /**
@@ -174,6 +316,8 @@ public:
   using arrayFloat = std::array<float_t, nparts>;
   /** type alias for array of closed-form models */
   using arrayMod = std::array<cfModT, nparts>;
+  /** type alias for array of integers */
+  using arrayInt = std::array<unsigned int, nparts>;
 
   /**
    * @brief Default constructor.
@@ -194,47 +338,63 @@ public:
   void resampLogWts(arrayMod &oldMods, arrayVec &oldParts,
                     arrayFloat &oldLogUnNormWts);
 
+  /**
+   * @brief the ancestors picked by the most recent resampling step: particle i
+   * is a copy of old particle getAncestors()[i].
+   * @return the ancestor indexes
+   */
+  const arrayInt &getAncestors() const;
+
 private:
   /** @brief prng */
   std::mt19937 m_gen;
+
+  /** @brief ancestor indexes from the most recent resampling step */
+  arrayInt m_ancestors;
+
+  /** @brief samples ancestor indexes */
+  rvsamp::alias_sampler<nparts, float_t> m_idxSampler;
 };
 
 template <size_t nparts, size_t dimsampledx, typename cfModT, typename float_t>
 mn_resampler_rbpf<nparts, dimsampledx, cfModT, float_t>::mn_resampler_rbpf()
     : m_gen{static_cast<std::uint32_t>(std::chrono::high_resolution_clock::now()
                                            .time_since_epoch()
-                                           .count())} {}
+                                           .count())} {
+  std::iota(m_ancestors.begin(), m_ancestors.end(), 0);
+}
 
 template <size_t nparts, size_t dimsampledx, typename cfModT, typename float_t>
 mn_resampler_rbpf<nparts, dimsampledx, cfModT, float_t>::mn_resampler_rbpf(
     unsigned long seed)
-    : m_gen{static_cast<std::uint32_t>(seed)} {}
+    : m_gen{static_cast<std::uint32_t>(seed)} {
+  std::iota(m_ancestors.begin(), m_ancestors.end(), 0);
+}
+
+template <size_t nparts, size_t dimsampledx, typename cfModT, typename float_t>
+auto mn_resampler_rbpf<nparts, dimsampledx, cfModT, float_t>::getAncestors()
+    const -> const arrayInt & {
+  return m_ancestors;
+}
 
 template <size_t nparts, size_t dimsampledx, typename cfModT, typename float_t>
 void mn_resampler_rbpf<nparts, dimsampledx, cfModT, float_t>::resampLogWts(
     arrayMod &oldMods, arrayVec &oldSamps, arrayFloat &oldLogUnNormWts) {
   // Create the distribution with exponentiated log-weights
-  arrayFloat w;
-  float_t m = *std::max_element(oldLogUnNormWts.begin(), oldLogUnNormWts.end());
-  std::transform(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), w.begin(),
-                 [&m](float_t &d) -> float_t { return std::exp(d - m); });
-  std::discrete_distribution<> idxSampler(w.begin(), w.end());
+  m_idxSampler.setLogWeights(oldLogUnNormWts.data());
 
-  // create temporary vectors for samps and mods
-  arrayVec tmpSamps;
-  arrayMod tmpMods;
+  // sample ancestor indexes
+  for (size_t part = 0; part < nparts; ++part)
+    m_ancestors[part] = m_idxSampler.sample(m_gen);
 
-  // sample from the original parts and store in temporary
-  unsigned int whichPart;
+  // overwrite olds with news in place (survivors stay where they are)
+  arrangeAncestors<nparts>(m_ancestors);
   for (size_t part = 0; part < nparts; ++part) {
-    whichPart = idxSampler(m_gen);
-    tmpSamps[part] = oldSamps[whichPart];
-    tmpMods[part] = oldMods[whichPart];
+    if (m_ancestors[part] != part) {
+      oldSamps[part] = oldSamps[m_ancestors[part]];
+      oldMods[part] = oldMods[m_ancestors[part]];
+    }
   }
-
-  // overwrite olds with news
-  oldMods = std::move(tmpMods);
-  oldSamps = std::move(tmpSamps);
   std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0);
 }
 
@@ -259,6 +419,8 @@ public:
   using arrayFloat = std::array<float_t, nparts>;
   /** type alias for array of integers */
   using arrayInt = std::array<unsigned int, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
 
   /**
    * @brief Default constructor.
@@ -277,6 +439,30 @@ public:
    * @param oldLogUnNormWts the old log unnormalized weights
    */
   void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /**
+   * @brief draws ancestor indexes from the log unnormalized weights.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   * @param idx where the ancestor indexes are written
+   */
+  void sampleIdx(arrayFloat &oldLogUnNormWts, arrayInt &idx);
+
+  /** @brief samples the indexes of the leftover particles */
+  rvsamp::alias_sampler<nparts, float_t> m_idxSampler;
 };
 
 template <size_t nparts, size_t dimx, typename float_t>
@@ -286,16 +472,26 @@ resid_resampler<nparts, dimx, float_t>::resid_resampler(unsigned long seed)
 template <size_t nparts, size_t dimx, typename float_t>
 void resid_resampler<nparts, dimx, float_t>::resampLogWts(
     arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t>
+void resid_resampler<nparts, dimx, float_t>::resampLogWts(
+    soaMat &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t>
+void resid_resampler<nparts, dimx, float_t>::sampleIdx(
+    arrayFloat &oldLogUnNormWts, arrayInt &idx) {
 
   // calculate normalized weights
   arrayFloat w;
-  float_t m = *std::max_element(oldLogUnNormWts.begin(), oldLogUnNormWts.end());
-  std::transform(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), w.begin(),
-                 [&m](const float_t &d) -> float_t { return std::exp(d - m); });
-  float_t norm_const(0.0);
-  norm_const = std::accumulate(w.begin(), w.end(), norm_const);
-  for (auto &weight : w)
-    weight = weight / norm_const;
+  kernels::normalizedWeights(oldLogUnNormWts.data(), w.data(), nparts);
 
   // calc unNormWBars and numRandomSamples (N-R using IIHMM notation)
   size_t i;
@@ -307,7 +503,7 @@ void resid_resampler<nparts, dimx, float_t>::resampLogWts(
   }
 
   // make multinomial distribution for residuals
-  std::discrete_distribution<> idxSampler(unNormWBar.begin(), unNormWBar.end());
+  m_idxSampler.setWeights(unNormWBar.data());
 
   // start resampling by producing a count vector
   arrayInt sampleCounts;
@@ -316,28 +512,154 @@ void resid_resampler<nparts, dimx, float_t>::resampLogWts(
         static_cast<unsigned int>(std::floor(nparts * w[i])); // initial
   }
   for (i = 0; i < static_cast<unsigned int>(numRandomSamples); ++i) {
-    sampleCounts[idxSampler(this->m_gen)]++;
+    sampleCounts[m_idxSampler.sample(this->m_gen)]++;
   }
 
-  // now resample the particles using the counts
-  arrayVec tmpPartics;
+  // now turn the counts into ancestor indexes
   unsigned int c(0);
   for (i = 0; i < nparts; ++i) { // over count container
     unsigned int num_replicants = sampleCounts[i];
-    if (num_replicants > 0) {
-      for (size_t j = 0; j < num_replicants;
-           ++j) { // assign the same thing several times
-        tmpPartics[c] = oldParts[i];
-        c++;
-      }
+    for (size_t j = 0; j < num_replicants;
+         ++j) { // assign the same thing several times
+      idx[c] = i;
+      c++;
     }
   }
+}
+
+/**
+ * @class resid_sys_resampler
+ * @author taylor
+ * @file resamplers.h
+ * @brief Class that performs residual-systematic resampling on "standard"
+ * models. Particle i gets floor(nparts * w_i) copies, and the residuals
+ * nparts * w_i - floor(nparts * w_i) are resampled systematically. Both
+ * stages happen in the same forward pass over the weights, which writes the
+ * ancestor indexes directly, so there is no count buffer and no second pass.
+ * Every particle ends up with either floor(nparts * w_i) or one more copy.
+ * @tparam nparts the number of particles.
+ * @tparam dimx the dimension of each state sample.
+ * @tparam float_t the floating point for samples
+ */
+template <size_t nparts, size_t dimx, typename float_t>
+class resid_sys_resampler : private rbase<nparts, dimx, float_t> {
+public:
+  /** type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** type alias for array of Eigen Matrices */
+  using arrayVec = std::array<ssv, nparts>;
+  /** type alias for array of float_ts */
+  using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for array of integers */
+  using arrayInt = std::array<unsigned int, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+
+  /**
+   * @brief Default constructor.
+   */
+  resid_sys_resampler() = default;
+
+  /**
+   * @brief Constructor that sets the seed.
+   * @param seed
+   */
+  resid_sys_resampler(unsigned long seed);
+
+  /**
+   * @brief resamples particles.
+   * @param oldParts the old particles
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /**
+   * @brief draws ancestor indexes from the log unnormalized weights.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   * @param idx where the ancestor indexes are written
+   */
+  void sampleIdx(arrayFloat &oldLogUnNormWts, arrayInt &idx);
+};
+
+template <size_t nparts, size_t dimx, typename float_t>
+resid_sys_resampler<nparts, dimx, float_t>::resid_sys_resampler(
+    unsigned long seed)
+    : rbase<nparts, dimx, float_t>(seed) {}
+
+template <size_t nparts, size_t dimx, typename float_t>
+void resid_sys_resampler<nparts, dimx, float_t>::resampLogWts(
+    arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
 
-  // overwrite olds with news
-  oldParts = std::move(tmpPartics);
+template <size_t nparts, size_t dimx, typename float_t>
+void resid_sys_resampler<nparts, dimx, float_t>::resampLogWts(
+    soaMat &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
   std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
 }
 
+template <size_t nparts, size_t dimx, typename float_t>
+void resid_sys_resampler<nparts, dimx, float_t>::sampleIdx(
+    arrayFloat &oldLogUnNormWts, arrayInt &idx) {
+
+  // calculate the (unnormalized) weights, scaled so they sum to nparts
+  arrayFloat w;
+  float_t total =
+      kernels::expShift(oldLogUnNormWts.data(), w.data(), nparts,
+                        kernels::max(oldLogUnNormWts.data(), nparts));
+  float_t scale = nparts / total;
+
+  // the residuals sum to the number of leftover draws, so the systematic Us
+  // are u0, u0 + 1, u0 + 2, ... on the scale of their running sum
+  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0);
+  float_t u = u_sampler(this->m_gen);
+  float_t residSum = 0.0;
+  size_t c = 0;
+  size_t last = 0;
+  for (size_t i = 0; i < nparts && c < nparts; ++i) {
+
+    // deterministic copies, then one more for every U the residual covers
+    float_t nw = w[i] * scale;
+    float_t copies = std::floor(nw);
+    residSum += nw - copies;
+    while (residSum > u) {
+      copies += 1.0;
+      u += 1.0;
+    }
+
+    // assign (rounding can't overfill the ancestor indexes)
+    size_t num_replicants =
+        std::min(static_cast<size_t>(copies), nparts - c);
+    for (size_t j = 0; j < num_replicants; ++j)
+      idx[c++] = i;
+    if (nw >= 1.0)
+      last = i;
+  }
+
+  // if rounding left any slots, give them to the last particle that had a
+  // deterministic copy (the heaviest one always does)
+  while (c < nparts)
+    idx[c++] = last;
+}
+
 /**
  * @class stratif_resampler
  * @author taylor
@@ -359,6 +681,8 @@ public:
   using arrayFloat = std::array<float_t, nparts>;
   /** type alias for array of integers */
   using arrayInt = std::array<unsigned int, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
 
   /**
    * @brief Default constructor.
@@ -377,6 +701,27 @@ public:
    * @param oldLogUnNormWts the old log unnormalized weights
    */
   void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /**
+   * @brief draws ancestor indexes from the log unnormalized weights.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   * @param idx where the ancestor indexes are written
+   */
+  void sampleIdx(arrayFloat &oldLogUnNormWts, arrayInt &idx);
 };
 
 template <size_t nparts, size_t dimx, typename float_t>
@@ -386,50 +731,48 @@ stratif_resampler<nparts, dimx, float_t>::stratif_resampler(unsigned long seed)
 template <size_t nparts, size_t dimx, typename float_t>
 void stratif_resampler<nparts, dimx, float_t>::resampLogWts(
     arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
 
-  // calculate normalized weights
-  arrayFloat w;
-  float_t m = *std::max_element(oldLogUnNormWts.begin(), oldLogUnNormWts.end());
-  std::transform(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), w.begin(),
-                 [&m](const float_t &d) -> float_t { return std::exp(d - m); });
-  float_t norm_const(0.0);
-  norm_const = std::accumulate(w.begin(), w.end(), norm_const);
-  for (auto &weight : w)
-    weight = weight / norm_const;
-
-  // calculate the cumulative sums of the weights
-  arrayFloat cumsums;
-  std::partial_sum(w.begin(), w.end(), cumsums.begin());
+template <size_t nparts, size_t dimx, typename float_t>
+void stratif_resampler<nparts, dimx, float_t>::resampLogWts(
+    soaMat &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
 
-  // samplethe Uis
-  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0 / nparts);
-  arrayFloat u_samples;
-  for (size_t i = 0; i < nparts; ++i) {
-    u_samples[i] = i / nparts + u_sampler(this->m_gen);
-  }
+template <size_t nparts, size_t dimx, typename float_t>
+void stratif_resampler<nparts, dimx, float_t>::sampleIdx(
+    arrayFloat &oldLogUnNormWts, arrayInt &idx) {
+
+  // calculate the cumulative sums of the (unnormalized) weights in place
+  arrayFloat cumsums;
+  kernels::expShift(oldLogUnNormWts.data(), cumsums.data(), nparts,
+                    kernels::max(oldLogUnNormWts.data(), nparts));
+  std::partial_sum(cumsums.begin(), cumsums.end(), cumsums.begin());
+  float_t total = cumsums[nparts - 1];
 
   // resample
-  arrayVec tmpPartics;
-  for (size_t i = 0; i < nparts; ++i) { // tmpPartics, Uis
+  // the ith U is uniform on [i/nparts, (i+1)/nparts), so the Us arrive sorted
+  // and one forward pass over the cumulative sums finds every index. Scaling
+  // the Us by the total instead of normalizing the weights saves a pass.
+  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0 / nparts);
+  unsigned int j = 0;
+  for (size_t i = 0; i < nparts; ++i) { // Uis
 
-    // find which index
-    unsigned int idx;
-    for (unsigned int j = 0; j < nparts; ++j) {
+    float_t u =
+        (static_cast<float_t>(i) / nparts + u_sampler(this->m_gen)) * total;
 
-      // get the first time it gets covered by a cumsum
-      if (cumsums[j] >= u_samples[i]) {
-        idx = j;
-        break;
-      }
-    }
+    // find which index (the last one if rounding leaves u uncovered)
+    while (j < nparts - 1 && cumsums[j] < u)
+      j++;
 
     // assign
-    tmpPartics[i] = oldParts[idx];
+    idx[i] = j;
   }
-
-  // overwrite olds with news
-  oldParts = std::move(tmpPartics);
-  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
 }
 
 /**
@@ -453,6 +796,8 @@ public:
   using arrayFloat = std::array<float_t, nparts>;
   /** type alias for array of integers */
   using arrayInt = std::array<unsigned int, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
 
   /**
    * @brief Default constructor.
@@ -471,6 +816,27 @@ public:
    * @param oldLogUnNormWts the old log unnormalized weights
    */
   void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /**
+   * @brief draws ancestor indexes from the log unnormalized weights.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   * @param idx where the ancestor indexes are written
+   */
+  void sampleIdx(arrayFloat &oldLogUnNormWts, arrayInt &idx);
 };
 
 template <size_t nparts, size_t dimx, typename float_t>
@@ -481,68 +847,74 @@ systematic_resampler<nparts, dimx, float_t>::systematic_resampler(
 template <size_t nparts, size_t dimx, typename float_t>
 void systematic_resampler<nparts, dimx, float_t>::resampLogWts(
     arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
 
-  // calculate normalized weights
-  arrayFloat w;
-  float_t m = *std::max_element(oldLogUnNormWts.begin(), oldLogUnNormWts.end());
-  std::transform(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), w.begin(),
-                 [&m](const float_t &d) -> float_t { return std::exp(d - m); });
-  float_t norm_const(0.0);
-  norm_const = std::accumulate(w.begin(), w.end(), norm_const);
-  for (auto &weight : w)
-    weight = weight / norm_const;
-
-  // calculate the cumulative sums of the weights
+template <size_t nparts, size_t dimx, typename float_t>
+void systematic_resampler<nparts, dimx, float_t>::resampLogWts(
+    soaMat &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t>
+void systematic_resampler<nparts, dimx, float_t>::sampleIdx(
+    arrayFloat &oldLogUnNormWts, arrayInt &idx) {
+
+  // calculate the cumulative sums of the (unnormalized) weights in place
   arrayFloat cumsums;
-  std::partial_sum(w.begin(), w.end(), cumsums.begin());
+  kernels::expShift(oldLogUnNormWts.data(), cumsums.data(), nparts,
+                    kernels::max(oldLogUnNormWts.data(), nparts));
+  std::partial_sum(cumsums.begin(), cumsums.end(), cumsums.begin());
+  float_t total = cumsums[nparts - 1];
 
-  // samplethe Uis
+  // sample the first U; the ith is U_0 + i/nparts, scaled by the total
   std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0 / nparts);
-  arrayFloat u_samples;
-  u_samples[0] = u_sampler(this->m_gen);
-  for (size_t i = 1; i < nparts; ++i) {
-    u_samples[i] = u_samples[i - 1] + 1.0 / nparts;
-  }
+  float_t u0 = u_sampler(this->m_gen);
 
   // resample
   // unlike stratified, take advantage of U's being sorted
-  arrayVec tmpPartics;
-  unsigned idx;
   unsigned int j = 0;
-  for (size_t i = 0; i < nparts; ++i) { // tmpPartics, Uis
+  for (size_t i = 0; i < nparts; ++i) { // Uis
 
-    // find which index
-    while (j < nparts) {
-
-      // get the first time it gets covered by a cumsum
-      if (cumsums[j] >= u_samples[i]) {
-        idx = j;
-        break;
-      }
+    float_t u = (static_cast<float_t>(i) / nparts + u0) * total;
 
+    // find which index (the last one if rounding leaves u uncovered)
+    while (j < nparts - 1 && cumsums[j] < u)
       j++;
-    }
 
     // assign
-    tmpPartics[i] = oldParts[idx];
+    idx[i] = j;
   }
-
-  // overwrite olds with news
-  oldParts = std::move(tmpPartics);
-  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
 }
 
+//! Base class for resamplers that split their work across threads.
 /**
- * @class mn_resamp_fast1
+ * @class rbase_mt
  * @author taylor
  * @file resamplers.h
- * @brief Class that performs multinomial resampling for "standard" models.
- * For justification, see page 244 of "Inference in Hidden Markov Models"
+ * @brief Every pass of systematic or stratified resampling is spread over a
+ * pool of threads, each of which owns one contiguous block of particles. The
+ * cumulative sums are a blocked prefix sum: each thread scans its own block,
+ * the block totals are scanned once, and each thread then adds the total of
+ * the blocks before it to its own. Each thread then binary searches for the
+ * ancestor of the first output particle in its block, merges forward for the
+ * rest, and finally copies its own block of particles. The uniforms, the
+ * comparisons and the in-place copying are the same as in the one-thread
+ * resamplers, so with the same seed the ancestors are the same as theirs
+ * whenever the two ways of summing the weights round the same way (e.g.
+ * always for equal weights). Otherwise they can only differ for a uniform
+ * that lands within rounding error of a cumulative sum.
  * @tparam nparts the number of particles.
  * @tparam dimx the dimension of each state sample.
+ * @tparam float_t the floating point for samples
+ * @tparam nthreads the number of threads (including the calling thread)
  */
-template <size_t nparts, size_t dimx, typename float_t>
-class mn_resamp_fast1 : private rbase<nparts, dimx, float_t> {
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+class rbase_mt : public rbase<nparts, dimx, float_t> {
 public:
   /** type alias for linear algebra stuff */
   using ssv = Eigen::Matrix<float_t, dimx, 1>;
@@ -552,95 +924,1527 @@ public:
   using arrayFloat = std::array<float_t, nparts>;
   /** type alias for array of integers */
   using arrayInt = std::array<unsigned int, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+
+  static_assert(nthreads > 0, "need at least one thread");
 
   /**
-   * @brief Default constructor.
+   * @brief The default constructor sets the seed with the clock.
    */
-  mn_resamp_fast1() = default;
+  rbase_mt();
 
   /**
-   * @brief Default constructor.
+   * @brief The constructor that sets the seed deterministically.
+   * @param seed the seed
    */
-  mn_resamp_fast1(unsigned long seed);
+  rbase_mt(unsigned long seed);
 
+protected:
   /**
-   * @brief resamples particles.
-   * @param oldParts the old particles
-   * @param oldLogUnNormWts the old log unnormalized weights
+   * @brief fills m_cumsums with the cumulative sums of the exponentiated,
+   * shifted log weights.
+   * @param logWts the log unnormalized weights
+   * @return the sum of all of the shifted weights
    */
-  void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+  float_t cumsumWeights(const arrayFloat &logWts);
+
+  /**
+   * @brief finds the ancestor of every output particle and writes it to
+   * m_ancestors. Output particle i descends from the first particle whose
+   * cumulative sum covers unif(i) * total.
+   * @param unif the ith sorted uniform on [0, 1) is unif(i)
+   * @param total what cumsumWeights() returned
+   */
+  template <typename unif_t> void searchIdx(const unif_t &unif, float_t total);
+
+  /**
+   * @brief overwrites particle i with old particle m_ancestors[i], in place.
+   * m_ancestors is rearranged first (see arrangeAncestors()), then each
+   * thread copies its own block.
+   * @param parts the particles
+   */
+  void gatherParts(arrayVec &parts);
+
+  /**
+   * @brief overwrites column i with old column m_ancestors[i], in place.
+   * m_ancestors is rearranged first (see arrangeAncestors()), then each
+   * thread copies its own block.
+   * @param parts the particles (one per column)
+   */
+  void gatherParts(soaMat &parts);
+
+  /** @brief cumulative sums of the shifted weights */
+  arrayFloat m_cumsums;
+
+  /** @brief per-block scratch (largest log weight, then block totals) */
+  std::array<float_t, nthreads> m_blockVals;
+
+  /** @brief the worker threads */
+  parallel::thread_pool m_pool;
+};
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+rbase_mt<nparts, dimx, float_t, nthreads>::rbase_mt()
+    : rbase<nparts, dimx, float_t>(), m_pool(nthreads) {}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+rbase_mt<nparts, dimx, float_t, nthreads>::rbase_mt(unsigned long seed)
+    : rbase<nparts, dimx, float_t>(seed), m_pool(nthreads) {}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+float_t rbase_mt<nparts, dimx, float_t, nthreads>::cumsumWeights(
+    const arrayFloat &logWts) {
+
+  // the largest log weight of each block, then of them all
+  m_pool.run([this, &logWts](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    m_blockVals[tid] = -std::numeric_limits<float_t>::infinity();
+    if (range.second > range.first)
+      m_blockVals[tid] = kernels::max(logWts.data() + range.first,
+                                      range.second - range.first);
+  });
+  float_t m = *std::max_element(m_blockVals.begin(), m_blockVals.end());
+
+  // exponentiate and scan each block
+  m_pool.run([this, &logWts, m](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    m_blockVals[tid] = 0.0;
+    if (range.second > range.first) {
+      float_t *c = m_cumsums.data();
+      kernels::expShift(logWts.data() + range.first, c + range.first,
+                        range.second - range.first, m);
+      std::partial_sum(c + range.first, c + range.second, c + range.first);
+      m_blockVals[tid] = c[range.second - 1];
+    }
+  });
+
+  // scan the block totals, so each holds the total of the blocks before it
+  float_t total = 0.0;
+  for (size_t b = 0; b < nthreads; ++b) {
+    float_t blockTotal = m_blockVals[b];
+    m_blockVals[b] = total;
+    total += blockTotal;
+  }
+
+  // shift every block by that
+  m_pool.run([this](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    for (size_t i = range.first; i < range.second; ++i)
+      m_cumsums[i] += m_blockVals[tid];
+  });
+  return m_cumsums[nparts - 1];
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+template <typename unif_t>
+void rbase_mt<nparts, dimx, float_t, nthreads>::searchIdx(const unif_t &unif,
+                                                          float_t total) {
+  m_pool.run([this, &unif, total](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    if (range.second == range.first)
+      return;
+
+    // binary search for the first U in the block (the last particle if
+    // rounding leaves it uncovered)...
+    const float_t *c = m_cumsums.data();
+    float_t u = unif(range.first) * total;
+    unsigned int j = std::lower_bound(c, c + nparts - 1, u) - c;
+
+    // ...then merge forward, exactly like the one-thread resamplers
+    for (size_t i = range.first; i < range.second; ++i) {
+      u = unif(i) * total;
+      while (j < nparts - 1 && c[j] < u)
+        j++;
+      this->m_ancestors[i] = j;
+    }
+  });
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+void rbase_mt<nparts, dimx, float_t, nthreads>::gatherParts(arrayVec &parts) {
+  arrangeAncestors<nparts>(this->m_ancestors);
+  m_pool.run([this, &parts](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    for (size_t i = range.first; i < range.second; ++i)
+      if (this->m_ancestors[i] != i)
+        parts[i] = parts[this->m_ancestors[i]];
+  });
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+void rbase_mt<nparts, dimx, float_t, nthreads>::gatherParts(soaMat &parts) {
+  arrangeAncestors<nparts>(this->m_ancestors);
+  m_pool.run([this, &parts](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    for (size_t i = range.first; i < range.second; ++i)
+      if (this->m_ancestors[i] != i)
+        parts.col(i) = parts.col(this->m_ancestors[i]);
+  });
+}
+
+/**
+ * @class systematic_resampler_mt
+ * @author taylor
+ * @file resamplers.h
+ * @brief Class that performs systematic resampling on "standard" models with
+ * several threads (see rbase_mt). It draws the same uniform as
+ * systematic_resampler, so for the same seed the two pick the same ancestors
+ * up to rounding in the cumulative sums.
+ * @tparam nparts the number of particles.
+ * @tparam dimx the dimension of each state sample.
+ * @tparam float_t the floating point for samples
+ * @tparam nthreads the number of threads (including the calling thread)
+ */
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+class systematic_resampler_mt
+    : private rbase_mt<nparts, dimx, float_t, nthreads> {
+public:
+  /** type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** type alias for array of Eigen Matrices */
+  using arrayVec = std::array<ssv, nparts>;
+  /** type alias for array of float_ts */
+  using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+
+  /**
+   * @brief Default constructor.
+   */
+  systematic_resampler_mt() = default;
+
+  /**
+   * @brief Constructor that sets the seed.
+   * @param seed
+   */
+  systematic_resampler_mt(unsigned long seed);
+
+  /**
+   * @brief resamples particles.
+   * @param oldParts the old particles
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /**
+   * @brief draws ancestor indexes from the log unnormalized weights.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void sampleIdx(arrayFloat &oldLogUnNormWts);
+};
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+systematic_resampler_mt<nparts, dimx, float_t,
+                        nthreads>::systematic_resampler_mt(unsigned long seed)
+    : rbase_mt<nparts, dimx, float_t, nthreads>(seed) {}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+void systematic_resampler_mt<nparts, dimx, float_t, nthreads>::resampLogWts(
+    arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts);
+  this->gatherParts(oldParts);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+void systematic_resampler_mt<nparts, dimx, float_t, nthreads>::resampLogWts(
+    soaMat &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts);
+  this->gatherParts(oldParts);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+void systematic_resampler_mt<nparts, dimx, float_t, nthreads>::sampleIdx(
+    arrayFloat &oldLogUnNormWts) {
+  float_t total = this->cumsumWeights(oldLogUnNormWts);
+  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0 / nparts);
+  float_t u0 = u_sampler(this->m_gen);
+  this->searchIdx(
+      [u0](size_t i) { return static_cast<float_t>(i) / nparts + u0; },
+      total);
+}
+
+/**
+ * @class stratif_resampler_mt
+ * @author taylor
+ * @file resamplers.h
+ * @brief Class that performs stratified resampling on "standard" models with
+ * several threads (see rbase_mt). The uniforms come from one generator, in
+ * the same order as in stratif_resampler, so for the same seed the two pick
+ * the same ancestors up to rounding in the cumulative sums. Drawing them is
+ * the only pass that is not split across threads.
+ * @tparam nparts the number of particles.
+ * @tparam dimx the dimension of each state sample.
+ * @tparam float_t the floating point for samples
+ * @tparam nthreads the number of threads (including the calling thread)
+ */
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+class stratif_resampler_mt : private rbase_mt<nparts, dimx, float_t, nthreads> {
+public:
+  /** type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** type alias for array of Eigen Matrices */
+  using arrayVec = std::array<ssv, nparts>;
+  /** type alias for array of float_ts */
+  using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+
+  /**
+   * @brief Default constructor.
+   */
+  stratif_resampler_mt() = default;
+
+  /**
+   * @brief Constructor that sets the seed.
+   * @param seed
+   */
+  stratif_resampler_mt(unsigned long seed);
+
+  /**
+   * @brief resamples particles.
+   * @param oldParts the old particles
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /**
+   * @brief draws ancestor indexes from the log unnormalized weights.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void sampleIdx(arrayFloat &oldLogUnNormWts);
+
+  /** @brief the sorted uniforms */
+  arrayFloat m_us;
+};
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+stratif_resampler_mt<nparts, dimx, float_t, nthreads>::stratif_resampler_mt(
+    unsigned long seed)
+    : rbase_mt<nparts, dimx, float_t, nthreads>(seed) {}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+void stratif_resampler_mt<nparts, dimx, float_t, nthreads>::resampLogWts(
+    arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts);
+  this->gatherParts(oldParts);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+void stratif_resampler_mt<nparts, dimx, float_t, nthreads>::resampLogWts(
+    soaMat &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts);
+  this->gatherParts(oldParts);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+void stratif_resampler_mt<nparts, dimx, float_t, nthreads>::sampleIdx(
+    arrayFloat &oldLogUnNormWts) {
+  float_t total = this->cumsumWeights(oldLogUnNormWts);
+  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0 / nparts);
+  for (size_t i = 0; i < nparts; ++i)
+    m_us[i] = static_cast<float_t>(i) / nparts + u_sampler(this->m_gen);
+  this->searchIdx([this](size_t i) { return m_us[i]; }, total);
+}
+
+/**
+ * @class mn_resamp_fast1
+ * @author taylor
+ * @file resamplers.h
+ * @brief Class that performs multinomial resampling for "standard" models.
+ * For justification, see page 244 of "Inference in Hidden Markov Models"
+ * @tparam nparts the number of particles.
+ * @tparam dimx the dimension of each state sample.
+ */
+template <size_t nparts, size_t dimx, typename float_t>
+class mn_resamp_fast1 : private rbase<nparts, dimx, float_t> {
+public:
+  /** type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** type alias for array of Eigen Matrices */
+  using arrayVec = std::array<ssv, nparts>;
+  /** type alias for array of float_ts */
+  using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for array of integers */
+  using arrayInt = std::array<unsigned int, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+
+  /**
+   * @brief Default constructor.
+   */
+  mn_resamp_fast1() = default;
+
+  /**
+   * @brief Default constructor.
+   */
+  mn_resamp_fast1(unsigned long seed);
+
+  /**
+   * @brief resamples particles.
+   * @param oldParts the old particles
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /**
+   * @brief draws ancestor indexes from the log unnormalized weights.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   * @param idx where the ancestor indexes are written
+   */
+  void sampleIdx(arrayFloat &oldLogUnNormWts, arrayInt &idx);
+};
+
+template <size_t nparts, size_t dimx, typename float_t>
+mn_resamp_fast1<nparts, dimx, float_t>::mn_resamp_fast1(unsigned long seed)
+    : rbase<nparts, dimx, float_t>(seed) {}
+
+template <size_t nparts, size_t dimx, typename float_t>
+void mn_resamp_fast1<nparts, dimx, float_t>::resampLogWts(
+    arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t>
+void mn_resamp_fast1<nparts, dimx, float_t>::resampLogWts(
+    soaMat &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts, this->m_ancestors);
+  this->gatherParts(oldParts, this->m_ancestors);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t>
+void mn_resamp_fast1<nparts, dimx, float_t>::sampleIdx(
+    arrayFloat &oldLogUnNormWts, arrayInt &idx) {
+  // these log weights may be very negative. If that's the case, exponentiating
+  // them may cause underflow so we use the "log-exp-sum" trick actually not
+  // quite...we just shift the log-weights because after they're exponentiated
+  // they have the same normalized probabilities
+
+  // Also, we're using a fancier algorthm detailed on page 244 of IHMM
+
+  // Create unnormalized weights (and their normalizing constant)
+  arrayFloat unnorm_weights;
+  float_t weight_norm_const =
+      kernels::expShift(oldLogUnNormWts.data(), unnorm_weights.data(), nparts,
+                        kernels::max(oldLogUnNormWts.data(), nparts));
+
+  // get a uniform rv sampler
+  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0);
+
+  // generate all these exponentials to help with getting order statistics
+  // NB: you never need to store E_{N+1}! (this is subtle)
+  arrayFloat exponentials;
+  float_t G(0.0);
+  for (size_t i = 0; i < nparts; ++i) {
+    exponentials[i] = -std::log(u_sampler(this->m_gen));
+    G += exponentials[i];
+  }
+  G -= std::log(u_sampler(this->m_gen)); // E_{N+1}
+
+  // see Fig 7.15 in IHMM on page 243
+  float_t uniform_order_stat(0.0); // U_{(i)} in the notation of IHMM
+  float_t running_sum_normalized_weights(
+      unnorm_weights[0] /
+      weight_norm_const); // \sum_{j=1}^I \omega^j in the notation of IHMM
+  float_t one_less_summand(0.0); // \sum_{j=1}^{I-1} \omega^j
+  unsigned int which = 0;
+  for (size_t i = 0; i < nparts; ++i) {
+    uniform_order_stat += exponentials[i] / G; // add a spacing E_i/G
+    do {
+      if ((one_less_summand < uniform_order_stat) &&
+          (uniform_order_stat <= running_sum_normalized_weights)) {
+        // select index which
+        idx[i] = which;
+        break;
+      } else {
+        // increment idx because it will never be chosen (all the other order
+        // statistics are even higher)
+        which++;
+        running_sum_normalized_weights +=
+            unnorm_weights[which] / weight_norm_const;
+        one_less_summand += unnorm_weights[which - 1] / weight_norm_const;
+      }
+    } while (true);
+  }
+}
+
+/**
+ * @class metropolis_resampler
+ * @author taylor
+ * @file resamplers.h
+ * @brief Class that performs Metropolis resampling on "standard" models (see
+ * Murray, Lee and Jacob, "Parallel resampling in the particle filter", 2016).
+ * Each offspring starts at its own index and takes nsteps Metropolis steps
+ * over ancestor indexes, proposing uniformly and accepting with probability
+ * min(1, w_j / w_k). Only ratios of weights are used, so there is no
+ * normalizing constant or cumulative sum, and every offspring is drawn
+ * independently of the others: the offspring are split across nthreads
+ * threads, and offspring i draws from its own counter_rng stream, so for a
+ * given seed the ancestors are the same for any nthreads. The result is
+ * biased when nsteps is too small for the chain to mix; Murray et al. suggest
+ * nsteps >= log(eps) / log(1 - mean(w) / max(w)) for a bias of about eps.
+ * @tparam nparts the number of particles.
+ * @tparam dimx the dimension of each state sample.
+ * @tparam float_t the floating point for samples
+ * @tparam nsteps the number of Metropolis steps per offspring (B)
+ * @tparam nthreads the number of threads (including the calling thread)
+ */
+template <size_t nparts, size_t dimx, typename float_t, size_t nsteps = 32,
+          size_t nthreads = 1>
+class metropolis_resampler
+    : private rbase_mt<nparts, dimx, float_t, nthreads> {
+public:
+  /** type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** type alias for array of Eigen Matrices */
+  using arrayVec = std::array<ssv, nparts>;
+  /** type alias for array of float_ts */
+  using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for array of integers */
+  using arrayInt = std::array<unsigned int, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+
+  /**
+   * @brief Default constructor.
+   */
+  metropolis_resampler() = default;
+
+  /**
+   * @brief Constructor that sets the seed.
+   * @param seed
+   */
+  metropolis_resampler(unsigned long seed);
+
+  /**
+   * @brief resamples particles.
+   * @param oldParts the old particles
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /**
+   * @brief draws ancestor indexes from the log unnormalized weights into
+   * m_ancestors.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void sampleIdx(arrayFloat &oldLogUnNormWts);
+};
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nsteps,
+          size_t nthreads>
+metropolis_resampler<nparts, dimx, float_t, nsteps,
+                     nthreads>::metropolis_resampler(unsigned long seed)
+    : rbase_mt<nparts, dimx, float_t, nthreads>(seed) {}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nsteps,
+          size_t nthreads>
+void metropolis_resampler<nparts, dimx, float_t, nsteps,
+                          nthreads>::resampLogWts(arrayVec &oldParts,
+                                                  arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts);
+  this->gatherParts(oldParts);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nsteps,
+          size_t nthreads>
+void metropolis_resampler<nparts, dimx, float_t, nsteps,
+                          nthreads>::resampLogWts(soaMat &oldParts,
+                                                  arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts);
+  this->gatherParts(oldParts);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nsteps,
+          size_t nthreads>
+void metropolis_resampler<nparts, dimx, float_t, nsteps, nthreads>::sampleIdx(
+    arrayFloat &oldLogUnNormWts) {
+  const float_t *logWts = oldLogUnNormWts.data();
+
+  // one key per call; offspring i uses stream i
+  std::uint64_t key = (std::uint64_t(this->m_gen()) << 32) | this->m_gen();
+
+  // accept j over k when log w_j - log w_k >= log U, and -log U ~ Exp(1)
+  this->m_pool.run([this, logWts, key](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    for (size_t i = range.first; i < range.second; ++i) {
+      rvsamp::counter_rng gen(key, i);
+      unsigned int k = i;
+      for (size_t b = 0; b < nsteps; ++b) {
+        unsigned int j = std::min(static_cast<size_t>(gen.unif() * nparts),
+                                  nparts - 1);
+        float_t logRatio = logWts[j] - logWts[k];
+        if (logRatio >= 0.0 || -logRatio <= -std::log1p(-gen.unif()))
+          k = j;
+      }
+      this->m_ancestors[i] = k;
+    }
+  });
+}
+
+/**
+ * @class rejection_resampler
+ * @author taylor
+ * @file resamplers.h
+ * @brief Class that performs rejection resampling on "standard" models (see
+ * Murray, Lee and Jacob, "Parallel resampling in the particle filter", 2016).
+ * Each offspring first proposes its own index, then uniformly drawn indexes,
+ * until one is accepted with probability w_j / max(w). The largest weight is
+ * the only quantity shared by all offspring, so there is no cumulative sum,
+ * and every offspring is drawn independently of the others: the offspring are
+ * split across nthreads threads, and offspring i draws from its own
+ * counter_rng stream, so for a given seed the ancestors are the same for any
+ * nthreads. The result is unbiased, but the expected number of proposals per
+ * offspring is max(w) / mean(w), which grows with the skewness of the
+ * weights.
+ * @tparam nparts the number of particles.
+ * @tparam dimx the dimension of each state sample.
+ * @tparam float_t the floating point for samples
+ * @tparam nthreads the number of threads (including the calling thread)
+ */
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads = 1>
+class rejection_resampler
+    : private rbase_mt<nparts, dimx, float_t, nthreads> {
+public:
+  /** type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** type alias for array of Eigen Matrices */
+  using arrayVec = std::array<ssv, nparts>;
+  /** type alias for array of float_ts */
+  using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for array of integers */
+  using arrayInt = std::array<unsigned int, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+
+  /**
+   * @brief Default constructor.
+   */
+  rejection_resampler() = default;
+
+  /**
+   * @brief Constructor that sets the seed.
+   * @param seed
+   */
+  rejection_resampler(unsigned long seed);
+
+  /**
+   * @brief resamples particles.
+   * @param oldParts the old particles
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /**
+   * @brief draws ancestor indexes from the log unnormalized weights into
+   * m_ancestors.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void sampleIdx(arrayFloat &oldLogUnNormWts);
+};
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+rejection_resampler<nparts, dimx, float_t, nthreads>::rejection_resampler(
+    unsigned long seed)
+    : rbase_mt<nparts, dimx, float_t, nthreads>(seed) {}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+void rejection_resampler<nparts, dimx, float_t, nthreads>::resampLogWts(
+    arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts);
+  this->gatherParts(oldParts);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+void rejection_resampler<nparts, dimx, float_t, nthreads>::resampLogWts(
+    soaMat &oldParts, arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts);
+  this->gatherParts(oldParts);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads>
+void rejection_resampler<nparts, dimx, float_t, nthreads>::sampleIdx(
+    arrayFloat &oldLogUnNormWts) {
+  const float_t *logWts = oldLogUnNormWts.data();
+  float_t logMax = kernels::max(logWts, nparts);
+
+  // one key per call; offspring i uses stream i
+  std::uint64_t key = (std::uint64_t(this->m_gen()) << 32) | this->m_gen();
+
+  // accept j when log w_j - max log w >= log U, and -log U ~ Exp(1)
+  this->m_pool.run([this, logWts, logMax, key](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    for (size_t i = range.first; i < range.second; ++i) {
+      rvsamp::counter_rng gen(key, i);
+      unsigned int j = i;
+      while (logWts[j] < logMax &&
+             logMax - logWts[j] > -std::log1p(-gen.unif()))
+        j = std::min(static_cast<size_t>(gen.unif() * nparts), nparts - 1);
+      this->m_ancestors[i] = j;
+    }
+  });
+}
+
+/**
+ * @class log_mn_resampler_mt
+ * @author taylor
+ * @file resamplers.h
+ * @brief Class that performs multinomial resampling on "standard" models
+ * straight from the log weights, with several threads. Every offspring is
+ * drawn on its own, from its own counter_rng stream, by rejection sampling in
+ * the log domain: propose j uniformly and accept it when
+ * max log w - log w_j <= E, E ~ Exp(1). The weights are never exponentiated
+ * and never summed, and only their maximum is shared between threads. An
+ * offspring whose max_tries proposals are all rejected (typical when a few
+ * particles carry most of the weight) is drawn exactly instead, from an alias
+ * table of the shifted weights (in double precision) that is only built when
+ * some offspring needs it. Either way each offspring has exactly the
+ * multinomial distribution, and because the streams don't depend on the
+ * threads, for a given seed the ancestors are the same for any nthreads.
+ * @tparam nparts the number of particles.
+ * @tparam dimx the dimension of each state sample.
+ * @tparam float_t the floating point for samples
+ * @tparam nthreads the number of threads (including the calling thread)
+ * @tparam max_tries the number of proposals before an offspring is drawn
+ * exactly
+ */
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads = 1,
+          size_t max_tries = 4>
+class log_mn_resampler_mt
+    : private rbase_mt<nparts, dimx, float_t, nthreads> {
+public:
+  /** type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** type alias for array of Eigen Matrices */
+  using arrayVec = std::array<ssv, nparts>;
+  /** type alias for array of float_ts */
+  using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+
+  static_assert(max_tries > 0, "need at least one proposal");
+
+  /**
+   * @brief Default constructor.
+   */
+  log_mn_resampler_mt() = default;
+
+  /**
+   * @brief Constructor that sets the seed.
+   * @param seed
+   */
+  log_mn_resampler_mt(unsigned long seed);
+
+  /**
+   * @brief resamples particles.
+   * @param oldParts the old particles
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /**
+   * @brief draws ancestor indexes from the log unnormalized weights.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void sampleIdx(arrayFloat &oldLogUnNormWts);
+
+  /** @brief the shifted weights (only computed if needed) */
+  std::array<double, nparts> m_shiftedWts;
+
+  /** @brief draws the offspring that rejection sampling gave up on */
+  rvsamp::alias_sampler<nparts, double> m_exactSampler;
+};
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads,
+          size_t max_tries>
+log_mn_resampler_mt<nparts, dimx, float_t, nthreads,
+                    max_tries>::log_mn_resampler_mt(unsigned long seed)
+    : rbase_mt<nparts, dimx, float_t, nthreads>(seed) {}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads,
+          size_t max_tries>
+void log_mn_resampler_mt<nparts, dimx, float_t, nthreads,
+                         max_tries>::resampLogWts(arrayVec &oldParts,
+                                                  arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts);
+  this->gatherParts(oldParts);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads,
+          size_t max_tries>
+void log_mn_resampler_mt<nparts, dimx, float_t, nthreads,
+                         max_tries>::resampLogWts(soaMat &oldParts,
+                                                  arrayFloat &oldLogUnNormWts) {
+  sampleIdx(oldLogUnNormWts);
+  this->gatherParts(oldParts);
+  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nthreads,
+          size_t max_tries>
+void log_mn_resampler_mt<nparts, dimx, float_t, nthreads,
+                         max_tries>::sampleIdx(arrayFloat &oldLogUnNormWts) {
+  const float_t *logWts = oldLogUnNormWts.data();
+  float_t logMax = kernels::max(logWts, nparts);
+
+  // one key per call; offspring i uses stream i
+  std::uint64_t key = (std::uint64_t(this->m_gen()) << 32) | this->m_gen();
+
+  // rejection sampling, marking offspring that run out of proposals with
+  // nparts. Each proposal uses two outputs of the stream.
+  std::array<size_t, nthreads> numLeft{};
+  this->m_pool.run([this, logWts, logMax, key, &numLeft](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    for (size_t i = range.first; i < range.second; ++i) {
+      rvsamp::counter_rng gen(key, i);
+      unsigned int idx = nparts;
+      for (size_t t = 0; t < max_tries; ++t) {
+        size_t j = std::min(static_cast<size_t>(gen.unif() * nparts),
+                            nparts - 1);
+        double e = -std::log1p(-gen.unif());
+        if (logMax - logWts[j] <= e) {
+          idx = j;
+          break;
+        }
+      }
+      this->m_ancestors[i] = idx;
+      if (idx == nparts)
+        numLeft[tid]++;
+    }
+  });
+  if (std::accumulate(numLeft.begin(), numLeft.end(), size_t(0)) == 0)
+    return;
+
+  // an alias table of the shifted weights, which the leftover offspring draw
+  // from with the rest of their streams
+  this->m_pool.run([this, logWts, logMax](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    for (size_t i = range.first; i < range.second; ++i)
+      m_shiftedWts[i] = std::exp(static_cast<double>(logWts[i]) - logMax);
+  });
+  m_exactSampler.setWeights(m_shiftedWts.data());
+  this->m_pool.run([this, key](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    for (size_t i = range.first; i < range.second; ++i) {
+      if (this->m_ancestors[i] != nparts)
+        continue;
+      rvsamp::counter_rng gen(key, i);
+      gen.discard(2 * max_tries);
+      this->m_ancestors[i] = m_exactSampler.sample(gen);
+    }
+  });
+}
+
+/**
+ * @class island_resampler_mt
+ * @author taylor
+ * @file resamplers.h
+ * @brief Class that resamples "standard" models island by island. The
+ * particles are split into nislands contiguous islands, and each island is
+ * resampled on its own (systematically, from its own weights), so the islands
+ * can be spread over threads and never have to agree on a global weight sum.
+ * Each island keeps its share of the total weight: afterwards every particle
+ * on island k has log weight log(nislands * W_k), where W_k is the fraction
+ * of the total weight that was on island k, so the log weights still sum to
+ * log(nparts) (what the filters assume after resampling) and they are all 0
+ * when the islands are balanced. When the largest island carries more than
+ * imbalance_pct percent of an even share, the islands also exchange
+ * particles: the last exch_pct percent of every island are pooled,
+ * systematically resampled by their weights, and dealt back to the islands
+ * in turn, with equal weights. With exch_pct = 100 every exchange is a global
+ * systematic resampling. The uniforms are drawn in island order from one
+ * generator, so for a given seed the ancestors are the same for any nthreads.
+ * @tparam nparts the number of particles.
+ * @tparam dimx the dimension of each state sample.
+ * @tparam float_t the floating point for samples
+ * @tparam nislands the number of islands (it must divide nparts)
+ * @tparam exch_pct the percentage of each island that is exchanged
+ * @tparam imbalance_pct how large the largest island's weight can be, as a
+ * percentage of an even share, before the islands exchange particles
+ * @tparam nthreads the number of threads (including the calling thread)
+ */
+template <size_t nparts, size_t dimx, typename float_t, size_t nislands,
+          size_t exch_pct = 25, size_t imbalance_pct = 200,
+          size_t nthreads = 1>
+class island_resampler_mt
+    : private rbase_mt<nparts, dimx, float_t, nthreads> {
+public:
+  /** type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** type alias for array of Eigen Matrices */
+  using arrayVec = std::array<ssv, nparts>;
+  /** type alias for array of float_ts */
+  using arrayFloat = std::array<float_t, nparts>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+
+  /** the number of particles on each island */
+  static constexpr size_t island_size = nparts / nislands;
+  /** the number of particles each island gives up in an exchange */
+  static constexpr size_t num_migrants = island_size * exch_pct / 100;
+
+  static_assert(nislands > 0 && nparts % nislands == 0,
+                "the islands must all be the same size");
+  static_assert(exch_pct <= 100, "can't exchange more than every particle");
+  static_assert(imbalance_pct >= 100,
+                "the largest island always has at least an even share");
+
+  /**
+   * @brief Default constructor.
+   */
+  island_resampler_mt() = default;
+
+  /**
+   * @brief Constructor that sets the seed.
+   * @param seed
+   */
+  island_resampler_mt(unsigned long seed);
+
+  /**
+   * @brief resamples particles.
+   * @param oldParts the old particles
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles that are stored one per column.
+   * @param oldParts the old particles (dimx rows, nparts columns)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief whether the islands exchanged particles in the most recent
+   * resampling step.
+   * @return true or false
+   */
+  bool getExchanged() const;
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase<nparts, dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase<nparts, dimx, float_t>::seed;
+
+private:
+  /** the number of particles pooled in an exchange */
+  static constexpr size_t num_pooled = nislands * num_migrants;
+
+  /**
+   * @brief resamples every island, then exchanges particles if the islands
+   * are too unbalanced.
+   * @param oldParts the old particles
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  template <typename parts_t>
+  void resample(parts_t &oldParts, arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief draws ancestor indexes for every island from its own log
+   * unnormalized weights, and fills m_islandLogWts.
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void sampleIdx(const arrayFloat &oldLogUnNormWts);
+
+  /**
+   * @brief pools the last num_migrants particles of every island, resamples
+   * them, and deals them back out.
+   * @param parts the particles (already resampled on each island)
+   * @param logWts their log weights
+   */
+  template <typename parts_t>
+  void exchange(parts_t &parts, arrayFloat &logWts);
+
+  /** @brief particle i */
+  static ssv &part(arrayVec &parts, size_t i);
+
+  /** @brief particle i (column i) */
+  static typename soaMat::ColXpr part(soaMat &parts, size_t i);
+
+  /** @brief the log of the total weight on each island */
+  std::array<float_t, nislands> m_islandLogWts;
+
+  /** @brief the uniform each island is resampled with */
+  std::array<float_t, nislands> m_islandUnifs;
+
+  /** @brief the pooled particles */
+  std::array<ssv, num_pooled> m_pooled;
+
+  /** @brief the ancestors of the pooled particles */
+  std::array<unsigned int, num_pooled> m_pooledAncestors;
+
+  /** @brief cumulative sums of the pooled particles' weights */
+  std::array<float_t, num_pooled> m_pooledCumsums;
+
+  /** @brief whether the most recent step exchanged particles */
+  bool m_exchanged = false;
+};
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nislands,
+          size_t exch_pct, size_t imbalance_pct, size_t nthreads>
+island_resampler_mt<nparts, dimx, float_t, nislands, exch_pct, imbalance_pct,
+                    nthreads>::island_resampler_mt(unsigned long seed)
+    : rbase_mt<nparts, dimx, float_t, nthreads>(seed) {}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nislands,
+          size_t exch_pct, size_t imbalance_pct, size_t nthreads>
+void island_resampler_mt<nparts, dimx, float_t, nislands, exch_pct,
+                         imbalance_pct, nthreads>::
+    resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
+  resample(oldParts, oldLogUnNormWts);
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nislands,
+          size_t exch_pct, size_t imbalance_pct, size_t nthreads>
+void island_resampler_mt<nparts, dimx, float_t, nislands, exch_pct,
+                         imbalance_pct, nthreads>::
+    resampLogWts(soaMat &oldParts, arrayFloat &oldLogUnNormWts) {
+  resample(oldParts, oldLogUnNormWts);
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nislands,
+          size_t exch_pct, size_t imbalance_pct, size_t nthreads>
+bool island_resampler_mt<nparts, dimx, float_t, nislands, exch_pct,
+                         imbalance_pct, nthreads>::getExchanged() const {
+  return m_exchanged;
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nislands,
+          size_t exch_pct, size_t imbalance_pct, size_t nthreads>
+auto island_resampler_mt<nparts, dimx, float_t, nislands, exch_pct,
+                         imbalance_pct, nthreads>::part(arrayVec &parts,
+                                                        size_t i) -> ssv & {
+  return parts[i];
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nislands,
+          size_t exch_pct, size_t imbalance_pct, size_t nthreads>
+auto island_resampler_mt<nparts, dimx, float_t, nislands, exch_pct,
+                         imbalance_pct, nthreads>::part(soaMat &parts,
+                                                        size_t i) ->
+    typename soaMat::ColXpr {
+  return parts.col(i);
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nislands,
+          size_t exch_pct, size_t imbalance_pct, size_t nthreads>
+template <typename parts_t>
+void island_resampler_mt<nparts, dimx, float_t, nislands, exch_pct,
+                         imbalance_pct, nthreads>::
+    resample(parts_t &oldParts, arrayFloat &oldLogUnNormWts) {
+
+  // every island resamples on its own; the ancestors never leave their
+  // island, so arranging them keeps every island in place
+  sampleIdx(oldLogUnNormWts);
+  this->gatherParts(oldParts);
+
+  // each island keeps its share of the weight, scaled so an even share is 1
+  float_t logEven = kernels::logSumExp(m_islandLogWts.data(), nislands) -
+                    std::log(static_cast<float_t>(nislands));
+  this->m_pool.run([this, &oldLogUnNormWts, logEven](unsigned int tid) {
+    auto range = parallel::block_range(nparts, nthreads, tid);
+    for (size_t i = range.first; i < range.second; ++i)
+      oldLogUnNormWts[i] = m_islandLogWts[i / island_size] - logEven;
+  });
+
+  // exchange if the largest island has too much of it
+  float_t logLargest = kernels::max(m_islandLogWts.data(), nislands) - logEven;
+  float_t logThreshold = std::log(static_cast<float_t>(imbalance_pct) / 100);
+  m_exchanged = num_migrants > 0 && logLargest > logThreshold;
+  if (m_exchanged)
+    exchange(oldParts, oldLogUnNormWts);
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nislands,
+          size_t exch_pct, size_t imbalance_pct, size_t nthreads>
+void island_resampler_mt<nparts, dimx, float_t, nislands, exch_pct,
+                         imbalance_pct, nthreads>::
+    sampleIdx(const arrayFloat &oldLogUnNormWts) {
+
+  // one uniform per island, in island order
+  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0);
+  for (auto &u : m_islandUnifs)
+    u = u_sampler(this->m_gen);
+
+  this->m_pool.run([this, &oldLogUnNormWts](unsigned int tid) {
+    auto islands = parallel::block_range(nislands, nthreads, tid);
+    for (size_t k = islands.first; k < islands.second; ++k) {
+      size_t first = k * island_size;
+      const float_t *logWts = oldLogUnNormWts.data() + first;
+      float_t *c = this->m_cumsums.data() + first;
+
+      // an island with no weight keeps its particles
+      float_t m = kernels::max(logWts, island_size);
+      if (m == -std::numeric_limits<float_t>::infinity()) {
+        m_islandLogWts[k] = m;
+        std::iota(this->m_ancestors.begin() + first,
+                  this->m_ancestors.begin() + first + island_size, first);
+        continue;
+      }
+
+      // systematic resampling within the island
+      kernels::expShift(logWts, c, island_size, m);
+      std::partial_sum(c, c + island_size, c);
+      float_t total = c[island_size - 1];
+      m_islandLogWts[k] = m + std::log(total);
+      unsigned int j = 0;
+      for (size_t i = 0; i < island_size; ++i) {
+        float_t u = (i + m_islandUnifs[k]) / island_size * total;
+        while (j < island_size - 1 && c[j] < u)
+          j++;
+        this->m_ancestors[first + i] = first + j;
+      }
+    }
+  });
+}
+
+template <size_t nparts, size_t dimx, typename float_t, size_t nislands,
+          size_t exch_pct, size_t imbalance_pct, size_t nthreads>
+template <typename parts_t>
+void island_resampler_mt<nparts, dimx, float_t, nislands, exch_pct,
+                         imbalance_pct, nthreads>::exchange(parts_t &parts,
+                                                            arrayFloat
+                                                                &logWts) {
+
+  // pooled particle p is slot p % num_migrants of island p / num_migrants's
+  // exchanged slots, which are its last num_migrants slots
+  auto slot = [](size_t island, size_t s) {
+    return island * island_size + island_size - num_migrants + s;
+  };
+  float_t total = 0.0;
+  for (size_t p = 0; p < num_pooled; ++p) {
+    size_t i = slot(p / num_migrants, p % num_migrants);
+    m_pooled[p] = part(parts, i);
+    m_pooledAncestors[p] = this->m_ancestors[i];
+    total += std::exp(logWts[i]);
+    m_pooledCumsums[p] = total;
+  }
+
+  // systematic resampling of the pool; draw j goes to island j % nislands,
+  // so each island gets num_migrants of them, spread over the whole pool
+  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0);
+  float_t u0 = u_sampler(this->m_gen);
+  float_t logEqualWt = std::log(total / num_pooled);
+  unsigned int q = 0;
+  for (size_t j = 0; j < num_pooled; ++j) {
+    float_t u = (j + u0) / num_pooled * total;
+    while (q < num_pooled - 1 && m_pooledCumsums[q] < u)
+      q++;
+    size_t i = slot(j % nislands, j / nislands);
+    part(parts, i) = m_pooled[q];
+    this->m_ancestors[i] = m_pooledAncestors[q];
+    logWts[i] = logEqualWt;
+  }
+}
+
+//! Base class for resamplers whose number of particles is only known at run
+//! time.
+/**
+ * @class rbase_dyn
+ * @author taylor
+ * @file resamplers.h
+ * @brief The particles are the columns of one heap-allocated matrix and the
+ * log weights are one heap-allocated array, so the number of particles is
+ * whatever the arguments say it is. The scratch buffers (cumulative weights,
+ * ancestor indexes and a second particle matrix) are members, so after the
+ * first call they are only reallocated when the number of particles changes.
+ * @tparam dimx the dimension of each state sample.
+ * @tparam float_t the type of floating point numbers (e.g. float or double)
+ */
+template <size_t dimx, typename float_t> class rbase_dyn {
+public:
+  /** type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+  /** type alias for a dynamically sized array of weights */
+  using wtArray = Eigen::Array<float_t, Eigen::Dynamic, 1>;
+  /** type alias for a dynamically sized array of indexes */
+  using vecInt = std::vector<unsigned int>;
+
+  /**
+   * @brief The default constructor sets the seed with the clock.
+   */
+  rbase_dyn();
+
+  /**
+   * @brief The constructor that sets the seed deterministically.
+   * @param seed the seed
+   */
+  rbase_dyn(unsigned long seed);
+
+  /**
+   * @brief the ancestors picked by the most recent resampling step: particle i
+   * is a copy of old particle getAncestors()[i].
+   * @return the ancestor indexes
+   */
+  const vecInt &getAncestors() const;
+
+  /**
+   * @brief Reseeds the generator, e.g. so that a copy of a filter does not
+   * draw the same numbers as the filter it was copied from.
+   * @param seed the new seed
+   */
+  void seed(unsigned long seed);
+
+protected:
+  /**
+   * @brief fills m_cumsums with the normalized cumulative sums of the weights
+   * @param logWts the log unnormalized weights
+   */
+  void setCumsums(const wtArray &logWts);
+
+  /**
+   * @brief overwrites the particles with columns m_idx[0], ...,
+   * m_idx[nout - 1] of the old particles
+   * @param parts the particles (one per column)
+   * @param nout the number of particles after resampling
+   */
+  void gatherParts(soaMat &parts, size_t nout);
+
+  /** @brief prng */
+  std::mt19937 m_gen;
+
+  /** @brief normalized cumulative sums of the weights */
+  wtArray m_cumsums;
+
+  /** @brief ancestor indexes */
+  vecInt m_idx;
+
+  /** @brief where the resampled particles are written before swapping */
+  soaMat m_tmpParts;
 };
 
-template <size_t nparts, size_t dimx, typename float_t>
-mn_resamp_fast1<nparts, dimx, float_t>::mn_resamp_fast1(unsigned long seed)
-    : rbase<nparts, dimx, float_t>(seed) {}
+template <size_t dimx, typename float_t>
+rbase_dyn<dimx, float_t>::rbase_dyn()
+    : m_gen{static_cast<std::uint32_t>(std::chrono::high_resolution_clock::now()
+                                           .time_since_epoch()
+                                           .count())} {}
 
-template <size_t nparts, size_t dimx, typename float_t>
-void mn_resamp_fast1<nparts, dimx, float_t>::resampLogWts(
-    arrayVec &oldParts, arrayFloat &oldLogUnNormWts) {
-  // these log weights may be very negative. If that's the case, exponentiating
-  // them may cause underflow so we use the "log-exp-sum" trick actually not
-  // quite...we just shift the log-weights because after they're exponentiated
-  // they have the same normalized probabilities
+template <size_t dimx, typename float_t>
+rbase_dyn<dimx, float_t>::rbase_dyn(unsigned long seed)
+    : m_gen{static_cast<std::uint32_t>(seed)} {}
 
-  // Also, we're using a fancier algorthm detailed on page 244 of IHMM
+template <size_t dimx, typename float_t>
+auto rbase_dyn<dimx, float_t>::getAncestors() const -> const vecInt & {
+  return m_idx;
+}
 
-  // Create unnormalized weights
-  arrayFloat unnorm_weights;
-  float_t m = *std::max_element(oldLogUnNormWts.begin(), oldLogUnNormWts.end());
-  std::transform(oldLogUnNormWts.begin(), oldLogUnNormWts.end(),
-                 unnorm_weights.begin(),
-                 [&m](float_t &d) -> float_t { return std::exp(d - m); });
+template <size_t dimx, typename float_t>
+void rbase_dyn<dimx, float_t>::seed(unsigned long seed) {
+  m_gen.seed(static_cast<std::uint32_t>(seed));
+}
 
-  // get a uniform rv sampler
-  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0);
+template <size_t dimx, typename float_t>
+void rbase_dyn<dimx, float_t>::setCumsums(const wtArray &logWts) {
+  size_t n = logWts.size();
+  m_cumsums.resize(n);
+  kernels::normalizedWeights(logWts.data(), m_cumsums.data(), n);
+  for (size_t i = 1; i < n; ++i)
+    m_cumsums[i] += m_cumsums[i - 1];
+}
 
-  // two things:
-  // 1.) calculate normalizing constant for weights, and
-  // 2.) generate all these exponentials to help with getting order statistics
-  // NB: you never need to store E_{N+1}! (this is subtle)
-  float_t weight_norm_const(0.0);
-  arrayFloat exponentials;
-  float_t G(0.0);
-  for (size_t i = 0; i < nparts; ++i) {
-    weight_norm_const += unnorm_weights[i];
-    exponentials[i] = -std::log(u_sampler(this->m_gen));
-    G += exponentials[i];
+template <size_t dimx, typename float_t>
+void rbase_dyn<dimx, float_t>::gatherParts(soaMat &parts, size_t nout) {
+  m_tmpParts.resize(dimx, nout);
+  for (size_t i = 0; i < nout; ++i)
+    m_tmpParts.col(i) = parts.col(m_idx[i]);
+  parts.swap(m_tmpParts);
+}
+
+/**
+ * @class mn_resampler_dyn
+ * @author taylor
+ * @file resamplers.h
+ * @brief Multinomial resampling with a run-time number of particles. The
+ * sorted uniforms are generated from the largest down (U_(n) = U^{1/n}), so
+ * one pass over the cumulative weights is enough and nothing is sorted.
+ * @tparam dimx the dimension of each state sample.
+ * @tparam float_t the type of floating point numbers (e.g. float or double)
+ */
+template <size_t dimx, typename float_t>
+class mn_resampler_dyn : private rbase_dyn<dimx, float_t> {
+public:
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+  /** type alias for a dynamically sized array of weights */
+  using wtArray = Eigen::Array<float_t, Eigen::Dynamic, 1>;
+
+  /**
+   * @brief Default constructor.
+   */
+  mn_resampler_dyn() = default;
+
+  /**
+   * @brief Constructor that sets the seed.
+   * @param seed
+   */
+  mn_resampler_dyn(unsigned long seed);
+
+  /**
+   * @brief resamples particles, keeping the number of particles fixed.
+   * @param oldParts the old particles (one per column)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, wtArray &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles and changes how many there are.
+   * @param oldParts the old particles (one per column)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   * @param nout the number of particles afterwards
+   */
+  void resampLogWts(soaMat &oldParts, wtArray &oldLogUnNormWts, size_t nout);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase_dyn<dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase_dyn<dimx, float_t>::seed;
+};
+
+template <size_t dimx, typename float_t>
+mn_resampler_dyn<dimx, float_t>::mn_resampler_dyn(unsigned long seed)
+    : rbase_dyn<dimx, float_t>(seed) {}
+
+template <size_t dimx, typename float_t>
+void mn_resampler_dyn<dimx, float_t>::resampLogWts(soaMat &oldParts,
+                                                   wtArray &oldLogUnNormWts) {
+  resampLogWts(oldParts, oldLogUnNormWts, oldParts.cols());
+}
+
+template <size_t dimx, typename float_t>
+void mn_resampler_dyn<dimx, float_t>::resampLogWts(soaMat &oldParts,
+                                                   wtArray &oldLogUnNormWts,
+                                                   size_t nout) {
+  this->setCumsums(oldLogUnNormWts);
+  this->m_idx.resize(nout);
+
+  // walk down the cumulative sums with decreasing order statistics
+  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0);
+  float_t logU(0.0);
+  size_t j = oldLogUnNormWts.size() - 1;
+  for (size_t i = nout; i-- > 0;) {
+    logU += std::log(1.0 - u_sampler(this->m_gen)) / (i + 1);
+    float_t u = std::exp(logU);
+    while (j > 0 && this->m_cumsums[j - 1] >= u)
+      j--;
+    this->m_idx[i] = j;
   }
-  G -= std::log(u_sampler(this->m_gen)); // E_{N+1}
 
-  // see Fig 7.15 in IHMM on page 243
-  arrayVec tmpPartics = oldParts;  // the new particles
-  float_t uniform_order_stat(0.0); // U_{(i)} in the notation of IHMM
-  float_t running_sum_normalized_weights(
-      unnorm_weights[0] /
-      weight_norm_const); // \sum_{j=1}^I \omega^j in the notation of IHMM
-  float_t one_less_summand(0.0); // \sum_{j=1}^{I-1} \omega^j
-  unsigned int idx = 0;
-  for (size_t i = 0; i < nparts; ++i) {
-    uniform_order_stat += exponentials[i] / G; // add a spacing E_i/G
-    do {
-      if ((one_less_summand < uniform_order_stat) &&
-          (uniform_order_stat <= running_sum_normalized_weights)) {
-        // select index idx
-        tmpPartics[i] = oldParts[idx];
-        break;
-      } else {
-        // increment idx because it will never be chosen (all the other order
-        // statistics are even higher)
-        idx++;
-        running_sum_normalized_weights +=
-            unnorm_weights[idx] / weight_norm_const;
-        one_less_summand += unnorm_weights[idx - 1] / weight_norm_const;
-      }
-    } while (true);
+  this->gatherParts(oldParts, nout);
+  oldLogUnNormWts.setZero(nout); // change back
+}
+
+/**
+ * @class systematic_resampler_dyn
+ * @author taylor
+ * @file resamplers.h
+ * @brief Systematic resampling with a run-time number of particles.
+ * @tparam dimx the dimension of each state sample.
+ * @tparam float_t the type of floating point numbers (e.g. float or double)
+ */
+template <size_t dimx, typename float_t>
+class systematic_resampler_dyn : private rbase_dyn<dimx, float_t> {
+public:
+  /** type alias for particles stored column-by-column in one matrix */
+  using soaMat = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+  /** type alias for a dynamically sized array of weights */
+  using wtArray = Eigen::Array<float_t, Eigen::Dynamic, 1>;
+
+  /**
+   * @brief Default constructor.
+   */
+  systematic_resampler_dyn() = default;
+
+  /**
+   * @brief Constructor that sets the seed.
+   * @param seed
+   */
+  systematic_resampler_dyn(unsigned long seed);
+
+  /**
+   * @brief resamples particles, keeping the number of particles fixed.
+   * @param oldParts the old particles (one per column)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   */
+  void resampLogWts(soaMat &oldParts, wtArray &oldLogUnNormWts);
+
+  /**
+   * @brief resamples particles and changes how many there are.
+   * @param oldParts the old particles (one per column)
+   * @param oldLogUnNormWts the old log unnormalized weights
+   * @param nout the number of particles afterwards
+   */
+  void resampLogWts(soaMat &oldParts, wtArray &oldLogUnNormWts, size_t nout);
+
+  /** @brief the ancestors picked by the most recent resampling step */
+  using rbase_dyn<dimx, float_t>::getAncestors;
+
+  /** @brief reseeds the generator */
+  using rbase_dyn<dimx, float_t>::seed;
+};
+
+template <size_t dimx, typename float_t>
+systematic_resampler_dyn<dimx, float_t>::systematic_resampler_dyn(
+    unsigned long seed)
+    : rbase_dyn<dimx, float_t>(seed) {}
+
+template <size_t dimx, typename float_t>
+void systematic_resampler_dyn<dimx, float_t>::resampLogWts(
+    soaMat &oldParts, wtArray &oldLogUnNormWts) {
+  resampLogWts(oldParts, oldLogUnNormWts, oldParts.cols());
+}
+
+template <size_t dimx, typename float_t>
+void systematic_resampler_dyn<dimx, float_t>::resampLogWts(
+    soaMat &oldParts, wtArray &oldLogUnNormWts, size_t nout) {
+  this->setCumsums(oldLogUnNormWts);
+  this->m_idx.resize(nout);
+
+  // one uniform, then evenly spaced
+  std::uniform_real_distribution<float_t> u_sampler(0.0, 1.0 / nout);
+  float_t u0 = u_sampler(this->m_gen);
+  size_t nin = oldLogUnNormWts.size();
+  size_t j = 0;
+  for (size_t i = 0; i < nout; ++i) {
+
+    // find which index (the last one if rounding leaves u uncovered)
+    float_t u = u0 + static_cast<float_t>(i) / nout;
+    while (j < nin - 1 && this->m_cumsums[j] < u)
+      j++;
+    this->m_idx[i] = j;
   }
 
-  // overwrite olds with news
-  oldParts = std::move(tmpPartics);
-  std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0);
+  this->gatherParts(oldParts, nout);
+  oldLogUnNormWts.setZero(nout); // change back
 }
 
+#ifdef __SIZEOF_INT128__
+/** an unsigned 128-bit integer (a GCC/Clang extension) */
+__extension__ typedef unsigned __int128 uint128_t;
+
+/** the longest Hilbert index that fits in a key */
+constexpr size_t max_hilbert_key_bits = 128;
+#else
+/** the longest Hilbert index that fits in a key */
+constexpr size_t max_hilbert_key_bits = 64;
+#endif
+
+/**
+ * @brief the smallest unsigned integer type that holds num_bits bits: 32, 64
+ * or (where the compiler supports it) 128 bits wide. Positions on a Hilbert
+ * curve with num_bits bits per dimension in num_dims dimensions are stored in
+ * hilbert_key_t<num_bits * num_dims>.
+ * @file resamplers.h
+ * @tparam num_bits the number of bits needed
+ */
+template <size_t num_bits>
+using hilbert_key_t = std::conditional_t<
+    (num_bits <= 32), std::uint32_t,
+#ifdef __SIZEOF_INT128__
+    std::conditional_t<(num_bits <= 64), std::uint64_t, uint128_t>>;
+#else
+    std::uint64_t>;
+#endif
+
 /**
  * @brief converts an integer in a transpose form to a position on the Hilbert
  * Curve. Code is based off of John Skilling , "Programming the Hilbert curve",
@@ -664,9 +2468,11 @@ TransposeToAxes(std::array<std::bitset<num_bits>, num_dims> X) {
     X[i] ^= X[i - 1];
   X[0] ^= t;
 
-  // Undo excess work
-  coord_t N = 2 << (num_bits - 1);
-  for (coord_t Q = 2; Q != N; Q <<= 1) {
+  // Undo excess work (Q = 2, 4, ..., 2^(num_bits - 1), set bit by bit so
+  // that nothing overflows when num_bits is as wide as an int)
+  for (size_t q = 1; q < num_bits; ++q) {
+    coord_t Q;
+    Q.set(q);
     coord_t P = Q.to_ulong() - 1;
     for (int i = num_dims - 1; i >= 0; i--) {
       if ((X[i] & Q).any()) { // invert low bits of X[0]
@@ -699,9 +2505,10 @@ std::array<std::bitset<num_bits>, num_dims>
 AxesToTranspose(std::array<std::bitset<num_bits>, num_dims> X) {
   using coord_t = std::bitset<num_bits>;
 
-  // Inverse undo
-  coord_t M = 1 << (num_bits - 1);
-  for (coord_t Q = M; Q.to_ulong() > 1; Q >>= 1) {
+  // Inverse undo (Q = 2^(num_bits - 1), ..., 4, 2)
+  for (size_t q = num_bits - 1; q > 0; --q) {
+    coord_t Q;
+    Q.set(q);
     coord_t P = Q.to_ulong() - 1;
     for (size_t i = 0; i < num_dims; i++) {
       if ((X[i] & Q).any())
@@ -719,9 +2526,9 @@ AxesToTranspose(std::array<std::bitset<num_bits>, num_dims> X) {
     X[i] ^= X[i - 1];
 
   coord_t t = 0;
-  for (coord_t Q = M; Q.to_ulong() > 1; Q >>= 1) {
-    if ((X[num_dims - 1] & Q).any())
-      t ^= Q.to_ulong() - 1;
+  for (size_t q = num_bits - 1; q > 0; --q) {
+    if (X[num_dims - 1].test(q))
+      t ^= (std::uint64_t(1) << q) - 1;
   }
 
   for (size_t i = 0; i < num_dims; i++)
@@ -742,12 +2549,11 @@ AxesToTranspose(std::array<std::bitset<num_bits>, num_dims> X) {
  * @return a position on the real line (in a "Transpose" form)
  */
 template <size_t num_bits, size_t num_dims>
-std::array<std::bitset<num_bits>, num_dims> makeHTranspose(unsigned int H) {
+std::array<std::bitset<num_bits>, num_dims>
+makeHTranspose(hilbert_key_t<num_bits * num_dims> H) {
   using coord_t = std::bitset<num_bits>;
   using coords_t = std::array<coord_t, num_dims>;
-  using big_coord_t = std::bitset<num_bits * num_dims>;
 
-  big_coord_t Hb = H;
   coords_t X;
   for (size_t dim = 0; dim < num_dims; ++dim) {
 
@@ -755,7 +2561,7 @@ std::array<std::bitset<num_bits>, num_dims> makeHTranspose(unsigned int H) {
     unsigned start_bit = num_bits * num_dims - 1 - dim;
     unsigned int c = num_bits - 1;
     for (int bit = start_bit; bit >= 0; bit -= num_dims) {
-      dim_coord_tmp[c] = Hb[bit];
+      dim_coord_tmp[c] = static_cast<bool>((H >> bit) & 1);
       c--;
     }
     X[dim] = dim_coord_tmp;
@@ -775,20 +2581,186 @@ std::array<std::bitset<num_bits>, num_dims> makeHTranspose(unsigned int H) {
  * @return a position on the hilbert curve (0,1,..,2^(num_dims * num_bits) )
  */
 template <size_t num_bits, size_t num_dims>
-unsigned int makeH(std::array<std::bitset<num_bits>, num_dims> Htrans) {
-  using big_coord_t = std::bitset<num_bits * num_dims>;
+hilbert_key_t<num_bits * num_dims>
+makeH(std::array<std::bitset<num_bits>, num_dims> Htrans) {
+  using key_t = hilbert_key_t<num_bits * num_dims>;
+  static_assert(num_bits * num_dims <= max_hilbert_key_bits,
+                "Hilbert index is too long for the widest key type");
 
-  big_coord_t H;
+  key_t H = 0;
   unsigned int which_dim = 0;
   unsigned which_bit;
   for (int i = num_bits * num_dims - 1; i >= 0; i--) {
     which_bit = i / num_dims;
-    H[i] = Htrans[which_dim][which_bit];
+    H = (H << 1) | static_cast<key_t>(Htrans[which_dim][which_bit]);
     which_dim = (which_dim + 1) % num_dims;
   }
-  return H.to_ulong();
+  return H;
+}
+
+/**
+ * @brief the bit positions that bit-interleaving gives to one coordinate:
+ * bit b of coordinate dim goes to bit b * num_dims + (num_dims - 1 - dim) of
+ * the result, so coordinate 0 supplies the most significant bit of each group.
+ * @file resamplers.h
+ * @tparam num_bits the number of bits per coordinate
+ * @tparam num_dims the number of coordinates
+ * @param dim which coordinate
+ * @return a mask with num_bits bits set
+ */
+template <size_t num_bits, size_t num_dims>
+constexpr hilbert_key_t<num_bits * num_dims> interleaveMask(size_t dim) {
+  using key_t = hilbert_key_t<num_bits * num_dims>;
+  key_t mask = 0;
+  for (size_t b = 0; b < num_bits; ++b)
+    mask |= key_t(1) << (b * num_dims + num_dims - 1 - dim);
+  return mask;
+}
+
+/**
+ * @brief interleaves the bits of num_dims coordinates, most significant bits
+ * first: the result is X[0] bit num_bits-1, X[1] bit num_bits-1, ..., then
+ * X[0] bit num_bits-2, and so on. When the compiler targets BMI2 (e.g.
+ * -mbmi2 or -march=native on Haswell and later) and the result fits in 64
+ * bits, each coordinate is scattered with one pdep instruction.
+ * @file resamplers.h
+ * @tparam num_bits the number of bits per coordinate (at most 32)
+ * @tparam num_dims the number of coordinates
+ * @param X the coordinates, each in [0, 2^num_bits)
+ * @return the interleaved bits
+ */
+template <size_t num_bits, size_t num_dims>
+hilbert_key_t<num_bits * num_dims>
+interleaveBits(const std::array<std::uint32_t, num_dims> &X) {
+  using key_t = hilbert_key_t<num_bits * num_dims>;
+#ifdef __BMI2__
+  if constexpr (num_bits * num_dims <= 64) {
+    std::uint64_t H = 0;
+    for (size_t i = 0; i < num_dims; i++)
+      H |= _pdep_u64(X[i], interleaveMask<num_bits, num_dims>(i));
+    return static_cast<key_t>(H);
+  }
+#endif
+  key_t H = 0;
+  for (int bit = num_bits - 1; bit >= 0; bit--)
+    for (size_t i = 0; i < num_dims; i++)
+      H = (H << 1) | static_cast<key_t>((X[i] >> bit) & 1);
+  return H;
+}
+
+/**
+ * @brief converts a point on a grid directly into its position on the Hilbert
+ * curve. This gives the same result as makeH(AxesToTranspose(X)), but it works
+ * on whole machine words instead of std::bitsets, so it is much cheaper to
+ * call once per particle. Code is based off of John Skilling , "Programming
+ * the Hilbert curve", AIP Conference Proceedings 707, 381-387 (2004)
+ * https://doi.org/10.1063/1.1751381
+ * @file resamplers.h
+ * @tparam num_bits how "accurate/fine/squiggly" you want the Hilbert curve
+ * (at most 32)
+ * @tparam num_dims the number of dimensions the curve is in
+ * @param X the coordinates of the point, each in [0, 2^num_bits)
+ * @return a position on the hilbert curve (0,1,..,2^(num_dims * num_bits) )
+ */
+template <size_t num_bits, size_t num_dims>
+hilbert_key_t<num_bits * num_dims>
+hilbertIndex(std::array<std::uint32_t, num_dims> X) {
+  static_assert(num_bits <= 32, "at most 32 bits per dimension");
+  static_assert(num_bits * num_dims <= max_hilbert_key_bits,
+                "Hilbert index is too long for the widest key type");
+
+  // Inverse undo
+  const std::uint32_t M = std::uint32_t(1) << (num_bits - 1);
+  for (std::uint32_t Q = M; Q > 1; Q >>= 1) {
+    std::uint32_t P = Q - 1;
+    for (size_t i = 0; i < num_dims; i++) {
+      if (X[i] & Q)
+        X[0] ^= P;
+      else {
+        std::uint32_t t = (X[0] ^ X[i]) & P;
+        X[0] ^= t;
+        X[i] ^= t;
+      }
+    }
+  } // exchange
+
+  // Gray encode
+  for (size_t i = 1; i < num_dims; i++)
+    X[i] ^= X[i - 1];
+  std::uint32_t t = 0;
+  for (std::uint32_t Q = M; Q > 1; Q >>= 1) {
+    if (X[num_dims - 1] & Q)
+      t ^= Q - 1;
+  }
+  for (size_t i = 0; i < num_dims; i++)
+    X[i] ^= t;
+
+  // interleave the transpose, most significant bits first
+  return interleaveBits<num_bits, num_dims>(X);
+}
+
+/**
+ * @brief converts a point on a grid into its position on the Morton (or
+ * Z-order) curve, which just interleaves the bits of the coordinates. It
+ * preserves locality less well than the Hilbert curve (consecutive positions
+ * can be far apart), but it skips the Hilbert transform entirely.
+ * @file resamplers.h
+ * @tparam num_bits how "accurate/fine" you want the curve (at most 32)
+ * @tparam num_dims the number of dimensions the curve is in
+ * @param X the coordinates of the point, each in [0, 2^num_bits)
+ * @return a position on the Morton curve (0,1,..,2^(num_dims * num_bits) )
+ */
+template <size_t num_bits, size_t num_dims>
+hilbert_key_t<num_bits * num_dims>
+mortonIndex(const std::array<std::uint32_t, num_dims> &X) {
+  static_assert(num_bits <= 32, "at most 32 bits per dimension");
+  static_assert(num_bits * num_dims <= max_hilbert_key_bits,
+                "Morton index is too long for the widest key type");
+  return interleaveBits<num_bits, num_dims>(X);
 }
 
+/**
+ * @class hilbert_curve
+ * @author taylor
+ * @file resamplers.h
+ * @brief Orders particles along a Hilbert curve (see hilbertIndex()).
+ */
+struct hilbert_curve {
+  /**
+   * @brief a point's position on the curve
+   * @tparam num_bits the number of bits per dimension
+   * @tparam num_dims the number of dimensions
+   * @param X the coordinates of the point, each in [0, 2^num_bits)
+   * @return its position on the curve
+   */
+  template <size_t num_bits, size_t num_dims>
+  static hilbert_key_t<num_bits * num_dims>
+  index(const std::array<std::uint32_t, num_dims> &X) {
+    return hilbertIndex<num_bits, num_dims>(X);
+  }
+};
+
+/**
+ * @class morton_curve
+ * @author taylor
+ * @file resamplers.h
+ * @brief Orders particles along a Morton curve (see mortonIndex()).
+ */
+struct morton_curve {
+  /**
+   * @brief a point's position on the curve
+   * @tparam num_bits the number of bits per dimension
+   * @tparam num_dims the number of dimensions
+   * @param X the coordinates of the point, each in [0, 2^num_bits)
+   * @return its position on the curve
+   */
+  template <size_t num_bits, size_t num_dims>
+  static hilbert_key_t<num_bits * num_dims>
+  index(const std::array<std::uint32_t, num_dims> &X) {
+    return mortonIndex<num_bits, num_dims>(X);
+  }
+};
+
 //! Base class for resampler types that use a Hilbert curve sorting technique.
 /**
  * @class rbase_hcs
@@ -801,9 +2773,11 @@ unsigned int makeH(std::array<std::bitset<num_bits>, num_dims> Htrans) {
  * @tparam nparts the number of particles.
  * @tparam dimx the dimension of each state sample.
  * @tparam float_t the type of floating point numbers (e.g. float or double)
+ * @tparam curve_t the space-filling curve particles are sorted along
+ * (hilbert_curve or morton_curve)
  */
 template <size_t nparts, size_t dimx, size_t dimur, size_t num_hilb_bits,
-          typename float_t>
+          typename float_t, typename curve_t = hilbert_curve>
 class rbase_hcs {
 public:
   /** type alias for linear algebra stuff */
@@ -830,84 +2804,129 @@ public:
                             const usvr &ur) = 0;
 
 private:
+  /** number of bits in a curve key */
+  static constexpr size_t num_key_bits = num_hilb_bits * dimx;
+
+  /** number of bits sorted per radix sort pass */
+  static constexpr size_t radix_bits = 8;
+
+  /** number of radix sort passes */
+  static constexpr size_t num_passes =
+      (num_key_bits + radix_bits - 1) / radix_bits;
+
+  static_assert(num_hilb_bits <= 32, "at most 32 bits per dimension");
+  static_assert(num_key_bits <= max_hilbert_key_bits,
+                "Hilbert index is too long for the widest key type");
+
+  /** the narrowest integer type that holds a curve index */
+  using key_t = hilbert_key_t<num_key_bits>;
+
   /**
-   * @brief Function that "sorts" multidimensional vectors using an (inverse)
-   * Hilbert-curve map. For more information see
-   * https://arxiv.org/pdf/1511.04992.pdf
+   * @brief Function that maps a multidimensional vector to its position on an
+   * (inverse) Hilbert or Morton curve, so that sorting vectors by their keys
+   * "sorts" them. For more information see https://arxiv.org/pdf/1511.04992.pdf
+   * @param x the vector
+   * @return its position on the curve
    */
-  static bool hilbertComparison(const ssv &first, const ssv &second);
+  static key_t sortKey(const ssv &x);
 
 public:
   /**
    * @brief get a permutation based on unsorted particle samples (not their
-   * weights)
+   * weights). Every particle's curve key is computed once, then the keys are
+   * sorted with a (stable) least-significant-digit radix sort, so the cost is
+   * linear in nparts.
    * @param unsortedParts the particle samples
    * @return the permutation as a std::array
    */
   std::array<unsigned, nparts> get_permutation(const arrayVec &unsortedParts);
+
+private:
+  /** @brief the curve keys (one radix sort buffer) */
+  std::array<key_t, nparts> m_keys;
+
+  /** @brief the other radix sort buffer for the keys */
+  std::array<key_t, nparts> m_keysTmp;
+
+  /** @brief the other radix sort buffer for the permutation */
+  std::array<unsigned, nparts> m_permTmp;
 };
 
 template <size_t nparts, size_t dimx, size_t dimur, size_t num_hilb_bits,
-          typename float_t>
-bool rbase_hcs<nparts, dimx, dimur, num_hilb_bits, float_t>::hilbertComparison(
-    const ssv &first, const ssv &second) {
-  // return true if first "<" second
-  // three intermediate steps to do that:
+          typename float_t, typename curve_t>
+auto rbase_hcs<nparts, dimx, dimur, num_hilb_bits, float_t,
+               curve_t>::sortKey(const ssv &x) -> key_t {
+  // two intermediate steps:
   // 1.
   // squash each vector's elements from
   // (-infty,infty) -> [0, 2^num_hilb_bits)
   // with the function
   // f(x) = 2^num_bits/(1 + e^{-x}) = 2^{num_bits - 1} + 2^{num_bits -
   // 1}*tanh(x/2)
+  // tanh rounds to 1 for large x, so the top is clamped back onto the grid
   float_t c = std::pow(2, num_hilb_bits - 1);
-  ssv squashed_first = first * .5;
-  squashed_first = squashed_first.array().tanh() * c + c;
-  ssv squashed_second = second * .5;
-  squashed_second = squashed_second.array().tanh() * c + c;
+  ssv squashed = (x * .5).array().tanh() * c + c;
+  const double top = std::pow(2.0, num_hilb_bits) - 1.0;
+  std::array<std::uint32_t, dimx> axes;
+  for (size_t dim = 0; dim < dimx; ++dim)
+    axes[dim] = static_cast<std::uint32_t>(
+        std::min<double>(std::floor(squashed(dim)), top));
 
   // 2.
-  // convert the squashed matrix into bitset type obj"
-  std::array<std::bitset<num_hilb_bits>, dimx> axes_first;
-  std::array<std::bitset<num_hilb_bits>, dimx> axes_second;
-  for (size_t dim = 0; dim < dimx; ++dim) {
-    axes_first[dim] =
-        static_cast<unsigned int>(std::floor(squashed_first(dim)));
-    axes_second[dim] =
-        static_cast<unsigned int>(std::floor(squashed_second(dim)));
-  }
-
-  // 3.
-  // convert to one dimensional unsigned using "AxesToTranspose" and "makeH"
-  return makeH(AxesToTranspose(axes_first)) <
-         makeH(AxesToTranspose(axes_second));
+  // convert to one dimensional key on whole words (see hilbertIndex and
+  // mortonIndex)
+  return curve_t::template index<num_hilb_bits, dimx>(axes);
 }
 
 template <size_t nparts, size_t dimx, size_t dimur, size_t num_hilb_bits,
-          typename float_t>
+          typename float_t, typename curve_t>
 std::array<unsigned, nparts>
-rbase_hcs<nparts, dimx, dimur, num_hilb_bits, float_t>::get_permutation(
+rbase_hcs<nparts, dimx, dimur, num_hilb_bits, float_t,
+          curve_t>::get_permutation(
     const arrayVec &unsortedParts) {
-  // create unsorted index
+  // create unsorted index and every particle's key
   std::array<unsigned, nparts> indexes;
-  for (unsigned i = 0; i < nparts; ++i)
+  for (unsigned i = 0; i < nparts; ++i) {
     indexes[i] = i;
+    m_keys[i] = sortKey(unsortedParts[i]);
+  }
 
-  // create functor to help sort indexes based on particle samples (not weights)
-  struct sort_indexes {
-
-    arrayVec m_unsorted_parts;
-
-    sort_indexes(const arrayVec &prts) : m_unsorted_parts(prts){};
+  // sort the indexes by their keys, radix_bits at a time, starting with the
+  // least significant digit. Each pass reads one pair of buffers and writes
+  // the other.
+  constexpr size_t num_buckets = size_t(1) << radix_bits;
+  constexpr key_t mask = num_buckets - 1;
+  key_t *keys = m_keys.data();
+  key_t *keysOut = m_keysTmp.data();
+  unsigned *perm = indexes.data();
+  unsigned *permOut = m_permTmp.data();
+  for (size_t pass = 0; pass < num_passes; ++pass) {
+    size_t shift = pass * radix_bits;
+
+    // count each digit, then turn the counts into starting positions
+    std::array<size_t, num_buckets> starts{};
+    for (size_t i = 0; i < nparts; ++i)
+      starts[static_cast<size_t>((keys[i] >> shift) & mask)]++;
+    size_t pos = 0;
+    for (size_t d = 0; d < num_buckets; ++d) {
+      size_t count = starts[d];
+      starts[d] = pos;
+      pos += count;
+    }
 
-    bool operator()(unsigned i, unsigned j) const {
-      return rbase_hcs<nparts, dimx, dimur, num_hilb_bits,
-                       float_t>::hilbertComparison(m_unsorted_parts[i],
-                                                   m_unsorted_parts[j]);
+    // scatter (ties keep their order)
+    for (size_t i = 0; i < nparts; ++i) {
+      size_t dest = starts[static_cast<size_t>((keys[i] >> shift) & mask)]++;
+      keysOut[dest] = keys[i];
+      permOut[dest] = perm[i];
     }
-  };
+    std::swap(keys, keysOut);
+    std::swap(perm, permOut);
+  }
 
-  // sort the indexes and return them
-  std::sort(indexes.begin(), indexes.end(), sort_indexes(unsortedParts));
+  // after an odd number of passes the sorted indexes are in the scratch buffer
+  if (perm != indexes.data())
+    std::copy(perm, perm + nparts, indexes.begin());
   return indexes;
 }
 
@@ -920,11 +2939,15 @@ rbase_hcs<nparts, dimx, dimur, num_hilb_bits, float_t>::get_permutation(
  * scheme.
  * @tparam nparts the number of particles.
  * @tparam dimx the dimension of each state sample.
+ * @tparam num_hilb_bits the number of bits per dimension of the curve
  * @tparam float_t the floating point for samples
+ * @tparam curve_t the curve particles are sorted along before resampling
+ * (hilbert_curve, or morton_curve for sys_morton_resampler)
  */
-template <size_t nparts, size_t dimx, size_t num_hilb_bits, typename float_t>
+template <size_t nparts, size_t dimx, size_t num_hilb_bits, typename float_t,
+          typename curve_t = hilbert_curve>
 class sys_hilb_resampler
-    : private rbase_hcs<nparts, dimx, 1, num_hilb_bits, float_t> {
+    : private rbase_hcs<nparts, dimx, 1, num_hilb_bits, float_t, curve_t> {
 public:
   /** type alias for linear algebra stuff */
   using ssv = Eigen::Matrix<float_t, dimx, 1>;
@@ -952,20 +2975,35 @@ public:
    */
   void resampLogWts(arrayVec &oldParts, arrayFloat &oldLogUnNormWts,
                     const usvr &ur);
+
+  /**
+   * @brief the ancestors picked by the most recent resampling step: particle i
+   * is a copy of old particle getAncestors()[i].
+   * @return the ancestor indexes
+   */
+  const arrayInt &getAncestors() const;
+
+private:
+  /** @brief ancestor indexes from the most recent resampling step */
+  arrayInt m_ancestors;
 };
 
-template <size_t nparts, size_t dimx, size_t num_hilb_bits, typename float_t>
-void sys_hilb_resampler<nparts, dimx, num_hilb_bits, float_t>::resampLogWts(
-    arrayVec &oldParts, arrayFloat &oldLogUnNormWts, const usvr &ur) {
+template <size_t nparts, size_t dimx, size_t num_hilb_bits, typename float_t,
+          typename curve_t>
+auto sys_hilb_resampler<nparts, dimx, num_hilb_bits, float_t,
+                        curve_t>::getAncestors() const -> const arrayInt & {
+  return m_ancestors;
+}
+
+template <size_t nparts, size_t dimx, size_t num_hilb_bits, typename float_t,
+          typename curve_t>
+void sys_hilb_resampler<nparts, dimx, num_hilb_bits, float_t,
+                        curve_t>::resampLogWts(arrayVec &oldParts,
+                                               arrayFloat &oldLogUnNormWts,
+                                               const usvr &ur) {
   // calculate normalized weights
   arrayFloat w;
-  float_t m = *std::max_element(oldLogUnNormWts.begin(), oldLogUnNormWts.end());
-  std::transform(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), w.begin(),
-                 [&m](const float_t &d) -> float_t { return std::exp(d - m); });
-  float_t norm_const(0.0);
-  norm_const = std::accumulate(w.begin(), w.end(), norm_const);
-  for (auto &weight : w)
-    weight = weight / norm_const;
+  kernels::normalizedWeights(oldLogUnNormWts.data(), w.data(), nparts);
 
   // samplethe Ubar_tis
   arrayFloat ubar_samples;
@@ -987,34 +3025,40 @@ void sys_hilb_resampler<nparts, dimx, num_hilb_bits, float_t>::resampLogWts(
   arrayFloat cumsums;
   std::partial_sum(sortedWeights.begin(), sortedWeights.end(), cumsums.begin());
 
-  // resample
-  // unlike stratified, take advantage of U's being sorted
-  arrayVec tmpPartics;
-  unsigned idx;
+  // resample straight from the sorted copy
+  // unlike stratified, take advantage of U's being sorted (if rounding
+  // leaves the last U above every cumsum, it takes the last particle)
   unsigned int j = 0;
-  for (size_t i = 0; i < nparts; ++i) { // tmpPartics, Uis
-
-    // find which index
-    while (j < nparts) {
-
-      // get the first time it gets covered by a cumsum
-      if (cumsums[j] >= ubar_samples[i]) {
-        idx = j;
-        break;
-      }
+  for (size_t i = 0; i < nparts; ++i) { // Uis
 
+    // find the first cumsum that covers it
+    while (j < nparts - 1 && cumsums[j] < ubar_samples[i])
       j++;
-    }
+    unsigned idx = j;
 
     // assign
-    tmpPartics[i] = sortedParts[idx];
+    oldParts[i] = sortedParts[idx];
+    m_ancestors[i] = sigmaPermutation[idx];
   }
-
-  // overwrite olds with news
-  oldParts = std::move(tmpPartics);
   std::fill(oldLogUnNormWts.begin(), oldLogUnNormWts.end(), 0.0); // change back
 }
 
+/**
+ * @brief systematic resampling after sorting particles along a Morton
+ * (Z-order) curve. It is a drop-in replacement for sys_hilb_resampler (same
+ * template arguments, same common random number): computing a Morton key is
+ * only a bit interleave, which makes each resampling step cheaper, but the
+ * curve preserves locality less well, which can make likelihood estimates
+ * noisier as a function of the common random numbers.
+ * @tparam nparts the number of particles.
+ * @tparam dimx the dimension of each state sample.
+ * @tparam num_hilb_bits the number of bits per dimension of the curve
+ * @tparam float_t the floating point for samples
+ */
+template <size_t nparts, size_t dimx, size_t num_hilb_bits, typename float_t>
+using sys_morton_resampler =
+    sys_hilb_resampler<nparts, dimx, num_hilb_bits, float_t, morton_curve>;
+
 } // namespace resamplers
 } // namespace pf
 
@@ -10,8 +10,14 @@
 #include <Eigen/Dense>
 #endif
 
+#include <algorithm> // min
+#include <array>
+#include <cstdint> // uint64_t
+#include <numeric> // accumulate
 #include <random>
 
+#include "weight_kernels.h"
+
 namespace pf {
 
 namespace rvsamp {
@@ -660,13 +666,208 @@ template <typename float_t> float_t UniformSampler<float_t>::sample() {
   return m_unif_gen(m_rng);
 }
 
+//! A class that performs sampling with replacement in constant time per draw
+/**
+ * @class alias_sampler
+ * @author taylor
+ * @file rv_samp.h
+ * @brief Walker's alias method, with Vose's construction of the table. After
+ * the table is built from N weights (in O(N) time), each draw picks an index
+ * in (0,1,...N-1) with probability proportional to its weight using one
+ * uniform and at most one table lookup. All storage is fixed-size, so
+ * rebuilding the table never allocates. It does not own a random number
+ * generator; draws use the caller's, so they are as reproducible as the
+ * caller's seed.
+ * @tparam N the number of categories
+ * @tparam float_t the type of floating point number
+ */
+template <size_t N, typename float_t> class alias_sampler {
+public:
+  /**
+   * @brief builds the table from weights.
+   * @param w nonnegative (not necessarily normalized) weights, N of them
+   */
+  void setWeights(const float_t *w);
+
+  /**
+   * @brief builds the table from log weights.
+   * @param logWts log unnormalized weights, N of them
+   */
+  void setLogWeights(const float_t *logWts);
+
+  /**
+   * @brief draws one index.
+   * @param gen the random number generator to use
+   * @return an integer in (0,1,...N-1)
+   */
+  template <typename urng_t> unsigned int sample(urng_t &gen) const;
+
+private:
+  /**
+   * @brief turns the weights in m_prob into the alias table
+   * @param sum the sum of the weights
+   */
+  void build(float_t sum);
+
+  /** @brief the probability of keeping each column (instead of its alias) */
+  std::array<float_t, N> m_prob;
+
+  /** @brief the index each column falls back to */
+  std::array<unsigned int, N> m_alias;
+
+  /** @brief the small and large work lists used while building */
+  std::array<unsigned int, N> m_work;
+};
+
+template <size_t N, typename float_t>
+void alias_sampler<N, float_t>::setWeights(const float_t *w) {
+  std::copy(w, w + N, m_prob.begin());
+  build(std::accumulate(m_prob.begin(), m_prob.end(), float_t(0.0)));
+}
+
+template <size_t N, typename float_t>
+void alias_sampler<N, float_t>::setLogWeights(const float_t *logWts) {
+  build(kernels::expShift(logWts, m_prob.data(), N, kernels::max(logWts, N)));
+}
+
+template <size_t N, typename float_t>
+void alias_sampler<N, float_t>::build(float_t sum) {
+
+  // scale so the average column has probability one
+  kernels::normalize(m_prob.data(), N, sum / N);
+
+  // small columns are stacked from the front of m_work, large ones from the
+  // back; whenever one is popped from each, a slot opens up between them
+  size_t s = 0;
+  size_t l = N;
+  for (size_t i = 0; i < N; ++i) {
+    m_alias[i] = i;
+    if (m_prob[i] < 1.0)
+      m_work[s++] = i;
+    else
+      m_work[--l] = i;
+  }
+
+  // top up each small column with part of a large one
+  while (s > 0 && l < N) {
+    unsigned int small = m_work[--s];
+    unsigned int large = m_work[l++];
+    m_alias[small] = large;
+    m_prob[large] -= 1.0 - m_prob[small];
+    if (m_prob[large] < 1.0)
+      m_work[s++] = large;
+    else
+      m_work[--l] = large;
+  }
+
+  // whatever is left is full up to rounding error
+  for (size_t i = 0; i < s; ++i)
+    m_prob[m_work[i]] = 1.0;
+  for (size_t i = l; i < N; ++i)
+    m_prob[m_work[i]] = 1.0;
+}
+
+template <size_t N, typename float_t>
+template <typename urng_t>
+unsigned int alias_sampler<N, float_t>::sample(urng_t &gen) const {
+  // the integer part picks the column, the fractional part flips the coin
+  double u = std::uniform_real_distribution<double>(0.0, N)(gen);
+  unsigned int col = std::min(static_cast<size_t>(u), N - 1);
+  return (u - col < m_prob[col]) ? col : m_alias[col];
+}
+
+//! A counter-based random number generator
+/**
+ * @class counter_rng
+ * @author taylor
+ * @file rv_samp.h
+ * @brief The nth output of the stream (key, stream) is a fixed function of
+ * key, stream and n (SplitMix64's output function applied to an evenly spaced
+ * sequence), so any stream can be started, or skipped ahead, anywhere without
+ * generating what comes before it. Giving every unit of parallel work its own
+ * stream makes results independent of how the work is split across threads.
+ * It satisfies UniformRandomBitGenerator, so it also works with the standard
+ * distributions.
+ */
+class counter_rng {
+public:
+  /** type alias for the outputs */
+  using result_type = std::uint64_t;
+
+  /**
+   * @brief starts a stream at its beginning.
+   * @param key e.g. a seed, or a value drawn once per call from a seeded
+   * generator
+   * @param stream which stream (e.g. the index of a particle)
+   */
+  counter_rng(std::uint64_t key, std::uint64_t stream);
+
+  /** @brief the smallest possible output */
+  static constexpr result_type min() { return 0; }
+
+  /** @brief the largest possible output */
+  static constexpr result_type max() { return ~result_type(0); }
+
+  /**
+   * @brief the next output of the stream
+   * @return 64 random bits
+   */
+  result_type operator()();
+
+  /**
+   * @brief the next output as a uniform on [0, 1) (with 53 random bits)
+   * @return a uniform random number
+   */
+  double unif();
+
+  /**
+   * @brief skips ahead in constant time
+   * @param n how many outputs to skip
+   */
+  void discard(std::uint64_t n);
+
+private:
+  /** @brief SplitMix64's spacing between successive states */
+  static constexpr std::uint64_t m_gamma = 0x9e3779b97f4a7c15ull;
+
+  /**
+   * @brief SplitMix64's output function
+   * @param z a state
+   * @return 64 well-mixed bits
+   */
+  static std::uint64_t mix(std::uint64_t z);
+
+  /** @brief the current state */
+  std::uint64_t m_state;
+};
+
+inline counter_rng::counter_rng(std::uint64_t key, std::uint64_t stream)
+    : m_state(mix(key ^ mix(stream + m_gamma))) {}
+
+inline std::uint64_t counter_rng::mix(std::uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+inline auto counter_rng::operator()() -> result_type {
+  m_state += m_gamma;
+  return mix(m_state);
+}
+
+inline double counter_rng::unif() {
+  return static_cast<double>((*this)() >> 11) * 0x1.0p-53;
+}
+
+inline void counter_rng::discard(std::uint64_t n) { m_state += n * m_gamma; }
+
 //! A class that performs sampling with replacement (useful for the index
 //! sampler in an APF)
 /**
  * @class k_gen
  * @author taylor
  * @file rv_samp.h
- * @brief Basically a wrapper for std::discrete_distribution<>
+ * @brief Samples indexes with replacement with an alias_sampler
  * outputs are in the rage (0,1,...N-1)
  */
 template <size_t N, typename float_t> class k_gen : public rvsamp_base {
@@ -682,6 +883,10 @@ public:
    * @return the integers in a std::array<unsigned int, N>
    */
   std::array<unsigned int, N> sample(const std::array<float_t, N> &logWts);
+
+private:
+  /** @brief the alias table, rebuilt on every call to sample() */
+  alias_sampler<N, float_t> m_kGen;
 };
 
 template <size_t N, typename float_t>
@@ -690,24 +895,14 @@ k_gen<N, float_t>::k_gen() : rvsamp_base() {}
 template <size_t N, typename float_t>
 std::array<unsigned int, N>
 k_gen<N, float_t>::sample(const std::array<float_t, N> &logWts) {
-  // these log weights may be very negative. If that's the case, exponentiating
-  // them may cause underflow so we use the "log-exp-sum" trick actually not
-  // quite...we just shift the log-weights because after they're exponentiated
-  // they have the same normalized probabilities
-
-  // Create the distribution with exponentiated log-weights
-  // subtract the max first to prevent underflow
-  // normalization is taken care of by std::discrete_distribution
-  std::array<float_t, N> w;
-  float_t m = *std::max_element(logWts.begin(), logWts.end());
-  std::transform(logWts.begin(), logWts.end(), w.begin(),
-                 [&m](float_t d) -> float_t { return std::exp(d - m); });
-  std::discrete_distribution<> kGen(w.begin(), w.end());
+  // these log weights may be very negative, so the table is built from
+  // exponentiated weights after subtracting the largest log weight
+  m_kGen.setLogWeights(logWts.data());
 
   // sample and return ks
   std::array<unsigned int, N> ks;
   for (size_t i = 0; i < N; ++i) {
-    ks[i] = kGen(this->m_rng);
+    ks[i] = m_kGen.sample(this->m_rng);
   }
   return ks;
 }
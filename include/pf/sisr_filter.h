@@ -2,6 +2,8 @@
 #define SISR_FILTER_H
 
 #include <array>
+#include <iostream>
+#include <tuple> // apply, make_tuple
 
 #ifdef DROPPINGTHISINRPACKAGE
 #include <RcppEigen.h>
@@ -11,17 +13,25 @@
 #endif
 
 #include "pf_base.h"
+#include "weight_kernels.h"
 
 namespace pf {
 
 namespace filters {
 
-//! A base class for the Sequential Important Sampling with Resampling (SISR).
+//! CRTP (static dispatch) version of SISRFilter.
 /**
- * @class SISRFilter
+ * @class static_sisrfilter
  * @author taylor
  * @file sisr_filter.h
  * @brief SISR filter.
+ *
+ * The model hooks are resolved at compile time: Derived inherits from this
+ * class and provides logMuEv, q1Samp, logQ1Ev, logGEv, logFEv, qSamp and logQEv
+ * as public member functions with the same signatures as the pure virtual ones
+ * in SISRFilter, so they can be inlined into the particle loops. Derived may
+ * also provide its own logGEvBatch, logFEvBatch, qSampBatch or logQEvBatch.
+ * @tparam Derived the model class
  * @tparam nparts the number of particles
  * @tparam dimx the size of the state
  * @tparam the size of the observation
@@ -30,9 +40,9 @@ namespace filters {
  * double)
  * @tparam debug whether to debug or not
  */
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug = false>
-class SISRFilter : public bases::pf_base<float_t, dimy, dimx> {
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug = false>
+class static_sisrfilter : public bases::pf_base<float_t, dimy, dimx> {
 private:
   /** "state size vector" type alias for linear algebra stuff */
   using ssv = Eigen::Matrix<float_t, dimx, 1>;
@@ -49,13 +59,15 @@ public:
   /**
    * @brief The (one and only) constructor.
    * @param rs the resampling schedule (resample every rs time points).
+   * @param essFrac if positive, rs is ignored and the particles are resampled
+   * whenever the effective sample size drops below essFrac * nparts.
    */
-  SISRFilter(const unsigned int &rs = 1);
+  static_sisrfilter(const unsigned int &rs = 1, const float_t &essFrac = 0.0);
 
   /**
    * @brief The (virtual) destructor.
    */
-  virtual ~SISRFilter();
+  virtual ~static_sisrfilter();
 
   /**
    * @brief Returns the most recent (log-) conditional likelihood.
@@ -63,6 +75,40 @@ public:
    */
   float_t getLogCondLike() const;
 
+  /**
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
+   */
+  float_t getESS() const;
+
+  /**
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
+   */
+  bool getResampled() const;
+
+  /**
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
+   */
+  unsigned int getNumResamps() const;
+
+  /**
+   * @brief Reseeds the generator of the resampler. Generators that belong to
+   * the model are left alone. island_filter calls this on every island it
+   * copies, so a copy does not resample exactly like its ancestor.
+   * @param seed the new seed
+   */
+  void reseedGenerators(unsigned long seed);
+
+  /**
+   * @brief Takes the filter back to before its first time step, so it can be
+   * run again (e.g. on new parameters) without being rebuilt. The particle
+   * storage, the resampler and any generators are kept as they are.
+   */
+  void reset();
+
   /**
    * @brief return all stored expectations (taken with respect to
    * $p(x_t|y_{1:t})$
@@ -82,59 +128,59 @@ public:
                   std::vector<std::function<const Mat(const ssv &)>>());
 
   /**
-   * @brief  Calculate muEv or logmuEv
-   * @param x1 is a const Vec& describing the state sample
-   * @return the density or log-density evaluation as a float_t
-   */
-  virtual float_t logMuEv(const ssv &x1) = 0;
-
-  /**
-   * @brief Samples from time 1 proposal
-   * @param y1 is a const Vec& representing the first observed datum
-   * @return the sample as a Vec
-   */
-  virtual ssv q1Samp(const osv &y1) = 0;
-
-  /**
-   * @brief Calculate q1Ev or log q1Ev
-   * @param x1 is a const Vec& describing the time 1 state sample
-   * @param y1 is a const Vec& describing the time 1 datum
-   * @return the density or log-density evaluation as a float_t
+   * @brief updates filtering distribution on a new datapoint and returns
+   * expectations of functionals whose types are known at compile time. Each
+   * h in hs is called with a state and returns a scalar or a fixed-size Eigen
+   * matrix. The weighted sums are accumulated in that type, so unlike the
+   * std::function version nothing is allocated per particle and every h can
+   * be inlined. getExpectations() returns an empty vector after a call to
+   * this overload.
+   * @param data the most recent data point
+   * @param hs a std::tuple of functors
+   * @return a std::tuple with E[h(x_t) | y_{1:t}] for every h in hs
    */
-  virtual float_t logQ1Ev(const ssv &x1, const osv &y1) = 0;
+  template <typename... Hs>
+  auto filter(const osv &data, const std::tuple<Hs...> &hs)
+      -> std::tuple<bases::expectation_t<Hs, ssv>...>;
 
   /**
-   * @brief Calculate gEv or logGEv
+   * @brief Calculate logGEv for every particle at once. The default calls
+   * logGEv once per particle; override it to vectorize the computation.
    * @param yt is a const Vec& describing the time t datum
-   * @param xt is a const Vec& describing the time t state
-   * @return the density or log-density evaluation as a float_t
+   * @param xt all of the time t states
+   * @param out where the nparts evaluations are written
    */
-  virtual float_t logGEv(const osv &yt, const ssv &xt) = 0;
+  void logGEvBatch(const osv &yt, const arrayStates &xt, arrayfloat_t &out);
 
   /**
-   * @brief Evaluates the state transition density.
-   * @param xt the current state
-   * @param xtm1 the previous state
-   * @return a float_t evaluaton of the log density/pmf
+   * @brief Evaluates the state transition density for every particle at once.
+   * The default calls logFEv once per particle.
+   * @param xt all of the current states
+   * @param xtm1 all of the previous states
+   * @param out where the nparts evaluations are written
    */
-  virtual float_t logFEv(const ssv &xt, const ssv &xtm1) = 0;
+  void logFEvBatch(const arrayStates &xt, const arrayStates &xtm1,
+                   arrayfloat_t &out);
 
   /**
-   * @brief Samples from the proposal/instrumental/importance density at time t
-   * @param xtm1 the previous state sample
+   * @brief Samples from the proposal for every particle at once. The default
+   * calls qSamp once per particle.
+   * @param xtm1 all of the previous state samples
    * @param yt the current observation
-   * @return a state sample for the current time xt
+   * @param xt where the current state samples are written
    */
-  virtual ssv qSamp(const ssv &xtm1, const osv &yt) = 0;
+  void qSampBatch(const arrayStates &xtm1, const osv &yt, arrayStates &xt);
 
   /**
-   * @brief Evaluates the proposal/instrumental/importance density/pmf
-   * @param xt current state
-   * @param xtm1 previous state
+   * @brief Evaluates the proposal density/pmf for every particle at once. The
+   * default calls logQEv once per particle.
+   * @param xt all of the current states
+   * @param xtm1 all of the previous states
    * @param yt current observation
-   * @return a float_t evaluation of the log density/pmf
+   * @param out where the nparts evaluations are written
    */
-  virtual float_t logQEv(const ssv &xt, const ssv &xtm1, const osv &yt) = 0;
+  void logQEvBatch(const arrayStates &xt, const arrayStates &xtm1,
+                   const osv &yt, arrayfloat_t &out);
 
 protected:
   /** @brief particle samples */
@@ -158,186 +204,507 @@ protected:
   /** @brief resampling schedule (e.g. resample every __ time points) */
   unsigned int m_resampSched;
 
+  /** @brief resample when the ESS drops below this fraction of nparts (if
+   * positive) */
+  float_t m_essFrac;
+
+  /** @brief the most recent effective sample size */
+  float_t m_ess;
+
+  /** @brief whether the most recent step resampled */
+  bool m_resampled;
+
+  /** @brief how many times the particles have been resampled */
+  unsigned int m_numResamps;
+
+  /** @brief exp(log weight - max log weight), filled once per time step */
+  arrayfloat_t m_expWts;
+
+  /** @brief log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
+
   /**
    * @todo implement ESS stuff
    */
+
+  /**
+   * @brief samples and weights the particles for one time step, then
+   * exponentiates the weights into m_expWts and updates the log conditional
+   * likelihood and the ESS
+   * @param data the most recent data point
+   * @return the sum of m_expWts
+   */
+  float_t weightStep(const osv &data);
+
+  /**
+   * @brief the weighted average of h over the current particles
+   * @param h a functor taking a state
+   * @param sumExp the sum of m_expWts
+   * @return E[h(x_t) | y_{1:t}]
+   */
+  template <typename H>
+  auto weightedMean(const H &h, float_t sumExp) -> bases::expectation_t<H, ssv>;
+
+  /**
+   * @brief resamples if it is time to, and advances the time step
+   */
+  void resampleStep();
+
+  /**
+   * @brief this object as the model class (the CRTP cast)
+   * @return a reference to the model
+   */
+  Derived &derived();
 };
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::SISRFilter(
-    const unsigned int &rs)
-    : m_now(0), m_logLastCondLike(0.0), m_resampSched(rs) {
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                  debug>::static_sisrfilter(const unsigned int &rs,
+                                            const float_t &essFrac)
+    : m_now(0), m_logLastCondLike(0.0), m_resampSched(rs), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nparts)), m_resampled(false), m_numResamps(0),
+      m_logOldWtSum(std::log(static_cast<float_t>(nparts))) {
   std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(),
             0.0); // log(1) = 0
 }
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::~SISRFilter() {}
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                  debug>::~static_sisrfilter() {}
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
 float_t
-SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::getLogCondLike()
+static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                  debug>::getLogCondLike()
     const {
   return m_logLastCondLike;
 }
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-auto SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::getExpectations()
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+float_t static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                          debug>::getESS() const {
+  return m_ess;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+bool static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+unsigned int static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                               debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::reseedGenerators(unsigned long seed) {
+  m_resampler.seed(seed);
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::reset() {
+  m_now = 0;
+  m_logLastCondLike = 0.0;
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
+  m_ess = static_cast<float_t>(nparts);
+  m_resampled = false;
+  m_numResamps = 0;
+  m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+auto static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::getExpectations()
     const -> std::vector<Mat> {
   return m_expectations;
 }
 
-template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
-          typename float_t, bool debug>
-void SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
-    const osv &data,
-    const std::vector<std::function<const Mat(const ssv &)>> &fs) {
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::logGEvBatch(
+    const osv &yt, const arrayStates &xt, arrayfloat_t &out) {
+  for (size_t ii = 0; ii < nparts; ++ii)
+    out[ii] = derived().logGEv(yt, xt[ii]);
+}
 
-  if (m_now > 0) {
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::logFEvBatch(
+    const arrayStates &xt, const arrayStates &xtm1, arrayfloat_t &out) {
+  for (size_t ii = 0; ii < nparts; ++ii)
+    out[ii] = derived().logFEv(xt[ii], xtm1[ii]);
+}
 
-    // try to iterate over particles all at once
-    ssv newSamp;
-    arrayfloat_t oldLogUnNormWts = m_logUnNormWeights;
-    float_t maxOldLogUnNormWts(-std::numeric_limits<float_t>::infinity());
-    for (size_t ii = 0; ii < nparts; ++ii) {
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::qSampBatch(
+    const arrayStates &xtm1, const osv &yt, arrayStates &xt) {
+  for (size_t ii = 0; ii < nparts; ++ii)
+    xt[ii] = derived().qSamp(xtm1[ii], yt);
+}
 
-      // update max of old logUnNormWts before you change the element
-      if (m_logUnNormWeights[ii] > maxOldLogUnNormWts)
-        maxOldLogUnNormWts = m_logUnNormWeights[ii];
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::logQEvBatch(
+    const arrayStates &xt, const arrayStates &xtm1, const osv &yt,
+    arrayfloat_t &out) {
+  for (size_t ii = 0; ii < nparts; ++ii)
+    out[ii] = derived().logQEv(xt[ii], xtm1[ii], yt);
+}
 
-      // sample and get weight adjustments
-      newSamp = qSamp(m_particles[ii], data);
-      m_logUnNormWeights[ii] += logFEv(newSamp, m_particles[ii]);
-      m_logUnNormWeights[ii] += logGEv(data, newSamp);
-      m_logUnNormWeights[ii] -= logQEv(newSamp, m_particles[ii], data);
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::filter(
+    const osv &data,
+    const std::vector<std::function<const Mat(const ssv &)>> &fs) {
 
-      // overwrite stuff
-      m_particles[ii] = newSamp;
+  // fs may be a different size than last time (or than at time 1)
+  if (m_expectations.size() != fs.size())
+    m_expectations.resize(fs.size());
+  float_t sumExp = weightStep(data);
+
+  // calculate expectations before you resample
+  unsigned int fId(0);
+  for (auto &h : fs) { // iterate over all functions
 
+    Mat numer = h(m_particles[0]) * m_expWts[0];
+    for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+      numer += h(m_particles[prtcl]) * m_expWts[prtcl];
+    m_expectations[fId] = numer / sumExp;
+
+// print stuff if debug mode is on
 #ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "time: " << m_now
-                  << ", transposed sample: " << m_particles[ii].transpose()
-                  << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
+    if constexpr (debug)
+      std::cout << "transposed expectation " << fId << ": "
+                << m_expectations[fId].transpose() << "\n";
 #endif
-    }
 
-    // compute estimate of log p(y_t|y_{1:t-1}) with log-exp-sum trick
-    float_t maxNumer = *std::max_element(
-        m_logUnNormWeights.begin(),
-        m_logUnNormWeights.end()); // because you added log adjustments
-    float_t sumExp1(0.0);
-    float_t sumExp2(0.0);
-    for (size_t i = 0; i < nparts; ++i) {
-      sumExp1 += std::exp(m_logUnNormWeights[i] - maxNumer);
-      sumExp2 += std::exp(oldLogUnNormWts[i] - maxOldLogUnNormWts);
-    }
-    m_logLastCondLike =
-        maxNumer + std::log(sumExp1) - maxOldLogUnNormWts - std::log(sumExp2);
+    fId++;
+  }
 
-    // calculate expectations before you resample
-    unsigned int fId(0);
-    float_t weightNormConst(0.0);
-    for (auto &h : fs) { // iterate over all functions
+  resampleStep();
+}
 
-      Mat testOut = h(m_particles[0]);
-      unsigned int rows = testOut.rows();
-      unsigned int cols = testOut.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+template <typename... Hs>
+auto static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::filter(const osv &data,
+                                      const std::tuple<Hs...> &hs)
+    -> std::tuple<bases::expectation_t<Hs, ssv>...> {
+
+  // no std::function expectations are stored at this time step
+  m_expectations.clear();
+  float_t sumExp = weightStep(data);
+
+  // calculate expectations before you resample
+  auto expectations = std::apply(
+      [this, sumExp](const auto &...h) {
+        return std::make_tuple(weightedMean(h, sumExp)...);
+      },
+      hs);
+
+  resampleStep();
+  return expectations;
+}
 
-      for (size_t prtcl = 0; prtcl < nparts;
-           ++prtcl) { // iterate over all particles
-        numer += h(m_particles[prtcl]) *
-                 std::exp(m_logUnNormWeights[prtcl] - maxNumer);
-        denom += std::exp(m_logUnNormWeights[prtcl] - maxNumer);
-      }
-      m_expectations[fId] = numer / denom;
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+float_t static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                          debug>::weightStep(const osv &data) {
 
-// print stuff if debug mode is on
-#ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "transposed expectation " << fId << ": "
-                  << m_expectations[fId].transpose() << "\n";
-#endif
+  if (m_now > 0) {
 
-      fId++;
-    }
+    // sample and get weight adjustments for all particles at once
+    arrayStates newSamps;
+    derived().qSampBatch(m_particles, data, newSamps);
+    arrayfloat_t logFs, logGs, logQs;
+    derived().logFEvBatch(newSamps, m_particles, logFs);
+    derived().logGEvBatch(data, newSamps, logGs);
+    derived().logQEvBatch(newSamps, m_particles, data, logQs);
 
-    // resample if you should
-    if ((m_now + 1) % m_resampSched == 0)
-      m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+    // overwrite stuff
+    m_particles = newSamps;
+    for (size_t ii = 0; ii < nparts; ++ii)
+      m_logUnNormWeights[ii] += logFs[ii] + logGs[ii] - logQs[ii];
 
-    // advance time
-    m_now += 1;
   } else // (m_now == 0) //time 1
   {
 
-    // only need to iterate over particles once
-    float_t sumWts(0.0);
+    // sample particles
+    for (size_t ii = 0; ii < nparts; ++ii)
+      m_particles[ii] = derived().q1Samp(data);
+    arrayfloat_t logGs;
+    derived().logGEvBatch(data, m_particles, logGs);
+
     for (size_t ii = 0; ii < nparts; ++ii) {
-      // sample particles
-      m_particles[ii] = q1Samp(data);
-      m_logUnNormWeights[ii] += logMuEv(m_particles[ii]);
-      m_logUnNormWeights[ii] += logGEv(data, m_particles[ii]);
-      m_logUnNormWeights[ii] -= logQ1Ev(m_particles[ii], data);
+      m_logUnNormWeights[ii] += derived().logMuEv(m_particles[ii]);
+      m_logUnNormWeights[ii] += logGs[ii];
+      m_logUnNormWeights[ii] -= derived().logQ1Ev(m_particles[ii], data);
+    }
+  }
 
 #ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "time: " << m_now
-                  << ", transposed sample: " << m_particles[ii].transpose()
-                  << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
+  if constexpr (debug)
+    for (size_t ii = 0; ii < nparts; ++ii)
+      std::cout << "time: " << m_now
+                << ", transposed sample: " << m_particles[ii].transpose()
+                << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
 #endif
-    }
 
-    // calculate log cond likelihood with log-exp-sum trick
-    float_t max =
-        *std::max_element(m_logUnNormWeights.begin(), m_logUnNormWeights.end());
-    float_t sumExp(0.0);
-    for (size_t i = 0; i < nparts; ++i) {
-      sumExp += std::exp(m_logUnNormWeights[i] - max);
-    }
-    m_logLastCondLike = -std::log(nparts) + max + std::log(sumExp);
+  // exponentiate the weights once (log-exp-sum trick) and use them for
+  // log p(y_t|y_{1:t-1}), the ESS and the expectations
+  float_t maxNumer = kernels::max(m_logUnNormWeights.data(), nparts);
+  float_t sumExp = kernels::expShift(
+      m_logUnNormWeights.data(), m_expWts.data(), nparts, maxNumer);
+  m_logLastCondLike = maxNumer + std::log(sumExp) - m_logOldWtSum;
+  m_ess = kernels::ess(m_expWts.data(), nparts, sumExp);
+  return sumExp;
+}
 
-    // calculate expectations before you resample
-    m_expectations.resize(fs.size());
-    unsigned int fId(0);
-    for (auto &h : fs) {
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+template <typename H>
+auto static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::weightedMean(const H &h, float_t sumExp)
+    -> bases::expectation_t<H, ssv> {
+  bases::expectation_t<H, ssv> numer = h(m_particles[0]) * m_expWts[0];
+  for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+    numer += h(m_particles[prtcl]) * m_expWts[prtcl];
+  return numer / sumExp;
+}
 
-      Mat testOut = h(m_particles[0]);
-      unsigned int rows = testOut.rows();
-      unsigned int cols = testOut.cols();
-      Mat numer = Mat::Zero(rows, cols);
-      float_t denom(0.0);
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+void static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                       debug>::resampleStep() {
+
+  // resample if you should (this sets all the log weights to 0)
+  m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                : (m_now + 1) % m_resampSched == 0;
+  if (m_resampled) {
+    m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+    m_numResamps++;
+    m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+  } else {
+    // (that is, max log weight + log sum of the exponentiated weights)
+    m_logOldWtSum += m_logLastCondLike;
+  }
+
+  // advance time
+  m_now += 1;
+}
+
+template <typename Derived, size_t nparts, size_t dimx, size_t dimy,
+          typename resamp_t, typename float_t, bool debug>
+Derived &static_sisrfilter<Derived, nparts, dimx, dimy, resamp_t, float_t,
+                           debug>::derived() {
+  return static_cast<Derived &>(*this);
+}
+
+//! A base class for the Sequential Important Sampling with Resampling (SISR).
+/**
+ * @class SISRFilter
+ * @author taylor
+ * @file sisr_filter.h
+ * @brief SISR filter.
+ * @tparam nparts the number of particles
+ * @tparam dimx the size of the state
+ * @tparam the size of the observation
+ * @tparam resamp_t the type of resampler
+ * @tparam float_t the type of floating point numbers used (e.g. float or
+ * double)
+ * @tparam debug whether to debug or not
+ */
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug = false>
+class SISRFilter
+    : public static_sisrfilter<
+          SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>, nparts,
+          dimx, dimy, resamp_t, float_t, debug> {
+private:
+  /** "state size vector" type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** "obs size vector" type alias for linear algebra stuff */
+  using osv = Eigen::Matrix<float_t, dimy, 1>; // obs size vec
+  /** type alias for linear algebra stuff */
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** type alias for linear algebra stuff */
+  using arrayStates = std::array<ssv, nparts>;
+  /** type alias for array of float_ts */
+  using arrayfloat_t = std::array<float_t, nparts>;
+
+  /** the static base class that runs the filter */
+  using base_t =
+      static_sisrfilter<SISRFilter, nparts, dimx, dimy, resamp_t, float_t,
+                        debug>;
+
+public:
+  /**
+   * @brief The (one and only) constructor.
+   * @param rs the resampling schedule (resample every rs time points).
+   * @param essFrac if positive, rs is ignored and the particles are resampled
+   * whenever the effective sample size drops below essFrac * nparts.
+   */
+  SISRFilter(const unsigned int &rs = 1, const float_t &essFrac = 0.0);
+
+  /**
+   * @brief The (virtual) destructor.
+   */
+  virtual ~SISRFilter();
+
+  /**
+   * @brief  Calculate muEv or logmuEv
+   * @param x1 is a const Vec& describing the state sample
+   * @return the density or log-density evaluation as a float_t
+   */
+  virtual float_t logMuEv(const ssv &x1) = 0;
+
+  /**
+   * @brief Samples from time 1 proposal
+   * @param y1 is a const Vec& representing the first observed datum
+   * @return the sample as a Vec
+   */
+  virtual ssv q1Samp(const osv &y1) = 0;
+
+  /**
+   * @brief Calculate q1Ev or log q1Ev
+   * @param x1 is a const Vec& describing the time 1 state sample
+   * @param y1 is a const Vec& describing the time 1 datum
+   * @return the density or log-density evaluation as a float_t
+   */
+  virtual float_t logQ1Ev(const ssv &x1, const osv &y1) = 0;
+
+  /**
+   * @brief Calculate gEv or logGEv
+   * @param yt is a const Vec& describing the time t datum
+   * @param xt is a const Vec& describing the time t state
+   * @return the density or log-density evaluation as a float_t
+   */
+  virtual float_t logGEv(const osv &yt, const ssv &xt) = 0;
+
+  /**
+   * @brief Evaluates the state transition density.
+   * @param xt the current state
+   * @param xtm1 the previous state
+   * @return a float_t evaluaton of the log density/pmf
+   */
+  virtual float_t logFEv(const ssv &xt, const ssv &xtm1) = 0;
+
+  /**
+   * @brief Samples from the proposal/instrumental/importance density at time t
+   * @param xtm1 the previous state sample
+   * @param yt the current observation
+   * @return a state sample for the current time xt
+   */
+  virtual ssv qSamp(const ssv &xtm1, const osv &yt) = 0;
+
+  /**
+   * @brief Evaluates the proposal/instrumental/importance density/pmf
+   * @param xt current state
+   * @param xtm1 previous state
+   * @param yt current observation
+   * @return a float_t evaluation of the log density/pmf
+   */
+  virtual float_t logQEv(const ssv &xt, const ssv &xtm1, const osv &yt) = 0;
+
+  /**
+   * @brief Calculate logGEv for every particle at once. The default calls
+   * logGEv once per particle; override it to vectorize the computation.
+   * @param yt is a const Vec& describing the time t datum
+   * @param xt all of the time t states
+   * @param out where the nparts evaluations are written
+   */
+  virtual void logGEvBatch(const osv &yt, const arrayStates &xt,
+                           arrayfloat_t &out);
+
+  /**
+   * @brief Evaluates the state transition density for every particle at once.
+   * The default calls logFEv once per particle.
+   * @param xt all of the current states
+   * @param xtm1 all of the previous states
+   * @param out where the nparts evaluations are written
+   */
+  virtual void logFEvBatch(const arrayStates &xt, const arrayStates &xtm1,
+                           arrayfloat_t &out);
+
+  /**
+   * @brief Samples from the proposal for every particle at once. The default
+   * calls qSamp once per particle.
+   * @param xtm1 all of the previous state samples
+   * @param yt the current observation
+   * @param xt where the current state samples are written
+   */
+  virtual void qSampBatch(const arrayStates &xtm1, const osv &yt,
+                          arrayStates &xt);
+
+  /**
+   * @brief Evaluates the proposal density/pmf for every particle at once. The
+   * default calls logQEv once per particle.
+   * @param xt all of the current states
+   * @param xtm1 all of the previous states
+   * @param yt current observation
+   * @param out where the nparts evaluations are written
+   */
+  virtual void logQEvBatch(const arrayStates &xt, const arrayStates &xtm1,
+                           const osv &yt, arrayfloat_t &out);
+};
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::SISRFilter(
+    const unsigned int &rs, const float_t &essFrac)
+    : base_t(rs, essFrac) {}
 
-      for (size_t prtcl = 0; prtcl < nparts; ++prtcl) {
-        numer +=
-            h(m_particles[prtcl]) * std::exp(m_logUnNormWeights[prtcl] - max);
-        denom += std::exp(m_logUnNormWeights[prtcl] - max);
-      }
-      m_expectations[fId] = numer / denom;
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::~SISRFilter() {}
 
-// print stuff if debug mode is on
-#ifndef DROPPINGTHISINRPACKAGE
-      if constexpr (debug)
-        std::cout << "transposed expectation " << fId << ": "
-                  << m_expectations[fId].transpose() << "\n";
-#endif
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::logGEvBatch(
+    const osv &yt, const arrayStates &xt, arrayfloat_t &out) {
+  base_t::logGEvBatch(yt, xt, out);
+}
 
-      fId++;
-    }
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::logFEvBatch(
+    const arrayStates &xt, const arrayStates &xtm1, arrayfloat_t &out) {
+  base_t::logFEvBatch(xt, xtm1, out);
+}
 
-    // resample if you should
-    if ((m_now + 1) % m_resampSched == 0)
-      m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::qSampBatch(
+    const arrayStates &xtm1, const osv &yt, arrayStates &xt) {
+  base_t::qSampBatch(xtm1, yt, xt);
+}
 
-    // advance time step
-    m_now += 1;
-  }
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void SISRFilter<nparts, dimx, dimy, resamp_t, float_t, debug>::logQEvBatch(
+    const arrayStates &xt, const arrayStates &xtm1, const osv &yt,
+    arrayfloat_t &out) {
+  base_t::logQEvBatch(xt, xtm1, yt, out);
 }
 
 //! A base class for the Sequential Important Sampling with Resampling (SISR).
@@ -564,21 +931,16 @@ void SISRFilterCRN<nparts, dimx, dimy, dimu, dimur, resamp_t, float_t, debug>::
     }
 
     // compute estimate of log p(y_t|y_{1:t-1}) with log-exp-sum trick
-    float_t maxNumer = *std::max_element(
-        m_logUnNormWeights.begin(),
-        m_logUnNormWeights.end()); // because you added log adjustments
-    float_t sumExp1(0.0);
-    float_t sumExp2(0.0);
-    for (size_t i = 0; i < nparts; ++i) {
-      sumExp1 += std::exp(m_logUnNormWeights[i] - maxNumer);
-      sumExp2 += std::exp(oldLogUnNormWts[i] - maxOldLogUnNormWts);
-    }
+    float_t maxNumer = kernels::max(m_logUnNormWeights.data(), nparts);
+    float_t sumExp1 =
+        kernels::sumExpShift(m_logUnNormWeights.data(), nparts, maxNumer);
+    float_t sumExp2 = kernels::sumExpShift(oldLogUnNormWts.data(), nparts,
+                                           maxOldLogUnNormWts);
     m_logLastCondLike =
         maxNumer + std::log(sumExp1) - maxOldLogUnNormWts - std::log(sumExp2);
 
     // calculate expectations before you resample
     unsigned int fId(0);
-    float_t weightNormConst(0.0);
     for (auto &h : fs) { // iterate over all functions
 
       Mat testOut = h(m_particles[0]);
@@ -615,7 +977,6 @@ void SISRFilterCRN<nparts, dimx, dimy, dimu, dimur, resamp_t, float_t, debug>::
   {
 
     // only need to iterate over particles once
-    float_t sumWts(0.0);
     for (size_t ii = 0; ii < nparts; ++ii) {
       // sample particles
       m_particles[ii] = Xi1(Uarr[ii], data);
@@ -632,12 +993,9 @@ void SISRFilterCRN<nparts, dimx, dimy, dimu, dimur, resamp_t, float_t, debug>::
     }
 
     // calculate log cond likelihood with log-exp-sum trick
-    float_t max =
-        *std::max_element(m_logUnNormWeights.begin(), m_logUnNormWeights.end());
-    float_t sumExp(0.0);
-    for (size_t i = 0; i < nparts; ++i) {
-      sumExp += std::exp(m_logUnNormWeights[i] - max);
-    }
+    float_t max = kernels::max(m_logUnNormWeights.data(), nparts);
+    float_t sumExp =
+        kernels::sumExpShift(m_logUnNormWeights.data(), nparts, max);
     m_logLastCondLike = -std::log(nparts) + max + std::log(sumExp);
 
     // calculate expectations before you resample
@@ -677,6 +1035,370 @@ void SISRFilterCRN<nparts, dimx, dimy, dimu, dimur, resamp_t, float_t, debug>::
   }
 }
 
+//! A base class for the SISR filter that stores its particles in one matrix.
+/**
+ * @class SISRFilterSoA
+ * @author taylor
+ * @file sisr_filter.h
+ * @brief SISR filter with "structure of arrays" storage. The particles are
+ * the columns of one dimx x nparts matrix, so the weights and each state
+ * coordinate are contiguous in memory and the weighting, likelihood and
+ * expectation loops can be vectorized. Hooks receive (read-only) views of
+ * columns, so nothing is copied on the way in. The resampler must provide
+ * resampLogWts(Eigen::Matrix<float_t, dimx, Eigen::Dynamic>&, arrayfloat_t&),
+ * which the standard resamplers in resamplers.h do.
+ * @tparam nparts the number of particles
+ * @tparam dimx the size of the state
+ * @tparam the size of the observation
+ * @tparam resamp_t the type of resampler
+ * @tparam float_t the type of floating point numbers used (e.g. float or
+ * double)
+ * @tparam debug whether to debug or not
+ */
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug = false>
+class SISRFilterSoA : public bases::pf_base<float_t, dimy, dimx> {
+private:
+  /** "state size vector" type alias for linear algebra stuff */
+  using ssv = Eigen::Matrix<float_t, dimx, 1>;
+  /** "obs size vector" type alias for linear algebra stuff */
+  using osv = Eigen::Matrix<float_t, dimy, 1>; // obs size vec
+  /** type alias for linear algebra stuff */
+  using Mat = Eigen::Matrix<float_t, Eigen::Dynamic, Eigen::Dynamic>;
+  /** type alias for all particles (one per column) */
+  using soaStates = Eigen::Matrix<float_t, dimx, Eigen::Dynamic>;
+  /** type alias for a read-only view of one particle */
+  using ssvRef = Eigen::Ref<const ssv>;
+  /** type alias for array of float_ts */
+  using arrayfloat_t = std::array<float_t, nparts>;
+  /** type alias for vectorized operations on the weights */
+  using wtArray = Eigen::Array<float_t, Eigen::Dynamic, 1>;
+
+public:
+  /**
+   * @brief The (one and only) constructor.
+   * @param rs the resampling schedule (resample every rs time points).
+   * @param essFrac if positive, rs is ignored and the particles are resampled
+   * whenever the effective sample size drops below essFrac * nparts.
+   */
+  SISRFilterSoA(const unsigned int &rs = 1, const float_t &essFrac = 0.0);
+
+  /**
+   * @brief The (virtual) destructor.
+   */
+  virtual ~SISRFilterSoA();
+
+  /**
+   * @brief Returns the most recent (log-) conditional likelihood.
+   * @return log p(y_t | y_{1:t-1}) or log p(y_1)
+   */
+  float_t getLogCondLike() const;
+
+  /**
+   * @brief Returns the effective sample size of the most recent weights
+   * (before any resampling).
+   * @return (sum_i w_i)^2 / sum_i w_i^2
+   */
+  float_t getESS() const;
+
+  /**
+   * @brief Whether the most recent call to filter() resampled.
+   * @return true if the particles were resampled
+   */
+  bool getResampled() const;
+
+  /**
+   * @brief The number of times the particles have been resampled so far.
+   * @return the number of resampling steps
+   */
+  unsigned int getNumResamps() const;
+
+  /**
+   * @brief Reseeds the generator of the resampler. Generators that belong to
+   * the model are left alone. island_filter calls this on every island it
+   * copies, so a copy does not resample exactly like its ancestor.
+   * @param seed the new seed
+   */
+  void reseedGenerators(unsigned long seed);
+
+  /**
+   * @brief Takes the filter back to before its first time step, so it can be
+   * run again (e.g. on new parameters) without being rebuilt. The particle
+   * storage, the resampler and any generators are kept as they are.
+   */
+  void reset();
+
+  /**
+   * @brief return all stored expectations (taken with respect to
+   * $p(x_t|y_{1:t})$
+   * @return return a std::vector<Mat> of expectations. How many depends on how
+   * many callbacks you gave to
+   */
+  std::vector<Mat> getExpectations() const;
+
+  /**
+   * @brief updates filtering distribution on a new datapoint.
+   * Optionally stores expectations of functionals.
+   * @param data the most recent data point
+   * @param fs a vector of functions if you want to calculate expectations.
+   */
+  void filter(const osv &data,
+              const std::vector<std::function<const Mat(const ssv &)>> &fs =
+                  std::vector<std::function<const Mat(const ssv &)>>());
+
+  /**
+   * @brief  Calculate muEv or logmuEv
+   * @param x1 is a view of the state sample
+   * @return the density or log-density evaluation as a float_t
+   */
+  virtual float_t logMuEv(const ssvRef &x1) = 0;
+
+  /**
+   * @brief Samples from time 1 proposal
+   * @param y1 is a const Vec& representing the first observed datum
+   * @return the sample as a Vec
+   */
+  virtual ssv q1Samp(const osv &y1) = 0;
+
+  /**
+   * @brief Calculate q1Ev or log q1Ev
+   * @param x1 is a view of the time 1 state sample
+   * @param y1 is a const Vec& describing the time 1 datum
+   * @return the density or log-density evaluation as a float_t
+   */
+  virtual float_t logQ1Ev(const ssvRef &x1, const osv &y1) = 0;
+
+  /**
+   * @brief Calculate gEv or logGEv
+   * @param yt is a const Vec& describing the time t datum
+   * @param xt is a view of the time t state
+   * @return the density or log-density evaluation as a float_t
+   */
+  virtual float_t logGEv(const osv &yt, const ssvRef &xt) = 0;
+
+  /**
+   * @brief Evaluates the state transition density.
+   * @param xt the current state
+   * @param xtm1 the previous state
+   * @return a float_t evaluaton of the log density/pmf
+   */
+  virtual float_t logFEv(const ssvRef &xt, const ssvRef &xtm1) = 0;
+
+  /**
+   * @brief Samples from the proposal/instrumental/importance density at time t
+   * @param xtm1 the previous state sample
+   * @param yt the current observation
+   * @return a state sample for the current time xt
+   */
+  virtual ssv qSamp(const ssvRef &xtm1, const osv &yt) = 0;
+
+  /**
+   * @brief Evaluates the proposal/instrumental/importance density/pmf
+   * @param xt current state
+   * @param xtm1 previous state
+   * @param yt current observation
+   * @return a float_t evaluation of the log density/pmf
+   */
+  virtual float_t logQEv(const ssvRef &xt, const ssvRef &xtm1,
+                         const osv &yt) = 0;
+
+protected:
+  /** @brief particle samples (one per column) */
+  soaStates m_particles;
+
+  /** @brief particle weights */
+  arrayfloat_t m_logUnNormWeights;
+
+  /** @brief current time point */
+  unsigned int m_now;
+
+  /** @brief log p(y_t|y_{1:t-1}) or log p(y1) */
+  float_t m_logLastCondLike;
+
+  /** @brief resampling object */
+  resamp_t m_resampler;
+
+  /** @brief expectations E[h(x_t) | y_{1:t}] for user defined "h"s */
+  std::vector<Mat> m_expectations; // stores any sample averages the user wants
+
+  /** @brief resampling schedule (e.g. resample every __ time points) */
+  unsigned int m_resampSched;
+
+  /** @brief resample when the ESS drops below this fraction of nparts (if
+   * positive) */
+  float_t m_essFrac;
+
+  /** @brief the most recent effective sample size */
+  float_t m_ess;
+
+  /** @brief whether the most recent step resampled */
+  bool m_resampled;
+
+  /** @brief how many times the particles have been resampled */
+  unsigned int m_numResamps;
+
+  /** @brief exp(log weight - max log weight), filled once per time step */
+  wtArray m_expWts;
+
+  /** @brief log of the sum of the weights carried into the next time step */
+  float_t m_logOldWtSum;
+};
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+SISRFilterSoA<nparts, dimx, dimy, resamp_t, float_t, debug>::SISRFilterSoA(
+    const unsigned int &rs, const float_t &essFrac)
+    : m_particles(soaStates::Zero(dimx, nparts)), m_now(0),
+      m_logLastCondLike(0.0), m_resampSched(rs), m_essFrac(essFrac),
+      m_ess(static_cast<float_t>(nparts)), m_resampled(false),
+      m_numResamps(0), m_expWts(nparts),
+      m_logOldWtSum(std::log(static_cast<float_t>(nparts))) {
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(),
+            0.0); // log(1) = 0
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+SISRFilterSoA<nparts, dimx, dimy, resamp_t, float_t, debug>::~SISRFilterSoA() {
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+float_t SISRFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                      debug>::getLogCondLike() const {
+  return m_logLastCondLike;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+float_t SISRFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                      debug>::getESS() const {
+  return m_ess;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+bool SISRFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                   debug>::getResampled() const {
+  return m_resampled;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+unsigned int SISRFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                           debug>::getNumResamps() const {
+  return m_numResamps;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void SISRFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                   debug>::reseedGenerators(unsigned long seed) {
+  m_resampler.seed(seed);
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void SISRFilterSoA<nparts, dimx, dimy, resamp_t, float_t, debug>::reset() {
+  m_now = 0;
+  m_logLastCondLike = 0.0;
+  std::fill(m_logUnNormWeights.begin(), m_logUnNormWeights.end(), 0.0);
+  m_ess = static_cast<float_t>(nparts);
+  m_resampled = false;
+  m_numResamps = 0;
+  m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+auto SISRFilterSoA<nparts, dimx, dimy, resamp_t, float_t,
+                   debug>::getExpectations() const -> std::vector<Mat> {
+  return m_expectations;
+}
+
+template <size_t nparts, size_t dimx, size_t dimy, typename resamp_t,
+          typename float_t, bool debug>
+void SISRFilterSoA<nparts, dimx, dimy, resamp_t, float_t, debug>::filter(
+    const osv &data,
+    const std::vector<std::function<const Mat(const ssv &)>> &fs) {
+
+  Eigen::Map<wtArray> logWts(m_logUnNormWeights.data(), nparts);
+
+  if (m_now > 0) {
+
+    // sample and get weight adjustments
+    ssv newSamp;
+    for (size_t ii = 0; ii < nparts; ++ii) {
+      newSamp = qSamp(m_particles.col(ii), data);
+      logWts(ii) += logFEv(newSamp, m_particles.col(ii));
+      logWts(ii) += logGEv(data, newSamp);
+      logWts(ii) -= logQEv(newSamp, m_particles.col(ii), data);
+      m_particles.col(ii) = newSamp;
+    }
+  } else {
+    // sample from the time 1 proposal
+    for (size_t ii = 0; ii < nparts; ++ii) {
+      m_particles.col(ii) = q1Samp(data);
+      logWts(ii) += logMuEv(m_particles.col(ii));
+      logWts(ii) += logGEv(data, m_particles.col(ii));
+      logWts(ii) -= logQ1Ev(m_particles.col(ii), data);
+    }
+  }
+
+#ifndef DROPPINGTHISINRPACKAGE
+  if constexpr (debug)
+    for (size_t ii = 0; ii < nparts; ++ii)
+      std::cout << "time: " << m_now
+                << ", transposed sample: " << m_particles.col(ii).transpose()
+                << ", log unnorm weight: " << m_logUnNormWeights[ii] << "\n";
+#endif
+
+  // exponentiate the weights once (log-exp-sum trick) and use them for
+  // log p(y_t|y_{1:t-1}), the ESS and the expectations
+  float_t maxNumer = kernels::max(m_logUnNormWeights.data(), nparts);
+  float_t sumWts = kernels::expShift(m_logUnNormWeights.data(), m_expWts.data(),
+                                     nparts, maxNumer);
+  m_logLastCondLike = maxNumer + std::log(sumWts) - m_logOldWtSum;
+  m_ess = kernels::ess(m_expWts.data(), nparts, sumWts);
+
+  // fs may be a different size than last time (or than at time 1)
+  if (m_expectations.size() != fs.size())
+    m_expectations.resize(fs.size());
+
+  // calculate expectations before you resample
+  unsigned int fId(0);
+  for (auto &h : fs) { // iterate over all functions
+
+    Mat numer = h(m_particles.col(0)) * m_expWts(0);
+    for (size_t prtcl = 1; prtcl < nparts; ++prtcl)
+      numer += h(m_particles.col(prtcl)) * m_expWts(prtcl);
+    m_expectations[fId] = numer / sumWts;
+
+// print stuff if debug mode is on
+#ifndef DROPPINGTHISINRPACKAGE
+    if constexpr (debug)
+      std::cout << "transposed expectation " << fId << ": "
+                << m_expectations[fId].transpose() << "\n";
+#endif
+
+    fId++;
+  }
+
+  // resample if you should (this sets all the log weights to 0)
+  m_resampled = m_essFrac > 0.0 ? m_ess < m_essFrac * nparts
+                                : (m_now + 1) % m_resampSched == 0;
+  if (m_resampled) {
+    m_resampler.resampLogWts(m_particles, m_logUnNormWeights);
+    m_numResamps++;
+    m_logOldWtSum = std::log(static_cast<float_t>(nparts));
+  } else {
+    m_logOldWtSum = maxNumer + std::log(sumWts);
+  }
+
+  // advance time
+  m_now += 1;
+}
+
 } // namespace filters
 } // namespace pf
 
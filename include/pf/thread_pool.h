@@ -0,0 +1,207 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>          // min
+#include <condition_variable> // condition_variable
+#include <cstddef>            // size_t
+#include <exception>          // exception_ptr
+#include <functional>         // function
+#include <mutex>              // mutex, unique_lock
+#include <thread>             // thread
+#include <utility>            // pair
+#include <vector>             // vector
+
+namespace pf {
+
+namespace parallel {
+
+/**
+ * @brief splits the index range [0, n) into nblocks contiguous blocks and
+ * returns the half-open range belonging to block b. Block sizes differ by at
+ * most one, and the split only depends on n and nblocks, so work assigned this
+ * way is reproducible for a fixed number of blocks.
+ * @param n the total number of items
+ * @param nblocks the number of blocks
+ * @param b which block (0, 1, ..., nblocks - 1)
+ * @return a pair (begin, end)
+ */
+inline std::pair<std::size_t, std::size_t>
+block_range(std::size_t n, std::size_t nblocks, std::size_t b) {
+  std::size_t base = n / nblocks;
+  std::size_t extra = n % nblocks;
+  std::size_t begin = b * base + std::min(b, extra);
+  std::size_t end = begin + base + (b < extra ? 1 : 0);
+  return std::make_pair(begin, end);
+}
+
+//! A small fixed-size pool of worker threads.
+/**
+ * @class thread_pool
+ * @author taylor
+ * @file thread_pool.h
+ * @brief Runs the same job on every thread of the pool and waits for all of
+ * them to finish. The calling thread participates as thread 0, so a pool of
+ * size 1 never spawns a thread and runs everything serially. Workers are
+ * created once and sleep between jobs, which keeps the per-call overhead small
+ * enough to use once per time step.
+ */
+class thread_pool {
+public:
+  /**
+   * @brief The constructor.
+   * @param nthreads the total number of threads (including the caller)
+   */
+  explicit thread_pool(unsigned int nthreads);
+
+  /**
+   * @brief The destructor joins all workers.
+   */
+  ~thread_pool();
+
+  thread_pool(const thread_pool &) = delete;
+  thread_pool &operator=(const thread_pool &) = delete;
+
+  /**
+   * @brief the number of threads (including the calling thread)
+   * @return the number of threads
+   */
+  unsigned int size() const;
+
+  /**
+   * @brief calls job(tid) for tid = 0, 1, ..., size() - 1, each on its own
+   * thread, and blocks until they have all returned. If any call throws, the
+   * first exception is rethrown here.
+   * @param job a callable taking the thread id as an unsigned int
+   */
+  void run(const std::function<void(unsigned int)> &job);
+
+private:
+  /** @brief the loop each worker thread runs */
+  void work(unsigned int tid);
+
+  /** @brief the total number of threads */
+  unsigned int m_nthreads;
+
+  /** @brief the worker threads (there are m_nthreads - 1 of them) */
+  std::vector<std::thread> m_workers;
+
+  /** @brief protects everything below */
+  std::mutex m_mut;
+
+  /** @brief wakes up workers when there is a new job */
+  std::condition_variable m_jobReady;
+
+  /** @brief wakes up the caller when the last worker finishes */
+  std::condition_variable m_jobDone;
+
+  /** @brief the current job */
+  const std::function<void(unsigned int)> *m_job;
+
+  /** @brief incremented once per job so workers can tell jobs apart */
+  unsigned long m_generation;
+
+  /** @brief number of workers still running the current job */
+  unsigned int m_busy;
+
+  /** @brief set when the pool is being destroyed */
+  bool m_stop;
+
+  /** @brief the first exception thrown by a job */
+  std::exception_ptr m_error;
+};
+
+inline thread_pool::thread_pool(unsigned int nthreads)
+    : m_nthreads(nthreads > 0 ? nthreads : 1), m_job(nullptr),
+      m_generation(0), m_busy(0), m_stop(false) {
+  m_workers.reserve(m_nthreads - 1);
+  for (unsigned int tid = 1; tid < m_nthreads; ++tid)
+    m_workers.emplace_back(&thread_pool::work, this, tid);
+}
+
+inline thread_pool::~thread_pool() {
+  {
+    std::unique_lock<std::mutex> lock(m_mut);
+    m_stop = true;
+  }
+  m_jobReady.notify_all();
+  for (auto &w : m_workers)
+    w.join();
+}
+
+inline unsigned int thread_pool::size() const { return m_nthreads; }
+
+inline void thread_pool::run(const std::function<void(unsigned int)> &job) {
+
+  // no need to wake anybody up
+  if (m_nthreads == 1) {
+    job(0);
+    return;
+  }
+
+  // hand out the job
+  {
+    std::unique_lock<std::mutex> lock(m_mut);
+    m_job = &job;
+    m_busy = m_nthreads - 1;
+    m_error = nullptr;
+    m_generation++;
+  }
+  m_jobReady.notify_all();
+
+  // do our share
+  std::exception_ptr callerError;
+  try {
+    job(0);
+  } catch (...) {
+    callerError = std::current_exception();
+  }
+
+  // wait for everybody else
+  std::unique_lock<std::mutex> lock(m_mut);
+  m_jobDone.wait(lock, [this] { return m_busy == 0; });
+  m_job = nullptr;
+  if (callerError)
+    std::rethrow_exception(callerError);
+  if (m_error)
+    std::rethrow_exception(m_error);
+}
+
+inline void thread_pool::work(unsigned int tid) {
+  unsigned long seen = 0;
+  while (true) {
+
+    // wait for a new job (or the end)
+    const std::function<void(unsigned int)> *job;
+    {
+      std::unique_lock<std::mutex> lock(m_mut);
+      m_jobReady.wait(lock,
+                      [this, seen] { return m_stop || m_generation != seen; });
+      if (m_stop)
+        return;
+      seen = m_generation;
+      job = m_job;
+    }
+
+    // run it
+    std::exception_ptr err;
+    try {
+      (*job)(tid);
+    } catch (...) {
+      err = std::current_exception();
+    }
+
+    // report back
+    {
+      std::unique_lock<std::mutex> lock(m_mut);
+      if (err && !m_error)
+        m_error = err;
+      if (--m_busy == 0)
+        m_jobDone.notify_one();
+    }
+  }
+}
+
+} // namespace parallel
+} // namespace pf
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,123 @@
+#ifndef WEIGHT_KERNELS_H
+#define WEIGHT_KERNELS_H
+
+#include <cmath>   // log
+#include <cstddef> // size_t
+
+#ifdef DROPPINGTHISINRPACKAGE
+#include <RcppEigen.h>
+// [[Rcpp::depends(RcppEigen)]]
+#else
+#include <Eigen/Dense>
+#endif
+
+namespace pf {
+
+/**
+ * @brief The model-independent part of every time step: finding the largest
+ * log weight, exponentiating shifted log weights, summing, normalizing and
+ * computing effective sample sizes. Everything works on contiguous buffers
+ * (std::array, std::vector or Eigen storage via .data()) and is written with
+ * Eigen array expressions, so it uses whichever SIMD instruction set the
+ * compiler is allowed to (e.g. -mavx2 or -march=native gives AVX2/AVX-512
+ * packets for both float and double), and plain scalar code otherwise.
+ */
+namespace kernels {
+
+/**
+ * @brief the largest element of a buffer
+ * @param x the buffer
+ * @param n its length (must be positive)
+ * @return max_i x[i]
+ */
+template <typename float_t> float_t max(const float_t *x, size_t n) {
+  using arr = Eigen::Array<float_t, Eigen::Dynamic, 1>;
+  return Eigen::Map<const arr>(x, n).maxCoeff();
+}
+
+/**
+ * @brief the sum of exp(x[i] - m), without storing the exponentials
+ * @param x the log weights
+ * @param n their number
+ * @param m the shift (usually the largest log weight)
+ * @return sum_i exp(x[i] - m)
+ */
+template <typename float_t>
+float_t sumExpShift(const float_t *x, size_t n, float_t m) {
+  using arr = Eigen::Array<float_t, Eigen::Dynamic, 1>;
+  return (Eigen::Map<const arr>(x, n) - m).exp().sum();
+}
+
+/**
+ * @brief writes w[i] = exp(x[i] - m) and returns the sum of the w[i]. The
+ * vectorized exponential clamps its argument, so a log weight of -infinity
+ * gives a weight below the smallest normal number instead of an exact zero,
+ * which vanishes as soon as it is added to any other weight.
+ * @param x the log weights
+ * @param w where the shifted, exponentiated weights are written
+ * @param n their number
+ * @param m the shift (usually the largest log weight)
+ * @return sum_i w[i]
+ */
+template <typename float_t>
+float_t expShift(const float_t *x, float_t *w, size_t n, float_t m) {
+  using arr = Eigen::Array<float_t, Eigen::Dynamic, 1>;
+  Eigen::Map<arr> wMap(w, n);
+  wMap = (Eigen::Map<const arr>(x, n) - m).exp();
+  return wMap.sum();
+}
+
+/**
+ * @brief the effective sample size of (unnormalized) weights
+ * @param w the weights (not logged)
+ * @param n their number
+ * @param sum their sum (e.g. what expShift() returned)
+ * @return (sum_i w[i])^2 / sum_i w[i]^2
+ */
+template <typename float_t>
+float_t ess(const float_t *w, size_t n, float_t sum) {
+  using arr = Eigen::Array<float_t, Eigen::Dynamic, 1>;
+  return sum * sum / Eigen::Map<const arr>(w, n).square().sum();
+}
+
+/**
+ * @brief divides every weight by their sum
+ * @param w the weights (changed in place)
+ * @param n their number
+ * @param sum their sum
+ */
+template <typename float_t> void normalize(float_t *w, size_t n, float_t sum) {
+  using arr = Eigen::Array<float_t, Eigen::Dynamic, 1>;
+  Eigen::Map<arr>(w, n) /= sum;
+}
+
+/**
+ * @brief turns log unnormalized weights into normalized weights
+ * @param x the log unnormalized weights
+ * @param w where the normalized weights are written
+ * @param n their number
+ * @return the log of the normalizing constant, log sum_i exp(x[i])
+ */
+template <typename float_t>
+float_t normalizedWeights(const float_t *x, float_t *w, size_t n) {
+  float_t m = max(x, n);
+  float_t sum = expShift(x, w, n, m);
+  normalize(w, n, sum);
+  return m + std::log(sum);
+}
+
+/**
+ * @brief calculates log sum_i exp(x[i]) in a way that prevents over/under-flow
+ * @param x the buffer
+ * @param n its length
+ * @return log sum_i exp(x[i])
+ */
+template <typename float_t> float_t logSumExp(const float_t *x, size_t n) {
+  float_t m = max(x, n);
+  return m + std::log(sumExpShift(x, n, m));
+}
+
+} // namespace kernels
+} // namespace pf
+
+#endif // WEIGHT_KERNELS_H
@@ -0,0 +1,83 @@
+#include <catch2/catch_all.hpp>
+
+#include <pf/island_filter.h>
+#include <pf/resamplers.h>
+
+#include "../examples/svol_apf.h"
+#include "../examples/svol_bs.h"
+#include "../examples/svol_sisr.h"
+
+#define NUMPARTS 100
+
+using svol_osv = Eigen::Matrix<double, 1, 1>;
+using svol_resamp_t = resamplers::mn_resampler<NUMPARTS, 1, double>;
+using svol_t = svol_bs<NUMPARTS, 1, 1, svol_resamp_t, double>;
+
+// checks a model's logGEvBatch against its logGEv, one particle at a time
+template <typename model_t> bool batchMatchesPerParticle(model_t &model) {
+  using ssv = typename model_t::ssv;
+  std::mt19937 gen(13);
+  std::normal_distribution<double> z(0.0, 2.0);
+  std::array<ssv, NUMPARTS> xt;
+  std::array<double, NUMPARTS> batch;
+  bool matches = true;
+  for (double y : {-3.0, -.1, 0.0, .5, 2.5}) {
+    for (auto &x : xt)
+      x = ssv::Constant(z(gen));
+    model.logGEvBatch(svol_osv::Constant(y), xt, batch);
+    for (size_t ii = 0; ii < NUMPARTS; ++ii)
+      matches = matches && batch[ii] == Approx(model.logGEv(
+                                            svol_osv::Constant(y), xt[ii]));
+  }
+  return matches;
+}
+
+TEST_CASE("islands of an unmodified example model", "[examples]") {
+
+  // svol_bs has no reseed(), so only the copies' resamplers get new seeds
+  static_assert(filters::has_reseed_generators<svol_t>::value);
+  static_assert(!filters::has_reseed<svol_t>::value);
+
+  // a copy draws the same noise as its ancestor, so the two agree on the
+  // step after the copy, and part ways once they have resampled differently
+  filters::island_filter<svol_t, 4, 2> islands(.99, filters::island_seed{7},
+                                               .91, .5, 1.0);
+  bool copiesPending = false;
+  bool quietBefore = false;
+  bool finite = true;
+  bool diverged = true;
+  unsigned int numChecks = 0;
+  for (unsigned int t = 0; t < 200; ++t) {
+    islands.filter(svol_osv::Constant(std::sin(t) + std::cos(.3 * t)));
+    finite = finite && std::isfinite(islands.getLogCondLike());
+
+    bool same = false;
+    for (size_t k = 1; k < 4; ++k)
+      for (size_t j = 0; j < k; ++j)
+        same = same || islands.getIsland(k).getLogCondLike() ==
+                           islands.getIsland(j).getLogCondLike();
+    if (islands.getResampled()) {
+      copiesPending = copiesPending || same;
+      quietBefore = false;
+    } else if (quietBefore && copiesPending) {
+      diverged = diverged && !same;
+      copiesPending = false;
+      numChecks++;
+    } else {
+      quietBefore = true;
+    }
+  }
+  REQUIRE(finite);
+  REQUIRE(numChecks > 0);
+  REQUIRE(diverged);
+}
+
+TEST_CASE("example models' batch observation densities", "[examples]") {
+
+  svol_t bs(.91, .5, 1.0);
+  svol_sisr<NUMPARTS, 1, 1, svol_resamp_t, double> sisr(.91, .5, 1.0);
+  svol_apf<NUMPARTS, 1, 1, svol_resamp_t, double> apf(.91, .5, 1.0);
+  REQUIRE(batchMatchesPerParticle(bs));
+  REQUIRE(batchMatchesPerParticle(sisr));
+  REQUIRE(batchMatchesPerParticle(apf));
+}
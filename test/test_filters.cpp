@@ -0,0 +1,794 @@
+#include <catch2/catch_all.hpp>
+
+#include <random>
+
+#include <pf/auxiliary_pf.h>
+#include <pf/batch_filter.h>
+#include <pf/bootstrap_filter.h>
+#include <pf/island_filter.h>
+#include <pf/resamplers.h>
+#include <pf/rv_eval.h>
+#include <pf/sisr_filter.h>
+
+#define NUMPARTS 50
+#define NUMSTEPS 10
+#define NORESAMP 1000 // resampling schedule that never resamples
+
+using namespace pf;
+using Catch::Approx;
+
+using ssv = Eigen::Matrix<double, 1, 1>;
+using osv = Eigen::Matrix<double, 1, 1>;
+using resamp_t = resamplers::mn_resampler<NUMPARTS, 1, double>;
+using resamp_dyn_t = resamplers::systematic_resampler_dyn<1, double>;
+
+// the same AR(1) plus noise model, written once for each kind of base class
+// (each model has its own seeded generator, so the outputs can be compared)
+class ar1_virtual
+    : public filters::BSFilter<NUMPARTS, 1, 1, resamp_t, double> {
+public:
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  using osv = Eigen::Matrix<double, 1, 1>;
+
+  std::mt19937 m_gen{42};
+  std::normal_distribution<double> m_z;
+
+  ar1_virtual(double essFrac = 0.0)
+      : filters::BSFilter<NUMPARTS, 1, 1, resamp_t, double>(NORESAMP, essFrac) {
+  }
+  double logMuEv(const ssv &x1) {
+    return rveval::evalUnivNorm<double>(x1(0), 0.0, 1.0, true);
+  }
+  ssv q1Samp(const osv & /*y1*/) { return ssv::Constant(m_z(m_gen)); }
+  double logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  double logGEv(const osv &yt, const ssv &xt) {
+    return rveval::evalUnivNorm<double>(yt(0), xt(0), 1.0, true);
+  }
+  ssv fSamp(const ssv &xtm1) {
+    return ssv::Constant(.9 * xtm1(0) + m_z(m_gen));
+  }
+  void reseed(unsigned long seed) { m_gen.seed(seed); }
+};
+
+class ar1_static
+    : public filters::static_bsfilter<ar1_static, NUMPARTS, 1, 1, resamp_t,
+                                      double> {
+public:
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  using osv = Eigen::Matrix<double, 1, 1>;
+
+  std::mt19937 m_gen{42};
+  std::normal_distribution<double> m_z;
+
+  ar1_static()
+      : filters::static_bsfilter<ar1_static, NUMPARTS, 1, 1, resamp_t, double>(
+            NORESAMP) {}
+  double logMuEv(const ssv &x1) {
+    return rveval::evalUnivNorm<double>(x1(0), 0.0, 1.0, true);
+  }
+  ssv q1Samp(const osv & /*y1*/) { return ssv::Constant(m_z(m_gen)); }
+  double logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  double logGEv(const osv &yt, const ssv &xt) {
+    return rveval::evalUnivNorm<double>(yt(0), xt(0), 1.0, true);
+  }
+  ssv fSamp(const ssv &xtm1) {
+    return ssv::Constant(.9 * xtm1(0) + m_z(m_gen));
+  }
+};
+
+class ar1_static_sisr
+    : public filters::static_sisrfilter<ar1_static_sisr, NUMPARTS, 1, 1,
+                                        resamp_t, double> {
+public:
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  using osv = Eigen::Matrix<double, 1, 1>;
+
+  std::mt19937 m_gen{42};
+  std::normal_distribution<double> m_z;
+
+  ar1_static_sisr(double essFrac = 0.0)
+      : filters::static_sisrfilter<ar1_static_sisr, NUMPARTS, 1, 1, resamp_t,
+                                   double>(NORESAMP, essFrac) {}
+  double logMuEv(const ssv &x1) {
+    return rveval::evalUnivNorm<double>(x1(0), 0.0, 1.0, true);
+  }
+  ssv q1Samp(const osv & /*y1*/) { return ssv::Constant(m_z(m_gen)); }
+  double logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  double logGEv(const osv &yt, const ssv &xt) {
+    return rveval::evalUnivNorm<double>(yt(0), xt(0), 1.0, true);
+  }
+  double logFEv(const ssv &xt, const ssv &xtm1) {
+    return rveval::evalUnivNorm<double>(xt(0), .9 * xtm1(0), 1.0, true);
+  }
+  ssv qSamp(const ssv &xtm1, const osv & /*yt*/) {
+    return ssv::Constant(.9 * xtm1(0) + m_z(m_gen));
+  }
+  double logQEv(const ssv &xt, const ssv &xtm1, const osv & /*yt*/) {
+    return logFEv(xt, xtm1);
+  }
+};
+
+class ar1_dyn : public filters::BSFilterDyn<1, 1, resamp_dyn_t, double> {
+public:
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  using osv = Eigen::Matrix<double, 1, 1>;
+  using ssvRef = Eigen::Ref<const ssv>;
+
+  std::mt19937 m_gen{42};
+  std::normal_distribution<double> m_z;
+
+  ar1_dyn(size_t numParts, unsigned int rs = NORESAMP)
+      : filters::BSFilterDyn<1, 1, resamp_dyn_t, double>(numParts, rs) {}
+  double logMuEv(const ssvRef &x1) {
+    return rveval::evalUnivNorm<double>(x1(0), 0.0, 1.0, true);
+  }
+  ssv q1Samp(const osv & /*y1*/) { return ssv::Constant(m_z(m_gen)); }
+  double logQ1Ev(const ssvRef &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  double logGEv(const osv &yt, const ssvRef &xt) {
+    return rveval::evalUnivNorm<double>(yt(0), xt(0), 1.0, true);
+  }
+  ssv fSamp(const ssvRef &xtm1) {
+    return ssv::Constant(.9 * xtm1(0) + m_z(m_gen));
+  }
+};
+
+class ar1_soa
+    : public filters::BSFilterSoA<NUMPARTS, 1, 1, resamp_t, double> {
+public:
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  using osv = Eigen::Matrix<double, 1, 1>;
+  using ssvRef = Eigen::Ref<const ssv>;
+
+  std::mt19937 m_gen{42};
+  std::normal_distribution<double> m_z;
+
+  ar1_soa()
+      : filters::BSFilterSoA<NUMPARTS, 1, 1, resamp_t, double>(NORESAMP) {}
+  double logMuEv(const ssvRef &x1) {
+    return rveval::evalUnivNorm<double>(x1(0), 0.0, 1.0, true);
+  }
+  ssv q1Samp(const osv & /*y1*/) { return ssv::Constant(m_z(m_gen)); }
+  double logQ1Ev(const ssvRef &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  double logGEv(const osv &yt, const ssvRef &xt) {
+    return rveval::evalUnivNorm<double>(yt(0), xt(0), 1.0, true);
+  }
+  ssv fSamp(const ssvRef &xtm1) {
+    return ssv::Constant(.9 * xtm1(0) + m_z(m_gen));
+  }
+};
+
+class ar1_soa_sisr
+    : public filters::SISRFilterSoA<NUMPARTS, 1, 1, resamp_t, double> {
+public:
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  using osv = Eigen::Matrix<double, 1, 1>;
+  using ssvRef = Eigen::Ref<const ssv>;
+
+  std::mt19937 m_gen{42};
+  std::normal_distribution<double> m_z;
+
+  ar1_soa_sisr()
+      : filters::SISRFilterSoA<NUMPARTS, 1, 1, resamp_t, double>(NORESAMP) {}
+  double logMuEv(const ssvRef &x1) {
+    return rveval::evalUnivNorm<double>(x1(0), 0.0, 1.0, true);
+  }
+  ssv q1Samp(const osv & /*y1*/) { return ssv::Constant(m_z(m_gen)); }
+  double logQ1Ev(const ssvRef &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  double logGEv(const osv &yt, const ssvRef &xt) {
+    return rveval::evalUnivNorm<double>(yt(0), xt(0), 1.0, true);
+  }
+  double logFEv(const ssvRef &xt, const ssvRef &xtm1) {
+    return rveval::evalUnivNorm<double>(xt(0), .9 * xtm1(0), 1.0, true);
+  }
+  ssv qSamp(const ssvRef &xtm1, const osv & /*yt*/) {
+    return ssv::Constant(.9 * xtm1(0) + m_z(m_gen));
+  }
+  double logQEv(const ssvRef &xt, const ssvRef &xtm1, const osv & /*yt*/) {
+    return logFEv(xt, xtm1);
+  }
+};
+
+// ar1_virtual again, with every density and sample of a time step done in
+// one batch hook (the noise is drawn in the same order as fSamp draws it)
+class ar1_vectorized : public ar1_virtual {
+public:
+  using arrayStates = std::array<ssv, NUMPARTS>;
+  using arrayFloat = std::array<double, NUMPARTS>;
+
+  void logGEvBatch(const osv &yt, const arrayStates &xt,
+                   arrayFloat &out) override {
+    Eigen::Map<const Eigen::ArrayXd> x(xt[0].data(), NUMPARTS);
+    Eigen::Map<Eigen::ArrayXd> logGs(out.data(), NUMPARTS);
+    logGs = -.5 * rveval::log_two_pi<double> - .5 * (yt(0) - x).square();
+  }
+  void fSampBatch(const arrayStates &xtm1, arrayStates &xt) override {
+    for (size_t ii = 0; ii < NUMPARTS; ++ii)
+      xt[ii] = ssv::Constant(.9 * xtm1[ii](0) + m_z(m_gen));
+  }
+};
+
+// ar1_static_sisr as a virtual SISR filter with all four batch hooks
+class ar1_sisr_vectorized
+    : public filters::SISRFilter<NUMPARTS, 1, 1, resamp_t, double> {
+public:
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  using osv = Eigen::Matrix<double, 1, 1>;
+  using arrayStates = std::array<ssv, NUMPARTS>;
+  using arrayFloat = std::array<double, NUMPARTS>;
+  using arrayMap = Eigen::Map<const Eigen::ArrayXd>;
+
+  std::mt19937 m_gen{42};
+  std::normal_distribution<double> m_z;
+
+  ar1_sisr_vectorized()
+      : filters::SISRFilter<NUMPARTS, 1, 1, resamp_t, double>(NORESAMP) {}
+  double logMuEv(const ssv &x1) {
+    return rveval::evalUnivNorm<double>(x1(0), 0.0, 1.0, true);
+  }
+  ssv q1Samp(const osv & /*y1*/) { return ssv::Constant(m_z(m_gen)); }
+  double logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  double logGEv(const osv &yt, const ssv &xt) {
+    return rveval::evalUnivNorm<double>(yt(0), xt(0), 1.0, true);
+  }
+  double logFEv(const ssv &xt, const ssv &xtm1) {
+    return rveval::evalUnivNorm<double>(xt(0), .9 * xtm1(0), 1.0, true);
+  }
+  ssv qSamp(const ssv &xtm1, const osv & /*yt*/) {
+    return ssv::Constant(.9 * xtm1(0) + m_z(m_gen));
+  }
+  double logQEv(const ssv &xt, const ssv &xtm1, const osv & /*yt*/) {
+    return logFEv(xt, xtm1);
+  }
+  void logGEvBatch(const osv &yt, const arrayStates &xt,
+                   arrayFloat &out) override {
+    Eigen::Map<Eigen::ArrayXd>(out.data(), NUMPARTS) =
+        -.5 * rveval::log_two_pi<double> -
+        .5 * (yt(0) - arrayMap(xt[0].data(), NUMPARTS)).square();
+  }
+  void logFEvBatch(const arrayStates &xt, const arrayStates &xtm1,
+                   arrayFloat &out) override {
+    Eigen::Map<Eigen::ArrayXd>(out.data(), NUMPARTS) =
+        -.5 * rveval::log_two_pi<double> -
+        .5 * (arrayMap(xt[0].data(), NUMPARTS) -
+              .9 * arrayMap(xtm1[0].data(), NUMPARTS))
+                 .square();
+  }
+  void qSampBatch(const arrayStates &xtm1, const osv & /*yt*/,
+                  arrayStates &xt) override {
+    for (size_t ii = 0; ii < NUMPARTS; ++ii)
+      xt[ii] = ssv::Constant(.9 * xtm1[ii](0) + m_z(m_gen));
+  }
+  void logQEvBatch(const arrayStates &xt, const arrayStates &xtm1,
+                   const osv & /*yt*/, arrayFloat &out) override {
+    logFEvBatch(xt, xtm1, out);
+  }
+};
+
+TEST_CASE("static and virtual filters agree", "[filters]") {
+
+  ar1_virtual virt;
+  ar1_static stat;
+  ar1_static_sisr sisr;
+  std::vector<std::function<const Eigen::MatrixXd(const ssv &)>> fs{
+      [](const ssv &x) -> const Eigen::MatrixXd { return x; }};
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    osv y = osv::Constant(std::sin(t));
+    virt.filter(y, fs);
+    stat.filter(y, fs);
+    sisr.filter(y, fs);
+    REQUIRE(stat.getLogCondLike() == virt.getLogCondLike());
+    REQUIRE(stat.getExpectations()[0](0) == virt.getExpectations()[0](0));
+
+    // the SISR filter with q = f is a bootstrap filter
+    REQUIRE(sisr.getLogCondLike() == Approx(virt.getLogCondLike()));
+  }
+}
+
+TEST_CASE("batch hooks", "[filters]") {
+
+  // models that override the batch hooks give the same answers as the same
+  // models left with the default (one particle at a time) hooks
+  ar1_virtual perParticle;
+  ar1_vectorized vectorized;
+  ar1_static_sisr sisrPerParticle;
+  ar1_sisr_vectorized sisrVectorized;
+  std::vector<std::function<const Eigen::MatrixXd(const ssv &)>> fs{
+      [](const ssv &x) -> const Eigen::MatrixXd { return x; }};
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    osv y = osv::Constant(std::sin(t));
+    perParticle.filter(y, fs);
+    vectorized.filter(y, fs);
+    sisrPerParticle.filter(y, fs);
+    sisrVectorized.filter(y, fs);
+    REQUIRE(vectorized.getLogCondLike() ==
+            Approx(perParticle.getLogCondLike()));
+    REQUIRE(vectorized.getExpectations()[0](0) ==
+            Approx(perParticle.getExpectations()[0](0)));
+    REQUIRE(sisrVectorized.getLogCondLike() ==
+            Approx(sisrPerParticle.getLogCondLike()));
+    REQUIRE(sisrVectorized.getExpectations()[0](0) ==
+            Approx(sisrPerParticle.getExpectations()[0](0)));
+  }
+}
+
+TEST_CASE("adaptive resampling follows the effective sample size",
+          "[filters]") {
+
+  ar1_virtual fixed;
+  ar1_virtual adaptive(.5);
+  ar1_static_sisr adaptiveSisr(.5);
+  unsigned int numResamps(0);
+  unsigned int numResampsSisr(0);
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    osv y = osv::Constant(3.0 * std::sin(t));
+    fixed.filter(y);
+    adaptive.filter(y);
+    adaptiveSisr.filter(y);
+
+    // same seeds, so the first weights are the same
+    if (t == 0)
+      REQUIRE(adaptive.getESS() == Approx(fixed.getESS()));
+
+    REQUIRE(fixed.getESS() > 0.0);
+    REQUIRE(fixed.getESS() <= Approx(NUMPARTS));
+    REQUIRE_FALSE(fixed.getResampled());
+
+    REQUIRE(adaptive.getResampled() == (adaptive.getESS() < .5 * NUMPARTS));
+    REQUIRE(adaptiveSisr.getResampled() ==
+            (adaptiveSisr.getESS() < .5 * NUMPARTS));
+    numResamps += adaptive.getResampled();
+    numResampsSisr += adaptiveSisr.getResampled();
+  }
+  REQUIRE(fixed.getNumResamps() == 0);
+  REQUIRE(adaptive.getNumResamps() == numResamps);
+  REQUIRE(adaptiveSisr.getNumResamps() == numResampsSisr);
+}
+
+TEST_CASE("run-time particle counts", "[filters]") {
+
+  // same model, same seed, no resampling: same answers as the fixed-size one
+  ar1_virtual fixed;
+  ar1_dyn dyn(NUMPARTS);
+  std::vector<std::function<const Eigen::MatrixXd(const ssv &)>> fs{
+      [](const ssv &x) -> const Eigen::MatrixXd { return x; }};
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    osv y = osv::Constant(std::sin(t));
+    fixed.filter(y, fs);
+    dyn.filter(y, fs);
+    REQUIRE(dyn.getLogCondLike() == Approx(fixed.getLogCondLike()));
+    REQUIRE(dyn.getExpectations()[0](0) ==
+            Approx(fixed.getExpectations()[0](0)));
+  }
+
+  // the number of particles can change between time steps
+  ar1_dyn growing(10, 1);
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    unsigned int numResamps = growing.getNumResamps();
+    growing.setNumParts(10 * (t + 1));
+    REQUIRE(growing.getNumParts() == 10 * (t + 1));
+    // resizing after the first step resamples, and says so
+    REQUIRE(growing.getResampled() == (t > 0));
+    REQUIRE(growing.getNumResamps() == numResamps + (t > 0 ? 1 : 0));
+
+    // and so can the number of functions, after the first step too
+    auto moreFs = fs;
+    if (t >= NUMSTEPS / 2)
+      moreFs.push_back([](const ssv &x) -> const Eigen::MatrixXd {
+        return x * x.transpose();
+      });
+    growing.filter(osv::Constant(std::sin(t)), moreFs);
+    REQUIRE(std::isfinite(growing.getLogCondLike()));
+    REQUIRE(growing.getESS() <= Approx(10 * (t + 1)));
+    REQUIRE(growing.getExpectations().size() == moreFs.size());
+    REQUIRE(std::abs(growing.getExpectations()[0](0)) < 5.0);
+    if (t >= NUMSTEPS / 2) {
+      double mean = growing.getExpectations()[0](0);
+      REQUIRE(growing.getExpectations()[1](0) >= mean * mean);
+    }
+  }
+}
+
+TEST_CASE("structure-of-arrays filters", "[filters]") {
+
+  // same model, same seed, no resampling: same answers as BSFilter, and the
+  // SISR filter with q = f is a bootstrap filter
+  ar1_virtual aos;
+  ar1_soa soa;
+  ar1_soa_sisr soaSisr;
+  std::vector<std::function<const Eigen::MatrixXd(const ssv &)>> fs{
+      [](const ssv &x) -> const Eigen::MatrixXd { return x; },
+      [](const ssv &x) -> const Eigen::MatrixXd { return x * x.transpose(); }};
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+
+    // one function at first, and a second one from half way on
+    auto someFs = fs;
+    someFs.resize(t < NUMSTEPS / 2 ? 1 : 2);
+    osv y = osv::Constant(std::sin(t));
+    aos.filter(y, someFs);
+    soa.filter(y, someFs);
+    soaSisr.filter(y, someFs);
+    REQUIRE(soa.getLogCondLike() == Approx(aos.getLogCondLike()));
+    REQUIRE(soaSisr.getLogCondLike() == Approx(aos.getLogCondLike()));
+    REQUIRE(soa.getExpectations().size() == someFs.size());
+    REQUIRE(soaSisr.getExpectations().size() == someFs.size());
+    for (size_t i = 0; i < someFs.size(); ++i) {
+      REQUIRE(soa.getExpectations()[i](0) ==
+              Approx(aos.getExpectations()[i](0)));
+      REQUIRE(soaSisr.getExpectations()[i](0) ==
+              Approx(aos.getExpectations()[i](0)));
+    }
+  }
+}
+
+TEST_CASE("compile-time expectation functors", "[filters]") {
+
+  // identically seeded, so only the way expectations are requested differs
+  ar1_static dynamicFs;
+  ar1_static staticFs;
+  ar1_static_sisr sisrStaticFs;
+  std::vector<std::function<const Eigen::MatrixXd(const ssv &)>> fs{
+      [](const ssv &x) -> const Eigen::MatrixXd { return x; },
+      [](const ssv &x) -> const Eigen::MatrixXd { return x * x.transpose(); }};
+  auto hs = std::make_tuple([](const ssv &x) { return x; },
+                            [](const ssv &x) { return x * x.transpose(); },
+                            [](const ssv &x) { return x(0); });
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    osv y = osv::Constant(std::sin(t));
+    dynamicFs.filter(y, fs);
+    auto [mean, secondMoment, firstCoord] = staticFs.filter(y, hs);
+    auto [sisrMean, sisrSecond, sisrFirst] = sisrStaticFs.filter(y, hs);
+
+    // fixed-size results
+    static_assert(std::is_same_v<decltype(mean), ssv>);
+    static_assert(std::is_same_v<decltype(secondMoment),
+                                 Eigen::Matrix<double, 1, 1>>);
+    static_assert(std::is_same_v<decltype(firstCoord), double>);
+
+    REQUIRE(staticFs.getLogCondLike() == dynamicFs.getLogCondLike());
+    REQUIRE(mean(0) == Approx(dynamicFs.getExpectations()[0](0)));
+    REQUIRE(secondMoment(0) == Approx(dynamicFs.getExpectations()[1](0)));
+    REQUIRE(firstCoord == Approx(mean(0)));
+    REQUIRE(sisrMean(0) == Approx(mean(0)));
+    REQUIRE(sisrSecond(0) == Approx(secondMoment(0)));
+    REQUIRE(sisrFirst == Approx(sisrMean(0)));
+  }
+}
+
+TEST_CASE("mixing expectation overloads", "[filters]") {
+
+  // the tuple overload at time 1, then more and fewer std::functions
+  ar1_static mixed;
+  ar1_static reference;
+  ar1_static_sisr sisrMixed;
+  std::vector<std::function<const Eigen::MatrixXd(const ssv &)>> fs{
+      [](const ssv &x) -> const Eigen::MatrixXd { return x; },
+      [](const ssv &x) -> const Eigen::MatrixXd { return x * x.transpose(); }};
+  auto hs = std::make_tuple([](const ssv &x) { return x; });
+  bool sameMeans = true;
+  bool rightSizes = true;
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    osv y = osv::Constant(std::sin(t));
+    reference.filter(y, fs);
+    if (t % 3 == 0) {
+      auto [mean] = mixed.filter(y, hs);
+      auto [sisrMean] = sisrMixed.filter(y, hs);
+      sameMeans = sameMeans &&
+                  std::abs(mean(0) - reference.getExpectations()[0](0)) < 1e-12;
+      rightSizes = rightSizes && mixed.getExpectations().empty() &&
+                   sisrMixed.getExpectations().empty() &&
+                   std::isfinite(sisrMean(0));
+    } else {
+      // two functions, then one
+      auto someFs = fs;
+      someFs.resize(t % 3);
+      mixed.filter(y, someFs);
+      sisrMixed.filter(y, someFs);
+      sameMeans = sameMeans && std::abs(mixed.getExpectations()[0](0) -
+                                        reference.getExpectations()[0](0)) <
+                                   1e-12;
+      rightSizes = rightSizes && mixed.getExpectations().size() == t % 3 &&
+                   sisrMixed.getExpectations().size() == t % 3;
+    }
+  }
+  REQUIRE(sameMeans);
+  REQUIRE(rightSizes);
+}
+
+// ar1_virtual with a different seed for every object
+class ar1_island : public ar1_virtual {
+public:
+  static inline unsigned int next_seed = 1;
+  ar1_island() : ar1_virtual(.5) { m_gen.seed(next_seed++); }
+};
+
+class ar1_apf : public filters::APF<NUMPARTS, 1, 1, resamp_t, double> {
+public:
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  using osv = Eigen::Matrix<double, 1, 1>;
+
+  std::mt19937 m_gen{42};
+  std::normal_distribution<double> m_z;
+
+  double logMuEv(const ssv &x1) {
+    return rveval::evalUnivNorm<double>(x1(0), 0.0, 1.0, true);
+  }
+  ssv q1Samp(const osv & /*y1*/) { return ssv::Constant(m_z(m_gen)); }
+  double logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  double logGEv(const osv &yt, const ssv &xt) {
+    return rveval::evalUnivNorm<double>(yt(0), xt(0), 1.0, true);
+  }
+  ssv fSamp(const ssv &xtm1) {
+    return ssv::Constant(.9 * xtm1(0) + m_z(m_gen));
+  }
+  ssv propMu(const ssv &xtm1) { return .9 * xtm1; }
+};
+
+TEST_CASE("resetting filters", "[filters]") {
+
+  // a reset filter with a reseeded model starts over exactly
+  ar1_virtual f;
+  std::vector<double> firstRun;
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    f.filter(osv::Constant(std::sin(t)));
+    firstRun.push_back(f.getLogCondLike());
+  }
+  f.reset();
+  f.reseed(42);
+  bool same = true;
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    f.filter(osv::Constant(std::sin(t)));
+    same = same && f.getLogCondLike() == firstRun[t];
+  }
+  REQUIRE(same);
+  REQUIRE(f.getNumResamps() == 0);
+
+  // so do the SISR filters (which never resample here)
+  ar1_static_sisr sisr;
+  ar1_soa_sisr soaSisr;
+  std::vector<double> sisrRun, soaSisrRun;
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    sisr.filter(osv::Constant(std::sin(t)));
+    soaSisr.filter(osv::Constant(std::sin(t)));
+    sisrRun.push_back(sisr.getLogCondLike());
+    soaSisrRun.push_back(soaSisr.getLogCondLike());
+  }
+  sisr.reset();
+  soaSisr.reset();
+  sisr.m_gen.seed(42);
+  soaSisr.m_gen.seed(42);
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    sisr.filter(osv::Constant(std::sin(t)));
+    soaSisr.filter(osv::Constant(std::sin(t)));
+    same = same && sisr.getLogCondLike() == sisrRun[t] &&
+           soaSisr.getLogCondLike() == soaSisrRun[t];
+  }
+  REQUIRE(same);
+
+  // the APF resamples with generators of its own, so only its first step
+  // (which draws from the model alone) repeats exactly
+  ar1_apf apf;
+  double firstLogLike = 0.0;
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    apf.filter(osv::Constant(std::sin(t)));
+    if (t == 0)
+      firstLogLike = apf.getLogCondLike();
+  }
+  REQUIRE(apf.getNumResamps() > 0);
+  apf.reset();
+  apf.m_gen.seed(42);
+  REQUIRE(apf.getNumResamps() == 0);
+  REQUIRE_FALSE(apf.getResampled());
+  apf.filter(osv::Constant(std::sin(0)));
+  REQUIRE(apf.getLogCondLike() == firstLogLike);
+}
+
+TEST_CASE("island filters", "[filters]") {
+
+  // one island is the filter itself
+  ar1_virtual lone;
+  filters::island_filter<ar1_virtual, 1> oneIsland(.5, 0.0);
+  std::vector<std::function<const Eigen::MatrixXd(const ssv &)>> fs{
+      [](const ssv &x) -> const Eigen::MatrixXd { return x; }};
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    osv y = osv::Constant(std::sin(t));
+    lone.filter(y, fs);
+    oneIsland.filter(y, fs);
+    REQUIRE(oneIsland.getLogCondLike() == lone.getLogCondLike());
+    REQUIRE(oneIsland.getExpectations()[0](0) ==
+            lone.getExpectations()[0](0));
+    REQUIRE_FALSE(oneIsland.getResampled());
+  }
+
+  // the exact log-likelihood and filtering means, from the Kalman filter
+  std::vector<double> kalmanMeans;
+  double kalmanLogLike = 0.0;
+  double m = 0.0;
+  double P = 1.0;
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    double y = std::sin(t);
+    kalmanLogLike += rveval::evalUnivNorm<double>(y, m, std::sqrt(P + 1.0),
+                                                  true);
+    m += P / (P + 1.0) * (y - m);
+    P /= P + 1.0;
+    kalmanMeans.push_back(m);
+    m *= .9;
+    P = .81 * P + 1.0;
+  }
+
+  // eight islands on four threads, resampled whenever their weights differ
+  unsigned int num_reps = 20;
+  double meanLogLike = 0.0;
+  bool resampledByESS = true;
+  bool closeMeans = true;
+  unsigned int numResamps = 0;
+  for (unsigned int rep = 0; rep < num_reps; ++rep) {
+    filters::island_filter<ar1_island, 8, 4> islands(1.0);
+    double logLike = 0.0;
+    for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+      islands.filter(osv::Constant(std::sin(t)), fs);
+      logLike += islands.getLogCondLike();
+      resampledByESS = resampledByESS && islands.getResampled() ==
+                                             (islands.getESS() < 8);
+      closeMeans = closeMeans && std::abs(islands.getExpectations()[0](0) -
+                                          kalmanMeans[t]) < .3;
+    }
+    meanLogLike += logLike / num_reps;
+    numResamps += islands.getNumResamps();
+  }
+  REQUIRE(resampledByESS);
+  REQUIRE(closeMeans);
+  REQUIRE(numResamps > 0);
+  REQUIRE(meanLogLike == Approx(kalmanLogLike).margin(.05));
+
+  // copied islands go their own way after the step that copied them
+  // (checked on steps that don't resample, so no island is a fresh copy)
+  filters::island_filter<ar1_island, 8, 4> copied(.95, filters::island_seed{3});
+  bool diverged = true;
+  unsigned int numCopySteps = 0;
+  for (unsigned int t = 0; t < 60; ++t) {
+    bool hadCopies = false;
+    if (copied.getResampled())
+      for (size_t k = 1; k < 8; ++k)
+        for (size_t j = 0; j < k; ++j)
+          hadCopies = hadCopies || copied.getIsland(k).getLogCondLike() ==
+                                       copied.getIsland(j).getLogCondLike();
+    copied.filter(osv::Constant(std::sin(t)));
+    if (hadCopies && !copied.getResampled()) {
+      numCopySteps++;
+      for (size_t k = 1; k < 8; ++k)
+        for (size_t j = 0; j < k; ++j)
+          diverged = diverged && copied.getIsland(k).getLogCondLike() !=
+                                     copied.getIsland(j).getLogCondLike();
+    }
+  }
+  REQUIRE(numCopySteps > 0);
+  REQUIRE(diverged);
+}
+
+// the AR(1) plus noise model again, one series at a time
+template <size_t nthreads>
+class ar1_batch
+    : public filters::BSFilterBatch<NUMPARTS, 1, 1, double, nthreads> {
+public:
+  using base_t = filters::BSFilterBatch<NUMPARTS, 1, 1, double, nthreads>;
+  using typename base_t::constStateRef;
+  using typename base_t::osv;
+  using typename base_t::rng_t;
+  using typename base_t::stateRef;
+  using typename base_t::wtRef;
+
+  ar1_batch(size_t numSeries, unsigned long seed)
+      : base_t(numSeries, NORESAMP, seed, .5) {}
+  void muSampBatch(stateRef x1, size_t, rng_t &gen) {
+    std::normal_distribution<double> z;
+    for (size_t i = 0; i < NUMPARTS; ++i)
+      x1(0, i) = z(gen);
+  }
+  void fSampBatch(stateRef xt, size_t, rng_t &gen) {
+    std::normal_distribution<double> z;
+    for (size_t i = 0; i < NUMPARTS; ++i)
+      xt(0, i) = .9 * xt(0, i) + z(gen);
+  }
+  void logGEvBatch(const osv &yt, constStateRef xt, wtRef out, size_t) {
+    out = -.5 * rveval::log_two_pi<double> -
+          .5 * (yt(0) - xt.row(0).array().transpose()).square();
+  }
+};
+
+TEST_CASE("batches of series", "[filters]") {
+
+  // three series (series s is sin(t + s)), each copied 200 times
+  size_t num_series = 3;
+  size_t num_copies = 200;
+  Eigen::MatrixXd ys(NUMSTEPS, num_series);
+  for (unsigned int t = 0; t < NUMSTEPS; ++t)
+    for (size_t s = 0; s < num_series; ++s)
+      ys(t, s) = 2.0 * std::sin(t + s);
+
+  // the exact log-likelihoods and filtering means, from the Kalman filter
+  Eigen::VectorXd kalmanLogLikes = Eigen::VectorXd::Zero(num_series);
+  Eigen::MatrixXd kalmanMeans(NUMSTEPS, num_series);
+  for (size_t s = 0; s < num_series; ++s) {
+    double m = 0.0;
+    double P = 1.0;
+    for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+      kalmanLogLikes(s) += rveval::evalUnivNorm<double>(
+          ys(t, s), m, std::sqrt(P + 1.0), true);
+      m += P / (P + 1.0) * (ys(t, s) - m);
+      P /= P + 1.0;
+      kalmanMeans(t, s) = m;
+      m *= .9;
+      P = .81 * P + 1.0;
+    }
+  }
+
+  // the thread count doesn't change anything
+  size_t num_cols = num_series * num_copies;
+  ar1_batch<1> oneThread(num_cols, 3);
+  ar1_batch<3> threeThreads(num_cols, 3);
+  REQUIRE(threeThreads.getNumSeries() == num_cols);
+  Eigen::ArrayXd logLikes = Eigen::ArrayXd::Zero(num_cols);
+  bool sameEverywhere = true;
+  bool closeMeans = true;
+  for (unsigned int t = 0; t < NUMSTEPS; ++t) {
+    Eigen::Matrix<double, 1, Eigen::Dynamic> data(1, num_cols);
+    for (size_t c = 0; c < num_cols; ++c)
+      data(c) = ys(t, c % num_series);
+    oneThread.filter(data);
+    threeThreads.filter(data);
+    sameEverywhere =
+        sameEverywhere &&
+        (oneThread.getLogCondLikes() == threeThreads.getLogCondLikes())
+            .all() &&
+        oneThread.getFilterMeans() == threeThreads.getFilterMeans();
+
+    // the copies average out to the exact means
+    logLikes += threeThreads.getLogCondLikes();
+    Eigen::VectorXd means = Eigen::VectorXd::Zero(num_series);
+    for (size_t c = 0; c < num_cols; ++c)
+      means(c % num_series) += threeThreads.getFilterMeans()(0, c) / num_copies;
+    for (size_t s = 0; s < num_series; ++s)
+      closeMeans = closeMeans && std::abs(means(s) - kalmanMeans(t, s)) < .1;
+  }
+  REQUIRE(sameEverywhere);
+  REQUIRE(closeMeans);
+
+  // and the likelihood estimates (not their logs) are unbiased
+  for (size_t s = 0; s < num_series; ++s) {
+    double maxLogLike = logLikes(s);
+    for (size_t c = s; c < num_cols; c += num_series)
+      maxLogLike = std::max(maxLogLike, logLikes(c));
+    double sumExp = 0.0;
+    for (size_t c = s; c < num_cols; c += num_series)
+      sumExp += std::exp(logLikes(c) - maxLogLike);
+    double logMeanLike = maxLogLike + std::log(sumExp / num_copies);
+    REQUIRE(logMeanLike == Approx(kalmanLogLikes(s)).margin(.1));
+  }
+
+  // resampling follows each series' own ESS
+  unsigned int numResamps = 0;
+  for (size_t c = 0; c < num_cols; ++c)
+    numResamps += threeThreads.getNumResamps(c);
+  REQUIRE(numResamps > 0);
+  REQUIRE((threeThreads.getESS() <= NUMPARTS + 1e-9).all());
+
+  // one column of data per series
+  Eigen::Matrix<double, 1, Eigen::Dynamic> tooShort(1, num_cols - 1);
+  REQUIRE_THROWS_AS(threeThreads.filter(tooShort), std::invalid_argument);
+}
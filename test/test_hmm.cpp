@@ -75,3 +75,22 @@ TEST_CASE_METHOD(HmmFixture, "test correct update 2", "[hmm]") {
   REQUIRE(std::abs(mod.getFilterVecLogProbs()(1) - std::log(.8)) < .0001);
   REQUIRE(std::abs(mod.getLogCondLike() - std::log(.5)) < .00001);
 }
+
+TEST_CASE_METHOD(HmmFixture, "test copies update independently", "[hmm]") {
+  // copies share the transition matrix but not the filter vector
+  Vec logCondDensVec;
+  logCondDensVec << std::log(1.0), std::log(0.0);
+  mod.update(logCondDensVec);
+  auto copy = mod;
+  logCondDensVec << std::log(.5), std::log(.5);
+  copy.update(logCondDensVec);
+
+  REQUIRE(mod.getFilterVecLogProbs()(0) == log(1.0));
+  REQUIRE(mod.getFilterVecLogProbs()(1) == log(0.0));
+  REQUIRE(std::abs(copy.getFilterVecLogProbs()(0) - std::log(.9)) < .0001);
+  REQUIRE(std::abs(copy.getFilterVecLogProbs()(1) - std::log(.1)) < .0001);
+
+  // and the original still uses the same transitions
+  mod.update(logCondDensVec);
+  REQUIRE(mod.getFilterVecLogProbs() == copy.getFilterVecLogProbs());
+}
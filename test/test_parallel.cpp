@@ -0,0 +1,237 @@
+#include <catch2/catch_all.hpp>
+
+#include <atomic>
+#include <stdexcept>
+
+#include <pf/bootstrap_filter.h>
+#include <pf/resamplers.h>
+#include <pf/rv_eval.h>
+
+#define NUMPARTS 101
+#define NUMTHREADS 4
+
+using namespace pf;
+using Catch::Approx;
+
+// a small stochastic volatility model that is safe to call from many threads
+template <size_t nthreads>
+class svol_mt
+    : public filters::BSFilterMT<NUMPARTS, 1, 1,
+                                 resamplers::mn_resampler<NUMPARTS, 1, double>,
+                                 double, nthreads> {
+public:
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  using osv = Eigen::Matrix<double, 1, 1>;
+  using base_t =
+      filters::BSFilterMT<NUMPARTS, 1, 1,
+                          resamplers::mn_resampler<NUMPARTS, 1, double>, double,
+                          nthreads>;
+  using rng_t = typename base_t::rng_t;
+
+  svol_mt(unsigned long seed) : base_t(1, seed) {}
+
+  double logMuEv(const ssv &x1) {
+    return rveval::evalUnivNorm<double>(x1(0), 0.0, 1.0 / std::sqrt(1 - .81),
+                                        true);
+  }
+  ssv q1Samp(const osv & /*y1*/, rng_t &gen) {
+    std::normal_distribution<double> z(0.0, 1.0);
+    return ssv::Constant(z(gen) / std::sqrt(1 - .81));
+  }
+  double logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  double logGEv(const osv &yt, const ssv &xt) {
+    return rveval::evalUnivNorm<double>(yt(0), 0.0, .5 * std::exp(.5 * xt(0)),
+                                        true);
+  }
+  ssv fSamp(const ssv &xtm1, rng_t &gen) {
+    std::normal_distribution<double> z(0.0, 1.0);
+    return ssv::Constant(.9 * xtm1(0) + z(gen));
+  }
+};
+
+TEST_CASE("thread pool runs every thread id once", "[parallel]") {
+
+  parallel::thread_pool pool(NUMTHREADS);
+  REQUIRE(pool.size() == NUMTHREADS);
+
+  std::array<std::atomic<int>, NUMTHREADS> hits;
+  for (auto &h : hits)
+    h = 0;
+  for (int rep = 0; rep < 10; ++rep)
+    pool.run([&hits](unsigned int tid) { hits[tid]++; });
+  for (auto &h : hits)
+    REQUIRE(h == 10);
+}
+
+TEST_CASE("thread pool rethrows exceptions", "[parallel]") {
+
+  parallel::thread_pool pool(NUMTHREADS);
+  REQUIRE_THROWS_AS(pool.run([](unsigned int tid) {
+    if (tid == NUMTHREADS - 1)
+      throw std::runtime_error("oops");
+  }),
+                    std::runtime_error);
+
+  // still usable afterwards
+  std::atomic<int> count(0);
+  pool.run([&count](unsigned int) { count++; });
+  REQUIRE(count == NUMTHREADS);
+}
+
+TEST_CASE("block ranges cover everything exactly once", "[parallel]") {
+
+  size_t n = 103;
+  size_t nblocks = 8;
+  size_t next = 0;
+  for (size_t b = 0; b < nblocks; ++b) {
+    auto r = parallel::block_range(n, nblocks, b);
+    REQUIRE(r.first == next);
+    REQUIRE(r.second >= r.first);
+    next = r.second;
+  }
+  REQUIRE(next == n);
+}
+
+TEST_CASE("multi-threaded bootstrap filter is reproducible", "[parallel]") {
+
+  svol_mt<NUMTHREADS> f1(42);
+  svol_mt<NUMTHREADS> f2(42);
+  Eigen::Matrix<double, 1, 1> y;
+  for (int t = 0; t < 10; ++t) {
+    y(0) = std::sin(t);
+    f1.filter(y);
+    f2.filter(y);
+    REQUIRE(f1.getLogCondLike() == f2.getLogCondLike());
+    REQUIRE(std::isfinite(f1.getLogCondLike()));
+  }
+}
+
+TEST_CASE("multi-threaded bootstrap filter takes more functions later",
+          "[parallel]") {
+
+  // no functions at first, then one, then two
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  std::vector<std::function<const Eigen::MatrixXd(const ssv &)>> fs{
+      [](const ssv &x) -> const Eigen::MatrixXd { return x; },
+      [](const ssv &x) -> const Eigen::MatrixXd { return x * x.transpose(); }};
+  svol_mt<NUMTHREADS> f1(42);
+  svol_mt<NUMTHREADS> f2(42);
+  Eigen::Matrix<double, 1, 1> y;
+  for (int t = 0; t < 9; ++t) {
+    y(0) = std::sin(t);
+    auto someFs = fs;
+    someFs.resize(t / 3);
+    f1.filter(y, someFs);
+    f2.filter(y, fs);
+    REQUIRE(f1.getExpectations().size() == someFs.size());
+    for (size_t i = 0; i < someFs.size(); ++i)
+      REQUIRE(f1.getExpectations()[i](0) == f2.getExpectations()[i](0));
+  }
+}
+
+TEMPLATE_TEST_CASE("multi-threaded resamplers match one-thread ones",
+                   "[parallel]",
+                   (std::pair<resamplers::systematic_resampler<NUMPARTS, 1,
+                                                               double>,
+                              resamplers::systematic_resampler_mt<
+                                  NUMPARTS, 1, double, NUMTHREADS>>),
+                   (std::pair<resamplers::stratif_resampler<NUMPARTS, 1,
+                                                            double>,
+                              resamplers::stratif_resampler_mt<
+                                  NUMPARTS, 1, double, NUMTHREADS>>)) {
+
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  typename TestType::first_type r1(3);
+  typename TestType::second_type r2(3);
+
+  // weights that sum the same way in any order: equal, then some zero
+  std::array<ssv, NUMPARTS> p1, p2;
+  std::array<double, NUMPARTS> w1, w2;
+  for (int rep = 0; rep < 2; ++rep) {
+    for (size_t i = 0; i < NUMPARTS; ++i) {
+      p1[i] = ssv::Constant(i);
+      w1[i] = (rep == 1 && i % 3 == 1)
+                  ? -std::numeric_limits<double>::infinity()
+                  : 0.0;
+    }
+    p2 = p1;
+    w2 = w1;
+    r1.resampLogWts(p1, w1);
+    r2.resampLogWts(p2, w2);
+    for (size_t i = 0; i < NUMPARTS; ++i) {
+      REQUIRE(r1.getAncestors()[i] == r2.getAncestors()[i]);
+      REQUIRE(p1[i](0) == p2[i](0));
+      REQUIRE(w2[i] == 0.0);
+    }
+  }
+}
+
+TEST_CASE("multi-threaded systematic resampling keeps counts close",
+          "[parallel]") {
+
+  // systematic resampling gives every particle floor(n w) or ceil(n w) copies
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  resamplers::systematic_resampler_mt<NUMPARTS, 1, double, NUMTHREADS> r(5);
+  std::array<ssv, NUMPARTS> parts;
+  std::array<double, NUMPARTS> logWts;
+  for (size_t i = 0; i < NUMPARTS; ++i) {
+    parts[i] = ssv::Constant(i);
+    logWts[i] = std::sin(3.0 * i);
+  }
+  double logNorm = kernels::logSumExp(logWts.data(), NUMPARTS);
+  std::array<double, NUMPARTS> expected;
+  for (size_t i = 0; i < NUMPARTS; ++i)
+    expected[i] = NUMPARTS * std::exp(logWts[i] - logNorm);
+
+  r.resampLogWts(parts, logWts);
+  std::array<double, NUMPARTS> counts{};
+  for (size_t i = 0; i < NUMPARTS; ++i) {
+    REQUIRE(parts[i](0) == r.getAncestors()[i]);
+    counts[r.getAncestors()[i]] += 1.0;
+  }
+  for (size_t i = 0; i < NUMPARTS; ++i) {
+    REQUIRE(counts[i] >= std::floor(expected[i] - 1e-9));
+    REQUIRE(counts[i] <= std::ceil(expected[i] + 1e-9));
+  }
+}
+
+TEST_CASE("log-domain multinomial resampling ignores the thread count",
+          "[parallel]") {
+
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  resamplers::log_mn_resampler_mt<NUMPARTS, 1, double, 1> r1(9);
+  resamplers::log_mn_resampler_mt<NUMPARTS, 1, double, NUMTHREADS> r2(9);
+
+  // spread-out weights are all accepted by rejection; with one dominant
+  // particle most offspring fall back to the cumulative sums
+  std::array<ssv, NUMPARTS> p1, p2;
+  std::array<double, NUMPARTS> w1, w2;
+  double numDominant = 0.0;
+  bool samePartsEverywhere = true;
+  unsigned num_reps = 200;
+  for (unsigned rep = 0; rep < num_reps; ++rep) {
+    bool dominant = rep % 2 == 1;
+    for (size_t i = 0; i < NUMPARTS; ++i) {
+      p1[i] = ssv::Constant(i);
+      w1[i] = dominant ? (i == 7 ? std::log(NUMPARTS - 1.0) : 0.0)
+                       : std::sin(3.0 * i);
+    }
+    p2 = p1;
+    w2 = w1;
+    r1.resampLogWts(p1, w1);
+    r2.resampLogWts(p2, w2);
+    REQUIRE(r1.getAncestors() == r2.getAncestors());
+    for (size_t i = 0; i < NUMPARTS; ++i) {
+      samePartsEverywhere = samePartsEverywhere && p1[i](0) == p2[i](0) &&
+                            p2[i](0) == r2.getAncestors()[i];
+      if (dominant && r2.getAncestors()[i] == 7)
+        numDominant += 1.0;
+    }
+  }
+  REQUIRE(samePartsEverywhere);
+
+  // particle 7 carries half of the weight
+  REQUIRE(numDominant / (NUMPARTS * num_reps / 2) == Approx(.5).margin(.02));
+}
@@ -0,0 +1,160 @@
+#include <catch2/catch_all.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <pf/bootstrap_filter.h>
+#include <pf/pmmh.h>
+#include <pf/resamplers.h>
+#include <pf/rv_eval.h>
+
+#define NUMPARTS 50
+#define NUMSTEPS 20
+#define NUMITERS 500
+#define BURNIN 50
+#define NUMGRID 400
+
+using namespace pf;
+using Catch::Approx;
+
+using resamp_t = resamplers::systematic_resampler<NUMPARTS, 1, double>;
+using param_t = Eigen::Matrix<double, 1, 1>;
+
+// an AR(1) plus noise model with an unknown autoregressive coefficient
+class ar1_phi : public filters::BSFilter<NUMPARTS, 1, 1, resamp_t, double> {
+public:
+  using ssv = Eigen::Matrix<double, 1, 1>;
+  using osv = Eigen::Matrix<double, 1, 1>;
+
+  // filters are built on several threads at once
+  static inline std::atomic<unsigned int> num_built{0};
+
+  double m_phi;
+  std::mt19937 m_gen;
+  std::normal_distribution<double> m_z;
+
+  ar1_phi(double phi, unsigned long seed) : m_phi(phi), m_gen(seed) {
+    num_built++;
+  }
+  double logMuEv(const ssv &x1) {
+    return rveval::evalUnivNorm<double>(x1(0), 0.0, 1.0, true);
+  }
+  ssv q1Samp(const osv & /*y1*/) { return ssv::Constant(m_z(m_gen)); }
+  double logQ1Ev(const ssv &x1, const osv & /*y1*/) {
+    return logMuEv(x1);
+  }
+  double logGEv(const osv &yt, const ssv &xt) {
+    return rveval::evalUnivNorm<double>(yt(0), xt(0), 1.0, true);
+  }
+  ssv fSamp(const ssv &xtm1) {
+    return ssv::Constant(m_phi * xtm1(0) + m_z(m_gen));
+  }
+};
+
+// the exact log-likelihood, from the Kalman filter
+double kalmanLogLike(const std::vector<ar1_phi::osv> &data, double phi) {
+  double ans = 0.0;
+  double m = 0.0;
+  double P = 1.0;
+  for (const auto &yt : data) {
+    ans += rveval::evalUnivNorm<double>(yt(0), m, std::sqrt(P + 1.0), true);
+    m += P / (P + 1.0) * (yt(0) - m);
+    P /= P + 1.0;
+    m *= phi;
+    P = phi * phi * P + 1.0;
+  }
+  return ans;
+}
+
+TEST_CASE("pmmh", "[mcmc]") {
+
+  std::vector<ar1_phi::osv> data;
+  for (unsigned int t = 0; t < NUMSTEPS; ++t)
+    data.push_back(ar1_phi::osv::Constant(2.0 * std::sin(.5 * t)));
+
+  // the exact posterior mean of phi (uniform prior on (-1, 1)), on a grid
+  double maxLogLike = kalmanLogLike(data, 0.0);
+  std::vector<double> logLikes;
+  for (unsigned int i = 0; i < NUMGRID; ++i) {
+    logLikes.push_back(kalmanLogLike(data, -1.0 + (i + .5) * 2.0 / NUMGRID));
+    maxLogLike = std::max(maxLogLike, logLikes.back());
+  }
+  double numer = 0.0;
+  double denom = 0.0;
+  for (unsigned int i = 0; i < NUMGRID; ++i) {
+    double w = std::exp(logLikes[i] - maxLogLike);
+    numer += w * (-1.0 + (i + .5) * 2.0 / NUMGRID);
+    denom += w;
+  }
+  double postMean = numer / denom;
+
+  // four chains on two threads, with a random walk proposal
+  using sampler_t = mcmc::pmmh<ar1_phi, param_t, 4, 2>;
+  auto logPrior = [](const param_t &theta) -> double {
+    return std::abs(theta(0)) < 1.0
+               ? 0.0
+               : -std::numeric_limits<double>::infinity();
+  };
+  auto randomWalk = [](const param_t &theta,
+                       sampler_t::rng_t &gen) -> param_t {
+    std::normal_distribution<double> z(0.0, .3);
+    return param_t::Constant(theta(0) + z(gen));
+  };
+  auto factory = [](const param_t &theta, unsigned long seed) {
+    return ar1_phi(theta(0), seed);
+  };
+  auto reset = [](ar1_phi &f, const param_t &theta) {
+    f.m_phi = theta(0);
+    f.reset();
+  };
+  ar1_phi::num_built = 0;
+  sampler_t sampler(factory, reset, data, logPrior, randomWalk,
+                    sampler_t::log_prop_dens_t(), 7);
+  std::array<param_t, 4> starts{param_t::Constant(-.5), param_t::Zero(),
+                                param_t::Zero(), param_t::Constant(.5)};
+  sampler.run(starts, NUMITERS);
+
+  double sum = 0.0;
+  bool inSupport = true;
+  for (size_t k = 0; k < 4; ++k) {
+    REQUIRE(sampler.getDraws(k).size() == NUMITERS + 1);
+    REQUIRE(sampler.getLogLikes(k).size() == NUMITERS + 1);
+    REQUIRE(sampler.getDraws(k)[0] == starts[k]);
+    REQUIRE(sampler.getAcceptanceRate(k) > 0.0);
+    REQUIRE(sampler.getAcceptanceRate(k) < 1.0);
+    REQUIRE(sampler.getNumFilterRuns(k) <= NUMITERS + 1);
+    REQUIRE(sampler.getNumFilterRuns(k) > sampler.getNumAccepted(k));
+    REQUIRE(sampler.getFilterSeconds(k) > 0.0);
+    for (size_t i = BURNIN; i <= NUMITERS; ++i) {
+      sum += sampler.getDraws(k)[i](0);
+      inSupport = inSupport && std::abs(sampler.getDraws(k)[i](0)) < 1.0;
+    }
+  }
+  REQUIRE(inSupport);
+  REQUIRE(sampler.getRunSeconds() > 0.0);
+
+  // each chain built its filter once, and keeps it for later runs
+  REQUIRE(ar1_phi::num_built == 4);
+  sampler.run(starts, 10);
+  REQUIRE(ar1_phi::num_built == 4);
+  REQUIRE(sampler.getDraws(0).size() == 11);
+  REQUIRE(sum / (4 * (NUMITERS + 1 - BURNIN)) == Approx(postMean).margin(.1));
+
+  // independent uniform proposals, through the asymmetric proposal path
+  sampler_t independent(
+      factory, reset, data, logPrior,
+      [](const param_t &, sampler_t::rng_t &gen) -> param_t {
+        return param_t::Constant(2.0 * gen.unif() - 1.0);
+      },
+      [](const param_t &, const param_t &) -> double { return 0.0; }, 8);
+  independent.run(starts, NUMITERS);
+  sum = 0.0;
+  for (size_t k = 0; k < 4; ++k) {
+    REQUIRE(independent.getNumFilterRuns(k) == NUMITERS + 1);
+    for (size_t i = BURNIN; i <= NUMITERS; ++i)
+      sum += independent.getDraws(k)[i](0);
+  }
+  REQUIRE(sum / (4 * (NUMITERS + 1 - BURNIN)) == Approx(postMean).margin(.1));
+}
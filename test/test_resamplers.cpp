@@ -236,6 +236,51 @@ TEST_CASE_METHOD(MRFixture, "test resampLogWts_resid2"
   }
 }
 
+TEST_CASE("test residual-systematic resampling counts", "[resamplers]") {
+
+  using ssv = Eigen::Matrix<double, DIMSTATE, 1>;
+  std::array<ssv, NUMPARTICLES> parts;
+  std::array<double, NUMPARTICLES> wts;
+
+  // every particle gets floor(N w_i) or one more copy, and the expected
+  // number of copies is N w_i
+  resid_sys_resampler<NUMPARTICLES, DIMSTATE, double> r(3);
+  double total = NUMPARTICLES * (NUMPARTICLES + 1) / 2.0;
+  unsigned num_reps = 2000;
+  std::array<double, NUMPARTICLES> meanCounts{};
+  bool countsInRange = true;
+  for (unsigned rep = 0; rep < num_reps; ++rep) {
+    for (size_t i = 0; i < NUMPARTICLES; ++i)
+      wts[i] = std::log(i + 1.0);
+    r.resampLogWts(parts, wts);
+    std::array<unsigned, NUMPARTICLES> counts{};
+    for (size_t p = 0; p < NUMPARTICLES; ++p)
+      counts[r.getAncestors()[p]]++;
+    for (size_t i = 0; i < NUMPARTICLES; ++i) {
+      double nw = NUMPARTICLES * (i + 1.0) / total;
+      countsInRange = countsInRange && counts[i] >= std::floor(nw) &&
+                      counts[i] <= std::floor(nw) + 1;
+      meanCounts[i] += counts[i] / static_cast<double>(num_reps);
+    }
+  }
+  REQUIRE(countsInRange);
+  for (size_t i = 0; i < NUMPARTICLES; ++i)
+    REQUIRE(meanCounts[i] ==
+            Approx(NUMPARTICLES * (i + 1.0) / total).margin(.05));
+
+  // one particle with all the weight gets every copy
+  for (size_t i = 0; i < NUMPARTICLES; ++i) {
+    parts[i] = ssv::Constant(i);
+    wts[i] = -std::numeric_limits<double>::infinity();
+  }
+  wts[3] = 0.0;
+  r.resampLogWts(parts, wts);
+  for (size_t p = 0; p < NUMPARTICLES; ++p) {
+    REQUIRE(parts[p](0) == 3.0);
+    REQUIRE(wts[p] == 0.0);
+  }
+}
+
 TEST_CASE_METHOD(MRFixture, "test resampLogWts_stratif", "[resamplers]") {
 
   m_stratifr.resampLogWts(m_vparts3, m_vw3);
@@ -267,6 +312,49 @@ TEST_CASE_METHOD(MRFixture, "test resampLogWts_stratif2", "[resamplers]") {
   }
 }
 
+TEST_CASE("test stratified resampling matches a full search",
+          "[resamplers]") {
+
+  using ssv = Eigen::Matrix<double, DIMSTATE, 1>;
+  std::array<ssv, NUMPARTICLES> parts;
+  std::array<double, NUMPARTICLES> wts;
+  for (size_t i = 0; i < NUMPARTICLES; ++i) {
+    parts[i] = ssv::Constant(i);
+    wts[i] = std::sin(1.0 + i);
+  }
+
+  // the same Us, and for each the first cumulative sum that covers it
+  std::array<double, NUMPARTICLES> cumsums;
+  pf::kernels::expShift(wts.data(), cumsums.data(), NUMPARTICLES,
+                        pf::kernels::max(wts.data(), NUMPARTICLES));
+  std::partial_sum(cumsums.begin(), cumsums.end(), cumsums.begin());
+  double total = cumsums[NUMPARTICLES - 1];
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> u_sampler(0.0, 1.0 / NUMPARTICLES);
+  std::vector<unsigned int> expected;
+  for (size_t i = 0; i < NUMPARTICLES; ++i) {
+    double u = (static_cast<double>(i) / NUMPARTICLES + u_sampler(gen)) * total;
+    unsigned int j = 0;
+    while (j < NUMPARTICLES - 1 && cumsums[j] < u)
+      j++;
+    expected.push_back(j);
+  }
+
+  // in-place resampling reorders the ancestors, so compare them as multisets
+  stratif_resampler<NUMPARTICLES, DIMSTATE, double> r(7);
+  r.resampLogWts(parts, wts);
+  std::vector<unsigned int> anc(r.getAncestors().begin(),
+                                r.getAncestors().end());
+  std::sort(anc.begin(), anc.end());
+  REQUIRE(anc == expected);
+
+  // with equal weights every stratum picks its own particle
+  std::fill(wts.begin(), wts.end(), 0.0);
+  r.resampLogWts(parts, wts);
+  for (size_t p = 0; p < NUMPARTICLES; ++p)
+    REQUIRE(r.getAncestors()[p] == p);
+}
+
 TEST_CASE_METHOD(MRFixture, "test resampLogWts_systematic", "[resamplers]") {
 
   m_systematicr.resampLogWts(m_vparts4, m_vw4);
@@ -298,6 +386,190 @@ TEST_CASE_METHOD(MRFixture, "test resampLogWts_systematic2", "[resamplers]") {
   }
 }
 
+TEMPLATE_TEST_CASE("test resampLogWts on column storage", "[resamplers]",
+                   (mn_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (resid_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (resid_sys_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (stratif_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (systematic_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (mn_resamp_fast1<NUMPARTICLES, DIMSTATE, double>),
+                   (metropolis_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (rejection_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (log_mn_resampler_mt<NUMPARTICLES, DIMSTATE, double, 2>)) {
+
+  using ssv = Eigen::Matrix<double, DIMSTATE, 1>;
+  using soaMat = Eigen::Matrix<double, DIMSTATE, Eigen::Dynamic>;
+
+  // same particles and weights, stored both ways
+  std::array<ssv, NUMPARTICLES> aosParts;
+  soaMat soaParts(DIMSTATE, NUMPARTICLES);
+  std::array<double, NUMPARTICLES> aosWts;
+  for (size_t i = 0; i < NUMPARTICLES; ++i) {
+    aosParts[i] = ssv::Constant(i);
+    soaParts.col(i) = aosParts[i];
+    aosWts[i] = -0.1 * i;
+  }
+  std::array<double, NUMPARTICLES> soaWts = aosWts;
+
+  // identically seeded resamplers must pick the same ancestors
+  TestType r1(1);
+  TestType r2(1);
+  r1.resampLogWts(aosParts, aosWts);
+  r2.resampLogWts(soaParts, soaWts);
+  for (size_t p = 0; p < NUMPARTICLES; ++p) {
+    REQUIRE(soaWts[p] == 0.0);
+    for (size_t i = 0; i < DIMSTATE; ++i)
+      REQUIRE(soaParts(i, p) == aosParts[p](i));
+  }
+}
+
+TEMPLATE_TEST_CASE("test ancestors of in-place resampling", "[resamplers]",
+                   (mn_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (resid_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (resid_sys_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (stratif_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (systematic_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (mn_resamp_fast1<NUMPARTICLES, DIMSTATE, double>),
+                   (metropolis_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (rejection_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (log_mn_resampler_mt<NUMPARTICLES, DIMSTATE, double, 2>)) {
+
+  using ssv = Eigen::Matrix<double, DIMSTATE, 1>;
+
+  // particle i is the constant vector i
+  std::array<ssv, NUMPARTICLES> parts;
+  std::array<double, NUMPARTICLES> wts;
+  for (size_t i = 0; i < NUMPARTICLES; ++i) {
+    parts[i] = ssv::Constant(i);
+    wts[i] = -0.3 * i;
+  }
+
+  TestType r(1);
+  r.resampLogWts(parts, wts);
+  auto anc = r.getAncestors();
+  for (size_t p = 0; p < NUMPARTICLES; ++p) {
+
+    // every particle is a copy of its ancestor
+    REQUIRE(parts[p](0) == anc[p]);
+
+    // and every ancestor that survived kept its own slot
+    REQUIRE(anc[anc[p]] == anc[p]);
+  }
+}
+
+TEMPLATE_TEST_CASE("test resampling without a global weight sum",
+                   "[resamplers]",
+                   (metropolis_resampler<NUMPARTICLES, DIMSTATE, double, 200>),
+                   (metropolis_resampler<NUMPARTICLES, DIMSTATE, double, 200,
+                                         3>),
+                   (rejection_resampler<NUMPARTICLES, DIMSTATE, double>),
+                   (rejection_resampler<NUMPARTICLES, DIMSTATE, double, 3>),
+                   (log_mn_resampler_mt<NUMPARTICLES, DIMSTATE, double, 2>)) {
+
+  using ssv = Eigen::Matrix<double, DIMSTATE, 1>;
+  std::array<ssv, NUMPARTICLES> parts;
+  std::array<double, NUMPARTICLES> wts;
+
+  // offspring frequencies match weights proportional to i + 1
+  TestType r(11);
+  unsigned num_reps = 2000;
+  std::array<double, NUMPARTICLES> freq{};
+  for (unsigned rep = 0; rep < num_reps; ++rep) {
+    for (size_t i = 0; i < NUMPARTICLES; ++i)
+      wts[i] = std::log(i + 1.0) - 50.0;
+    r.resampLogWts(parts, wts);
+    for (size_t p = 0; p < NUMPARTICLES; ++p)
+      freq[r.getAncestors()[p]] += 1.0 / (num_reps * NUMPARTICLES);
+  }
+  double total = NUMPARTICLES * (NUMPARTICLES + 1) / 2.0;
+  for (size_t i = 0; i < NUMPARTICLES; ++i)
+    REQUIRE(std::abs(freq[i] - (i + 1.0) / total) < .01);
+
+  // particles with no weight are never picked
+  for (size_t i = 0; i < NUMPARTICLES; ++i)
+    wts[i] = (i % 2 == 0) ? 0.0 : -std::numeric_limits<double>::infinity();
+  r.resampLogWts(parts, wts);
+  for (size_t p = 0; p < NUMPARTICLES; ++p)
+    REQUIRE(r.getAncestors()[p] % 2 == 0);
+}
+
+TEST_CASE("test Metropolis and rejection resampling on several threads",
+          "[resamplers]") {
+
+  using ssv = Eigen::Matrix<double, DIMSTATE, 1>;
+  std::array<ssv, NUMPARTICLES> parts1, parts3, parts4;
+  std::array<double, NUMPARTICLES> wts1, wts3, wts4;
+
+  // identically seeded, so the thread count is the only difference
+  metropolis_resampler<NUMPARTICLES, DIMSTATE, double, 32, 1> m1(5);
+  metropolis_resampler<NUMPARTICLES, DIMSTATE, double, 32, 3> m3(5);
+  rejection_resampler<NUMPARTICLES, DIMSTATE, double, 1> r1(5);
+  rejection_resampler<NUMPARTICLES, DIMSTATE, double, 4> r4(5);
+  bool sameMetropolis = true;
+  bool sameRejection = true;
+  for (unsigned rep = 0; rep < 5; ++rep) {
+    for (size_t i = 0; i < NUMPARTICLES; ++i) {
+      parts1[i] = parts3[i] = parts4[i] = ssv::Constant(i);
+      wts1[i] = wts3[i] = wts4[i] = std::sin(i + rep);
+    }
+    m1.resampLogWts(parts1, wts1);
+    m3.resampLogWts(parts3, wts3);
+    sameMetropolis = sameMetropolis && m1.getAncestors() == m3.getAncestors() &&
+                     parts1 == parts3;
+
+    for (size_t i = 0; i < NUMPARTICLES; ++i) {
+      parts1[i] = ssv::Constant(i);
+      wts1[i] = std::sin(i + rep);
+    }
+    r1.resampLogWts(parts1, wts1);
+    r4.resampLogWts(parts4, wts4);
+    sameRejection = sameRejection && r1.getAncestors() == r4.getAncestors() &&
+                    parts1 == parts4;
+  }
+  REQUIRE(sameMetropolis);
+  REQUIRE(sameRejection);
+}
+
+TEMPLATE_TEST_CASE("test resampLogWts with run-time sizes", "[resamplers]",
+                   (mn_resampler_dyn<DIMSTATE, double>),
+                   (systematic_resampler_dyn<DIMSTATE, double>)) {
+
+  using soaMat = Eigen::Matrix<double, DIMSTATE, Eigen::Dynamic>;
+  using wtArray = Eigen::Array<double, Eigen::Dynamic, 1>;
+
+  // only particle 3 has any weight
+  soaMat parts(DIMSTATE, NUMPARTICLES);
+  wtArray logWts(NUMPARTICLES);
+  for (size_t i = 0; i < NUMPARTICLES; ++i) {
+    parts.col(i).setConstant(i);
+    logWts(i) = -std::numeric_limits<double>::infinity();
+  }
+  logWts(3) = 0.0;
+
+  // same size, then more particles, then fewer
+  TestType r(1);
+  for (size_t nout : {NUMPARTICLES, 3 * NUMPARTICLES, 5}) {
+    r.resampLogWts(parts, logWts, nout);
+    REQUIRE(parts.cols() == static_cast<Eigen::Index>(nout));
+    REQUIRE(logWts.size() == static_cast<Eigen::Index>(nout));
+    for (size_t p = 0; p < nout; ++p) {
+      REQUIRE(logWts(p) == 0.0);
+      for (size_t i = 0; i < DIMSTATE; ++i)
+        REQUIRE(parts(i, p) == 3.0);
+    }
+  }
+
+  // equal weights: every ancestor is a real particle
+  for (size_t i = 0; i < 5; ++i)
+    parts.col(i).setConstant(i);
+  r.resampLogWts(parts, logWts);
+  REQUIRE(parts.cols() == 5);
+  for (size_t p = 0; p < 5; ++p) {
+    REQUIRE((parts(0, p) >= 0.0 && parts(0, p) <= 4.0));
+    REQUIRE(parts(0, p) == r.getAncestors()[p]);
+  }
+}
+
 TEST_CASE_METHOD(MRFixture, "test auxiliary hilbert functions",
                  "[resamplers]") {
   using namespace pf::resamplers;
@@ -551,3 +823,183 @@ TEST_CASE_METHOD(MRFixture, "test hilbert inverses 8", "[resamplers]") {
   }
   REQUIRE(total_matches == pow(2, nb * nd));
 }
+
+TEMPLATE_TEST_CASE_SIG("test Hilbert resampling sorts particles",
+                       "[resamplers]", ((size_t nb, size_t nd), nb, nd),
+                       (12, 2), (10, 6), (16, 8)) {
+
+  // 32-, 64- and 128-bit keys, taking 3, 8 and 16 radix sort passes
+  using ssv = Eigen::Matrix<double, nd, 1>;
+  auto key = [](const ssv &x) {
+    double c = std::pow(2, nb - 1);
+    std::array<std::bitset<nb>, nd> axes;
+    for (size_t dim = 0; dim < nd; ++dim)
+      axes[dim] = static_cast<unsigned int>(
+          std::floor(std::tanh(.5 * x(dim)) * c + c));
+    return makeH<nb, nd>(AxesToTranspose<nb, nd>(axes));
+  };
+
+  std::array<ssv, NUMPARTICLES> parts;
+  std::array<double, NUMPARTICLES> wts;
+  std::array<unsigned, NUMPARTICLES> seen{};
+  for (size_t i = 0; i < NUMPARTICLES; ++i) {
+    for (size_t dim = 0; dim < nd; ++dim)
+      parts[i](dim) = std::sin((2.0 + dim) * i + dim);
+    wts[i] = 0.0;
+  }
+  auto old = parts;
+
+  // with equal weights every particle is kept once, in Hilbert order
+  sys_hilb_resampler<NUMPARTICLES, nd, nb, double> r;
+  r.resampLogWts(parts, wts, Eigen::Matrix<double, 1, 1>::Zero());
+  for (size_t i = 0; i < NUMPARTICLES; ++i) {
+    REQUIRE(parts[i] == old[r.getAncestors()[i]]);
+    seen[r.getAncestors()[i]]++;
+    if (i > 0)
+      REQUIRE(key(parts[i - 1]) <= key(parts[i]));
+  }
+  for (size_t i = 0; i < NUMPARTICLES; ++i)
+    REQUIRE(seen[i] == 1);
+}
+
+TEMPLATE_TEST_CASE_SIG("test word-level Hilbert indexes", "[resamplers]",
+                       ((size_t nb, size_t nd), nb, nd), (3, 3), (12, 5),
+                       (16, 6), (32, 4)) {
+
+  // the word-level index agrees with the bitset functions, and wide indexes
+  // survive the round trip through the transpose and back
+  std::mt19937_64 gen(1);
+  for (int rep = 0; rep < 200; ++rep) {
+    std::array<std::uint32_t, nd> X;
+    std::array<std::bitset<nb>, nd> Xb;
+    for (size_t dim = 0; dim < nd; ++dim) {
+      X[dim] = gen() & ((std::uint64_t(1) << nb) - 1);
+      Xb[dim] = X[dim];
+    }
+    auto H = hilbertIndex<nb, nd>(X);
+    REQUIRE(H == makeH<nb, nd>(AxesToTranspose<nb, nd>(Xb)));
+    REQUIRE(makeH<nb, nd>(AxesToTranspose<nb, nd>(TransposeToAxes<nb, nd>(
+                makeHTranspose<nb, nd>(H)))) == H);
+  }
+  REQUIRE(sizeof(hilbert_key_t<nb * nd>) * 8 >= nb * nd);
+}
+
+TEMPLATE_TEST_CASE_SIG("test Morton indexes and resampling", "[resamplers]",
+                       ((size_t nb, size_t nd), nb, nd), (12, 2), (10, 6),
+                       (16, 8)) {
+
+  // bit b of coordinate dim lands at position b * nd + (nd - 1 - dim),
+  // whether or not the interleave uses pdep
+  using key_t = hilbert_key_t<nb * nd>;
+  auto slowMorton = [](const std::array<std::uint32_t, nd> &X) {
+    key_t M = 0;
+    for (size_t p = 0; p < nb * nd; ++p)
+      M |= key_t((X[nd - 1 - p % nd] >> (p / nd)) & 1) << p;
+    return M;
+  };
+  std::mt19937_64 gen(1);
+  for (int rep = 0; rep < 200; ++rep) {
+    std::array<std::uint32_t, nd> X;
+    for (size_t dim = 0; dim < nd; ++dim)
+      X[dim] = gen() & ((std::uint64_t(1) << nb) - 1);
+    REQUIRE(mortonIndex<nb, nd>(X) == slowMorton(X));
+  }
+
+  using ssv = Eigen::Matrix<double, nd, 1>;
+  auto key = [&slowMorton](const ssv &x) {
+    double c = std::pow(2, nb - 1);
+    std::array<std::uint32_t, nd> X;
+    for (size_t dim = 0; dim < nd; ++dim)
+      X[dim] = static_cast<std::uint32_t>(
+          std::floor(std::tanh(.5 * x(dim)) * c + c));
+    return slowMorton(X);
+  };
+
+  std::array<ssv, NUMPARTICLES> parts;
+  std::array<double, NUMPARTICLES> wts;
+  std::array<unsigned, NUMPARTICLES> seen{};
+  for (size_t i = 0; i < NUMPARTICLES; ++i) {
+    for (size_t dim = 0; dim < nd; ++dim)
+      parts[i](dim) = std::sin((2.0 + dim) * i + dim);
+    wts[i] = 0.0;
+  }
+  auto old = parts;
+
+  // with equal weights every particle is kept once, in Morton order
+  sys_morton_resampler<NUMPARTICLES, nd, nb, double> r;
+  r.resampLogWts(parts, wts, Eigen::Matrix<double, 1, 1>::Zero());
+  for (size_t i = 0; i < NUMPARTICLES; ++i) {
+    REQUIRE(parts[i] == old[r.getAncestors()[i]]);
+    seen[r.getAncestors()[i]]++;
+    if (i > 0)
+      REQUIRE(key(parts[i - 1]) <= key(parts[i]));
+  }
+  for (size_t i = 0; i < NUMPARTICLES; ++i)
+    REQUIRE(seen[i] == 1);
+}
+
+TEST_CASE("test island resampling", "[resamplers]") {
+
+  // four islands of five particles; two of each island's slots are exchanged
+  using ssv = Eigen::Matrix<double, DIMSTATE, 1>;
+  using island_t =
+      island_resampler_mt<NUMPARTICLES, DIMSTATE, double, 4, 40, 150>;
+  using island3_t =
+      island_resampler_mt<NUMPARTICLES, DIMSTATE, double, 4, 40, 150, 3>;
+  std::array<ssv, NUMPARTICLES> parts, parts3;
+  std::array<double, NUMPARTICLES> wts, wts3;
+  auto reset = [&](bool balanced) {
+    for (size_t i = 0; i < NUMPARTICLES; ++i) {
+      parts[i] = ssv::Constant(i);
+      wts[i] = balanced ? std::sin(i % 5 + 1.0) : 0.1 * i;
+    }
+    parts3 = parts;
+    wts3 = wts;
+  };
+
+  // balanced islands only resample locally, and every weight goes back to 0
+  island_t r(5);
+  island3_t r3(5);
+  reset(true);
+  r.resampLogWts(parts, wts);
+  r3.resampLogWts(parts3, wts3);
+  REQUIRE(!r.getExchanged());
+  bool stayedHome = true;
+  for (size_t p = 0; p < NUMPARTICLES; ++p) {
+    stayedHome = stayedHome && parts[p](0) == r.getAncestors()[p] &&
+                 r.getAncestors()[p] / 5 == p / 5 &&
+                 std::abs(wts[p]) < 1e-12;
+  }
+  REQUIRE(stayedHome);
+
+  // unbalanced islands keep their weights and exchange particles. Either way
+  // the weights still sum to NUMPARTICLES, the weighted mean is unbiased,
+  // and the thread count doesn't matter
+  double total = 0.0;
+  double target = 0.0;
+  for (size_t i = 0; i < NUMPARTICLES; ++i) {
+    total += std::exp(0.1 * i);
+    target += i * std::exp(0.1 * i);
+  }
+  target /= total;
+  unsigned num_reps = 2000;
+  double mean = 0.0;
+  bool consistent = true;
+  for (unsigned rep = 0; rep < num_reps; ++rep) {
+    reset(false);
+    r.resampLogWts(parts, wts);
+    r3.resampLogWts(parts3, wts3);
+    consistent = consistent && r.getExchanged() &&
+                 r.getAncestors() == r3.getAncestors() && wts == wts3;
+    double sumWts = 0.0;
+    for (size_t p = 0; p < NUMPARTICLES; ++p) {
+      consistent = consistent && parts[p](0) == r.getAncestors()[p] &&
+                   parts3[p] == parts[p];
+      sumWts += std::exp(wts[p]);
+      mean += parts[p](0) * std::exp(wts[p]) / (num_reps * NUMPARTICLES);
+    }
+    consistent = consistent && sumWts == Approx(NUMPARTICLES);
+  }
+  REQUIRE(consistent);
+  REQUIRE(mean == Approx(target).margin(.05));
+}
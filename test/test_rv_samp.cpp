@@ -66,3 +66,63 @@ TEST_CASE_METHOD(SampFixture, "Beta Test", "[samplers]") {
   }
   REQUIRE(std::abs(ave - .75) < .01);
 }
+
+TEST_CASE("alias sampler frequencies", "[samplers]") {
+  constexpr size_t N = 5;
+  std::array<double, N> w{0.5, 0.0, 3.0, 1.5, 5.0};
+  rvsamp::alias_sampler<N, double> as;
+  as.setWeights(w.data());
+
+  // same weights on the log scale, shifted
+  std::array<double, N> logW;
+  for (size_t i = 0; i < N; ++i)
+    logW[i] = std::log(w[i]) - 700.0;
+  rvsamp::alias_sampler<N, double> logAs;
+  logAs.setLogWeights(logW.data());
+
+  // the relative frequencies match the normalized weights
+  std::mt19937 gen(1);
+  std::mt19937 logGen(1);
+  unsigned num_sims = 100000;
+  std::array<double, N> freq{};
+  unsigned num_mismatches = 0;
+  for (unsigned i = 0; i < num_sims; ++i) {
+    unsigned int k = as.sample(gen);
+    num_mismatches += logAs.sample(logGen) != k;
+    freq[k] += 1.0 / num_sims;
+  }
+  REQUIRE(num_mismatches == 0);
+  for (size_t i = 0; i < N; ++i)
+    REQUIRE(std::abs(freq[i] - w[i] / 10.0) < .01);
+  REQUIRE(freq[1] == 0.0);
+}
+
+TEST_CASE("counter rng streams", "[rv_samp]") {
+
+  // skipping ahead lands where drawing would have
+  rvsamp::counter_rng a(7, 3);
+  rvsamp::counter_rng b(7, 3);
+  for (int i = 0; i < 10; ++i)
+    a();
+  b.discard(10);
+  REQUIRE(a() == b());
+
+  // different streams and keys give different outputs
+  REQUIRE(rvsamp::counter_rng(7, 3)() != rvsamp::counter_rng(7, 4)());
+  REQUIRE(rvsamp::counter_rng(7, 3)() != rvsamp::counter_rng(8, 3)());
+
+  // uniforms look uniform
+  rvsamp::counter_rng c(1, 0);
+  double sum = 0.0;
+  double lo = 1.0;
+  double hi = 0.0;
+  for (int i = 0; i < 10000; ++i) {
+    double u = c.unif();
+    lo = std::min(lo, u);
+    hi = std::max(hi, u);
+    sum += u;
+  }
+  REQUIRE(lo >= 0.0);
+  REQUIRE(hi < 1.0);
+  REQUIRE(std::abs(sum / 10000 - .5) < .01);
+}
@@ -0,0 +1,53 @@
+#include <catch2/catch_all.hpp>
+
+#include <array>
+#include <cmath>
+#include <limits>
+
+#include <pf/weight_kernels.h>
+
+#define NUMWTS 37 // not a multiple of any packet size
+
+using namespace pf;
+using Catch::Approx;
+
+TEMPLATE_TEST_CASE("weight kernels match the scalar formulas", "[kernels]",
+                   float, double) {
+
+  std::array<TestType, NUMWTS> logWts;
+  for (size_t i = 0; i < NUMWTS; ++i)
+    logWts[i] = -0.5 * i + std::sin(static_cast<TestType>(i));
+  logWts[7] = -std::numeric_limits<TestType>::infinity();
+
+  // the obvious way
+  TestType m = -std::numeric_limits<TestType>::infinity();
+  for (auto lw : logWts)
+    m = std::max(m, lw);
+  TestType sum(0.0);
+  TestType sumSq(0.0);
+  for (auto lw : logWts) {
+    sum += std::exp(lw - m);
+    sumSq += std::exp(2 * (lw - m));
+  }
+
+  REQUIRE(kernels::max(logWts.data(), NUMWTS) == m);
+  REQUIRE(kernels::sumExpShift(logWts.data(), NUMWTS, m) == Approx(sum));
+
+  std::array<TestType, NUMWTS> w;
+  TestType s = kernels::expShift(logWts.data(), w.data(), NUMWTS, m);
+  REQUIRE(s == Approx(sum));
+  REQUIRE(w[7] == Approx(0.0).margin(1e-30));
+  REQUIRE(kernels::ess(w.data(), NUMWTS, s) == Approx(sum * sum / sumSq));
+  REQUIRE(kernels::logSumExp(logWts.data(), NUMWTS) ==
+          Approx(m + std::log(sum)));
+
+  TestType logNorm =
+      kernels::normalizedWeights(logWts.data(), w.data(), NUMWTS);
+  REQUIRE(logNorm == Approx(m + std::log(sum)));
+  TestType total(0.0);
+  for (size_t i = 0; i < NUMWTS; ++i) {
+    REQUIRE(w[i] == Approx(std::exp(logWts[i] - m) / sum).margin(1e-30));
+    total += w[i];
+  }
+  REQUIRE(total == Approx(1.0));
+}